@@ -0,0 +1,141 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for artifact checksum calculation (get_file_checksum(), digest_file() per
+ *        backend)
+ */
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include "bench.h"
+#include "digest.h"
+#include "hawkbit-client.h"
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FILE, fclose)
+
+typedef struct ChecksumBench_ {
+        FILE *fp;
+        GChecksumType type;
+        guint digest_types;
+        DigestBackend backend;
+} ChecksumBench;
+
+/**
+ * @brief Create file of given size filled with pseudo random data.
+ *
+ * @param[in] path File to create
+ * @param[in] size Size of file in bytes
+ * @return TRUE on success, FALSE otherwise
+ */
+static gboolean create_file(const gchar *path, guint64 size)
+{
+        g_autoptr(FILE) fp = g_fopen(path, "wb");
+        g_autofree guint32 *buf = g_new(guint32, 256 * 1024);
+
+        if (!fp) {
+                g_printerr("Failed to create %s: %s\n", path, g_strerror(errno));
+                return FALSE;
+        }
+
+        for (gsize i = 0; i < 256 * 1024; i++)
+                buf[i] = g_random_int();
+
+        while (size) {
+                gsize len = MIN(size, 256 * 1024 * sizeof(*buf));
+
+                if (fwrite(buf, 1, len, fp) != len) {
+                        g_printerr("Failed to write %s: %s\n", path, g_strerror(errno));
+                        return FALSE;
+                }
+                size -= len;
+        }
+
+        return TRUE;
+}
+
+static void bench_checksum(gpointer data)
+{
+        ChecksumBench *bench = data;
+        g_autofree gchar *checksum = NULL;
+
+        if (!get_file_checksum(bench->fp, bench->type, &checksum, NULL))
+                g_error("Checksum calculation failed");
+}
+
+static void bench_digest(gpointer data)
+{
+        ChecksumBench *bench = data;
+        g_autoptr(Digest) digest = NULL;
+
+        if (!digest_file(bench->fp, bench->digest_types, bench->backend, &digest, NULL))
+                g_error("Digest calculation failed");
+}
+
+/**
+ * @brief Run digest_file() benchmarks for each available backend, single digests and all
+ *        digests in one pass.
+ *
+ * @param[in] bench ChecksumBench with fp set
+ * @param[in] size  Size of file
+ * @param[in] label Size label used in benchmark name
+ */
+static void bench_digest_backends(ChecksumBench *bench, guint64 size, const gchar *label)
+{
+        static const DigestBackend backends[] = { DIGEST_BACKEND_GLIB, DIGEST_BACKEND_OPENSSL };
+        static const guint types[] = { DIGEST_MD5, DIGEST_SHA1, DIGEST_SHA256, DIGEST_ALL };
+
+        for (gsize b = 0; b < G_N_ELEMENTS(backends); b++) {
+                if (!digest_backend_available(backends[b]))
+                        continue;
+
+                for (gsize t = 0; t < G_N_ELEMENTS(types); t++) {
+                        g_autofree gchar *name = g_strdup_printf(
+                                "digest_%s_%s_%s", digest_backend_to_string(backends[b]),
+                                types[t] == DIGEST_ALL ? "all" : digest_type_to_string(types[t]),
+                                label);
+
+                        bench->backend = backends[b];
+                        bench->digest_types = types[t];
+                        bench_run("checksum", name, bench_digest, bench, size);
+                }
+        }
+}
+
+int bench_suite_checksum(void)
+{
+        static const gchar *default_sizes[] = { "10M", NULL };
+        const gchar * const *sizes = bench_options.sizes
+                                     ? (const gchar * const *) bench_options.sizes : default_sizes;
+
+        for (; *sizes; sizes++) {
+                g_autofree gchar *path = NULL, *name = NULL;
+                g_autoptr(FILE) fp = NULL;
+                ChecksumBench bench = { .type = G_CHECKSUM_SHA1 };
+                guint64 size = bench_parse_size(*sizes);
+
+                if (!size) {
+                        g_printerr("Invalid size: %s\n", *sizes);
+                        return 1;
+                }
+
+                path = g_build_filename(bench_options.tmpdir, "rhu-benchmark-checksum.bin", NULL);
+                if (!create_file(path, size))
+                        return 1;
+
+                fp = g_fopen(path, "rb");
+                g_unlink(path);
+                if (!fp) {
+                        g_printerr("Failed to open %s: %s\n", path, g_strerror(errno));
+                        return 1;
+                }
+                bench.fp = fp;
+
+                name = g_strdup_printf("get_file_checksum_sha1_%s", *sizes);
+                bench_run("checksum", name, bench_checksum, &bench, size);
+
+                bench_digest_backends(&bench, size, *sizes);
+        }
+
+        return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for device/firmware compatibility matching (compat_plan())
+ */
+
+#include <string.h>
+#include "bench.h"
+#include "compat.h"
+
+typedef struct CompatBench_ {
+        GList *devices;
+        CompatChunk *chunks;
+        guint n_chunks;
+        guint expected;
+} CompatBench;
+
+static void bench_compat_plan(gpointer data)
+{
+        CompatBench *bench = data;
+        g_autoptr(CompatIndex) index = compat_index_new(bench->devices);
+        g_autoptr(GArray) plan = compat_plan(index, bench->chunks, bench->n_chunks, FALSE);
+
+        if (plan->len != bench->expected)
+                g_error("Expected %u matches, got %u", bench->expected, plan->len);
+}
+
+/**
+ * @brief Baseline: scan the device list for every chunk, parsing versions per comparison.
+ */
+static void bench_compat_linear(gpointer data)
+{
+        CompatBench *bench = data;
+        guint matches = 0;
+
+        for (guint c = 0; c < bench->n_chunks; c++) {
+                for (GList *l = bench->devices; l; l = l->next) {
+                        const RCE_DEVICE *device = l->data;
+                        SemVer hw = { device->hw.major, device->hw.minor, 0, NULL };
+                        SemVer fw = { device->fw.major, device->fw.minor, 0, NULL };
+                        CompatRange range;
+                        SemVer version;
+
+                        if (strcmp(device->name, bench->chunks[c].name))
+                                continue;
+                        if (!semver_parse(bench->chunks[c].version, &version) ||
+                            !compat_range_parse(bench->chunks[c].hw, &range))
+                                continue;
+                        if (compat_range_contains(&range, &hw) && semver_compare(&version, &fw) > 0)
+                                matches++;
+                }
+        }
+
+        if (matches != bench->expected)
+                g_error("Expected %u matches, got %u", bench->expected, matches);
+}
+
+static void device_free(gpointer data)
+{
+        RCE_DEVICE *device = data;
+
+        g_free(device->name);
+        g_free(device);
+}
+
+int bench_suite_compat(void)
+{
+        guint n_chunks = bench_options.count > 0 ? bench_options.count : 500;
+        g_autoptr(GPtrArray) strings = g_ptr_array_new_with_free_func(g_free);
+        g_autofree gchar *name = NULL;
+        CompatBench bench = { .n_chunks = n_chunks };
+
+        // two hardware revisions per device name, only the newer one is compatible
+        for (guint i = 0; i < n_chunks * 2; i++) {
+                RCE_DEVICE *device = g_new0(RCE_DEVICE, 1);
+
+                device->id = i;
+                device->name = g_strdup_printf("device%u", i / 2);
+                device->hw.major = 1 + i % 2;
+                device->fw.major = 0;
+                device->fw.minor = i % 10;
+                bench.devices = g_list_prepend(bench.devices, device);
+        }
+
+        bench.chunks = g_new0(CompatChunk, n_chunks);
+        for (guint c = 0; c < n_chunks; c++) {
+                bench.chunks[c].name = g_strdup_printf("device%u", c);
+                bench.chunks[c].version = g_strdup_printf("%u.%u.%u-rc.%u", 1 + c % 7, c % 13,
+                                                          c % 5, c % 3);
+                bench.chunks[c].hw = g_strdup(">=1.5 <3");
+                g_ptr_array_add(strings, (gpointer) bench.chunks[c].name);
+                g_ptr_array_add(strings, (gpointer) bench.chunks[c].version);
+                g_ptr_array_add(strings, (gpointer) bench.chunks[c].hw);
+        }
+        bench.expected = n_chunks;
+
+        name = g_strdup_printf("compat_plan_%ux%u", n_chunks * 2, n_chunks);
+        bench_run("compat", name, bench_compat_plan, &bench, 0);
+
+        g_free(name);
+        name = g_strdup_printf("compat_linear_%ux%u", n_chunks * 2, n_chunks);
+        bench_run("compat", name, bench_compat_linear, &bench, 0);
+
+        g_free(bench.chunks);
+        g_list_free_full(bench.devices, device_free);
+
+        return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for firmware chunk parsing (parse_fw() without download/install)
+ */
+
+#include <json-glib/json-glib.h>
+#include "bench.h"
+#include "fw-interface.h"
+#include "hawkbit-client.h"
+
+typedef struct FwBench_ {
+        JsonArray *chunks;
+        GList *devices;
+        guint expected;
+} FwBench;
+
+static void bench_collect_artifacts(gpointer data)
+{
+        FwBench *bench = data;
+        g_autoptr(Arena) arena = arena_new("benchmark");
+        GList *artifacts = fw_collect_artifacts(bench->chunks, bench->devices,
+                                                "https://hawkbit.example.com/DEFAULT/controller/v1/target/deploymentBase/4711/feedback",
+                                                FALSE, arena, NULL);
+
+        if (g_list_length(artifacts) != bench->expected)
+                g_error("Expected %u artifacts, got %u", bench->expected,
+                        g_list_length(artifacts));
+}
+
+static void device_free(gpointer data)
+{
+        RCE_DEVICE *device = data;
+
+        g_free(device->name);
+        g_free(device);
+}
+
+int bench_suite_fw(void)
+{
+        guint chunks = bench_options.count > 0 ? bench_options.count : 200;
+        g_autofree gchar *json = bench_deployment_json(chunks, 1);
+        g_autoptr(JsonParser) parser = json_parser_new_immutable();
+        g_autofree gchar *name = NULL;
+        FwBench bench = { 0 };
+
+        if (!json_parser_load_from_data(parser, json, -1, NULL))
+                return 1;
+
+        bench.chunks = json_get_array(json_parser_get_root(parser), "$.deployment.chunks", NULL);
+        if (!bench.chunks)
+                return 1;
+
+        // one device per chunk, all with older firmware and newer hardware
+        for (guint i = 0; i < chunks; i++) {
+                RCE_DEVICE *device = g_new0(RCE_DEVICE, 1);
+
+                device->id = i;
+                device->name = g_strdup_printf("device%u", i);
+                device->hw.major = 5;
+                device->fw.major = 0;
+                bench.devices = g_list_prepend(bench.devices, device);
+        }
+        bench.devices = g_list_reverse(bench.devices);
+        bench.expected = json_array_get_length(bench.chunks);
+
+        name = g_strdup_printf("parse_fw_%u_chunks", chunks);
+        bench_run("fw", name, bench_collect_artifacts, &bench, 0);
+
+        g_list_free_full(bench.devices, device_free);
+        json_array_unref(bench.chunks);
+
+        return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for Intel HEX firmware parsing and validation (ihex_parse())
+ */
+
+#include "bench.h"
+#include "ihex.h"
+
+#define BENCH_IHEX_BASE 0x08000000
+#define BENCH_IHEX_RECORD_LEN 32
+
+typedef struct IhexBench_ {
+        GString *hex;
+        GArray *memory_map;
+} IhexBench;
+
+/**
+ * @brief Append record with checksum to hex.
+ */
+static void append_record(GString *hex, guint8 type, guint16 address, const guint8 *data,
+                          guint8 len)
+{
+        guint8 sum = len + (address >> 8) + (address & 0xff) + type;
+
+        g_string_append_printf(hex, ":%02X%04X%02X", len, address, type);
+        for (guint i = 0; i < len; i++) {
+                g_string_append_printf(hex, "%02X", data[i]);
+                sum += data[i];
+        }
+        g_string_append_printf(hex, "%02X\r\n", (guint8) -sum);
+}
+
+/**
+ * @brief Build Intel HEX document with size bytes of pseudo random data at BENCH_IHEX_BASE.
+ *
+ * @param[in] size Number of data bytes
+ * @return GString with HEX document
+ */
+static GString* build_hex(guint64 size)
+{
+        GString *hex = g_string_sized_new(size * 2 + size / 2);
+        guint8 data[BENCH_IHEX_RECORD_LEN];
+
+        for (guint64 offset = 0; offset < size; offset += BENCH_IHEX_RECORD_LEN) {
+                guint32 address = BENCH_IHEX_BASE + offset;
+                guint8 len = MIN(BENCH_IHEX_RECORD_LEN, size - offset);
+
+                if (!offset || !(address & 0xffff)) {
+                        guint8 upper[2] = { address >> 24, (address >> 16) & 0xff };
+
+                        append_record(hex, 0x04, 0, upper, 2);
+                }
+
+                for (guint i = 0; i < len; i++)
+                        data[i] = g_random_int_range(0, 256);
+                append_record(hex, 0x00, address & 0xffff, data, len);
+        }
+        append_record(hex, 0x01, 0, NULL, 0);
+
+        return hex;
+}
+
+static void bench_ihex_parse(gpointer data)
+{
+        IhexBench *bench = data;
+        g_autoptr(IhexImage) image = ihex_parse(bench->hex->str, bench->hex->len, NULL);
+
+        if (!image || !ihex_image_check_memory_map(image, bench->memory_map, NULL))
+                g_error("Intel HEX parsing failed");
+}
+
+int bench_suite_ihex(void)
+{
+        static const gchar *default_sizes[] = { "256K", NULL };
+        const gchar * const *sizes = bench_options.sizes
+                                     ? (const gchar * const *) bench_options.sizes : default_sizes;
+        g_autoptr(GArray) memory_map = NULL;
+
+        if (!ihex_parse_memory_map("0x08000000-0x0bffffff", &memory_map, NULL))
+                return 1;
+
+        for (; *sizes; sizes++) {
+                g_autofree gchar *name = NULL;
+                IhexBench bench = { .memory_map = memory_map };
+                guint64 size = bench_parse_size(*sizes);
+
+                if (!size || size > 64 * 1024 * 1024) {
+                        g_printerr("Invalid size: %s\n", *sizes);
+                        return 1;
+                }
+
+                bench.hex = build_hex(size);
+                name = g_strdup_printf("ihex_parse_%s", *sizes);
+                bench_run("ihex", name, bench_ihex_parse, &bench, bench.hex->len);
+                g_string_free(bench.hex, TRUE);
+        }
+
+        return 0;
+}
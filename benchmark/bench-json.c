@@ -0,0 +1,76 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for JSON helper functions on deployment documents
+ */
+
+#include <json-glib/json-glib.h>
+#include "bench.h"
+#include "json-helper.h"
+
+typedef struct JsonBench_ {
+        const gchar *json;
+        JsonNode *root;
+        const gchar *path;
+} JsonBench;
+
+static void bench_parse(gpointer data)
+{
+        JsonBench *bench = data;
+        g_autoptr(JsonParser) parser = json_parser_new_immutable();
+
+        if (!json_parser_load_from_data(parser, bench->json, -1, NULL))
+                g_error("Failed to parse deployment document");
+}
+
+static void bench_get_string(gpointer data)
+{
+        JsonBench *bench = data;
+        g_autofree gchar *str = json_get_string(bench->root, bench->path, NULL);
+
+        g_assert_nonnull(str);
+}
+
+static void bench_get_array(gpointer data)
+{
+        JsonBench *bench = data;
+        g_autoptr(JsonArray) arr = json_get_array(bench->root, bench->path, NULL);
+
+        g_assert_nonnull(arr);
+}
+
+int bench_suite_json(void)
+{
+        guint chunks = bench_options.count > 0 ? bench_options.count : 50;
+        g_autofree gchar *json = bench_deployment_json(chunks, 1);
+        g_autoptr(JsonParser) parser = json_parser_new_immutable();
+        g_autofree gchar *name = NULL;
+        JsonBench bench = { .json = json };
+
+        if (!json_parser_load_from_data(parser, json, -1, NULL))
+                return 1;
+        bench.root = json_parser_get_root(parser);
+
+        name = g_strdup_printf("json_parser_load_%u_chunks", chunks);
+        bench_run("json", name, bench_parse, &bench, strlen(json));
+
+        bench.path = "$.id";
+        bench_run("json", "json_get_string_id", bench_get_string, &bench, 0);
+
+        bench.path = "$.deployment.update";
+        bench_run("json", "json_get_string_update", bench_get_string, &bench, 0);
+
+        bench.path = "$.deployment.chunks[0].artifacts[0]._links.download.href";
+        bench_run("json", "json_get_string_download_href", bench_get_string, &bench, 0);
+
+        bench.path = "$.deployment.chunks";
+        g_clear_pointer(&name, g_free);
+        name = g_strdup_printf("json_get_array_chunks_%u", chunks);
+        bench_run("json", name, bench_get_array, &bench, 0);
+
+        bench.path = "$.deployment.chunks[0].artifacts";
+        bench_run("json", "json_get_array_artifacts", bench_get_array, &bench, 0);
+
+        return 0;
+}
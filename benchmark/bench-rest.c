@@ -0,0 +1,57 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for the REST response buffer (curl_write_cb())
+ */
+
+#include "bench.h"
+#include "hawkbit-client.h"
+
+// libcurl hands over at most CURL_MAX_WRITE_SIZE (16 KiB) per write callback
+#define WRITE_CB_PIECE_SIZE (16 * 1024)
+
+typedef struct RestBench_ {
+        gchar piece[WRITE_CB_PIECE_SIZE];
+        guint64 payload_size;
+} RestBench;
+
+static void bench_write_cb(gpointer data)
+{
+        RestBench *bench = data;
+        g_autoptr(RestPayload) payload = g_new0(RestPayload, 1);
+
+        // same initial buffer as rest_request()
+        payload->payload = g_malloc0(DEFAULT_CURL_REQUEST_BUFFER_SIZE);
+
+        for (guint64 written = 0; written < bench->payload_size; written += WRITE_CB_PIECE_SIZE)
+                curl_write_cb(bench->piece, 1, WRITE_CB_PIECE_SIZE, payload);
+}
+
+int bench_suite_rest(void)
+{
+        static const gchar *default_sizes[] = { "64K", "1M", "16M", NULL };
+        const gchar * const *sizes = bench_options.sizes
+                                     ? (const gchar * const *) bench_options.sizes : default_sizes;
+        g_autofree RestBench *bench = g_new0(RestBench, 1);
+
+        memset(bench->piece, '{', sizeof(bench->piece));
+
+        for (; *sizes; sizes++) {
+                g_autofree gchar *name = NULL;
+
+                bench->payload_size = bench_parse_size(*sizes);
+                if (!bench->payload_size) {
+                        g_printerr("Invalid size: %s\n", *sizes);
+                        return 1;
+                }
+                // round up to whole pieces
+                bench->payload_size = (bench->payload_size + WRITE_CB_PIECE_SIZE - 1) /
+                                      WRITE_CB_PIECE_SIZE * WRITE_CB_PIECE_SIZE;
+
+                name = g_strdup_printf("curl_write_cb_%s", *sizes);
+                bench_run("rest", name, bench_write_cb, bench, bench->payload_size);
+        }
+
+        return 0;
+}
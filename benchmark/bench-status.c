@@ -0,0 +1,84 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Benchmarks for hawkBit status/feedback serialization (json_build_status(),
+ *        json_format_feedback())
+ */
+
+#include <json-glib/json-glib.h>
+#include "bench.h"
+#include "hawkbit-client.h"
+
+/**
+ * @brief Serialize a status the way rest_request() does.
+ */
+static void serialize(JsonBuilder *builder)
+{
+        g_autoptr(JsonGenerator) generator = json_generator_new();
+        g_autoptr(JsonNode) root = json_builder_get_root(builder);
+        g_autofree gchar *data = NULL;
+
+        json_generator_set_root(generator, root);
+        data = json_generator_to_data(generator, NULL);
+        g_assert_nonnull(data);
+}
+
+static void bench_feedback(gpointer data)
+{
+        g_autoptr(JsonBuilder) builder = json_build_status("4711", "Download complete. 1.23 MB/s",
+                                                           "none", "proceeding", NULL);
+
+        serialize(builder);
+}
+
+/**
+ * @brief Feedback body as formerly sent by rest_request(): tree, serialization and pretty
+ *        printed debug string.
+ */
+static void bench_feedback_builder(gpointer data)
+{
+        g_autoptr(JsonBuilder) builder = json_build_status("4711", "Download complete. 1.23 MB/s",
+                                                           "none", "proceeding", NULL);
+        g_autoptr(JsonNode) root = json_builder_get_root(builder);
+        g_autofree gchar *debug = json_to_string(root, TRUE);
+
+        serialize(builder);
+}
+
+static void bench_feedback_template(gpointer data)
+{
+        g_autofree gchar *body = json_format_feedback("4711", "Download complete. 1.23 MB/s",
+                                                      "none", "proceeding", 0, 0);
+
+        g_assert_nonnull(body);
+}
+
+static void bench_config_data(gpointer data)
+{
+        g_autoptr(JsonBuilder) builder = json_build_status(NULL, NULL, "success", "closed", data);
+
+        serialize(builder);
+}
+
+int bench_suite_status(void)
+{
+        g_autoptr(GHashTable) attributes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                                 g_free);
+        guint count = bench_options.count > 0 ? bench_options.count : 32;
+        g_autofree gchar *name = NULL;
+
+        for (guint i = 0; i < count; i++)
+                g_hash_table_insert(attributes, g_strdup_printf("device%u:%u", i, i),
+                                    g_strdup_printf("FW: 1.%u | HW: 2.0 | Current 1.%u  | Fallback: 1.0",
+                                                    i, i));
+
+        bench_run("status", "json_build_status_feedback", bench_feedback, NULL, 0);
+        bench_run("status", "feedback_body_builder", bench_feedback_builder, NULL, 0);
+        bench_run("status", "feedback_body_template", bench_feedback_template, NULL, 0);
+
+        name = g_strdup_printf("json_build_status_config_data_%u_attributes", count);
+        bench_run("status", name, bench_config_data, attributes, 0);
+
+        return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Micro benchmark runner for CPU hot paths of rauc-hawkbit-updater
+ *
+ * Results are printed as JSON lines, one object per benchmark, e.g.:
+ *
+ *   {"version": "1.3", "suite": "json", "name": "json_get_string", "iterations": 20000,
+ *    "total_ns": 501234567, "ns_per_op": 25061.7, "allocs_per_op": 12.0}
+ *
+ * Allocations (malloc(), calloc() and realloc() calls of all threads) are only counted with glibc.
+ *
+ * Run all benchmarks with `meson test --benchmark` or a single suite with
+ * `rhu-benchmark <suite> [options]`.
+ */
+
+#include <glib.h>
+#include <glib/gprintf.h>
+#include <stdio.h>
+#include "bench.h"
+
+#ifdef HAVE_LIBC_MALLOC
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 allocations = 0;
+
+// interpose the allocator of the whole process (GLib, libcurl, ...), forwarding to glibc
+void *malloc(size_t size)
+{
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+        __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_realloc(ptr, size);
+}
+#endif
+
+BenchOptions bench_options = {
+        .min_time = 0.5,
+        .min_iterations = 3,
+        .sizes = NULL,
+        .count = 0,
+        .tmpdir = NULL,
+};
+
+typedef struct BenchSuite_ {
+        const gchar *name;
+        int (*run)(void);
+} BenchSuite;
+
+static const BenchSuite suites[] = {
+        { "json",     bench_suite_json },
+        { "rest",     bench_suite_rest },
+        { "checksum", bench_suite_checksum },
+        { "status",   bench_suite_status },
+        { "fw",       bench_suite_fw },
+        { "ihex",     bench_suite_ihex },
+        { "compat",   bench_suite_compat },
+        { NULL, NULL }
+};
+
+void bench_run(const gchar *suite, const gchar *name, BenchFunc func, gpointer data,
+               guint64 bytes_per_iteration)
+{
+        guint64 iterations = 0;
+        gint64 start, elapsed_us;
+        gdouble ns_per_op;
+#ifdef HAVE_LIBC_MALLOC
+        guint64 allocations_start, allocations_run;
+#endif
+
+        g_return_if_fail(suite);
+        g_return_if_fail(name);
+        g_return_if_fail(func);
+
+        // warm up caches and lazily initialized state
+        func(data);
+
+#ifdef HAVE_LIBC_MALLOC
+        allocations_start = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+#endif
+        start = g_get_monotonic_time();
+        do {
+                func(data);
+                iterations++;
+                elapsed_us = g_get_monotonic_time() - start;
+        } while (iterations < bench_options.min_iterations ||
+                 elapsed_us < bench_options.min_time * G_USEC_PER_SEC);
+
+#ifdef HAVE_LIBC_MALLOC
+        allocations_run = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocations_start;
+#endif
+
+        ns_per_op = (gdouble) elapsed_us * 1000.0 / iterations;
+
+        g_printf("{\"version\": \"%s\", \"suite\": \"%s\", \"name\": \"%s\", "
+                 "\"iterations\": %" G_GUINT64_FORMAT ", \"total_ns\": %" G_GINT64_FORMAT ", "
+                 "\"ns_per_op\": %.1f",
+                 PROJECT_VERSION, suite, name, iterations, elapsed_us * 1000, ns_per_op);
+#ifdef HAVE_LIBC_MALLOC
+        g_printf(", \"allocs_per_op\": %.1f", (gdouble) allocations_run / iterations);
+#endif
+        if (bytes_per_iteration)
+                g_printf(", \"bytes_per_op\": %" G_GUINT64_FORMAT ", \"mb_per_s\": %.2f",
+                         bytes_per_iteration,
+                         (gdouble) bytes_per_iteration / (1024 * 1024) / (ns_per_op / 1e9));
+        g_printf("}\n");
+        fflush(stdout);
+}
+
+/**
+ * @brief GLogFunc dropping all messages.
+ */
+static void log_handler_discard(const gchar *log_domain, GLogLevelFlags log_level,
+                                const gchar *message, gpointer user_data)
+{
+}
+
+guint64 bench_parse_size(const gchar *size)
+{
+        gchar *end = NULL;
+        guint64 val;
+
+        g_return_val_if_fail(size, 0);
+
+        val = g_ascii_strtoull(size, &end, 10);
+        switch (g_ascii_toupper(*end)) {
+        case 'G':
+                val *= 1024;
+        // fall through
+        case 'M':
+                val *= 1024;
+        // fall through
+        case 'K':
+                val *= 1024;
+                end++;
+                break;
+        default:
+                break;
+        }
+
+        return *end ? 0 : val;
+}
+
+gchar* bench_deployment_json(guint chunks, guint artifacts)
+{
+        GString *json = g_string_new(NULL);
+
+        g_string_append(json, "{\"id\": \"4711\", \"deployment\": {\"download\": \"forced\", "
+                        "\"update\": \"forced\", \"maintenanceWindow\": \"available\", "
+                        "\"chunks\": [");
+        for (guint c = 0; c < chunks; c++) {
+                g_string_append_printf(json, "%s{\"part\": \"bApp\", \"version\": \"%u.%u\", "
+                                       "\"name\": \"device%u\", \"metadata\": ["
+                                       "{\"key\": \"HW\", \"value\": \"%u.0\"}, "
+                                       "{\"key\": \"install\", \"value\": \"yes\"}], "
+                                       "\"artifacts\": [",
+                                       c ? ", " : "", 1 + c % 7, c % 13, c, 2 + c % 3);
+                for (guint a = 0; a < artifacts; a++)
+                        g_string_append_printf(json, "%s{\"filename\": \"firmware%u_%u.raucb\", "
+                                               "\"hashes\": {\"sha1\": \"%040x\", \"md5\": \"%032x\", "
+                                               "\"sha256\": \"%064x\"}, \"size\": %u, "
+                                               "\"_links\": {\"download\": {\"href\": "
+                                               "\"https://hawkbit.example.com/DEFAULT/controller/v1/target/softwaremodules/%u/artifacts/firmware%u_%u.raucb\"}, "
+                                               "\"download-http\": {\"href\": "
+                                               "\"http://hawkbit.example.com/DEFAULT/controller/v1/target/softwaremodules/%u/artifacts/firmware%u_%u.raucb\"}}}",
+                                               a ? ", " : "", c, a, c * 31 + a, c * 17 + a,
+                                               c * 7 + a, 65536 + c * 1024 + a, c, c, a, c, c,
+                                               a);
+                g_string_append(json, "]}");
+        }
+        g_string_append(json, "]}, \"actionHistory\": {\"status\": \"RUNNING\", "
+                        "\"messages\": [\"Reboot\", \"Write firmware\"]}, "
+                        "\"_links\": {\"self\": {\"href\": "
+                        "\"https://hawkbit.example.com/DEFAULT/controller/v1/target/deploymentBase/4711\"}}}");
+
+        return g_string_free(json, FALSE);
+}
+
+int main(int argc, char **argv)
+{
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GOptionContext) context = NULL;
+        g_auto(GStrv) args = NULL;
+        g_autofree gchar *min_time = NULL;
+        gint min_iterations = 0;
+        GOptionEntry entries[] = {
+                { "min-time",       't', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,       &min_time,                 "Minimum run time per benchmark in seconds (default: 0.5)", "SECONDS" },
+                { "min-iterations", 'i', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,          &min_iterations,           "Minimum iterations per benchmark (default: 3)",            "N" },
+                { "size",           's', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY, &bench_options.sizes,      "Size(s) to benchmark, e.g. 10M (repeatable)",              "SIZE" },
+                { "count",          'n', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,          &bench_options.count,      "Element count, e.g. number of chunks",                     "N" },
+                { "tmpdir",         'd', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,     &bench_options.tmpdir,     "Directory for temporary files (default: system tmp dir)",  "DIR" },
+                { NULL }
+        };
+        int res = 0;
+
+        args = g_strdupv(argv);
+
+        context = g_option_context_new("[SUITE...] - benchmark rauc-hawkbit-updater hot paths");
+        g_option_context_add_main_entries(context, entries, NULL);
+        if (!g_option_context_parse_strv(context, &args, &error)) {
+                g_printerr("option parsing failed: %s\n", error->message);
+                return 1;
+        }
+
+        if (min_time)
+                bench_options.min_time = g_ascii_strtod(min_time, NULL);
+        if (min_iterations > 0)
+                bench_options.min_iterations = min_iterations;
+        if (!bench_options.tmpdir)
+                bench_options.tmpdir = g_strdup(g_get_tmp_dir());
+
+        // keep library messages (e.g. per-chunk g_message()) out of the results
+        g_log_set_handler(NULL, G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG,
+                          log_handler_discard, NULL);
+
+        for (const BenchSuite *suite = suites; suite->name; suite++) {
+                // no suite given: run all suites
+                if (g_strv_length(args) > 1 && !g_strv_contains((const gchar * const *) args + 1,
+                                                               suite->name))
+                        continue;
+
+                res |= suite->run();
+        }
+
+        g_strfreev(bench_options.sizes);
+        g_free(bench_options.tmpdir);
+
+        return res;
+}
@@ -0,0 +1,74 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Minimal micro benchmark harness
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <glib.h>
+
+/**
+ * @brief Function run repeatedly by bench_run().
+ *
+ * @param[in] data User data passed to bench_run()
+ */
+typedef void (*BenchFunc)(gpointer data);
+
+/**
+ * @brief Options shared by all benchmark suites (set from the command line).
+ */
+typedef struct BenchOptions_ {
+        gdouble min_time;             /**< minimum run time per benchmark [seconds] */
+        guint64 min_iterations;       /**< minimum number of iterations per benchmark */
+        gchar **sizes;                /**< file/payload sizes, e.g. "10M", "1G" */
+        gint count;                   /**< element count (chunks, devices, ...) or 0 for default */
+        gchar *tmpdir;                /**< directory for temporary benchmark files */
+} BenchOptions;
+
+extern BenchOptions bench_options;
+
+/**
+ * @brief Run func repeatedly (at least bench_options.min_iterations times and at least
+ *        bench_options.min_time seconds) and print the result as one JSON object per line to
+ *        stdout.
+ *
+ * @param[in] suite              Suite name the benchmark belongs to
+ * @param[in] name               Benchmark name, unique within the suite
+ * @param[in] func               Function to benchmark
+ * @param[in] data               User data passed to func
+ * @param[in] bytes_per_iteration Bytes processed per call of func, or 0 if not applicable
+ *                                (throughput is omitted from the result then)
+ */
+void bench_run(const gchar *suite, const gchar *name, BenchFunc func, gpointer data,
+               guint64 bytes_per_iteration);
+
+/**
+ * @brief Parse a human readable size such as "512", "64K", "10M" or "1G" (powers of 1024).
+ *
+ * @param[in] size Size string
+ * @return size in bytes, 0 on parse error
+ */
+guint64 bench_parse_size(const gchar *size);
+
+/**
+ * @brief Build a hawkBit deploymentBase response document.
+ *
+ * @param[in] chunks    Number of chunks
+ * @param[in] artifacts Number of artifacts per chunk
+ * @return newly allocated JSON string
+ */
+gchar* bench_deployment_json(guint chunks, guint artifacts);
+
+// benchmark suites, return 0 on success
+int bench_suite_json(void);
+int bench_suite_rest(void);
+int bench_suite_checksum(void);
+int bench_suite_status(void);
+int bench_suite_fw(void);
+int bench_suite_ihex(void);
+int bench_suite_compat(void);
+
+#endif // __BENCH_H__
@@ -0,0 +1,91 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <glib.h>
+
+typedef struct Arena_ Arena;
+
+/**
+ * @brief Create arena owning all allocations of one unit of work (e.g. a deployment). Memory is
+ *        handed out from large blocks and released as a whole by arena_free(). Not thread-safe,
+ *        an arena must only be used by one thread at a time.
+ *
+ * @param[in] name Name used when reporting memory usage
+ * @return Arena* (free with arena_free())
+ */
+Arena* arena_new(const gchar *name);
+
+/**
+ * @brief Allocate zero-initialized memory owned by arena, aligned for any type.
+ *
+ * @param[in] arena Arena
+ * @param[in] size  Number of bytes
+ * @return gpointer to memory valid until arena_free()
+ */
+gpointer arena_alloc(Arena *arena, gsize size);
+
+/**
+ * @brief Allocate zero-initialized struct_type owned by arena.
+ */
+#define arena_new0(arena, struct_type) ((struct_type *) arena_alloc((arena), sizeof(struct_type)))
+
+/**
+ * @brief Duplicate string into arena.
+ *
+ * @param[in] arena Arena
+ * @param[in] str   String to duplicate or NULL
+ * @return gchar* owned by arena, NULL if str is NULL
+ */
+gchar* arena_strdup(Arena *arena, const gchar *str);
+
+/**
+ * @brief Format string into arena.
+ *
+ * @param[in] arena  Arena
+ * @param[in] format printf() format
+ * @return gchar* owned by arena
+ */
+gchar* arena_strdup_printf(Arena *arena, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
+
+/**
+ * @brief Transfer ownership of an object allocated elsewhere (e.g. GList, JsonArray) to arena.
+ *        Objects are destroyed in reverse order of registration by arena_free(), before the
+ *        arena's memory is released.
+ *
+ * @param[in] arena   Arena
+ * @param[in] data    Object to own or NULL
+ * @param[in] destroy Function freeing data
+ * @return data
+ */
+gpointer arena_take(Arena *arena, gpointer data, GDestroyNotify destroy);
+
+/**
+ * @brief Bytes handed out by arena so far.
+ */
+gsize arena_get_size(const Arena *arena);
+
+/**
+ * @brief Read resident set size and its peak (high-water mark) of this process.
+ *
+ * @param[out] rss  Current RSS in bytes
+ * @param[out] peak Peak RSS in bytes
+ * @return TRUE on success, FALSE if not available
+ */
+gboolean arena_get_rss(gsize *rss, gsize *peak);
+
+/**
+ * @brief Release all memory and objects owned by arena as a unit. Logs the arena's size, the
+ *        largest arena so far and the process RSS. After large arenas, freed heap memory is
+ *        returned to the system (malloc_trim()).
+ *
+ * @param[in] arena Arena to free
+ */
+void arena_free(Arena *arena);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(Arena, arena_free)
+
+#endif // __ARENA_H__
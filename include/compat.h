@@ -0,0 +1,114 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __COMPAT_H__
+#define __COMPAT_H__
+
+#include <glib.h>
+#include "fw-interface.h"
+
+/**
+ * @brief Semantic version (major.minor.patch[-prerelease][+build]), missing components are 0.
+ */
+typedef struct SemVer_ {
+        guint32 major;
+        guint32 minor;
+        guint32 patch;
+        const gchar *prerelease;      /**< interned prerelease identifiers or NULL */
+} SemVer;
+
+/**
+ * @brief Version range, each bound is optional.
+ */
+typedef struct CompatRange_ {
+        SemVer lower;
+        SemVer upper;
+        gboolean has_lower;
+        gboolean has_upper;
+        gboolean lower_inclusive;
+        gboolean upper_inclusive;
+} CompatRange;
+
+/**
+ * @brief Chunk of a deployment to match against devices.
+ */
+typedef struct CompatChunk_ {
+        const gchar *name;            /**< device/firmware name */
+        const gchar *version;         /**< firmware version */
+        const gchar *hw;              /**< hardware range (see compat_range_parse()) or NULL */
+} CompatChunk;
+
+/**
+ * @brief Device selected for a chunk by compat_plan().
+ */
+typedef struct CompatMatch_ {
+        guint chunk;                  /**< index of chunk */
+        const RCE_DEVICE *device;     /**< device to install chunk on */
+} CompatMatch;
+
+typedef struct CompatIndex_ CompatIndex;
+
+/**
+ * @brief Parse semantic version, e.g. "1.2", "1.2.3", "v1.2.3-rc.1+build5".
+ *
+ * @param[in]  str     Version string
+ * @param[out] version Parsed version
+ * @return TRUE on success, FALSE if str is not a valid version
+ */
+gboolean semver_parse(const gchar *str, SemVer *version);
+
+/**
+ * @brief Compare semantic versions according to semver precedence (build metadata ignored).
+ *
+ * @return <0 if a < b, 0 if equal, >0 if a > b
+ */
+gint semver_compare(const SemVer *a, const SemVer *b);
+
+/**
+ * @brief Parse hardware range: whitespace or comma separated comparators (">=1.2", ">1.2",
+ *        "<2", "<=2.1", "=1.3"), all of which must match, or "*" for any hardware. A bare version
+ *        is treated as ">version", as hardware metadata has always been interpreted.
+ *
+ * @param[in]  str   Range string
+ * @param[out] range Parsed range
+ * @return TRUE on success, FALSE if str is invalid
+ */
+gboolean compat_range_parse(const gchar *str, CompatRange *range);
+
+/**
+ * @brief Check whether version lies within range.
+ */
+gboolean compat_range_contains(const CompatRange *range, const SemVer *version);
+
+/**
+ * @brief Index devices by name and hardware revision. The firmware of a device is the newer one of
+ *        FW and FW_LATEST, so devices are not flashed again before FW catches up.
+ *
+ * @param[in] devices GList of RCE_DEVICE, must outlive the index
+ * @return CompatIndex* (free with compat_index_free())
+ */
+CompatIndex* compat_index_new(GList *devices);
+
+/**
+ * @brief Frees a CompatIndex.
+ */
+void compat_index_free(CompatIndex *index);
+
+/**
+ * @brief Compute install plan in one pass: every chunk is parsed once and matched against the
+ *        devices of its name whose hardware lies in the chunk's range and whose firmware is older
+ *        than the chunk (or any firmware if forced). Chunks with invalid versions are skipped.
+ *
+ * @param[in] index    CompatIndex
+ * @param[in] chunks   Chunks to match
+ * @param[in] n_chunks Number of chunks
+ * @param[in] forced   Ignore installed firmware version
+ * @return GArray of CompatMatch ordered by chunk, then hardware revision
+ */
+GArray* compat_plan(const CompatIndex *index, const CompatChunk *chunks, guint n_chunks,
+                    gboolean forced);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(CompatIndex, compat_index_free)
+
+#endif // __COMPAT_H__
@@ -8,11 +8,22 @@
 
 #include <glib.h>
 
+/**
+ * @brief I/O scheduling class of worker threads, values match the kernel's IOPRIO_CLASS_*.
+ */
+typedef enum {
+        IO_CLASS_NONE = 0,            /**< leave unchanged */
+        IO_CLASS_REALTIME,
+        IO_CLASS_BEST_EFFORT,
+        IO_CLASS_IDLE,
+} IoClass;
+
 /**
  * @brief struct that contains the Rauc HawkBit configuration.
  */
 typedef struct Config_ {
-        gchar* hawkbit_server;            /**< hawkBit host or IP and port */
+        gchar** hawkbit_servers;          /**< hawkBit hosts or IPs and ports, in preferred order */
+        int server_probe_interval;        /**< seconds between probes of servers, 0 disables */
         gboolean ssl;                     /**< use https or http */
         gboolean ssl_verify;              /**< verify https certificate */
         gboolean post_update_reboot;      /**< reboot system after successful update */
@@ -24,13 +35,47 @@ typedef struct Config_ {
         gchar* controller_id;             /**< hawkBit controller id*/
         gchar* bundle_download_location;  /**< file to download rauc bundle to */
         gchar* database_location;
+        gchar** gateway_targets;          /**< additional controller ids served in gateway mode */
+        gboolean gateway_targets_from_database; /**< serve all devices of database as targets */
+        gchar* flash_command;             /**< bootloader command flashing firmware to devices */
+        gchar* flash_backend;             /**< shared library flash backend or NULL */
+        gchar* firmware_dir;              /**< directory the active firmware is installed in */
+        int flash_timeout;                /**< seconds until flashing a device is aborted */
+        int flash_retry_interval;         /**< seconds until an offline device is flashed again */
+        int flash_retry_timeout;          /**< seconds offline devices are retried, 0 disables */
+        gchar** staging_dirs;             /**< directories firmware downloads are staged in */
+        gchar* fallback_dir;              /**< directory fallback firmware is retained in or NULL */
+        int fallback_images;              /**< fallback firmware images kept per firmware name */
+        gchar* post_flash_check;          /**< command checking a device after flashing or NULL */
+        gchar* state_file;                /**< file the action state is persisted to or NULL */
+        int maintenance_window_start;     /**< local time of day the maintenance window opens [s after
+                                               midnight], -1 if not set */
+        int peer_port;                    /**< port artifacts are shared with peers on, 0 disables */
+        gchar* peer_cache_dir;            /**< directory artifacts are kept in for peers or NULL */
+        gchar** peers;                    /**< peers ("host:port") to download artifacts from */
         int connect_timeout;              /**< connection timeout */
         int timeout;                      /**< reply timeout */
         int retry_wait;                   /**< wait between retries */
         int low_speed_time;               /**< time to be below the speed to trigger low speed abort */
         int low_speed_rate;               /**< low speed limit to abort transfer */
+        gchar** download_mirrors;         /**< rules "<URL prefix>=<mirror URL prefix>" or NULL */
+        int download_stall_rate;          /**< throughput [B/s] below which a source stalls */
+        int download_stall_time;          /**< seconds below download_stall_rate, 0 disables */
+        int progress_interval;            /**< seconds between download progress reports, 0 disables */
+        int loop_stall_threshold;         /**< log main loop callbacks taking longer [ms], 0 disables */
+        int watchdog_stall_limit;         /**< seconds the main loop may block before the watchdog
+                                               health thread stops servicing it, 0 disables thread */
+        int worker_nice;                  /**< nice level of worker threads, 0 leaves it unchanged */
+        gboolean worker_sched_idle;       /**< run worker threads with SCHED_IDLE */
+        IoClass worker_io_class;          /**< I/O scheduling class of worker threads */
+        int worker_io_priority;           /**< I/O priority within worker_io_class (0-7) */
+        gchar** worker_cpus;              /**< CPUs worker threads may run on or NULL for all */
+        gchar* cgroup;                    /**< cgroup v2 directory to move the updater to or NULL */
+        int cgroup_cpu_weight;            /**< cpu.weight of cgroup, 0 leaves it unchanged */
+        int cgroup_io_weight;             /**< io.weight of cgroup, 0 leaves it unchanged */
         GLogLevelFlags log_level;         /**< log level */
         GHashTable* device;               /**< Additional attributes sent to hawkBit */
+        GHashTable* memory_map;           /**< firmware name to GArray of IhexRange or NULL */
 } Config;
 
 /**
@@ -42,6 +87,26 @@ typedef struct Config_ {
  */
 Config* load_config_file(const gchar *config_file, GError **error);
 
+/**
+ * @brief Keep settings only taking effect on restart (server, target, gateway targets, state file,
+ *        log level, watchdog, peer server, scheduling) of current in reloaded config.
+ *
+ * @param[in,out] config  Config reloaded
+ * @param[in]     current Config in use
+ * @return GPtrArray* of static names of settings that changed and were reset
+ */
+GPtrArray* config_file_keep_restart_settings(Config *config, const Config *current);
+
+/**
+ * @brief Compare settings that must not change while an action is in progress (download
+ *        locations, database, streaming, flashing).
+ *
+ * @param[in] config  Config reloaded
+ * @param[in] current Config in use
+ * @return GPtrArray* of static names of settings that changed
+ */
+GPtrArray* config_file_changed_action_settings(const Config *config, const Config *current);
+
 /**
  * @brief Frees the memory allocated by a Config
  *
@@ -0,0 +1,116 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __DIGEST_H__
+#define __DIGEST_H__
+
+#include <glib.h>
+#include <stdio.h>
+
+/**
+ * @brief Digest types, may be combined to calculate multiple digests in one pass.
+ */
+typedef enum {
+        DIGEST_MD5    = 1 << 0,
+        DIGEST_SHA1   = 1 << 1,
+        DIGEST_SHA256 = 1 << 2,
+} DigestType;
+
+#define DIGEST_ALL (DIGEST_MD5 | DIGEST_SHA1 | DIGEST_SHA256)
+
+/**
+ * @brief Digest implementations.
+ */
+typedef enum {
+        DIGEST_BACKEND_GLIB,          /**< GLib GChecksum, always available */
+        DIGEST_BACKEND_OPENSSL,       /**< OpenSSL EVP, uses ARMv8 crypto extensions/SHA-NI */
+} DigestBackend;
+
+typedef struct Digest_ Digest;
+
+/**
+ * @brief Create digest context calculating all requested digests.
+ *
+ * @param[in] types   Bitwise OR of DigestType to calculate
+ * @param[in] backend DigestBackend to use, see digest_default_backend()
+ * @return Digest* (free with digest_free()), NULL if backend is unavailable
+ */
+Digest* digest_new(guint types, DigestBackend backend);
+
+/**
+ * @brief Feed data into all digests of context.
+ *
+ * @param[in] digest Digest context
+ * @param[in] data   Data to add
+ * @param[in] len    Length of data
+ */
+void digest_update(Digest *digest, const guchar *data, gsize len);
+
+/**
+ * @brief Get hex string of digest, finalizes the context on first call. No further
+ *        digest_update() calls are allowed afterwards.
+ *
+ * @param[in] digest Digest context
+ * @param[in] type   Single DigestType requested on digest_new()
+ * @return hex string owned by digest, NULL if type was not requested
+ */
+const gchar* digest_get_string(Digest *digest, DigestType type);
+
+/**
+ * @brief Frees a Digest context.
+ *
+ * @param[in] digest Digest to free
+ */
+void digest_free(Digest *digest);
+
+/**
+ * @brief Calculate digests of complete file in one pass. The file is mmap'ed and processed in
+ *        large blocks, falling back to read() for files that cannot be mapped.
+ *
+ * @param[in]  fp      File to read data from (flushed and read from offset 0)
+ * @param[in]  types   Bitwise OR of DigestType to calculate
+ * @param[in]  backend DigestBackend to use
+ * @param[out] digest  Return location for finalized Digest context
+ * @param[out] error   Error
+ * @return TRUE if digest calculation succeeded, FALSE otherwise (error set)
+ */
+gboolean digest_file(FILE *fp, guint types, DigestBackend backend, Digest **digest,
+                     GError **error);
+
+/**
+ * @brief Fastest backend available in this build.
+ *
+ * @return DigestBackend
+ */
+DigestBackend digest_default_backend(void);
+
+/**
+ * @brief Check whether backend is available in this build.
+ *
+ * @param[in] backend DigestBackend
+ * @return TRUE if available, FALSE otherwise
+ */
+gboolean digest_backend_available(DigestBackend backend);
+
+/**
+ * @brief Name of backend, e.g. "openssl".
+ */
+const gchar* digest_backend_to_string(DigestBackend backend);
+
+/**
+ * @brief Name of digest type as used by hawkBit, e.g. "sha256".
+ */
+const gchar* digest_type_to_string(DigestType type);
+
+/**
+ * @brief Map GChecksumType to DigestType.
+ *
+ * @param[in] type GChecksumType (MD5, SHA1 or SHA256)
+ * @return DigestType, 0 if unsupported
+ */
+DigestType digest_type_from_checksum_type(GChecksumType type);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(Digest, digest_free)
+
+#endif // __DIGEST_H__
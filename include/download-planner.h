@@ -0,0 +1,69 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __DOWNLOAD_PLANNER_H__
+#define __DOWNLOAD_PLANNER_H__
+
+#include <glib.h>
+#include "hawkbit-client.h"
+
+#define DOWNLOAD_PLAN_ERROR download_plan_error_quark()
+GQuark download_plan_error_quark(void);
+
+typedef enum {
+        DOWNLOAD_PLAN_ERROR_NOSPC,    /**< deployment does not fit into the staging directories */
+        DOWNLOAD_PLAN_ERROR_STAGING,  /**< no usable staging directory */
+        DOWNLOAD_PLAN_ERROR_RESERVE,  /**< space could not be reserved */
+} DownloadPlanError;
+
+/**
+ * @brief Staging directory considered by the planner.
+ */
+typedef struct StagingDir_ {
+        gchar *path;                  /**< directory */
+        gboolean tmpfs;               /**< RAM-backed (tmpfs/ramfs) */
+        guint64 fsid;                 /**< file system ID */
+        goffset available;            /**< free bytes when planning */
+        goffset planned;              /**< bytes placed here by the plan */
+} StagingDir;
+
+/**
+ * @brief Placement and order of all artifact downloads of a deployment.
+ */
+typedef struct DownloadPlan_ {
+        GPtrArray *dirs;              /**< StagingDir in order of preference */
+        GList *order;                 /**< Artifact (borrowed) in download order */
+        GPtrArray *reservations;      /**< reserved staging files (Artifact file), released on free */
+        goffset total;                /**< bytes still to download */
+} DownloadPlan;
+
+/**
+ * @brief Plan downloads of a deployment before any transfer starts.
+ *
+ * Sums up the artifact sizes (minus partial downloads found for resuming) and places each
+ * artifact in one of staging_dirs, preferring persistent (flash) directories over RAM-backed
+ * ones and otherwise keeping the configured order. The space is reserved up front by
+ * preallocating the staging files (without changing their size, so resuming still works), and
+ * artifact->file is set to the staging file (owned by the plan). Directories on the same file system as a preceding
+ * one are skipped, as they share its free space. Downloads are ordered smallest first to minimize
+ * the time until the first artifact can be installed.
+ *
+ * @param[in]  artifacts    GList of Artifact to download
+ * @param[in]  staging_dirs NULL-terminated list of staging directories
+ * @param[out] error        Error
+ * @return DownloadPlan* (free with download_plan_free()), NULL if the deployment does not fit or
+ *         no space could be reserved (error set)
+ */
+DownloadPlan* download_plan_new(GList *artifacts, gchar **staging_dirs, GError **error);
+
+/**
+ * @brief Frees a DownloadPlan, releasing space reserved beyond the downloaded data.
+ *
+ * @param[in] plan DownloadPlan to free
+ */
+void download_plan_free(DownloadPlan *plan);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(DownloadPlan, download_plan_free)
+
+#endif // __DOWNLOAD_PLANNER_H__
@@ -0,0 +1,88 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __DOWNLOAD_SOURCES_H__
+#define __DOWNLOAD_SOURCES_H__
+
+#include <glib.h>
+
+/**
+ * @brief Source an artifact can be downloaded from.
+ */
+typedef struct DownloadSource_ {
+        gchar *url;                   /**< URL to download the artifact from */
+        gboolean authenticate;        /**< send hawkBit credentials, FALSE for mirrors and
+                                           cleartext URLs if hawkBit is reached via https */
+        gint64 transferred;           /**< bytes received from this source */
+        gint64 elapsed;               /**< time spent receiving them [us] */
+        guint failures;               /**< consecutive failed or stalled transfers */
+} DownloadSource;
+
+/**
+ * @brief Sources of one artifact download and the one currently used.
+ */
+typedef struct DownloadSources_ {
+        GPtrArray *list;              /**< DownloadSource* in order of preference */
+        DownloadSource *current;      /**< source of the next transfer */
+} DownloadSources;
+
+/**
+ * @brief Collect the sources of an artifact: the URLs derived by matching mirror rules first, then
+ *        the URL supplied by hawkBit itself. Duplicates are dropped.
+ *
+ * @param[in] url             URL supplied by hawkBit
+ * @param[in] mirrors         NULL-terminated list of mirror rules
+ *                            "<URL prefix>=<mirror URL prefix>" or NULL
+ * @param[in] plain_http_auth Whether a plain http:// URL supplied by hawkBit may carry the hawkBit
+ *                            credentials, i.e. hawkBit is not reached via https anyway
+ * @return newly allocated DownloadSources, the first source is current
+ */
+DownloadSources* download_sources_new(const gchar *url, gchar **mirrors, gboolean plain_http_auth);
+
+/**
+ * @brief Get number of sources.
+ *
+ * @param[in] sources DownloadSources
+ * @return number of sources
+ */
+guint download_sources_count(const DownloadSources *sources);
+
+/**
+ * @brief Record a transfer from the current source.
+ *
+ * @param[in,out] sources     DownloadSources
+ * @param[in]     transferred Bytes received
+ * @param[in]     elapsed     Duration of the transfer [us]
+ * @param[in]     success     FALSE if the transfer failed or stalled
+ */
+void download_sources_record(DownloadSources *sources, gint64 transferred, gint64 elapsed,
+                             gboolean success);
+
+/**
+ * @brief Make another source current: the one with the fewest consecutive failures, preferring
+ *        sources not tried yet and then the highest throughput measured.
+ *
+ * @param[in,out] sources DownloadSources
+ * @return the new current source, the current one if there is no other
+ */
+const DownloadSource* download_sources_switch(DownloadSources *sources);
+
+/**
+ * @brief Get average throughput measured for source.
+ *
+ * @param[in] source DownloadSource
+ * @return bytes per second, -1 if not measured yet
+ */
+gint64 download_source_get_speed(const DownloadSource *source);
+
+/**
+ * @brief Frees the memory allocated by DownloadSources.
+ *
+ * @param[in] sources DownloadSources to free
+ */
+void download_sources_free(DownloadSources *sources);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(DownloadSources, download_sources_free)
+
+#endif // __DOWNLOAD_SOURCES_H__
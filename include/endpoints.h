@@ -0,0 +1,81 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __ENDPOINTS_H__
+#define __ENDPOINTS_H__
+
+#include <glib.h>
+
+/**
+ * @brief Set up the hawkBit servers requests can be sent to. The first one is selected until
+ *        probes or failed requests suggest another one.
+ *
+ * @param[in] servers NULL-terminated list of hawkBit hosts or IPs and ports, in preferred order
+ */
+void endpoints_init(gchar **servers);
+
+/**
+ * @brief Forget servers set up by endpoints_init().
+ */
+void endpoints_clear(void);
+
+/**
+ * @brief Get number of servers set up by endpoints_init().
+ *
+ * @return number of servers
+ */
+guint endpoints_count(void);
+
+/**
+ * @brief Get the selected server.
+ *
+ * @return newly allocated host or IP and port of the selected server, NULL if none set up
+ */
+gchar* endpoints_get_current(void);
+
+/**
+ * @brief Get all servers, e.g. to probe them.
+ *
+ * @return newly allocated NULL-terminated list of servers in configured order
+ */
+gchar** endpoints_get_all(void);
+
+/**
+ * @brief Record the result of probing server. Call endpoints_select() once all servers were
+ *        probed.
+ *
+ * @param[in] server  Server probed
+ * @param[in] success Whether the server answered properly
+ * @param[in] rtt     Round trip time of the probe in microseconds, ignored unless success
+ */
+void endpoints_probed(const gchar *server, gboolean success, gint64 rtt);
+
+/**
+ * @brief Select the best ranked server: the one with the lowest round trip time, penalized by its
+ *        error rate. The selection only changes if the selected server failed or another one is
+ *        considerably faster, so it does not flap between servers of similar latency.
+ */
+void endpoints_select(void);
+
+/**
+ * @brief Record the result of a request sent to server. If the selected server failed, another
+ *        one is selected: the best ranked one not known to fail or, if all fail, the next one.
+ *
+ * @param[in] server  Server the request was sent to
+ * @param[in] success FALSE if the server could not be reached or reported a server error
+ * @return TRUE if the request failed and a server not known to fail was selected instead, so the
+ *         request is worth repeating right away, FALSE otherwise
+ */
+gboolean endpoints_request_done(const gchar *server, gboolean success);
+
+/**
+ * @brief Point url built for one of the servers (e.g. a stored feedback URL) to the selected
+ *        server.
+ *
+ * @param[in] url URL
+ * @return newly allocated URL, a copy of url if it does not refer to another configured server
+ */
+gchar* endpoints_rewrite_url(const gchar *url);
+
+#endif // __ENDPOINTS_H__
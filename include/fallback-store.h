@@ -0,0 +1,37 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __FALLBACK_STORE_H__
+#define __FALLBACK_STORE_H__
+
+#include <glib.h>
+
+/**
+ * @brief Retain verified firmware image in store, so devices can be rolled back to it without
+ *        network access. The image is copied to "<dir>/<name>/<version>.hex", already retained
+ *        versions are only marked as most recent. The least recently retained images of name
+ *        beyond keep are removed.
+ *
+ * @param[in]  dir      Store directory, created if missing
+ * @param[in]  keep     Maximum number of images kept per firmware name (at least 1)
+ * @param[in]  name     Firmware/device name
+ * @param[in]  version  Firmware version as stored in the device database
+ * @param[in]  firmware Path to firmware HEX file to retain
+ * @param[out] error    Error
+ * @return TRUE if retained, FALSE otherwise (error set)
+ */
+gboolean fallback_store_retain(const gchar *dir, guint keep, const gchar *name,
+                               const gchar *version, const gchar *firmware, GError **error);
+
+/**
+ * @brief Get retained firmware image.
+ *
+ * @param[in] dir     Store directory
+ * @param[in] name    Firmware/device name
+ * @param[in] version Firmware version as stored in the device database
+ * @return newly allocated path to the retained HEX file, NULL if not retained
+ */
+gchar* fallback_store_lookup(const gchar *dir, const gchar *name, const gchar *version);
+
+#endif // __FALLBACK_STORE_H__
@@ -0,0 +1,89 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __FLASH_BACKEND_H__
+#define __FLASH_BACKEND_H__
+
+#include <glib.h>
+
+#define FLASH_ERROR flash_error_quark()
+GQuark flash_error_quark(void);
+
+typedef enum {
+        FLASH_ERROR_FAILED,           /**< flashing failed */
+        FLASH_ERROR_COMMUNICATION,    /**< error in communication with bootloader */
+        FLASH_ERROR_OFFLINE,          /**< device is not online */
+        FLASH_ERROR_TIMEOUT,          /**< flashing did not finish in time and was killed */
+        FLASH_ERROR_BACKEND,          /**< backend could not be loaded/started */
+} FlashError;
+
+/**
+ * @brief Progress callback, called from the flashing thread.
+ *
+ * @param[in] percentage Progress in percent (0-100)
+ * @param[in] message    Progress message as reported by the backend
+ * @param[in] user_data  FlashRequest progress_data
+ */
+typedef void (*FlashProgressFunc)(gint percentage, const gchar *message, gpointer user_data);
+
+/**
+ * @brief Firmware flashing request for a single device.
+ */
+typedef struct FlashRequest_ {
+        gint device_id;               /**< bootloader device ID */
+        const gchar *device_name;     /**< device/firmware name */
+        const gchar *firmware;        /**< path to firmware HEX file */
+        guint timeout;                /**< seconds until flashing is aborted, 0 for no timeout */
+        FlashProgressFunc progress;   /**< progress callback or NULL */
+        gpointer progress_data;       /**< user data passed to progress */
+} FlashRequest;
+
+/**
+ * @brief Entry point of shared library backends, exported as FLASH_BACKEND_SYMBOL. Must block
+ *        until flashing finished, honor request->timeout and report errors in the FLASH_ERROR
+ *        domain.
+ *
+ * @param[in]  request FlashRequest
+ * @param[out] error   Error
+ * @return TRUE if flashing succeeded, FALSE otherwise (error set)
+ */
+typedef gboolean (*FlashFunc)(const FlashRequest *request, GError **error);
+
+#define FLASH_BACKEND_SYMBOL "rhu_flash_backend_flash"
+
+typedef struct FlashBackend_ FlashBackend;
+
+/**
+ * @brief Create flashing backend. Without module, command is spawned as
+ *        "<command> -start <device id> <firmware>" and its output is parsed for "<n>%" progress.
+ *
+ * @param[in]  module  Path to shared library backend or NULL
+ * @param[in]  command Bootloader command used if module is NULL
+ * @param[out] error   Error
+ * @return FlashBackend* (free with flash_backend_free()), NULL on error (error set)
+ */
+FlashBackend* flash_backend_new(const gchar *module, const gchar *command, GError **error);
+
+/**
+ * @brief Flash firmware to a single device, blocking until done, failed or timed out. On
+ *        timeout, the bootloader command is terminated (SIGTERM, SIGKILL after 5 seconds).
+ *
+ * @param[in]  backend FlashBackend
+ * @param[in]  request FlashRequest
+ * @param[out] error   Error
+ * @return TRUE if flashing succeeded, FALSE otherwise (error set)
+ */
+gboolean flash_backend_flash(FlashBackend *backend, const FlashRequest *request,
+                             GError **error);
+
+/**
+ * @brief Frees a FlashBackend, unloading its module.
+ *
+ * @param[in] backend FlashBackend to free
+ */
+void flash_backend_free(FlashBackend *backend);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(FlashBackend, flash_backend_free)
+
+#endif // __FLASH_BACKEND_H__
@@ -10,6 +10,7 @@
 #include "hawkbit-client.h"
 #include <curl/curl.h>
 #include "config-file.h"
+#include "arena.h"
 
 
 
@@ -29,6 +30,10 @@ typedef struct {
     version_t fw;
     version_t latest_fw;
     version_t fallback_fw;
+    gchar *fw_version;                /**< FW as stored in the database */
+    gchar *hw_version;                /**< HW as stored in the database */
+    gchar *latest_version;            /**< FW_LATEST as stored in the database */
+    gchar *fallback_version;          /**< FW_FALLBACK as stored in the database */
     int id;
 } RCE_DEVICE;
 
@@ -38,8 +43,23 @@ typedef struct {
 
 int get_devices();
 
+GList* get_current_devices();
+void free_image(gpointer data);
+
 gboolean  add_devices_to_config(GHashTable *hash);
 gboolean rauc_complete_cb(gpointer ptr);
-gboolean parse_fw(JsonArray *json_chunks, gchar *feedback_url_tmp, gboolean forced);
+GList* fw_collect_artifacts(JsonArray *json_chunks, GList *rce_devices_list,
+                            const gchar *feedback_url_tmp, gboolean forced, Arena *arena,
+                            GError **error);
+gboolean parse_fw(JsonArray *json_chunks, gchar *feedback_url_tmp, gboolean forced,
+                  gboolean do_install, GError **error);
+void fw_discard_prefetched(void);
+void fw_resume_deployment(GList *artifacts);
+void fw_resume_flash_retries(GList *artifacts, GHashTable *flash_retries, guint flashed,
+                             guint failed);
+struct HawkbitAction* fw_flash_retries_action(void);
+gboolean fw_flash_retries_due(void);
+gboolean fw_flash_retries_run(gpointer data);
+gboolean fw_flash_retries_finish(gboolean canceled);
 
 #endif // _FW_INTERFACE_H__
\ No newline at end of file
@@ -11,8 +11,11 @@
 #include <stdio.h>
 
 #include <curl/curl.h>
+#include <json-glib/json-glib.h>
 #include "config-file.h"
+#include "download-sources.h"
 #include "fw-interface.h"
+#include "worker.h"
 #define RHU_HAWKBIT_CLIENT_ERROR rhu_hawkbit_client_error_quark()
 GQuark rhu_hawkbit_client_error_quark(void);
 
@@ -71,9 +74,27 @@ enum ActionState {
  */
 struct HawkbitAction {
         gchar *id;                    /**< HawkBit action id */
+        gchar *feedback_url;          /**< feedback URL of action id, built once per action */
         GMutex mutex;                 /**< mutex used for accessing all other members */
         enum ActionState state;       /**< state of this action */
         GCond cond;                   /**< condition on state */
+        gint cancel_requested;        /**< set with state ACTION_STATE_CANCEL_REQUESTED, read
+                                           atomically by transfers without locking mutex */
+        gchar *cancel_id;             /**< stop id of cancelation to acknowledge once the
+                                           download thread stopped, or NULL */
+        gboolean prefetched;          /**< bundle downloaded and verified while hawkBit asked to
+                                           skip installation (maintenance window) */
+};
+
+/**
+ * @brief struct that contains the poll state of a hawkBit target (controller). In gateway mode
+ * one process serves multiple targets, each with its own action.
+ */
+struct HawkbitTarget {
+        gchar *controller_id;           /**< hawkBit controller id */
+        struct HawkbitAction *action;   /**< action state of this target */
+        long interval_check_sec;        /**< poll interval requested by hawkBit */
+        long last_run_sec;              /**< seconds since last poll */
 };
 
 /**
@@ -94,12 +115,32 @@ typedef struct Artifact_ {
         gchar *download_url;          /**< download URL of software bundle file */
         gchar *feedback_url;          /**< URL status feedback should be sent to */
         gchar *sha1;                  /**< sha1 checksum of software bundle file */
+        gchar *sha256;                /**< sha256 checksum of software bundle file or NULL */
+        gchar *md5;                   /**< md5 checksum of software bundle file or NULL */
         gboolean do_install;          /**< whether the installation should be started or not */
         gboolean install_can; 
         gboolean config_install;
+        gboolean rollback;            /**< re-flash retained firmware of version, no download */
+        const gchar *file;            /**< staging file owned by the DownloadPlan or NULL */
 } Artifact;
 
 
+/**
+ * @brief Progress of an artifact download, aggregated across resumed transfers.
+ */
+typedef struct DownloadProgress_ {
+        const Artifact *artifact;     /**< artifact downloaded */
+        curl_off_t offset;            /**< resume offset of current transfer */
+        curl_off_t transferred;       /**< bytes transferred by finished transfers */
+        curl_off_t current;           /**< bytes transferred by current transfer */
+        gint64 started;               /**< monotonic time the download started [us] */
+        gint64 last_report;           /**< monotonic time of last progress report [us] */
+        gint stall_time;              /**< abort transfers slower than download_stall_rate for
+                                           this many seconds, 0 disables */
+        gint64 window_start;          /**< monotonic time the throughput window started [us] */
+        curl_off_t window_current;    /**< bytes of current transfer when the window started */
+        gboolean stalled;             /**< current transfer was aborted as it stalled */
+} DownloadProgress;
 
 /**
  * @brief struct containing the new downloaded file.
@@ -130,6 +171,15 @@ struct on_install_complete_userdata {
  */
 void hawkbit_init(Config *config, GSourceFunc on_install_ready);
 
+/**
+ * @brief Reload config_file on SIGHUP or when it changes, while the service is running.
+ *        Settings that require a restart are kept, reloads changing settings an action in
+ *        progress depends on are deferred until it finished.
+ *
+ * @param[in] config_file Config file the Config passed to hawkbit_init() was loaded from
+ */
+void hawkbit_set_config_file(const gchar *config_file);
+
 /**
  * @brief Sets up timeout and event sourconfigces, initializes and runs main loop.
  *
@@ -170,10 +220,138 @@ void artifact_free(Artifact *artifact);
 
 void process_deployment_cleanup();
 
+/**
+ * @brief Run download (and installation) of the active action in a worker thread, so the
+ *        polling main loop never waits for it. Completion is reported back to the main loop.
+ *
+ * @param[in] func Worker function, returning TRUE on success
+ * @param[in] data Data passed to func
+ */
+void start_download_worker(WorkerFunc func, gpointer data);
+
+/**
+ * @brief Called by download threads after stopping the active action on a cancel request, so the
+ *        cancelation is acknowledged from the main loop. Must be called under locked
+ *        active_action->mutex.
+ */
+void process_cancel_complete(void);
+
+/**
+ * @brief Calculate checksum for file.
+ *
+ * @param[in]  fp       File to read data from
+ * @param[in]  type     Desired type of checksum
+ * @param[out] checksum Calculated checksum digest hex string
+ * @param[out] error    Error
+ * @return TRUE if checksum calculation succeeded, FALSE otherwise (error set)
+ */
+gboolean get_file_checksum(FILE *fp, const GChecksumType type, gchar **checksum,
+                           GError **error);
+
+/**
+ * @brief Get strongest checksum supplied by the server for artifact (sha256 > sha1 > md5).
+ *
+ * @param[in]  artifact Artifact
+ * @param[out] type     Type of the returned checksum
+ * @return checksum hex string owned by artifact, NULL if none available
+ */
+const gchar* artifact_get_checksum(const Artifact *artifact, GChecksumType *type);
+
+/**
+ * @brief Curl callback writing REST response to RestPayload*->payload buffer.
+ *
+ * @see   https://curl.haxx.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
+ */
+size_t curl_write_cb(const void *content, size_t size, size_t nmemb, void *data);
+
+/**
+ * @brief Build hawkBit JSON request.
+ *
+ * @see https://www.eclipse.org/hawkbit/rest-api/rootcontroller-api-guide/#_post_tenant_controller_v1_controllerid_deploymentbase_actionid_feedback
+ *
+ * @param[in] id         hawkBit action ID or NULL (configData usecase)
+ * @param[in] detail     Detail message or NULL (configData usecase)
+ * @param[in] finished   hawkBit status of the result
+ * @param[in] execution  hawkBit status of the action execution
+ * @param[in] attributes hawkBit controller attributes or NULL (feedback usecase)
+ * @return JsonBuilder* with built hawkBit request
+ */
+JsonBuilder* json_build_status(const gchar *id, const gchar *detail, const gchar *finished,
+                               const gchar *execution, GHashTable *attributes);
+
+/**
+ * @brief Format hawkBit feedback JSON request from a preformatted template, escaping only the
+ *        variable parts in. Produces the same document as json_build_status() (plus progress)
+ *        without building a JSON tree.
+ *
+ * @param[in] id        hawkBit action ID
+ * @param[in] detail    Detail message
+ * @param[in] finished  hawkBit status of the result
+ * @param[in] execution hawkBit status of the action execution
+ * @param[in] cnt       progress achieved (of of)
+ * @param[in] of        progress total or 0 to omit progress
+ * @return newly allocated JSON string
+ */
+gchar* json_format_feedback(const gchar *id, const gchar *detail, const gchar *finished,
+                            const gchar *execution, gint cnt, gint of);
+
+/**
+ * @brief Build API URL for the target currently owning the active action.
+ *
+ * @param path[in] a printf()-like format string describing the API path or NULL for base path
+ * @param ... The arguments to be inserted in path
+ *
+ * @return a newly allocated full API URL
+ */
 gchar* build_api_url(const gchar *path, ...);
 
-gboolean get_binary(const gchar *download_url, const gchar *file, curl_off_t resume_from,
-                           gchar **sha1sum, curl_off_t *speed, GError **error);
+/**
+ * @brief Download artifact to file from its current source. If the transfer fails or stalls
+ *        (see download_stall_rate) and there are other sources, it is resumed from the best of
+ *        them with a range request. Gives up once every source failed in turn.
+ *
+ * @param[in,out] sources       DownloadSources of the artifact
+ * @param[in]     file          Download destination
+ * @param[in]     resume_from   Offset to resume download from
+ * @param[in]     checksum_type Type of checksum to calculate
+ * @param[out]    checksum      Calculated checksum or NULL
+ * @param[in,out] progress      DownloadProgress updated during the transfer
+ * @param[out]    error         Error of the last transfer
+ * @return TRUE if download succeeded, FALSE otherwise (error set)
+ */
+gboolean get_binary(DownloadSources *sources, const gchar *file, curl_off_t resume_from,
+                    GChecksumType checksum_type, gchar **checksum, DownloadProgress *progress,
+                    GError **error);
+
+/**
+ * @brief Download artifact to file from the configured peers, trying them in order and resuming
+ *        from the current size of file. Artifacts with a checksum different from the strongest
+ *        one supplied by hawkBit are discarded.
+ *
+ * @param[in]  artifact Artifact to download
+ * @param[in]  file     Download destination
+ * @param[out] checksum Checksum of the downloaded file, set if TRUE is returned
+ * @param[in,out] progress DownloadProgress updated during the transfer
+ * @return TRUE if a peer provided the verified artifact, FALSE otherwise (download from hawkBit)
+ */
+gboolean get_binary_from_peers(const Artifact *artifact, const gchar *file, gchar **checksum,
+                               DownloadProgress *progress);
+
+/**
+ * @brief Start tracking progress of an artifact download.
+ *
+ * @param[out] progress DownloadProgress to initialize
+ * @param[in]  artifact Artifact to download
+ */
+void download_progress_init(DownloadProgress *progress, const Artifact *artifact);
+
+/**
+ * @brief Get effective download speed across all transfers since download_progress_init().
+ *
+ * @param[in] progress DownloadProgress of the download
+ * @return speed in bytes per second
+ */
+curl_off_t download_progress_get_speed(const DownloadProgress *progress);
 
 
 
@@ -0,0 +1,95 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __IHEX_H__
+#define __IHEX_H__
+
+#include <glib.h>
+
+#define IHEX_ERROR ihex_error_quark()
+GQuark ihex_error_quark(void);
+
+typedef enum {
+        IHEX_ERROR_PARSE,             /**< malformed or truncated record */
+        IHEX_ERROR_CHECKSUM,          /**< record checksum mismatch */
+        IHEX_ERROR_RANGE,             /**< data outside of memory map or overlapping */
+        IHEX_ERROR_SIZE,              /**< image too large */
+} IhexError;
+
+/** block size of the CRC table */
+#define IHEX_CRC_BLOCK_SIZE 4096
+
+/**
+ * @brief Address range [start, end).
+ */
+typedef struct IhexRange_ {
+        guint64 start;
+        guint64 end;
+} IhexRange;
+
+/**
+ * @brief Binary image built from an Intel HEX file. Gaps between records are filled with 0xff.
+ */
+typedef struct IhexImage_ {
+        gint ref_count;
+        guint32 base;                 /**< address of first byte of data */
+        guint32 size;                 /**< size of data */
+        guint8 *data;                 /**< image data */
+        GArray *extents;              /**< IhexRange of address ranges covered by records, sorted */
+        guint32 *crc;                 /**< CRC-32 per IHEX_CRC_BLOCK_SIZE block of data */
+        guint n_blocks;               /**< number of entries in crc */
+        gint64 hex_mtime;             /**< modification time of the parsed HEX file */
+        gint64 hex_size;              /**< size of the parsed HEX file */
+} IhexImage;
+
+/**
+ * @brief Parse memory map specification "<start>-<end>[,<start>-<end>...]" (inclusive end
+ *        addresses, decimal or 0x prefixed hexadecimal).
+ *
+ * @param[in]  spec   Memory map specification
+ * @param[out] ranges Return location for sorted and merged GArray of IhexRange
+ * @param[out] error  Error
+ * @return TRUE on success, FALSE otherwise (error set)
+ */
+gboolean ihex_parse_memory_map(const gchar *spec, GArray **ranges, GError **error);
+
+/**
+ * @brief Parse and validate Intel HEX data: record syntax and checksums, supported record
+ *        types, terminating EOF record and non-overlapping data records.
+ *
+ * @param[in]  data  Intel HEX data
+ * @param[in]  len   Length of data
+ * @param[out] error Error
+ * @return IhexImage* (unref with ihex_image_unref()), NULL on error (error set)
+ */
+IhexImage* ihex_parse(const gchar *data, gsize len, GError **error);
+
+/**
+ * @brief Get image for Intel HEX file. Images are cached in memory and as "<path>.bin" binary
+ *        image and "<path>.crc" CRC table next to the HEX file, so each file is parsed only once
+ *        as long as it is unchanged.
+ *
+ * @param[in]  path  Intel HEX file
+ * @param[out] error Error
+ * @return IhexImage* (unref with ihex_image_unref()), NULL on error (error set)
+ */
+IhexImage* ihex_image_load(const gchar *path, GError **error);
+
+/**
+ * @brief Check that all data of image lies within memory map.
+ *
+ * @param[in]  image      IhexImage to check
+ * @param[in]  memory_map GArray of IhexRange as returned by ihex_parse_memory_map()
+ * @param[out] error      Error
+ * @return TRUE if image fits, FALSE otherwise (error set)
+ */
+gboolean ihex_image_check_memory_map(const IhexImage *image, const GArray *memory_map,
+                                     GError **error);
+
+IhexImage* ihex_image_ref(IhexImage *image);
+void ihex_image_unref(IhexImage *image);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(IhexImage, ihex_image_unref)
+
+#endif // __IHEX_H__
@@ -49,4 +49,25 @@ JsonArray* json_get_array(JsonNode *json_node, const gchar *path, GError **error
  */
 gboolean json_contains(JsonNode *root, gchar *key);
 
+/**
+ * @brief Get the string member of a JSON object node without evaluating a JSONPath expression.
+ *        Use this for direct members in hot loops, e.g. per chunk of large deployments.
+ *
+ * @param[in] json_node JsonNode holding an object
+ * @param[in] member    Member name
+ * @return const gchar*, string value owned by json_node, NULL if json_node is no object or the
+ *         member is missing or no string
+ */
+const gchar* json_get_member_string(JsonNode *json_node, const gchar *member);
+
+/**
+ * @brief Get the array member of a JSON object node without evaluating a JSONPath expression.
+ *
+ * @param[in] json_node JsonNode holding an object
+ * @param[in] member    Member name
+ * @return JsonArray*, array owned by json_node, NULL if json_node is no object or the member is
+ *         missing or no array
+ */
+JsonArray* json_get_member_array(JsonNode *json_node, const gchar *member);
+
 #endif // __JSON_HELPER_H__
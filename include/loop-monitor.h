@@ -0,0 +1,60 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __LOOP_MONITOR_H__
+#define __LOOP_MONITOR_H__
+
+#include <glib.h>
+
+/**
+ * @brief Configure main loop monitoring.
+ *
+ * @param[in] stall_threshold_ms Log callbacks dispatched for at least this long [ms], 0 disables
+ *                               logging (latencies are recorded nonetheless)
+ */
+void loop_monitor_init(gint stall_threshold_ms);
+
+/**
+ * @brief Set callback of source, recording how long each dispatch of it takes under the source's
+ *        name (see g_source_set_name()).
+ *
+ * @param[in] source GSource attached to the monitored main loop
+ * @param[in] func   Callback
+ * @param[in] data   Data passed to func
+ */
+void loop_monitor_source_set_callback(GSource *source, GSourceFunc func, gpointer data);
+
+/**
+ * @brief Monitored variant of g_main_context_invoke(), func is always dispatched by the main loop
+ *        of context, even if called from the thread owning context.
+ *
+ * @param[in] context GMainContext to dispatch func in
+ * @param[in] name    Name func is recorded as
+ * @param[in] func    Callback
+ * @param[in] data    Data passed to func
+ */
+void loop_monitor_invoke(GMainContext *context, const gchar *name, GSourceFunc func,
+                         gpointer data);
+
+/**
+ * @brief Start health thread checking main loop liveness. With a systemd watchdog configured, the
+ *        thread services it as long as the main loop did not block for stall_limit_sec, instead of
+ *        the main loop itself. Once blocked, the stalled callback is logged and pinging stops.
+ *
+ * @param[in] stall_limit_sec Time the main loop may block [s]
+ * @return TRUE if the health thread services the systemd watchdog, FALSE otherwise
+ */
+gboolean loop_monitor_start_watchdog(gint stall_limit_sec);
+
+/**
+ * @brief Stop health thread started by loop_monitor_start_watchdog(), if any.
+ */
+void loop_monitor_stop_watchdog(void);
+
+/**
+ * @brief Log histogram of dispatch latencies per callback recorded so far.
+ */
+void loop_monitor_log_histogram(void);
+
+#endif // __LOOP_MONITOR_H__
@@ -0,0 +1,55 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __PEER_SERVER_H__
+#define __PEER_SERVER_H__
+
+#include <glib.h>
+#include "hawkbit-client.h"
+
+/**
+ * @brief Start HTTP server sharing verified artifacts with peers on the local network, see
+ *        peer_server_artifact_path(). Artifacts found in cache_dir are served right away.
+ *
+ * @param[in]  context   GMainContext accepting connections, requests are served by threads
+ * @param[in]  port      TCP port to listen on (all interfaces)
+ * @param[in]  cache_dir Directory verified artifacts are kept in for peers or NULL to serve them
+ *                       only as long as they exist at their download location
+ * @param[out] error     Error
+ * @return TRUE if the server is listening, FALSE otherwise (error set)
+ */
+gboolean peer_server_start(GMainContext *context, gint port, const gchar *cache_dir,
+                           GError **error);
+
+/**
+ * @brief Stop server started by peer_server_start(), if any.
+ */
+void peer_server_stop(void);
+
+/**
+ * @brief Share artifact verified at file with peers. With a cache directory, file is hard linked
+ *        into it, replacing artifacts of other actions. No-op if the server is not running.
+ *
+ * @param[in] action_id hawkBit action id the artifact was downloaded for
+ * @param[in] artifact  Artifact verified against the checksums supplied by hawkBit
+ * @param[in] file      File the artifact was downloaded to
+ */
+void peer_server_add(const gchar *action_id, const Artifact *artifact, const gchar *file);
+
+/**
+ * @brief Stop sharing file, e.g. because it is about to be overwritten by another download.
+ *
+ * @param[in] file File passed to peer_server_add()
+ */
+void peer_server_forget(const gchar *file);
+
+/**
+ * @brief Get path an artifact is served at by peers.
+ *
+ * @param[in] sha1 SHA1 hex digest of the artifact
+ * @return newly allocated path, e.g. "/artifacts/<sha1>"
+ */
+gchar* peer_server_artifact_path(const gchar *sha1);
+
+#endif // __PEER_SERVER_H__
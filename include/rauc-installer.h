@@ -20,14 +20,18 @@ struct install_context {
         GMutex status_mutex;          /**< Mutex used for accessing status_messages */
         GQueue status_messages;       /**< Queue of status messages from Rauc DBUS */
         gint status_result;           /**< The result of the installation */
-        GMainLoop *mainloop;          /**< The installation GMainLoop  */
-        GMainContext *loop_context;   /**< GMainContext for the GMainLoop */
+        GMainContext *loop_context;   /**< GMainContext of the installer thread, callbacks are invoked in */
         gboolean keep_install_context; /**< Whether the installation thread should free this struct or keep it */
+        gboolean finished;            /**< Whether the installation finished (only used with keep_install_context) */
+        GCond finished_cond;          /**< Signaled with status_mutex held when finished is set */
 };
 
 /**
  * @brief RAUC install bundle
  *
+ * Queues the installation to the long-lived installer thread, which reuses its D-Bus connection
+ * and RAUC proxy. Installations are processed one after another in the order they were queued.
+ *
  * @param[in] bundle RAUC bundle file (.raucb) to install.
  * @param[in] auth_header Authentication header on HTTP streaming installation or NULL on normal
  *                        installation.
@@ -36,7 +40,7 @@ struct install_context {
  *                              installation.
  * @param[in] on_install_complete Callback function to be called with the result of the
  *                                installation.
- * @param[in] wait Whether to wait until install thread finished or not.
+ * @param[in] wait Whether to wait until this installation finished or not.
  * @return for wait=TRUE, TRUE if installation succeeded, FALSE otherwise; for
  *         wait=FALSE TRUE is always returned immediately
  */
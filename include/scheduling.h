@@ -0,0 +1,29 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __SCHEDULING_H__
+#define __SCHEDULING_H__
+
+#include <glib.h>
+#include "config-file.h"
+
+/**
+ * @brief Set up scheduling of updater work from config: remember the CPU and I/O scheduling
+ *        applied to worker threads by scheduling_apply_to_thread() and, if configured, move the
+ *        process into its cgroup v2 sub-tree with the configured weights. Failing to set up the
+ *        cgroup is logged, the updater keeps running in its current cgroup.
+ *
+ * @param[in] config Config with worker_* and cgroup* settings
+ */
+void scheduling_init(const Config *config);
+
+/**
+ * @brief Apply the scheduling set up by scheduling_init() to the calling thread. Threads started
+ *        by it (and processes spawned by them) inherit it. Failures are logged.
+ *
+ * @param[in] name Name of the thread used in log messages
+ */
+void scheduling_apply_to_thread(const gchar *name);
+
+#endif // __SCHEDULING_H__
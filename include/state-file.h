@@ -0,0 +1,138 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __STATE_FILE_H__
+#define __STATE_FILE_H__
+
+#include <glib.h>
+#include "hawkbit-client.h"
+
+/**
+ * @brief Phase of the persisted action.
+ */
+typedef enum {
+        STATE_PHASE_DOWNLOADING,      /**< artifacts are (being) downloaded */
+        STATE_PHASE_INSTALLING,       /**< installation started */
+        STATE_PHASE_RETRYING,         /**< installed, flashing offline devices is retried */
+        STATE_PHASE_FEEDBACK,         /**< action finished, final feedback not acknowledged yet */
+} StatePhase;
+
+/**
+ * @brief Action persisted by a previous run.
+ */
+typedef struct SavedAction_ {
+        gchar *controller_id;         /**< target owning the action */
+        gchar *id;                    /**< hawkBit action id */
+        StatePhase phase;
+        gboolean firmware;            /**< firmware deployment (multiple chunks) */
+        GList *artifacts;             /**< Artifact to download and install */
+        GHashTable *flash_retries;    /**< artifact name to GArray of gint ids of devices whose
+                                           flashing is retried (STATE_PHASE_RETRYING only) */
+        guint flashed;                /**< devices flashed (STATE_PHASE_RETRYING only) */
+        guint failed;                 /**< devices failed to flash (STATE_PHASE_RETRYING only) */
+        gchar *last_feedback;         /**< detail of last feedback acknowledged by hawkBit or NULL */
+        gchar *feedback_url;          /**< pending final feedback (STATE_PHASE_FEEDBACK only) */
+        gchar *feedback_detail;
+        gchar *feedback_finished;
+        gchar *feedback_execution;
+} SavedAction;
+
+/**
+ * @brief Set file the action state machine is persisted to at each transition.
+ *
+ * @param[in] path State file or NULL to disable persisting
+ */
+void state_file_init(const gchar *path);
+
+/**
+ * @brief Load state file written by a previous run.
+ *
+ * @param[out] error Error
+ * @return SavedAction* (free with saved_action_free()), NULL if there is no state file or it is
+ *         invalid (error set, the file is removed)
+ */
+SavedAction* state_file_load(GError **error);
+
+/**
+ * @brief Start persisting a new action, replacing any previous state.
+ *
+ * @param[in] controller_id Target owning the action
+ * @param[in] id            hawkBit action id
+ */
+void state_file_begin(const gchar *controller_id, const gchar *id);
+
+/**
+ * @brief Persist the artifacts of the current action (phase downloading).
+ *
+ * @param[in] firmware  Whether this is a firmware deployment (multiple chunks)
+ * @param[in] artifacts GList of Artifact
+ */
+void state_file_set_artifacts(gboolean firmware, GList *artifacts);
+
+/**
+ * @brief Persist phase of the current action.
+ *
+ * @param[in] phase Phase entered
+ */
+void state_file_set_phase(StatePhase phase);
+
+/**
+ * @brief Persist number of bytes of artifact already on disk.
+ *
+ * @param[in] artifact Artifact of current action
+ * @param[in] bytes    Bytes downloaded
+ */
+void state_file_set_downloaded(const Artifact *artifact, goffset bytes);
+
+/**
+ * @brief Persist devices flashing artifact is retried for (phase retrying).
+ *
+ * @param[in] artifact   Artifact of current action
+ * @param[in] device_ids GArray of gint device ids, empty if there is nothing to retry
+ */
+void state_file_set_flash_retries(const Artifact *artifact, GArray *device_ids);
+
+/**
+ * @brief Persist number of devices flashed and failed to flash for good (phase retrying).
+ *
+ * @param[in] flashed Devices flashed successfully
+ * @param[in] failed  Devices failed to flash
+ */
+void state_file_set_flash_counts(guint flashed, guint failed);
+
+/**
+ * @brief Persist final feedback before sending it, so it can be re-sent after a restart.
+ *        Ignored if id is not the current action.
+ */
+void state_file_feedback_pending(const gchar *url, const gchar *id, const gchar *detail,
+                                 const gchar *finished, const gchar *execution);
+
+/**
+ * @brief Record feedback acknowledged by hawkBit. Final (closed) feedback finishes the action
+ *        and removes the state file. Ignored if id is not the current action.
+ */
+void state_file_feedback_sent(const gchar *id, const gchar *detail, const gchar *execution);
+
+/**
+ * @brief Check if final feedback is pending for the current action.
+ *
+ * @return SavedAction* (free with saved_action_free()) if feedback is pending, NULL otherwise
+ */
+SavedAction* state_file_get_pending_feedback(void);
+
+/**
+ * @brief Forget the current action and remove the state file.
+ */
+void state_file_clear(void);
+
+/**
+ * @brief Frees the memory allocated by a SavedAction
+ *
+ * @param[in] saved SavedAction to free
+ */
+void saved_action_free(SavedAction *saved);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(SavedAction, saved_action_free)
+
+#endif // __STATE_FILE_H__
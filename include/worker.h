@@ -0,0 +1,48 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef __WORKER_H__
+#define __WORKER_H__
+
+#include <glib.h>
+
+/**
+ * @brief Function run by a worker thread.
+ *
+ * @param[in] data Data passed to worker_start()
+ * @return result passed to the WorkerDoneFunc
+ */
+typedef gboolean (*WorkerFunc)(gpointer data);
+
+/**
+ * @brief Completion callback of a worker, dispatched by the main loop the worker reports to.
+ *
+ * @param[in] result    Return value of the WorkerFunc
+ * @param[in] user_data Data passed to worker_start()
+ */
+typedef void (*WorkerDoneFunc)(gboolean result, gpointer user_data);
+
+/**
+ * @brief Run func in a dedicated worker thread, without blocking the caller. The thread gets the
+ *        scheduling set up by scheduling_init(). The worker is tracked until done has been
+ *        dispatched by context, nobody has to join it.
+ *
+ * @param[in] context   GMainContext to dispatch done in, NULL for the default context
+ * @param[in] name      Worker name used in log messages
+ * @param[in] func      Function to run in the worker thread
+ * @param[in] data      Data passed to func
+ * @param[in] done      Completion callback or NULL
+ * @param[in] user_data Data passed to done
+ */
+void worker_start(GMainContext *context, const gchar *name, WorkerFunc func, gpointer data,
+                  WorkerDoneFunc done, gpointer user_data);
+
+/**
+ * @brief Get number of workers whose completion has not been dispatched yet.
+ *
+ * @return number of workers running or about to report completion
+ */
+guint worker_count(void);
+
+#endif // __WORKER_H__
@@ -0,0 +1,245 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Per-deployment memory arena and process memory accounting
+ */
+
+#include <string.h>
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
+#include <glib.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE     (16 * 1024)   /**< default size of arena blocks */
+#define ARENA_ALIGN          16            /**< alignment of arena allocations */
+#define ARENA_TRIM_THRESHOLD (1024 * 1024) /**< memory released before trimming the heap */
+
+/**
+ * @brief Chunk of memory allocations are carved out of.
+ */
+typedef struct ArenaBlock_ {
+        struct ArenaBlock_ *next;
+        gsize size;                   /**< usable bytes in data */
+        gsize used;                   /**< bytes handed out */
+        guint8 data[] __attribute__((aligned(ARENA_ALIGN)));
+} ArenaBlock;
+
+/**
+ * @brief Object allocated elsewhere and owned by the arena.
+ */
+typedef struct ArenaObject_ {
+        gpointer data;
+        GDestroyNotify destroy;
+} ArenaObject;
+
+struct Arena_ {
+        gchar *name;
+        ArenaBlock *blocks;           /**< current block first */
+        GArray *objects;              /**< ArenaObject in order of registration */
+        gsize size;                   /**< bytes handed out */
+        gsize reserved;               /**< bytes allocated for blocks */
+        guint allocations;
+        gsize rss;                    /**< process RSS when arena was created */
+};
+
+// size of the largest arena released so far
+static gsize arena_high_water;
+G_LOCK_DEFINE_STATIC(arena_high_water);
+
+static ArenaBlock* arena_block_new(Arena *arena, gsize size)
+{
+        ArenaBlock *block = g_malloc(sizeof(ArenaBlock) + size);
+
+        block->size = size;
+        block->used = 0;
+        arena->reserved += size;
+
+        return block;
+}
+
+Arena* arena_new(const gchar *name)
+{
+        Arena *arena = g_new0(Arena, 1);
+
+        arena->name = g_strdup(name);
+        arena->objects = g_array_new(FALSE, FALSE, sizeof(ArenaObject));
+        arena_get_rss(&arena->rss, NULL);
+
+        return arena;
+}
+
+gpointer arena_alloc(Arena *arena, gsize size)
+{
+        ArenaBlock *block = NULL;
+        gpointer mem = NULL;
+
+        g_return_val_if_fail(arena, NULL);
+
+        size = (size + ARENA_ALIGN - 1) & ~((gsize) ARENA_ALIGN - 1);
+        if (!size)
+                size = ARENA_ALIGN;
+
+        block = arena->blocks;
+        if (size > ARENA_BLOCK_SIZE / 4) {
+                // large allocations get a block of their own, behind the current block so its
+                // remaining space is still used
+                ArenaBlock *large = arena_block_new(arena, size);
+
+                if (block) {
+                        large->next = block->next;
+                        block->next = large;
+                } else {
+                        large->next = NULL;
+                        arena->blocks = large;
+                }
+                block = large;
+        } else if (!block || block->size - block->used < size) {
+                block = arena_block_new(arena, ARENA_BLOCK_SIZE);
+                block->next = arena->blocks;
+                arena->blocks = block;
+        }
+
+        mem = block->data + block->used;
+        block->used += size;
+        arena->size += size;
+        arena->allocations++;
+
+        return memset(mem, 0, size);
+}
+
+gchar* arena_strdup(Arena *arena, const gchar *str)
+{
+        gsize len;
+
+        if (!str)
+                return NULL;
+
+        len = strlen(str) + 1;
+        return memcpy(arena_alloc(arena, len), str, len);
+}
+
+gchar* arena_strdup_printf(Arena *arena, const gchar *format, ...)
+{
+        va_list args, copy;
+        gchar *str = NULL;
+        int len;
+
+        va_start(args, format);
+        va_copy(copy, args);
+        len = g_vsnprintf(NULL, 0, format, copy);
+        va_end(copy);
+
+        str = arena_alloc(arena, len + 1);
+        g_vsnprintf(str, len + 1, format, args);
+        va_end(args);
+
+        return str;
+}
+
+gpointer arena_take(Arena *arena, gpointer data, GDestroyNotify destroy)
+{
+        ArenaObject object = { data, destroy };
+
+        g_return_val_if_fail(arena, data);
+
+        if (data && destroy)
+                g_array_append_val(arena->objects, object);
+
+        return data;
+}
+
+gsize arena_get_size(const Arena *arena)
+{
+        g_return_val_if_fail(arena, 0);
+
+        return arena->size;
+}
+
+gboolean arena_get_rss(gsize *rss, gsize *peak)
+{
+        g_autofree gchar *status = NULL;
+        gchar *line = NULL;
+        gboolean found = FALSE;
+
+        if (rss)
+                *rss = 0;
+        if (peak)
+                *peak = 0;
+
+        if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL))
+                return FALSE;
+
+        line = strstr(status, "VmRSS:");
+        if (line && rss) {
+                *rss = g_ascii_strtoull(line + strlen("VmRSS:"), NULL, 10) * 1024;
+                found = TRUE;
+        }
+        line = strstr(status, "VmHWM:");
+        if (line && peak) {
+                *peak = g_ascii_strtoull(line + strlen("VmHWM:"), NULL, 10) * 1024;
+                found = TRUE;
+        }
+
+        return found;
+}
+
+void arena_free(Arena *arena)
+{
+        g_autofree gchar *size = NULL, *high_water = NULL;
+        gsize rss = 0, peak = 0, largest;
+        gboolean trim;
+
+        if (!arena)
+                return;
+
+        for (guint i = arena->objects->len; i > 0; i--) {
+                ArenaObject *object = &g_array_index(arena->objects, ArenaObject, i - 1);
+
+                object->destroy(object->data);
+        }
+
+        while (arena->blocks) {
+                ArenaBlock *block = arena->blocks;
+
+                arena->blocks = block->next;
+                g_free(block);
+        }
+
+        G_LOCK(arena_high_water);
+        arena_high_water = MAX(arena_high_water, arena->reserved);
+        largest = arena_high_water;
+        G_UNLOCK(arena_high_water);
+
+        // released objects not allocated by the arena show up as RSS growth
+        arena_get_rss(&rss, NULL);
+        trim = arena->reserved >= ARENA_TRIM_THRESHOLD ||
+               (rss > arena->rss && rss - arena->rss >= ARENA_TRIM_THRESHOLD);
+#ifdef HAVE_MALLOC_TRIM
+        if (trim)
+                malloc_trim(0);
+#else
+        trim = FALSE;
+#endif
+        arena_get_rss(&rss, &peak);
+
+        size = g_format_size(arena->reserved);
+        high_water = g_format_size(largest);
+        if (rss) {
+                g_autofree gchar *rss_str = g_format_size(rss);
+                g_autofree gchar *peak_str = g_format_size(peak);
+
+                g_message("Released %s memory: %s in %u allocations and %u objects (high-water mark %s), RSS %s (peak %s)%s",
+                          arena->name, size, arena->allocations, arena->objects->len,
+                          high_water, rss_str, peak_str, trim ? ", heap trimmed" : "");
+        } else {
+                g_message("Released %s memory: %s in %u allocations and %u objects (high-water mark %s)",
+                          arena->name, size, arena->allocations, arena->objects->len,
+                          high_water);
+        }
+
+        g_array_unref(arena->objects);
+        g_free(arena->name);
+        g_free(arena);
+}
@@ -0,0 +1,416 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Device/firmware compatibility matching
+ *
+ * Devices are kept in one array sorted by name and hardware revision, a hash table maps each name
+ * to its slice of the array. Matching a chunk is a hash lookup plus a walk over the devices of
+ * that name, evaluating the hardware range once per distinct hardware revision.
+ */
+
+#include <string.h>
+#include "compat.h"
+
+typedef struct CompatDevice_ {
+        const gchar *name;
+        SemVer hw;
+        SemVer fw;
+        const RCE_DEVICE *device;
+} CompatDevice;
+
+typedef struct CompatSlice_ {
+        guint start;
+        guint len;
+} CompatSlice;
+
+struct CompatIndex_ {
+        GArray *devices;              /**< CompatDevice sorted by name, hw */
+        GHashTable *names;            /**< device name to CompatSlice of devices */
+};
+
+/**
+ * @brief Parse decimal version component.
+ *
+ * @param[in,out] p     Position in string, advanced behind the number
+ * @param[out]    value Parsed value
+ * @return TRUE on success, FALSE if there is no number or it overflows
+ */
+static gboolean parse_component(const gchar **p, guint32 *value)
+{
+        guint64 v = 0;
+        const gchar *start = *p;
+
+        while (g_ascii_isdigit(**p)) {
+                v = v * 10 + (**p - '0');
+                if (v > G_MAXUINT32)
+                        return FALSE;
+                (*p)++;
+        }
+
+        *value = v;
+        return *p != start;
+}
+
+/**
+ * @brief Check for valid prerelease/build identifier characters ([0-9A-Za-z-.]).
+ */
+static gboolean valid_identifiers(const gchar *start, const gchar *end)
+{
+        if (start == end)
+                return FALSE;
+
+        for (const gchar *p = start; p < end; p++) {
+                if (!g_ascii_isalnum(*p) && *p != '-' && *p != '.')
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+gboolean semver_parse(const gchar *str, SemVer *version)
+{
+        SemVer v = { 0 };
+        const gchar *p = str, *end;
+
+        g_return_val_if_fail(version, FALSE);
+
+        if (!str)
+                return FALSE;
+
+        if (*p == 'v' || *p == 'V')
+                p++;
+
+        if (!parse_component(&p, &v.major))
+                return FALSE;
+        if (*p == '.' && (p++, !parse_component(&p, &v.minor)))
+                return FALSE;
+        if (*p == '.' && (p++, !parse_component(&p, &v.patch)))
+                return FALSE;
+
+        if (*p == '-') {
+                g_autofree gchar *prerelease = NULL;
+
+                end = strchr(++p, '+');
+                if (!end)
+                        end = p + strlen(p);
+                if (!valid_identifiers(p, end))
+                        return FALSE;
+
+                prerelease = g_strndup(p, end - p);
+                v.prerelease = g_intern_string(prerelease);
+                p = end;
+        }
+
+        if (*p == '+') {
+                end = p + strlen(p);
+                if (!valid_identifiers(p + 1, end))
+                        return FALSE;
+                p = end;
+        }
+
+        if (*p)
+                return FALSE;
+
+        *version = v;
+        return TRUE;
+}
+
+/**
+ * @brief Compare dot separated prerelease identifiers according to semver precedence.
+ */
+static gint prerelease_compare(const gchar *a, const gchar *b)
+{
+        while (*a && *b) {
+                gsize len_a = strcspn(a, "."), len_b = strcspn(b, ".");
+                gboolean num_a = strspn(a, "0123456789") == len_a;
+                gboolean num_b = strspn(b, "0123456789") == len_b;
+                gint c;
+
+                if (num_a && num_b) {
+                        // numeric identifiers have no leading zeros, longer is larger
+                        c = (len_a > len_b) - (len_a < len_b);
+                        if (!c)
+                                c = strncmp(a, b, len_a);
+                } else if (num_a != num_b) {
+                        // numeric identifiers have lower precedence
+                        c = num_a ? -1 : 1;
+                } else {
+                        c = strncmp(a, b, MIN(len_a, len_b));
+                        if (!c)
+                                c = (len_a > len_b) - (len_a < len_b);
+                }
+                if (c)
+                        return c;
+
+                a += len_a + (a[len_a] == '.');
+                b += len_b + (b[len_b] == '.');
+        }
+
+        return (*a != '\0') - (*b != '\0');
+}
+
+gint semver_compare(const SemVer *a, const SemVer *b)
+{
+        g_return_val_if_fail(a && b, 0);
+
+        if (a->major != b->major)
+                return a->major < b->major ? -1 : 1;
+        if (a->minor != b->minor)
+                return a->minor < b->minor ? -1 : 1;
+        if (a->patch != b->patch)
+                return a->patch < b->patch ? -1 : 1;
+
+        // interned, so equal strings are identical pointers
+        if (a->prerelease == b->prerelease)
+                return 0;
+        // release has higher precedence than prerelease
+        if (!a->prerelease)
+                return 1;
+        if (!b->prerelease)
+                return -1;
+
+        return prerelease_compare(a->prerelease, b->prerelease);
+}
+
+/**
+ * @brief Narrow range by a single comparator.
+ *
+ * @param[in,out] range   CompatRange to narrow
+ * @param[in]     op      Comparator (">=", ">", "<=", "<", "=")
+ * @param[in]     version Version of comparator
+ */
+static void range_apply(CompatRange *range, const gchar *op, const SemVer *version)
+{
+        gboolean inclusive = op[1] == '=' || op[0] == '=';
+        gint c;
+
+        if (op[0] == '>' || op[0] == '=') {
+                c = range->has_lower ? semver_compare(version, &range->lower) : 1;
+                if (c > 0 || (c == 0 && !inclusive)) {
+                        range->lower = *version;
+                        range->lower_inclusive = inclusive;
+                        range->has_lower = TRUE;
+                }
+        }
+
+        if (op[0] == '<' || op[0] == '=') {
+                c = range->has_upper ? semver_compare(version, &range->upper) : -1;
+                if (c < 0 || (c == 0 && !inclusive)) {
+                        range->upper = *version;
+                        range->upper_inclusive = inclusive;
+                        range->has_upper = TRUE;
+                }
+        }
+}
+
+gboolean compat_range_parse(const gchar *str, CompatRange *range)
+{
+        CompatRange r = { 0 };
+        g_auto(GStrv) tokens = NULL;
+        const gchar *pending_op = NULL;
+
+        g_return_val_if_fail(str, FALSE);
+        g_return_val_if_fail(range, FALSE);
+
+        tokens = g_strsplit_set(str, ", \t", -1);
+        for (gchar **token = tokens; *token; token++) {
+                static const gchar *ops[] = { ">=", "<=", ">", "<", "=", NULL };
+                const gchar *op = pending_op, *p = *token;
+                SemVer version;
+
+                if (!*p || !g_strcmp0(p, "*"))
+                        continue;
+
+                for (const gchar **o = ops; *o && !op; o++) {
+                        if (g_str_has_prefix(p, *o))
+                                op = *o;
+                }
+                if (op && !pending_op)
+                        p += strlen(op);
+                pending_op = NULL;
+
+                // operator separated from its version by whitespace
+                if (!*p) {
+                        pending_op = op;
+                        continue;
+                }
+
+                if (!semver_parse(p, &version))
+                        return FALSE;
+
+                range_apply(&r, op ? op : ">", &version);
+        }
+
+        if (pending_op)
+                return FALSE;
+
+        *range = r;
+        return TRUE;
+}
+
+gboolean compat_range_contains(const CompatRange *range, const SemVer *version)
+{
+        gint c;
+
+        g_return_val_if_fail(range && version, FALSE);
+
+        if (range->has_lower) {
+                c = semver_compare(version, &range->lower);
+                if (c < 0 || (c == 0 && !range->lower_inclusive))
+                        return FALSE;
+        }
+
+        if (range->has_upper) {
+                c = semver_compare(version, &range->upper);
+                if (c > 0 || (c == 0 && !range->upper_inclusive))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Parse version as stored in the device database, falling back to the major.minor version
+ *        parsed by parse_version() for strings that are no semantic versions.
+ *
+ * @param[in]  str      Version string or NULL
+ * @param[in]  fallback Version parsed by parse_version()
+ * @param[out] version  Parsed version
+ */
+static void device_version(const gchar *str, const version_t *fallback, SemVer *version)
+{
+        if (semver_parse(str, version))
+                return;
+
+        version->major = MAX(fallback->major, 0);
+        version->minor = MAX(fallback->minor, 0);
+        version->patch = 0;
+        version->prerelease = NULL;
+}
+
+static gint device_compare(gconstpointer a, gconstpointer b)
+{
+        const CompatDevice *da = a, *db = b;
+        gint c = strcmp(da->name, db->name);
+
+        if (!c)
+                c = semver_compare(&da->hw, &db->hw);
+        if (!c)
+                c = (da->device->id > db->device->id) - (da->device->id < db->device->id);
+
+        return c;
+}
+
+CompatIndex* compat_index_new(GList *devices)
+{
+        CompatIndex *index = g_new0(CompatIndex, 1);
+        CompatSlice *slice = NULL;
+
+        index->devices = g_array_sized_new(FALSE, FALSE, sizeof(CompatDevice),
+                                           g_list_length(devices));
+        index->names = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+        for (GList *l = devices; l; l = l->next) {
+                const RCE_DEVICE *rce_device = l->data;
+                CompatDevice device = {
+                        .name = rce_device->name,
+                        .device = rce_device,
+                };
+                SemVer latest;
+
+                if (!rce_device->name)
+                        continue;
+
+                device_version(rce_device->hw_version, &rce_device->hw, &device.hw);
+                device_version(rce_device->fw_version, &rce_device->fw, &device.fw);
+                // FW may lag behind the firmware flashed last, recorded as FW_LATEST
+                if (semver_parse(rce_device->latest_version, &latest) &&
+                    semver_compare(&latest, &device.fw) > 0)
+                        device.fw = latest;
+
+                g_array_append_val(index->devices, device);
+        }
+
+        g_array_sort(index->devices, device_compare);
+
+        for (guint i = 0; i < index->devices->len; i++) {
+                const CompatDevice *device = &g_array_index(index->devices, CompatDevice, i);
+
+                if (!slice || strcmp(device->name,
+                                     g_array_index(index->devices, CompatDevice, slice->start).name)) {
+                        slice = g_new0(CompatSlice, 1);
+                        slice->start = i;
+                        g_hash_table_insert(index->names, (gpointer) device->name, slice);
+                }
+                slice->len++;
+        }
+
+        return index;
+}
+
+void compat_index_free(CompatIndex *index)
+{
+        if (!index)
+                return;
+
+        g_array_unref(index->devices);
+        g_hash_table_destroy(index->names);
+        g_free(index);
+}
+
+GArray* compat_plan(const CompatIndex *index, const CompatChunk *chunks, guint n_chunks,
+                    gboolean forced)
+{
+        GArray *plan = g_array_new(FALSE, FALSE, sizeof(CompatMatch));
+
+        g_return_val_if_fail(index, plan);
+        g_return_val_if_fail(chunks || !n_chunks, plan);
+
+        for (guint c = 0; c < n_chunks; c++) {
+                const CompatSlice *slice = NULL;
+                const SemVer *last_hw = NULL;
+                gboolean hw_ok = FALSE;
+                CompatRange range = { 0 };
+                SemVer version;
+
+                if (!chunks[c].name)
+                        continue;
+
+                slice = g_hash_table_lookup(index->names, chunks[c].name);
+                if (!slice)
+                        continue;
+
+                if (!semver_parse(chunks[c].version, &version)) {
+                        g_warning("Skipping %s: invalid version '%s'", chunks[c].name,
+                                  chunks[c].version);
+                        continue;
+                }
+                if (chunks[c].hw && !compat_range_parse(chunks[c].hw, &range)) {
+                        g_warning("Skipping %s: invalid hardware range '%s'", chunks[c].name,
+                                  chunks[c].hw);
+                        continue;
+                }
+
+                for (guint d = slice->start; d < slice->start + slice->len; d++) {
+                        const CompatDevice *device = &g_array_index(index->devices,
+                                                                     CompatDevice, d);
+                        CompatMatch match = { c, device->device };
+
+                        // devices are sorted by hardware revision
+                        if (!last_hw || semver_compare(&device->hw, last_hw)) {
+                                hw_ok = compat_range_contains(&range, &device->hw);
+                                last_hw = &device->hw;
+                        }
+                        if (!hw_ok)
+                                continue;
+
+                        if (!forced && semver_compare(&version, &device->fw) <= 0)
+                                continue;
+
+                        g_array_append_val(plan, match);
+                }
+        }
+
+        return plan;
+}
@@ -10,16 +10,31 @@
 #include "config-file.h"
 #include <glib/gtypes.h>
 #include "fw-interface.h"
+#include "ihex.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 static const gint DEFAULT_CONNECTTIMEOUT  = 20;     // 20 sec.
 static const gint DEFAULT_TIMEOUT         = 60;     // 1 min.
 static const gint DEFAULT_RETRY_WAIT      = 5 * 60; // 5 min.
+static const gint DEFAULT_SERVER_PROBE_INTERVAL = 5 * 60; // 5 min.
 static const gboolean DEFAULT_SSL         = TRUE;
 static const gboolean DEFAULT_SSL_VERIFY  = TRUE;
 static const gboolean DEFAULT_REBOOT      = FALSE;
 static const gchar* DEFAULT_LOG_LEVEL     = "message";
+static const gchar* DEFAULT_FLASH_COMMAND = "/app/BootloaderCmd";
+static const gchar* DEFAULT_FIRMWARE_DIR  = "/data/fw";
+static const gint DEFAULT_FLASH_TIMEOUT   = 10 * 60; // 10 min.
+static const gint DEFAULT_FLASH_RETRY_INTERVAL = 60;   // 1 min.
+static const gint DEFAULT_FLASH_RETRY_TIMEOUT = 60 * 60; // 1 h
+static const gint DEFAULT_FALLBACK_IMAGES = 2;       // installed and previous firmware
+static const gint DEFAULT_DOWNLOAD_STALL_RATE = 10 * 1024; // 10 kB/s
+static const gint DEFAULT_DOWNLOAD_STALL_TIME = 15;  // 15 sec.
+static const gint DEFAULT_PROGRESS_INTERVAL = 30;   // 30 sec.
+static const gint DEFAULT_LOOP_STALL_THRESHOLD = 5000; // 5 sec.
+static const gint DEFAULT_WORKER_IO_PRIORITY = 4;     // kernel default within a class
 
 /**
  * @brief Get string value from key_file for key in group, optional default_value can be specified
@@ -200,6 +215,143 @@ static gboolean get_group(GKeyFile *key_file, const gchar *group, GHashTable **h
         return TRUE;
 }
 
+/**
+ * @brief Get list of strings from key_file for key in group. The value is split at commas and
+ * whitespace, empty elements are dropped.
+ *
+ * @param[in]  key_file GKeyFile to look value up
+ * @param[in]  group    A group name
+ * @param[in]  key      A key
+ * @param[out] value    Output NULL-terminated string array, NULL if key not found or empty
+ * @param[out] error    Error
+ * @return TRUE if found or not found, FALSE on other errors (error is set)
+ */
+static gboolean get_key_string_list(GKeyFile *key_file, const gchar *group, const gchar *key,
+                                    gchar ***value, GError **error)
+{
+        g_autofree gchar *val = NULL;
+        g_auto(GStrv) items = NULL;
+        g_autoptr(GPtrArray) list = NULL;
+
+        g_return_val_if_fail(key_file, FALSE);
+        g_return_val_if_fail(group, FALSE);
+        g_return_val_if_fail(key, FALSE);
+        g_return_val_if_fail(value && *value == NULL, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        if (!get_key_string(key_file, group, key, &val, "", error))
+                return FALSE;
+
+        list = g_ptr_array_new_with_free_func(g_free);
+        items = g_strsplit_set(val, ", \t", -1);
+        for (gchar **item = items; *item; item++) {
+                if (**item)
+                        g_ptr_array_add(list, g_strdup(*item));
+        }
+
+        if (list->len) {
+                g_ptr_array_add(list, NULL);
+                *value = (gchar **) g_ptr_array_free(g_steal_pointer(&list), FALSE);
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Get IoClass for I/O scheduling class name.
+ *
+ * @param[in]  name     I/O scheduling class name ("none", "realtime", "best-effort" or "idle")
+ * @param[out] io_class Output IoClass
+ * @param[out] error    Error
+ * @return TRUE if name is valid, FALSE otherwise (error set)
+ */
+static gboolean io_class_from_string(const gchar *name, IoClass *io_class, GError **error)
+{
+        static const gchar *names[] = {
+                [IO_CLASS_NONE] = "none",
+                [IO_CLASS_REALTIME] = "realtime",
+                [IO_CLASS_BEST_EFFORT] = "best-effort",
+                [IO_CLASS_IDLE] = "idle",
+        };
+
+        for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+                if (!g_strcmp0(name, names[i])) {
+                        *io_class = i;
+                        return TRUE;
+                }
+        }
+
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Invalid 'worker_io_class' '%s' (none, realtime, best-effort or idle)", name);
+        return FALSE;
+}
+
+/**
+ * @brief Check that cpus are CPU numbers.
+ *
+ * @param[in]  cpus  NULL-terminated string array of CPU numbers or NULL
+ * @param[out] error Error
+ * @return TRUE if all elements are CPU numbers, FALSE otherwise (error set)
+ */
+static gboolean check_cpus(gchar **cpus, GError **error)
+{
+        for (gchar **cpu = cpus; cpus && *cpu; cpu++) {
+                gchar *end = NULL;
+                guint64 number = g_ascii_strtoull(*cpu, &end, 10);
+
+                // CPU_SETSIZE
+                if (*end || !g_ascii_isdigit(**cpu) || number >= 1024) {
+                        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                                    "Invalid CPU '%s' in 'worker_cpus'", *cpu);
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Get local time of day from key_file for key in group, given as "HH:MM" or "HH:MM:SS".
+ *
+ * @param[in]  key_file GKeyFile to look value up
+ * @param[in]  group    A group name
+ * @param[in]  key      A key
+ * @param[out] value    Output seconds after midnight, -1 if key not found
+ * @param[out] error    Error
+ * @return TRUE if found or not found, FALSE on invalid value or other errors (error is set)
+ */
+static gboolean get_key_time_of_day(GKeyFile *key_file, const gchar *group, const gchar *key,
+                                    gint *value, GError **error)
+{
+        g_autofree gchar *val = NULL;
+        guint hours = 0, minutes = 0, seconds = 0;
+        gint end = 0;
+
+        g_return_val_if_fail(key_file, FALSE);
+        g_return_val_if_fail(group, FALSE);
+        g_return_val_if_fail(key, FALSE);
+        g_return_val_if_fail(value, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        if (!get_key_string(key_file, group, key, &val, "", error))
+                return FALSE;
+
+        if (!*val) {
+                *value = -1;
+                return TRUE;
+        }
+
+        if ((sscanf(val, "%2u:%2u%n:%2u%n", &hours, &minutes, &end, &seconds, &end) < 2) ||
+            val[end] || hours > 23 || minutes > 59 || seconds > 59) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Value '%s' of '%s' is not a time of day (HH:MM[:SS])", val, key);
+                return FALSE;
+        }
+
+        *value = (hours * 60 + minutes) * 60 + seconds;
+        return TRUE;
+}
+
 /**
  * @brief Get GLogLevelFlags for error string.
  *
@@ -235,10 +387,52 @@ static GLogLevelFlags log_level_from_string(const gchar *log_level)
         }
 }
 
+/**
+ * @brief Get optional [memory_map] group, mapping firmware names to memory maps.
+ *
+ * @param[in]  key_file   GKeyFile to look value up
+ * @param[out] memory_map Output GHashTable of firmware name to GArray of IhexRange, NULL if
+ *                        group is not set
+ * @param[out] error      Error
+ * @return TRUE if group is not set or all memory maps are valid, FALSE otherwise (error set)
+ */
+static gboolean get_memory_map(GKeyFile *key_file, GHashTable **memory_map, GError **error)
+{
+        g_autoptr(GHashTable) group = NULL, tmp_hash = NULL;
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_return_val_if_fail(key_file, FALSE);
+        g_return_val_if_fail(memory_map && *memory_map == NULL, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        if (!g_key_file_has_group(key_file, "memory_map"))
+                return TRUE;
+
+        if (!get_group(key_file, "memory_map", &group, error))
+                return FALSE;
+
+        tmp_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) g_array_unref);
+        g_hash_table_iter_init(&iter, group);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+                GArray *ranges = NULL;
+
+                if (!ihex_parse_memory_map(value, &ranges, error)) {
+                        g_prefix_error(error, "Memory map of '%s': ", (const gchar *) key);
+                        return FALSE;
+                }
+                g_hash_table_insert(tmp_hash, g_strdup(key), ranges);
+        }
+
+        *memory_map = g_steal_pointer(&tmp_hash);
+        return TRUE;
+}
+
 Config* load_config_file(const gchar *config_file, GError **error)
 {
         g_autoptr(Config) config = NULL;
-        g_autofree gchar *val = NULL;
+        g_autofree gchar *val = NULL, *io_class = NULL;
         g_autoptr(GKeyFile) ini_file = NULL;
         gboolean key_auth_token_exists = FALSE;
         gboolean key_gateway_token_exists = FALSE;
@@ -253,9 +447,18 @@ Config* load_config_file(const gchar *config_file, GError **error)
         if (!g_key_file_load_from_file(ini_file, config_file, G_KEY_FILE_NONE, error))
                 return NULL;
 
-        if (!get_key_string(ini_file, "client", "hawkbit_server", &config->hawkbit_server, NULL,
-                            error))
+        // list of servers, but required like a single one
+        if (!get_key_string(ini_file, "client", "hawkbit_server", &val, NULL, error))
+                return NULL;
+        g_clear_pointer(&val, g_free);
+        if (!get_key_string_list(ini_file, "client", "hawkbit_server", &config->hawkbit_servers,
+                                 error))
+                return NULL;
+        if (!config->hawkbit_servers) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'hawkbit_server' must name at least one server");
                 return NULL;
+        }
 
         key_auth_token_exists = get_key_string(ini_file, "client", "auth_token",
                                                &config->auth_token, NULL, NULL);
@@ -288,6 +491,8 @@ Config* load_config_file(const gchar *config_file, GError **error)
                 return NULL;
         if (!get_group(ini_file, "device", &config->device, error))
                 return NULL;
+        if (!get_memory_map(ini_file, &config->memory_map, error))
+                return NULL;
         if (!get_key_int(ini_file, "client", "connect_timeout", &config->connect_timeout,
                          DEFAULT_CONNECTTIMEOUT, error))
                 return NULL;
@@ -296,11 +501,32 @@ Config* load_config_file(const gchar *config_file, GError **error)
         if (!get_key_int(ini_file, "client", "retry_wait", &config->retry_wait, DEFAULT_RETRY_WAIT,
                          error))
                 return NULL;
+        if (!get_key_int(ini_file, "client", "server_probe_interval",
+                         &config->server_probe_interval, DEFAULT_SERVER_PROBE_INTERVAL, error))
+                return NULL;
         if (!get_key_int(ini_file, "client", "low_speed_rate", &config->low_speed_rate, 100,
                          error))
                 return NULL;
         if (!get_key_int(ini_file, "client", "low_speed_time", &config->low_speed_time, 60, error))
                 return NULL;
+        if (!get_key_string_list(ini_file, "client", "download_mirrors", &config->download_mirrors,
+                                 error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "download_stall_rate", &config->download_stall_rate,
+                         DEFAULT_DOWNLOAD_STALL_RATE, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "download_stall_time", &config->download_stall_time,
+                         DEFAULT_DOWNLOAD_STALL_TIME, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "progress_interval", &config->progress_interval,
+                         DEFAULT_PROGRESS_INTERVAL, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "loop_stall_threshold",
+                         &config->loop_stall_threshold, DEFAULT_LOOP_STALL_THRESHOLD, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "watchdog_stall_limit",
+                         &config->watchdog_stall_limit, 0, error))
+                return NULL;
         if (!get_key_bool(ini_file, "client", "resume_downloads", &config->resume_downloads, FALSE,
                           error))
                 return NULL;
@@ -313,6 +539,119 @@ Config* load_config_file(const gchar *config_file, GError **error)
 
         if (!get_key_bool(ini_file, "client", "post_update_reboot", &config->post_update_reboot, DEFAULT_REBOOT, error))
                 return NULL;
+        if (!get_key_string_list(ini_file, "client", "gateway_targets", &config->gateway_targets,
+                                 error))
+                return NULL;
+        if (!get_key_bool(ini_file, "client", "gateway_targets_from_database",
+                          &config->gateway_targets_from_database, FALSE, error))
+                return NULL;
+
+        if (!get_key_string(ini_file, "client", "flash_command", &config->flash_command,
+                            DEFAULT_FLASH_COMMAND, error))
+                return NULL;
+        get_key_string(ini_file, "client", "flash_backend", &config->flash_backend, NULL, NULL);
+        if (!get_key_string(ini_file, "client", "firmware_dir", &config->firmware_dir,
+                            DEFAULT_FIRMWARE_DIR, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "flash_timeout", &config->flash_timeout,
+                         DEFAULT_FLASH_TIMEOUT, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "flash_retry_interval",
+                         &config->flash_retry_interval, DEFAULT_FLASH_RETRY_INTERVAL, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "flash_retry_timeout", &config->flash_retry_timeout,
+                         DEFAULT_FLASH_RETRY_TIMEOUT, error))
+                return NULL;
+
+        if (!get_key_string_list(ini_file, "client", "staging_dirs", &config->staging_dirs,
+                                 error))
+                return NULL;
+        if (!config->staging_dirs) {
+                config->staging_dirs = g_new0(gchar*, 2);
+                config->staging_dirs[0] = config->bundle_download_location
+                                          ? g_path_get_dirname(config->bundle_download_location)
+                                          : g_strdup(g_get_tmp_dir());
+        }
+        get_key_string(ini_file, "client", "fallback_dir", &config->fallback_dir, NULL, NULL);
+        if (!get_key_int(ini_file, "client", "fallback_images", &config->fallback_images,
+                         DEFAULT_FALLBACK_IMAGES, error))
+                return NULL;
+        get_key_string(ini_file, "client", "post_flash_check", &config->post_flash_check, NULL,
+                       NULL);
+        get_key_string(ini_file, "client", "state_file", &config->state_file, NULL, NULL);
+
+        if (!get_key_time_of_day(ini_file, "client", "maintenance_window_start",
+                                 &config->maintenance_window_start, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "peer_port", &config->peer_port, 0, error))
+                return NULL;
+        get_key_string(ini_file, "client", "peer_cache_dir", &config->peer_cache_dir, NULL, NULL);
+        if (!get_key_string_list(ini_file, "client", "peers", &config->peers, error))
+                return NULL;
+
+        if (!get_key_int(ini_file, "client", "worker_nice", &config->worker_nice, 0, error))
+                return NULL;
+        if (!get_key_bool(ini_file, "client", "worker_sched_idle", &config->worker_sched_idle,
+                          FALSE, error))
+                return NULL;
+        if (!get_key_string(ini_file, "client", "worker_io_class", &io_class, "none", error))
+                return NULL;
+        if (!io_class_from_string(io_class, &config->worker_io_class, error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "worker_io_priority", &config->worker_io_priority,
+                         DEFAULT_WORKER_IO_PRIORITY, error))
+                return NULL;
+        if (!get_key_string_list(ini_file, "client", "worker_cpus", &config->worker_cpus, error))
+                return NULL;
+        if (!check_cpus(config->worker_cpus, error))
+                return NULL;
+        get_key_string(ini_file, "client", "cgroup", &config->cgroup, NULL, NULL);
+        if (!get_key_int(ini_file, "client", "cgroup_cpu_weight", &config->cgroup_cpu_weight, 0,
+                         error))
+                return NULL;
+        if (!get_key_int(ini_file, "client", "cgroup_io_weight", &config->cgroup_io_weight, 0,
+                         error))
+                return NULL;
+
+        if (config->flash_retry_interval < 1 || config->flash_retry_timeout < 0) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'flash_retry_interval' (%d) must be positive and 'flash_retry_timeout' (%d) must not be negative",
+                            config->flash_retry_interval, config->flash_retry_timeout);
+                return NULL;
+        }
+
+        if (config->fallback_images < 1) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'fallback_images' (%d) must be at least 1", config->fallback_images);
+                return NULL;
+        }
+
+        if (config->worker_nice < -20 || config->worker_nice > 19) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'worker_nice' (%d) must be between -20 and 19", config->worker_nice);
+                return NULL;
+        }
+
+        if (config->worker_io_priority < 0 || config->worker_io_priority > 7) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'worker_io_priority' (%d) must be between 0 and 7",
+                            config->worker_io_priority);
+                return NULL;
+        }
+
+        if (config->cgroup_cpu_weight < 0 || config->cgroup_cpu_weight > 10000 ||
+            config->cgroup_io_weight < 0 || config->cgroup_io_weight > 10000) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'cgroup_cpu_weight' and 'cgroup_io_weight' must be between 1 and 10000");
+                return NULL;
+        }
+
+        if ((config->gateway_targets || config->gateway_targets_from_database) &&
+            !key_gateway_token_exists) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Gateway mode ('gateway_targets', 'gateway_targets_from_database') requires 'gateway_token'");
+                return NULL;
+        }
 
         if (config->timeout > 0 && config->connect_timeout > 0 &&
             config->timeout < config->connect_timeout) {
@@ -323,6 +662,38 @@ Config* load_config_file(const gchar *config_file, GError **error)
                 return NULL;
         }
 
+        for (gchar **rule = config->download_mirrors; rule && *rule; rule++) {
+                const gchar *mirror = strchr(*rule, '=');
+
+                if (!mirror || mirror == *rule || !mirror[1]) {
+                        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                                    "'download_mirrors' rule '%s' must be <URL prefix>=<mirror URL prefix>",
+                                    *rule);
+                        return NULL;
+                }
+        }
+
+        if (config->download_stall_rate < 0 || config->download_stall_time < 0) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'download_stall_rate' (%d) and 'download_stall_time' (%d) must not be negative",
+                            config->download_stall_rate, config->download_stall_time);
+                return NULL;
+        }
+
+        if (config->server_probe_interval < 0) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'server_probe_interval' (%d) must not be negative",
+                            config->server_probe_interval);
+                return NULL;
+        }
+
+        if (config->peer_port < 0 || config->peer_port > G_MAXUINT16) {
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "'peer_port' (%d) must be between 0 and %d", config->peer_port,
+                            G_MAXUINT16);
+                return NULL;
+        }
+
         if (!bundle_location_given && !config->stream_bundle) {
                 g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
                             "'bundle_download_location' is required if 'stream_bundle' is disabled");
@@ -332,21 +703,133 @@ Config* load_config_file(const gchar *config_file, GError **error)
         return g_steal_pointer(&config);
 }
 
+/**
+ * @brief Compare string vectors, NULL only equals NULL.
+ */
+static gboolean strv_equal(gchar **a, gchar **b)
+{
+        if (!a || !b)
+                return a == b;
+
+        for (; *a && *b; a++, b++) {
+                if (g_strcmp0(*a, *b))
+                        return FALSE;
+        }
+
+        return !*a && !*b;
+}
+
+// keep value of current config in config, recording the key of the setting if it changed
+#define KEEP_STRING(name, key) \
+        if (g_strcmp0(config->name, current->name)) { \
+                g_ptr_array_add(changed, key); \
+                g_free(config->name); \
+                config->name = g_strdup(current->name); \
+        }
+#define KEEP_VALUE(name, key) \
+        if (config->name != current->name) { \
+                g_ptr_array_add(changed, key); \
+                config->name = current->name; \
+        }
+
+GPtrArray* config_file_keep_restart_settings(Config *config, const Config *current)
+{
+        GPtrArray *changed = g_ptr_array_new();
+
+        g_return_val_if_fail(config, changed);
+        g_return_val_if_fail(current, changed);
+
+        KEEP_STRING(tenant_id, "tenant_id");
+        KEEP_STRING(controller_id, "target_name");
+        KEEP_STRING(state_file, "state_file");
+        KEEP_STRING(peer_cache_dir, "peer_cache_dir");
+        KEEP_STRING(cgroup, "cgroup");
+        KEEP_VALUE(ssl, "ssl");
+        KEEP_VALUE(gateway_targets_from_database, "gateway_targets_from_database");
+        KEEP_VALUE(log_level, "log_level");
+        KEEP_VALUE(watchdog_stall_limit, "watchdog_stall_limit");
+        KEEP_VALUE(peer_port, "peer_port");
+        KEEP_VALUE(worker_nice, "worker_nice");
+        KEEP_VALUE(worker_sched_idle, "worker_sched_idle");
+        KEEP_VALUE(worker_io_class, "worker_io_class");
+        KEEP_VALUE(worker_io_priority, "worker_io_priority");
+        KEEP_VALUE(cgroup_cpu_weight, "cgroup_cpu_weight");
+        KEEP_VALUE(cgroup_io_weight, "cgroup_io_weight");
+        if (!strv_equal(config->hawkbit_servers, current->hawkbit_servers)) {
+                g_ptr_array_add(changed, "hawkbit_server");
+                g_strfreev(config->hawkbit_servers);
+                config->hawkbit_servers = g_strdupv(current->hawkbit_servers);
+        }
+        if (!strv_equal(config->gateway_targets, current->gateway_targets)) {
+                g_ptr_array_add(changed, "gateway_targets");
+                g_strfreev(config->gateway_targets);
+                config->gateway_targets = g_strdupv(current->gateway_targets);
+        }
+        if (!strv_equal(config->worker_cpus, current->worker_cpus)) {
+                g_ptr_array_add(changed, "worker_cpus");
+                g_strfreev(config->worker_cpus);
+                config->worker_cpus = g_strdupv(current->worker_cpus);
+        }
+
+        return changed;
+}
 
+#undef KEEP_STRING
+#undef KEEP_VALUE
+
+GPtrArray* config_file_changed_action_settings(const Config *config, const Config *current)
+{
+        GPtrArray *changed = g_ptr_array_new();
+
+        g_return_val_if_fail(config, changed);
+        g_return_val_if_fail(current, changed);
+
+        if (g_strcmp0(config->bundle_download_location, current->bundle_download_location))
+                g_ptr_array_add(changed, "bundle_download_location");
+        if (g_strcmp0(config->database_location, current->database_location))
+                g_ptr_array_add(changed, "database_location");
+        if (!strv_equal(config->staging_dirs, current->staging_dirs))
+                g_ptr_array_add(changed, "staging_dirs");
+        if (config->stream_bundle != current->stream_bundle)
+                g_ptr_array_add(changed, "stream_bundle");
+        if (g_strcmp0(config->flash_command, current->flash_command))
+                g_ptr_array_add(changed, "flash_command");
+        if (g_strcmp0(config->flash_backend, current->flash_backend))
+                g_ptr_array_add(changed, "flash_backend");
+        if (g_strcmp0(config->firmware_dir, current->firmware_dir))
+                g_ptr_array_add(changed, "firmware_dir");
+
+        return changed;
+}
 
 void config_file_free(Config *config)
 {
         if (!config)
                 return;
 
-        g_free(config->hawkbit_server);
+        g_strfreev(config->hawkbit_servers);
         g_free(config->controller_id);
         g_free(config->tenant_id);
         g_free(config->auth_token);
         g_free(config->gateway_token);
         g_free(config->bundle_download_location);
         g_free(config->database_location);
+        g_strfreev(config->gateway_targets);
+        g_strfreev(config->download_mirrors);
+        g_free(config->flash_command);
+        g_free(config->flash_backend);
+        g_free(config->firmware_dir);
+        g_strfreev(config->staging_dirs);
+        g_free(config->fallback_dir);
+        g_free(config->post_flash_check);
+        g_free(config->state_file);
+        g_free(config->peer_cache_dir);
+        g_strfreev(config->peers);
+        g_strfreev(config->worker_cpus);
+        g_free(config->cgroup);
         if (config->device)
                 g_hash_table_destroy(config->device);
+        if (config->memory_map)
+                g_hash_table_destroy(config->memory_map);
         g_free(config);
 }
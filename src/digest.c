@@ -0,0 +1,335 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Multi-digest engine calculating several checksums in one pass
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+#ifdef WITH_OPENSSL
+#include <openssl/evp.h>
+#endif
+#include "digest.h"
+
+// block size fed to all digests in turn, small enough to stay in L2 cache
+#define DIGEST_BLOCK_SIZE (1024 * 1024)
+#define DIGEST_TYPES 3
+
+static const DigestType digest_types[DIGEST_TYPES] = { DIGEST_MD5, DIGEST_SHA1, DIGEST_SHA256 };
+
+struct Digest_ {
+        DigestBackend backend;
+        guint types;
+        GChecksum *checksum[DIGEST_TYPES];
+#ifdef WITH_OPENSSL
+        EVP_MD_CTX *evp[DIGEST_TYPES];
+#endif
+        gchar *hex[DIGEST_TYPES];
+        gboolean finalized;
+};
+
+static gint digest_index(DigestType type)
+{
+        for (gint i = 0; i < DIGEST_TYPES; i++) {
+                if (digest_types[i] == type)
+                        return i;
+        }
+
+        return -1;
+}
+
+static GChecksumType digest_glib_type(DigestType type)
+{
+        switch (type) {
+        case DIGEST_MD5:
+                return G_CHECKSUM_MD5;
+        case DIGEST_SHA1:
+                return G_CHECKSUM_SHA1;
+        default:
+                return G_CHECKSUM_SHA256;
+        }
+}
+
+#ifdef WITH_OPENSSL
+static const EVP_MD* digest_evp_type(DigestType type)
+{
+        switch (type) {
+        case DIGEST_MD5:
+                return EVP_md5();
+        case DIGEST_SHA1:
+                return EVP_sha1();
+        default:
+                return EVP_sha256();
+        }
+}
+#endif
+
+gboolean digest_backend_available(DigestBackend backend)
+{
+        switch (backend) {
+        case DIGEST_BACKEND_GLIB:
+                return TRUE;
+        case DIGEST_BACKEND_OPENSSL:
+#ifdef WITH_OPENSSL
+                return TRUE;
+#else
+                return FALSE;
+#endif
+        default:
+                return FALSE;
+        }
+}
+
+DigestBackend digest_default_backend(void)
+{
+#ifdef WITH_OPENSSL
+        return DIGEST_BACKEND_OPENSSL;
+#else
+        return DIGEST_BACKEND_GLIB;
+#endif
+}
+
+const gchar* digest_backend_to_string(DigestBackend backend)
+{
+        switch (backend) {
+        case DIGEST_BACKEND_GLIB:
+                return "glib";
+        case DIGEST_BACKEND_OPENSSL:
+                return "openssl";
+        default:
+                return "unknown";
+        }
+}
+
+const gchar* digest_type_to_string(DigestType type)
+{
+        switch (type) {
+        case DIGEST_MD5:
+                return "md5";
+        case DIGEST_SHA1:
+                return "sha1";
+        case DIGEST_SHA256:
+                return "sha256";
+        default:
+                return "unknown";
+        }
+}
+
+DigestType digest_type_from_checksum_type(GChecksumType type)
+{
+        switch (type) {
+        case G_CHECKSUM_MD5:
+                return DIGEST_MD5;
+        case G_CHECKSUM_SHA1:
+                return DIGEST_SHA1;
+        case G_CHECKSUM_SHA256:
+                return DIGEST_SHA256;
+        default:
+                return 0;
+        }
+}
+
+Digest* digest_new(guint types, DigestBackend backend)
+{
+        g_autoptr(Digest) digest = NULL;
+
+        g_return_val_if_fail(types && !(types & ~DIGEST_ALL), NULL);
+
+        if (!digest_backend_available(backend))
+                return NULL;
+
+        digest = g_new0(Digest, 1);
+        digest->backend = backend;
+        digest->types = types;
+
+        for (gint i = 0; i < DIGEST_TYPES; i++) {
+                if (!(types & digest_types[i]))
+                        continue;
+
+                if (backend == DIGEST_BACKEND_GLIB) {
+                        digest->checksum[i] = g_checksum_new(digest_glib_type(digest_types[i]));
+                        continue;
+                }
+#ifdef WITH_OPENSSL
+                digest->evp[i] = EVP_MD_CTX_new();
+                if (!digest->evp[i] ||
+                    !EVP_DigestInit_ex(digest->evp[i], digest_evp_type(digest_types[i]), NULL))
+                        return NULL;
+#endif
+        }
+
+        return g_steal_pointer(&digest);
+}
+
+void digest_update(Digest *digest, const guchar *data, gsize len)
+{
+        g_return_if_fail(digest);
+        g_return_if_fail(!digest->finalized);
+
+        for (gint i = 0; i < DIGEST_TYPES; i++) {
+                if (digest->checksum[i])
+                        g_checksum_update(digest->checksum[i], data, len);
+#ifdef WITH_OPENSSL
+                if (digest->evp[i])
+                        EVP_DigestUpdate(digest->evp[i], data, len);
+#endif
+        }
+}
+
+/**
+ * @brief Finalize all digests of context and store their hex strings.
+ *
+ * @param[in] digest Digest context
+ */
+static void digest_finalize(Digest *digest)
+{
+        if (digest->finalized)
+                return;
+
+        for (gint i = 0; i < DIGEST_TYPES; i++) {
+                if (digest->checksum[i])
+                        digest->hex[i] = g_strdup(g_checksum_get_string(digest->checksum[i]));
+#ifdef WITH_OPENSSL
+                if (digest->evp[i]) {
+                        guchar md[EVP_MAX_MD_SIZE];
+                        guint md_len = 0;
+                        static const gchar hex_chars[] = "0123456789abcdef";
+
+                        EVP_DigestFinal_ex(digest->evp[i], md, &md_len);
+                        digest->hex[i] = g_malloc(md_len * 2 + 1);
+                        for (guint b = 0; b < md_len; b++) {
+                                digest->hex[i][b * 2] = hex_chars[md[b] >> 4];
+                                digest->hex[i][b * 2 + 1] = hex_chars[md[b] & 0xf];
+                        }
+                        digest->hex[i][md_len * 2] = '\0';
+                }
+#endif
+        }
+
+        digest->finalized = TRUE;
+}
+
+const gchar* digest_get_string(Digest *digest, DigestType type)
+{
+        gint i = digest_index(type);
+
+        g_return_val_if_fail(digest, NULL);
+        g_return_val_if_fail(i >= 0, NULL);
+
+        digest_finalize(digest);
+
+        return digest->hex[i];
+}
+
+void digest_free(Digest *digest)
+{
+        if (!digest)
+                return;
+
+        for (gint i = 0; i < DIGEST_TYPES; i++) {
+                if (digest->checksum[i])
+                        g_checksum_free(digest->checksum[i]);
+#ifdef WITH_OPENSSL
+                if (digest->evp[i])
+                        EVP_MD_CTX_free(digest->evp[i]);
+#endif
+                g_free(digest->hex[i]);
+        }
+        g_free(digest);
+}
+
+/**
+ * @brief Feed file content into digest using read() with large blocks.
+ *
+ * @param[in]  fd     File descriptor, read from current offset
+ * @param[in]  digest Digest context
+ * @param[out] error  Error
+ * @return TRUE on success, FALSE otherwise (error set)
+ */
+static gboolean digest_update_read(int fd, Digest *digest, GError **error)
+{
+        g_autofree guchar *buf = g_malloc(DIGEST_BLOCK_SIZE);
+
+        while (1) {
+                ssize_t r = read(fd, buf, DIGEST_BLOCK_SIZE);
+
+                if (r < 0) {
+                        int err = errno;
+
+                        if (err == EINTR)
+                                continue;
+
+                        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                                    "Read failed: %s", g_strerror(err));
+                        return FALSE;
+                }
+                if (r == 0)
+                        break;
+
+                digest_update(digest, buf, r);
+        }
+
+        return TRUE;
+}
+
+gboolean digest_file(FILE *fp, guint types, DigestBackend backend, Digest **digest,
+                     GError **error)
+{
+        g_autoptr(Digest) ctx = NULL;
+        struct stat st;
+        int fd;
+
+        g_return_val_if_fail(fp, FALSE);
+        g_return_val_if_fail(digest && *digest == NULL, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        ctx = digest_new(types, backend);
+        if (!ctx) {
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+                            "Digest backend %s not available", digest_backend_to_string(backend));
+                return FALSE;
+        }
+
+        // make data written via stdio visible to mmap()/read()
+        if (fflush(fp) != 0 || fseek(fp, 0, SEEK_SET) != 0) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Read failed: %s", g_strerror(err));
+                return FALSE;
+        }
+
+        fd = fileno(fp);
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                guchar *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (map != MAP_FAILED) {
+                        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+                        for (off_t offset = 0; offset < st.st_size; offset += DIGEST_BLOCK_SIZE)
+                                digest_update(ctx, map + offset,
+                                              MIN(DIGEST_BLOCK_SIZE, st.st_size - offset));
+
+                        munmap(map, st.st_size);
+                        digest_finalize(ctx);
+                        *digest = g_steal_pointer(&ctx);
+                        return TRUE;
+                }
+                g_debug("mmap() failed, falling back to read(): %s", g_strerror(errno));
+        }
+
+        if (lseek(fd, 0, SEEK_SET) < 0 || !digest_update_read(fd, ctx, error)) {
+                if (error && !*error)
+                        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                                    "Read failed: %s", g_strerror(errno));
+                return FALSE;
+        }
+
+        digest_finalize(ctx);
+        *digest = g_steal_pointer(&ctx);
+        return TRUE;
+}
@@ -0,0 +1,353 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Placement, space reservation and ordering of deployment downloads
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/falloc.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/vfs.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "download-planner.h"
+
+/**
+ * @brief Staging file with space reserved beyond its current size.
+ */
+typedef struct Reservation_ {
+        gchar *path;
+        goffset offset;               /**< size of file when reserved */
+        goffset length;               /**< bytes reserved after offset */
+        gboolean created;             /**< file did not exist before */
+} Reservation;
+
+GQuark download_plan_error_quark(void)
+{
+        return g_quark_from_static_string("download_plan_error_quark");
+}
+
+static void staging_dir_free(StagingDir *dir)
+{
+        g_free(dir->path);
+        g_free(dir);
+}
+
+static void reservation_free(Reservation *reservation)
+{
+        g_free(reservation->path);
+        g_free(reservation);
+}
+
+/**
+ * @brief Release space reserved for a staging file that was not filled by a download.
+ *        Files created for the reservation are removed if nothing was downloaded to them.
+ */
+static void reservation_release(const Reservation *reservation)
+{
+        goffset end = reservation->offset + reservation->length;
+        GStatBuf st;
+        int fd;
+
+        if (g_stat(reservation->path, &st))
+                return;
+
+        if (reservation->created && !st.st_size) {
+                g_unlink(reservation->path);
+                return;
+        }
+
+        if (end <= st.st_size)
+                return;
+
+        fd = g_open(reservation->path, O_WRONLY, 0);
+        if (fd < 0)
+                return;
+
+        // deallocate blocks past EOF, truncating to the same size does not on all file systems
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, st.st_size,
+                      end - st.st_size))
+                (void) !ftruncate(fd, st.st_size);
+        close(fd);
+}
+
+/**
+ * @brief Determine free space and medium type of a staging directory.
+ *
+ * @param[in]  path  Directory
+ * @param[out] error Error
+ * @return StagingDir*, NULL if the directory is not usable (error set)
+ */
+static StagingDir* staging_dir_new(const gchar *path, GError **error)
+{
+        struct statvfs vfs;
+        struct statfs fs;
+        StagingDir *dir = NULL;
+
+        if (g_mkdir_with_parents(path, 0755) || access(path, W_OK) || statvfs(path, &vfs) ||
+            statfs(path, &fs)) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Staging directory %s not usable: %s", path, g_strerror(err));
+                return NULL;
+        }
+
+        dir = g_new0(StagingDir, 1);
+        dir->path = g_strdup(path);
+        dir->available = (goffset) vfs.f_bsize * (goffset) vfs.f_bavail;
+        dir->tmpfs = fs.f_type == TMPFS_MAGIC || fs.f_type == RAMFS_MAGIC;
+        dir->fsid = vfs.f_fsid;
+
+        return dir;
+}
+
+/**
+ * @brief Staging file name of an artifact in dir.
+ */
+static gchar* staging_file(const StagingDir *dir, const Artifact *artifact)
+{
+        g_autofree gchar *name = g_strdelimit(g_strdup(artifact->name), G_DIR_SEPARATOR_S, '_');
+        g_autofree gchar *file = g_strconcat(name, ".raucb", NULL);
+
+        return g_build_filename(dir->path, file, NULL);
+}
+
+/**
+ * @brief Reserve length bytes after the current end of file.
+ *
+ * @param[in]  plan     DownloadPlan to record the reservation in
+ * @param[in]  path     Staging file (transfer full)
+ * @param[in]  length   Bytes to reserve
+ * @param[out] error    Error
+ * @return path owned by plan if reserved (or the file system cannot preallocate), NULL otherwise
+ *         (error set)
+ */
+static const gchar* reserve(DownloadPlan *plan, gchar *path, goffset length, GError **error)
+{
+        Reservation *reservation = NULL;
+        gboolean created = !g_file_test(path, G_FILE_TEST_EXISTS);
+        GStatBuf st;
+        int fd, err;
+
+        fd = g_open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0 || fstat(fd, &st)) {
+                err = errno;
+                if (fd >= 0)
+                        close(fd);
+                g_set_error(error, DOWNLOAD_PLAN_ERROR, DOWNLOAD_PLAN_ERROR_RESERVE,
+                            "Failed to reserve space for %s: %s", path, g_strerror(err));
+                g_free(path);
+                return NULL;
+        }
+
+        reservation = g_new0(Reservation, 1);
+        reservation->path = path;
+        reservation->offset = st.st_size;
+        reservation->created = created;
+
+        if (length && fallocate(fd, FALLOC_FL_KEEP_SIZE, st.st_size, length)) {
+                err = errno;
+                close(fd);
+                if (err != EOPNOTSUPP && err != ENOSYS) {
+                        g_autofree gchar *size = g_format_size(length);
+
+                        g_set_error(error, DOWNLOAD_PLAN_ERROR,
+                                    err == ENOSPC ? DOWNLOAD_PLAN_ERROR_NOSPC
+                                                  : DOWNLOAD_PLAN_ERROR_RESERVE,
+                                    "Failed to reserve %s for %s: %s", size, path,
+                                    g_strerror(err));
+                        reservation_release(reservation);
+                        reservation_free(reservation);
+                        return NULL;
+                }
+                // space was checked, file system just cannot preallocate
+                g_debug("Cannot preallocate %s: %s", path, g_strerror(err));
+        } else {
+                reservation->length = length;
+                close(fd);
+        }
+
+        g_ptr_array_add(plan->reservations, reservation);
+        return reservation->path;
+}
+
+/**
+ * @brief Artifact to place with the number of bytes still to download.
+ */
+typedef struct PlanItem_ {
+        Artifact *artifact;
+        goffset remaining;
+        StagingDir *dir;              /**< directory of partial download or NULL */
+} PlanItem;
+
+static gint artifact_size_compare(gconstpointer a, gconstpointer b)
+{
+        const Artifact *artifact_a = a, *artifact_b = b;
+
+        return (artifact_a->size > artifact_b->size) - (artifact_a->size < artifact_b->size);
+}
+
+static gint plan_item_compare_desc(gconstpointer a, gconstpointer b)
+{
+        const PlanItem *item_a = a, *item_b = b;
+
+        return (item_a->remaining < item_b->remaining) - (item_a->remaining > item_b->remaining);
+}
+
+/**
+ * @brief Persistent directories first, configured order otherwise (g_ptr_array_sort is not
+ *        stable, so the configured position is kept in planned until placement starts).
+ */
+static gint staging_dir_compare(gconstpointer a, gconstpointer b)
+{
+        const StagingDir *dir_a = *(StagingDir **) a, *dir_b = *(StagingDir **) b;
+
+        if (dir_a->tmpfs != dir_b->tmpfs)
+                return dir_a->tmpfs ? 1 : -1;
+
+        return (dir_a->planned > dir_b->planned) - (dir_a->planned < dir_b->planned);
+}
+
+DownloadPlan* download_plan_new(GList *artifacts, gchar **staging_dirs, GError **error)
+{
+        g_autoptr(DownloadPlan) plan = NULL;
+        g_autoptr(GArray) items = g_array_new(FALSE, TRUE, sizeof(PlanItem));
+        goffset available = 0;
+
+        g_return_val_if_fail(staging_dirs && *staging_dirs, NULL);
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+        plan = g_new0(DownloadPlan, 1);
+        plan->dirs = g_ptr_array_new_with_free_func((GDestroyNotify) staging_dir_free);
+        plan->reservations = g_ptr_array_new_with_free_func((GDestroyNotify) reservation_free);
+
+        for (gchar **path = staging_dirs; *path; path++) {
+                g_autoptr(GError) ierror = NULL;
+                StagingDir *dir = staging_dir_new(*path, &ierror);
+
+                if (!dir) {
+                        g_warning("%s", ierror->message);
+                        continue;
+                }
+                for (guint d = 0; d < plan->dirs->len; d++) {
+                        StagingDir *other = g_ptr_array_index(plan->dirs, d);
+
+                        if (other->fsid == dir->fsid) {
+                                g_debug("Skipping staging directory %s, same file system as %s",
+                                        dir->path, other->path);
+                                g_clear_pointer(&dir, staging_dir_free);
+                                break;
+                        }
+                }
+                if (!dir)
+                        continue;
+                dir->planned = plan->dirs->len;
+                g_ptr_array_add(plan->dirs, dir);
+        }
+        if (!plan->dirs->len) {
+                g_set_error(error, DOWNLOAD_PLAN_ERROR, DOWNLOAD_PLAN_ERROR_STAGING,
+                            "No usable staging directory");
+                return NULL;
+        }
+        g_ptr_array_sort(plan->dirs, staging_dir_compare);
+        for (guint d = 0; d < plan->dirs->len; d++) {
+                StagingDir *dir = g_ptr_array_index(plan->dirs, d);
+
+                dir->planned = 0;
+                available += dir->available;
+        }
+
+        // partial downloads are resumed where they are, only the remainder is needed
+        for (GList *l = artifacts; l; l = l->next) {
+                PlanItem item = { l->data, MAX(((Artifact *) l->data)->size, 0), NULL };
+
+                for (guint d = 0; !item.dir && d < plan->dirs->len; d++) {
+                        StagingDir *dir = g_ptr_array_index(plan->dirs, d);
+                        g_autofree gchar *file = staging_file(dir, item.artifact);
+                        GStatBuf st;
+
+                        if (g_stat(file, &st) || st.st_size > item.remaining)
+                                continue;
+
+                        item.remaining -= st.st_size;
+                        item.dir = dir;
+                }
+
+                plan->total += item.remaining;
+                g_array_append_val(items, item);
+        }
+
+        if (plan->total > available) {
+                g_autofree gchar *dirs = g_strjoinv(", ", staging_dirs);
+                g_autofree gchar *total = g_format_size(plan->total);
+                g_autofree gchar *free_space = g_format_size(available);
+
+                g_set_error(error, DOWNLOAD_PLAN_ERROR, DOWNLOAD_PLAN_ERROR_NOSPC,
+                            "Deployment needs %s, but only %s are available in staging directories %s",
+                            total, free_space, dirs);
+                return NULL;
+        }
+
+        // first fit decreasing, so large artifacts are placed while there is most room left
+        g_array_sort(items, plan_item_compare_desc);
+        for (guint i = 0; i < items->len; i++) {
+                PlanItem *item = &g_array_index(items, PlanItem, i);
+                StagingDir *dir = item->dir;
+                g_autofree gchar *size = g_format_size(item->remaining);
+
+                for (guint d = 0; !dir && d < plan->dirs->len; d++) {
+                        StagingDir *candidate = g_ptr_array_index(plan->dirs, d);
+
+                        if (candidate->available - candidate->planned >= item->remaining)
+                                dir = candidate;
+                }
+                if (!dir || dir->available - dir->planned < item->remaining) {
+                        g_autofree gchar *total = g_format_size(plan->total);
+
+                        g_set_error(error, DOWNLOAD_PLAN_ERROR, DOWNLOAD_PLAN_ERROR_NOSPC,
+                                    "Deployment needs %s, but %s (%s) does not fit into any staging directory",
+                                    total, item->artifact->name, size);
+                        return NULL;
+                }
+
+                dir->planned += item->remaining;
+                item->artifact->file = reserve(plan, staging_file(dir, item->artifact),
+                                               item->remaining, error);
+                if (!item->artifact->file)
+                        return NULL;
+
+                g_debug("Staging %s (%s) in %s%s", item->artifact->name, size, dir->path,
+                        dir->tmpfs ? " (RAM)" : "");
+        }
+
+        // smallest first: the first artifact is ready to install as early as possible
+        plan->order = g_list_sort(g_list_copy(artifacts), artifact_size_compare);
+
+        return g_steal_pointer(&plan);
+}
+
+void download_plan_free(DownloadPlan *plan)
+{
+        if (!plan)
+                return;
+
+        if (plan->reservations) {
+                for (guint r = 0; r < plan->reservations->len; r++)
+                        reservation_release(g_ptr_array_index(plan->reservations, r));
+                g_ptr_array_unref(plan->reservations);
+        }
+        if (plan->dirs)
+                g_ptr_array_unref(plan->dirs);
+        g_list_free(plan->order);
+        g_free(plan);
+}
@@ -0,0 +1,149 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Sources of an artifact download
+ *
+ * Mirror rules rewrite URL prefixes of the download URL supplied by hawkBit, so artifacts can also
+ * be fetched from mirrors or a CDN. Throughput is measured per source while
+ * downloading. Transfers failing or stalling on one source are resumed from another one with a
+ * range request, instead of waiting for the slow source.
+ */
+
+#include <string.h>
+#include "download-sources.h"
+
+static void download_source_free(DownloadSource *source)
+{
+        g_free(source->url);
+        g_free(source);
+}
+
+/**
+ * @brief Add source for url, unless present already.
+ *
+ * @param[in,out] sources      DownloadSources
+ * @param[in]     url          URL to download from (transfer full)
+ * @param[in]     authenticate Whether to send hawkBit credentials
+ */
+static void download_sources_add(DownloadSources *sources, gchar *url, gboolean authenticate)
+{
+        DownloadSource *source;
+
+        for (guint i = 0; i < sources->list->len; i++) {
+                source = g_ptr_array_index(sources->list, i);
+                if (!g_strcmp0(source->url, url)) {
+                        g_free(url);
+                        return;
+                }
+        }
+
+        source = g_new0(DownloadSource, 1);
+        source->url = url;
+        source->authenticate = authenticate;
+        g_ptr_array_add(sources->list, source);
+}
+
+DownloadSources* download_sources_new(const gchar *url, gchar **mirrors, gboolean plain_http_auth)
+{
+        DownloadSources *sources = NULL;
+
+        g_return_val_if_fail(url, NULL);
+
+        sources = g_new0(DownloadSources, 1);
+        sources->list = g_ptr_array_new_with_free_func((GDestroyNotify) download_source_free);
+
+        // mirrors take load off hawkBit, so they are tried first
+        for (gchar **rule = mirrors; rule && *rule; rule++) {
+                // validated by load_config_file()
+                const gchar *mirror = strchr(*rule, '=') + 1;
+                gsize prefix_len = mirror - *rule - 1;
+
+                // mirrors are not trusted with the hawkBit credentials
+                if (!strncmp(url, *rule, prefix_len))
+                        download_sources_add(sources, g_strconcat(mirror, url + prefix_len, NULL),
+                                             FALSE);
+        }
+
+        // never send credentials protected by TLS towards hawkBit in cleartext
+        download_sources_add(sources, g_strdup(url),
+                             plain_http_auth || !g_str_has_prefix(url, "http://"));
+        sources->current = g_ptr_array_index(sources->list, 0);
+
+        return sources;
+}
+
+guint download_sources_count(const DownloadSources *sources)
+{
+        g_return_val_if_fail(sources, 0);
+
+        return sources->list->len;
+}
+
+void download_sources_record(DownloadSources *sources, gint64 transferred, gint64 elapsed,
+                             gboolean success)
+{
+        DownloadSource *source;
+
+        g_return_if_fail(sources);
+
+        source = sources->current;
+        source->transferred += transferred;
+        source->elapsed += elapsed;
+        source->failures = success ? 0 : source->failures + 1;
+}
+
+gint64 download_source_get_speed(const DownloadSource *source)
+{
+        g_return_val_if_fail(source, -1);
+
+        if (source->elapsed <= 0)
+                return -1;
+
+        return source->transferred * G_USEC_PER_SEC / source->elapsed;
+}
+
+/**
+ * @brief Check whether source a should be tried before source b: fewer consecutive failures
+ *        first, then sources not tried yet, then higher throughput.
+ */
+static gboolean download_source_better(const DownloadSource *a, const DownloadSource *b)
+{
+        if (a->failures != b->failures)
+                return a->failures < b->failures;
+        if (!a->elapsed != !b->elapsed)
+                return !a->elapsed;
+
+        return download_source_get_speed(a) > download_source_get_speed(b);
+}
+
+const DownloadSource* download_sources_switch(DownloadSources *sources)
+{
+        DownloadSource *best = NULL;
+
+        g_return_val_if_fail(sources, NULL);
+
+        for (guint i = 0; i < sources->list->len; i++) {
+                DownloadSource *source = g_ptr_array_index(sources->list, i);
+
+                if (source == sources->current)
+                        continue;
+
+                if (!best || download_source_better(source, best))
+                        best = source;
+        }
+
+        if (best)
+                sources->current = best;
+
+        return sources->current;
+}
+
+void download_sources_free(DownloadSources *sources)
+{
+        if (!sources)
+                return;
+
+        g_clear_pointer(&sources->list, g_ptr_array_unref);
+        g_free(sources);
+}
@@ -0,0 +1,284 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Selection of the hawkBit server among configured endpoints
+ *
+ * Several hawkBit servers can be configured, e.g. regional replicas behind different DNS names.
+ * Requests go to the selected one. Servers are ranked by their smoothed round trip time measured
+ * by probes, penalized by their recent error rate. A failing server is replaced by the best ranked
+ * one right away (failover) and selected again once probes show it is healthy and considerably
+ * faster than the current one (fail-back).
+ */
+
+#include <string.h>
+#include "endpoints.h"
+
+#define RTT_WEIGHT 0.25               /**< weight of a new sample in the smoothed RTT */
+#define ERROR_WEIGHT 0.2              /**< weight of a new result in the error rate */
+#define ERROR_PENALTY 4.0             /**< score is RTT * (1 + ERROR_PENALTY * error rate) */
+#define SWITCH_MARGIN 0.7             /**< leave a healthy server only for a score below this
+                                           fraction of its score */
+
+typedef struct {
+        gchar *server;                /**< host or IP and port */
+        gdouble srtt;                 /**< smoothed round trip time in microseconds, 0 if not
+                                           measured yet */
+        gdouble error_rate;           /**< moving average of failed requests and probes (0..1) */
+        guint failures;               /**< consecutive failures, 0 if healthy */
+} Endpoint;
+
+static struct {
+        GMutex mutex;                 /**< protects all members below */
+        GPtrArray *list;              /**< Endpoint* in configured order */
+        Endpoint *current;            /**< selected endpoint */
+} endpoints;
+
+static void endpoint_free(Endpoint *endpoint)
+{
+        g_free(endpoint->server);
+        g_free(endpoint);
+}
+
+/**
+ * @brief Look up endpoint of server. Must be called under locked endpoints.mutex.
+ *
+ * @param[in] server Host or IP and port
+ * @return Endpoint* or NULL if server is not configured
+ */
+static Endpoint* endpoint_find(const gchar *server)
+{
+        for (guint i = 0; endpoints.list && i < endpoints.list->len; i++) {
+                Endpoint *endpoint = g_ptr_array_index(endpoints.list, i);
+
+                if (!g_strcmp0(endpoint->server, server))
+                        return endpoint;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Record result of a request or probe of endpoint.
+ */
+static void endpoint_record(Endpoint *endpoint, gboolean success)
+{
+        endpoint->error_rate += ERROR_WEIGHT * ((success ? 0.0 : 1.0) - endpoint->error_rate);
+        endpoint->failures = success ? 0 : endpoint->failures + 1;
+}
+
+/**
+ * @brief Get score of endpoint, lower is better. Endpoints not measured yet rank last.
+ */
+static gdouble endpoint_score(const Endpoint *endpoint)
+{
+        if (!endpoint->srtt)
+                return G_MAXDOUBLE;
+
+        return endpoint->srtt * (1.0 + ERROR_PENALTY * endpoint->error_rate);
+}
+
+/**
+ * @brief Find the best ranked endpoint not known to fail, the configured order breaks ties. Must
+ *        be called under locked endpoints.mutex.
+ *
+ * @return Endpoint* or NULL if all endpoints fail
+ */
+static Endpoint* endpoint_best(void)
+{
+        Endpoint *best = NULL;
+
+        for (guint i = 0; i < endpoints.list->len; i++) {
+                Endpoint *endpoint = g_ptr_array_index(endpoints.list, i);
+
+                if (endpoint->failures)
+                        continue;
+                if (!best || endpoint_score(endpoint) < endpoint_score(best))
+                        best = endpoint;
+        }
+
+        return best;
+}
+
+/**
+ * @brief Select endpoint. Must be called under locked endpoints.mutex.
+ *
+ * @param[in] endpoint Endpoint to select
+ * @param[in] reason   Reason logged
+ */
+static void endpoint_switch(Endpoint *endpoint, const gchar *reason)
+{
+        g_message("Switching hawkBit server from %s to %s (%s)", endpoints.current->server,
+                  endpoint->server, reason);
+        endpoints.current = endpoint;
+}
+
+void endpoints_init(gchar **servers)
+{
+        g_return_if_fail(servers && *servers);
+
+        endpoints_clear();
+
+        g_mutex_lock(&endpoints.mutex);
+        endpoints.list = g_ptr_array_new_with_free_func((GDestroyNotify) endpoint_free);
+        for (gchar **server = servers; *server; server++) {
+                Endpoint *endpoint = g_new0(Endpoint, 1);
+
+                endpoint->server = g_strdup(*server);
+                g_ptr_array_add(endpoints.list, endpoint);
+        }
+        endpoints.current = g_ptr_array_index(endpoints.list, 0);
+        g_mutex_unlock(&endpoints.mutex);
+}
+
+void endpoints_clear(void)
+{
+        g_mutex_lock(&endpoints.mutex);
+        g_clear_pointer(&endpoints.list, g_ptr_array_unref);
+        endpoints.current = NULL;
+        g_mutex_unlock(&endpoints.mutex);
+}
+
+guint endpoints_count(void)
+{
+        guint count;
+
+        g_mutex_lock(&endpoints.mutex);
+        count = endpoints.list ? endpoints.list->len : 0;
+        g_mutex_unlock(&endpoints.mutex);
+
+        return count;
+}
+
+gchar* endpoints_get_current(void)
+{
+        gchar *server;
+
+        g_mutex_lock(&endpoints.mutex);
+        server = endpoints.current ? g_strdup(endpoints.current->server) : NULL;
+        g_mutex_unlock(&endpoints.mutex);
+
+        return server;
+}
+
+gchar** endpoints_get_all(void)
+{
+        GPtrArray *servers = g_ptr_array_new();
+
+        g_mutex_lock(&endpoints.mutex);
+        for (guint i = 0; endpoints.list && i < endpoints.list->len; i++) {
+                Endpoint *endpoint = g_ptr_array_index(endpoints.list, i);
+
+                g_ptr_array_add(servers, g_strdup(endpoint->server));
+        }
+        g_mutex_unlock(&endpoints.mutex);
+
+        g_ptr_array_add(servers, NULL);
+        return (gchar **) g_ptr_array_free(servers, FALSE);
+}
+
+void endpoints_probed(const gchar *server, gboolean success, gint64 rtt)
+{
+        Endpoint *endpoint;
+
+        g_return_if_fail(server);
+
+        g_mutex_lock(&endpoints.mutex);
+        endpoint = endpoint_find(server);
+        if (endpoint) {
+                endpoint_record(endpoint, success);
+                // a zero sample would mark the endpoint as not measured
+                if (success)
+                        endpoint->srtt = endpoint->srtt
+                                         ? endpoint->srtt + RTT_WEIGHT * (rtt - endpoint->srtt)
+                                         : MAX(rtt, 1);
+                g_debug("Probed hawkBit server %s: %s, RTT %.1f ms, error rate %.2f", server,
+                        success ? "ok" : "failed", endpoint->srtt / 1000, endpoint->error_rate);
+        }
+        g_mutex_unlock(&endpoints.mutex);
+}
+
+void endpoints_select(void)
+{
+        Endpoint *best;
+
+        g_mutex_lock(&endpoints.mutex);
+        if (!endpoints.current)
+                goto out;
+
+        best = endpoint_best();
+        if (!best || best == endpoints.current)
+                goto out;
+
+        // stick to a healthy endpoint unless best is considerably faster
+        if (!endpoints.current->failures &&
+            endpoint_score(best) >= endpoint_score(endpoints.current) * SWITCH_MARGIN)
+                goto out;
+
+        endpoint_switch(best, endpoints.current->failures ? "unavailable" : "lower latency");
+
+out:
+        g_mutex_unlock(&endpoints.mutex);
+}
+
+gboolean endpoints_request_done(const gchar *server, gboolean success)
+{
+        Endpoint *endpoint, *best;
+        gboolean res = FALSE;
+        guint i;
+
+        g_return_val_if_fail(server, FALSE);
+
+        g_mutex_lock(&endpoints.mutex);
+        endpoint = endpoint_find(server);
+        if (!endpoint)
+                goto out;
+
+        endpoint_record(endpoint, success);
+        if (success || endpoint != endpoints.current || endpoints.list->len < 2)
+                goto out;
+
+        best = endpoint_best();
+        if (best) {
+                endpoint_switch(best, "unavailable");
+                res = TRUE;
+                goto out;
+        }
+
+        // all endpoints fail, try the next one with the next request
+        for (i = 0; i < endpoints.list->len; i++) {
+                if (g_ptr_array_index(endpoints.list, i) == endpoint)
+                        break;
+        }
+        endpoint_switch(g_ptr_array_index(endpoints.list, (i + 1) % endpoints.list->len),
+                        "all servers unavailable");
+
+out:
+        g_mutex_unlock(&endpoints.mutex);
+        return res;
+}
+
+gchar* endpoints_rewrite_url(const gchar *url)
+{
+        g_autofree gchar *server = NULL;
+        const gchar *start, *end;
+        gchar *res = NULL;
+
+        g_return_val_if_fail(url, NULL);
+
+        start = strstr(url, "://");
+        if (!start)
+                return g_strdup(url);
+        start += strlen("://");
+        end = start + strcspn(start, "/");
+        server = g_strndup(start, end - start);
+
+        g_mutex_lock(&endpoints.mutex);
+        if (endpoints.current && g_strcmp0(server, endpoints.current->server) &&
+            endpoint_find(server))
+                res = g_strdup_printf("%.*s%s%s", (int) (start - url), url,
+                                      endpoints.current->server, end);
+        g_mutex_unlock(&endpoints.mutex);
+
+        return res ? res : g_strdup(url);
+}
@@ -0,0 +1,175 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Bounded local store of fallback firmware images
+ *
+ * Verified firmware images are kept per firmware name as "<dir>/<name>/<version>.hex" before
+ * they are replaced by an update, so a device can be re-flashed with its fallback firmware right
+ * away instead of downloading it again. The modification time of an image records when it was
+ * last retained and decides which images are removed first.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "fallback-store.h"
+
+#define FALLBACK_SUFFIX ".hex"
+
+/**
+ * @brief Image found in a firmware name's store directory.
+ */
+typedef struct {
+        gchar *path;
+        gint64 mtime;
+} StoredImage;
+
+static void stored_image_free(StoredImage *image)
+{
+        g_free(image->path);
+        g_free(image);
+}
+
+static gint stored_image_compare_desc(gconstpointer a, gconstpointer b)
+{
+        const StoredImage *image_a = *(StoredImage **) a;
+        const StoredImage *image_b = *(StoredImage **) b;
+
+        return (image_a->mtime < image_b->mtime) - (image_a->mtime > image_b->mtime);
+}
+
+/**
+ * @brief Check name/version is usable as a single path component.
+ */
+static gboolean valid_component(const gchar *component)
+{
+        return component && *component && !strchr(component, G_DIR_SEPARATOR) &&
+               g_strcmp0(component, ".") && g_strcmp0(component, "..");
+}
+
+/**
+ * @brief Get path image of name/version is stored at.
+ *
+ * @return newly allocated path, NULL if name or version is not a valid file name
+ */
+static gchar* image_path(const gchar *dir, const gchar *name, const gchar *version)
+{
+        g_autofree gchar *file = NULL;
+
+        if (!valid_component(name) || !valid_component(version))
+                return NULL;
+
+        file = g_strconcat(version, FALLBACK_SUFFIX, NULL);
+        return g_build_filename(dir, name, file, NULL);
+}
+
+/**
+ * @brief Remove least recently retained images of directory beyond keep.
+ *
+ * @param[in] name_dir Store directory of a firmware name
+ * @param[in] keep     Number of images to keep
+ * @param[in] retained Path of image just retained, always kept
+ */
+static void evict(const gchar *name_dir, guint keep, const gchar *retained)
+{
+        g_autoptr(GPtrArray) images = NULL;
+        g_autoptr(GDir) dir = NULL;
+        const gchar *entry;
+
+        dir = g_dir_open(name_dir, 0, NULL);
+        if (!dir)
+                return;
+
+        images = g_ptr_array_new_with_free_func((GDestroyNotify) stored_image_free);
+        while ((entry = g_dir_read_name(dir))) {
+                StoredImage *image = NULL;
+                GStatBuf st;
+
+                if (!g_str_has_suffix(entry, FALLBACK_SUFFIX))
+                        continue;
+
+                image = g_new0(StoredImage, 1);
+                image->path = g_build_filename(name_dir, entry, NULL);
+                // mtime has a granularity of seconds, do not rely on it for the newest image
+                if (!g_strcmp0(image->path, retained) || g_stat(image->path, &st) != 0) {
+                        stored_image_free(image);
+                        continue;
+                }
+                image->mtime = st.st_mtime;
+                g_ptr_array_add(images, image);
+        }
+
+        g_ptr_array_sort(images, stored_image_compare_desc);
+        for (guint i = keep - 1; i < images->len; i++) {
+                StoredImage *image = g_ptr_array_index(images, i);
+
+                if (g_unlink(image->path) == 0)
+                        g_debug("Removed fallback firmware %s", image->path);
+                else
+                        g_warning("Failed to remove fallback firmware %s: %s", image->path,
+                                  g_strerror(errno));
+        }
+}
+
+gboolean fallback_store_retain(const gchar *dir, guint keep, const gchar *name,
+                               const gchar *version, const gchar *firmware, GError **error)
+{
+        g_autofree gchar *path = NULL, *name_dir = NULL, *contents = NULL;
+        gsize length;
+
+        g_return_val_if_fail(dir, FALSE);
+        g_return_val_if_fail(keep > 0, FALSE);
+        g_return_val_if_fail(firmware, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        path = image_path(dir, name, version);
+        if (!path) {
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                            "Invalid firmware name '%s' or version '%s'", name, version);
+                return FALSE;
+        }
+
+        name_dir = g_path_get_dirname(path);
+        if (g_mkdir_with_parents(name_dir, 0755) != 0) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Failed to create %s: %s", name_dir, g_strerror(err));
+                return FALSE;
+        }
+
+        // versions are immutable, only mark an already retained image as most recent
+        if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+                if (g_utime(path, NULL) != 0) {
+                        int err = errno;
+                        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                                    "Failed to touch %s: %s", path, g_strerror(err));
+                        return FALSE;
+                }
+        } else {
+                // copy, firmware is overwritten in place by the next installation
+                if (!g_file_get_contents(firmware, &contents, &length, error))
+                        return FALSE;
+                if (!g_file_set_contents(path, contents, length, error))
+                        return FALSE;
+        }
+        g_debug("Retained %s as fallback firmware %s", firmware, path);
+
+        evict(name_dir, keep, path);
+
+        return TRUE;
+}
+
+gchar* fallback_store_lookup(const gchar *dir, const gchar *name, const gchar *version)
+{
+        g_autofree gchar *path = NULL;
+
+        g_return_val_if_fail(dir, NULL);
+
+        path = image_path(dir, name, version);
+        if (!path || !g_file_test(path, G_FILE_TEST_IS_REGULAR))
+                return NULL;
+
+        return g_steal_pointer(&path);
+}
@@ -0,0 +1,324 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Firmware flashing backends
+ *
+ * The default backend spawns the bootloader command directly (no shell), streams its progress
+ * output and enforces a per-device timeout. Alternatively, a shared library exporting
+ * FLASH_BACKEND_SYMBOL can be loaded to flash in-process.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <gio/gio.h>
+#include <gmodule.h>
+#include "flash-backend.h"
+
+// grace period between SIGTERM and SIGKILL on timeout
+#define FLASH_KILL_GRACE_SEC 5
+
+struct FlashBackend_ {
+        gchar **command;              /**< bootloader command argv (spawn backend) */
+        GModule *module;              /**< shared library backend or NULL */
+        FlashFunc flash;              /**< entry point of shared library backend */
+};
+
+/**
+ * @brief State of a spawned bootloader command, only accessed from the flashing thread.
+ */
+typedef struct SpawnState_ {
+        const FlashRequest *request;
+        GSubprocess *subprocess;
+        GDataInputStream *output;
+        GCancellable *cancellable;
+        GMainContext *context;
+        GSource *kill_source;
+        gboolean output_done;
+        gboolean exited;
+        gboolean timed_out;
+} SpawnState;
+
+GQuark flash_error_quark(void)
+{
+        return g_quark_from_static_string("flash_error_quark");
+}
+
+/**
+ * @brief Find progress in line of bootloader output, i.e. the last number followed by '%'.
+ *
+ * @param[in] line Output line
+ * @return percentage (0-100), -1 if line contains no progress
+ */
+static gint parse_progress(const gchar *line)
+{
+        const gchar *percent = strrchr(line, '%');
+
+        while (percent) {
+                const gchar *digits = percent;
+
+                while (digits > line && g_ascii_isdigit(digits[-1]))
+                        digits--;
+
+                if (digits != percent)
+                        return MIN(g_ascii_strtoll(digits, NULL, 10), 100);
+
+                // '%' without number, look further left
+                percent = g_strrstr_len(line, percent - line, "%");
+        }
+
+        return -1;
+}
+
+static void spawn_read_line(SpawnState *state);
+
+static void on_spawn_output(GObject *source, GAsyncResult *res, gpointer data)
+{
+        SpawnState *state = data;
+        g_autofree gchar *line = NULL;
+        gint percentage;
+
+        line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), res, NULL,
+                                                     NULL);
+        if (!line) {
+                state->output_done = TRUE;
+                return;
+        }
+
+        g_strstrip(line);
+        if (!*line) {
+                spawn_read_line(state);
+                return;
+        }
+
+        g_debug("%s[%d]: %s", state->request->device_name, state->request->device_id, line);
+
+        percentage = parse_progress(line);
+        if (percentage >= 0 && state->request->progress)
+                state->request->progress(percentage, line, state->request->progress_data);
+
+        spawn_read_line(state);
+}
+
+/**
+ * @brief Read next line of bootloader output asynchronously. Progress bars updated with '\r'
+ *        are split into lines as well.
+ */
+static void spawn_read_line(SpawnState *state)
+{
+        g_data_input_stream_read_line_async(state->output, G_PRIORITY_DEFAULT,
+                                            state->cancellable, on_spawn_output, state);
+}
+
+static void on_spawn_exited(GObject *source, GAsyncResult *res, gpointer data)
+{
+        SpawnState *state = data;
+
+        g_subprocess_wait_finish(G_SUBPROCESS(source), res, NULL);
+        state->exited = TRUE;
+}
+
+static gboolean on_spawn_kill(gpointer data)
+{
+        SpawnState *state = data;
+
+        g_warning("Bootloader for %s[%d] did not terminate, killing it",
+                  state->request->device_name, state->request->device_id);
+        g_subprocess_force_exit(state->subprocess);
+
+        state->kill_source = NULL;
+        return G_SOURCE_REMOVE;
+}
+
+static gboolean on_spawn_timeout(gpointer data)
+{
+        SpawnState *state = data;
+
+        g_warning("Flashing %s[%d] timed out after %u s, terminating bootloader",
+                  state->request->device_name, state->request->device_id,
+                  state->request->timeout);
+        state->timed_out = TRUE;
+        g_subprocess_send_signal(state->subprocess, SIGTERM);
+
+        state->kill_source = g_timeout_source_new_seconds(FLASH_KILL_GRACE_SEC);
+        g_source_set_callback(state->kill_source, on_spawn_kill, state, NULL);
+        g_source_attach(state->kill_source, state->context);
+        g_source_unref(state->kill_source);
+
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Spawn bootloader command for request and wait for it, using a private GMainContext.
+ *
+ * @param[in]  backend FlashBackend with command set
+ * @param[in]  request FlashRequest
+ * @param[out] error   Error
+ * @return TRUE if the command exited with 0, FALSE otherwise (error set)
+ */
+static gboolean flash_spawn(FlashBackend *backend, const FlashRequest *request, GError **error)
+{
+        g_autoptr(GMainContext) context = g_main_context_new();
+        g_autoptr(GPtrArray) argv = g_ptr_array_new_with_free_func(g_free);
+        g_autoptr(GSubprocess) subprocess = NULL;
+        g_autoptr(GDataInputStream) output = NULL;
+        g_autoptr(GCancellable) cancellable = g_cancellable_new();
+        g_autoptr(GError) ierror = NULL;
+        GSource *timeout_source = NULL;
+        SpawnState state = {
+                .request = request,
+                .cancellable = cancellable,
+                .context = context,
+        };
+        gint status;
+
+        for (gchar **arg = backend->command; *arg; arg++)
+                g_ptr_array_add(argv, g_strdup(*arg));
+        g_ptr_array_add(argv, g_strdup("-start"));
+        g_ptr_array_add(argv, g_strdup_printf("%d", request->device_id));
+        g_ptr_array_add(argv, g_strdup(request->firmware));
+        g_ptr_array_add(argv, NULL);
+
+        g_main_context_push_thread_default(context);
+
+        subprocess = g_subprocess_newv((const gchar * const *) argv->pdata,
+                                       G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                                       G_SUBPROCESS_FLAGS_STDERR_MERGE, &ierror);
+        if (!subprocess) {
+                g_main_context_pop_thread_default(context);
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_BACKEND, "Failed to start %s: %s",
+                            backend->command[0], ierror->message);
+                return FALSE;
+        }
+        state.subprocess = subprocess;
+
+        output = g_data_input_stream_new(g_subprocess_get_stdout_pipe(subprocess));
+        g_data_input_stream_set_newline_type(output, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+        state.output = output;
+
+        spawn_read_line(&state);
+        g_subprocess_wait_async(subprocess, NULL, on_spawn_exited, &state);
+
+        if (request->timeout) {
+                timeout_source = g_timeout_source_new_seconds(request->timeout);
+                g_source_set_callback(timeout_source, on_spawn_timeout, &state, NULL);
+                g_source_attach(timeout_source, context);
+        }
+
+        // output may stay open if the killed command left children behind
+        while (!state.exited || (!state.output_done && !state.timed_out))
+                g_main_context_iteration(context, TRUE);
+
+        g_cancellable_cancel(cancellable);
+        while (!state.output_done)
+                g_main_context_iteration(context, TRUE);
+
+        if (timeout_source) {
+                g_source_destroy(timeout_source);
+                g_source_unref(timeout_source);
+        }
+        if (state.kill_source)
+                g_source_destroy(state.kill_source);
+
+        g_main_context_pop_thread_default(context);
+
+        if (state.timed_out) {
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_TIMEOUT,
+                            "Flashing timed out after %u s", request->timeout);
+                return FALSE;
+        }
+
+        if (!g_subprocess_get_if_exited(subprocess)) {
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_FAILED,
+                            "Bootloader killed by signal %d", g_subprocess_get_term_sig(subprocess));
+                return FALSE;
+        }
+
+        status = g_subprocess_get_exit_status(subprocess);
+        switch (status) {
+        case 0:
+                return TRUE;
+        case 4:
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_COMMUNICATION,
+                            "Error in communication with bootloader");
+                return FALSE;
+        case 5:
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_OFFLINE, "Device is not online");
+                return FALSE;
+        default:
+                g_set_error(error, FLASH_ERROR, FLASH_ERROR_FAILED,
+                            "Bootloader exited with %d", status);
+                return FALSE;
+        }
+}
+
+FlashBackend* flash_backend_new(const gchar *module, const gchar *command, GError **error)
+{
+        g_autoptr(FlashBackend) backend = NULL;
+
+        g_return_val_if_fail(module || command, NULL);
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+        backend = g_new0(FlashBackend, 1);
+
+        if (module) {
+                backend->module = g_module_open(module, G_MODULE_BIND_LOCAL);
+                if (!backend->module) {
+                        g_set_error(error, FLASH_ERROR, FLASH_ERROR_BACKEND,
+                                    "Failed to load flash backend: %s", g_module_error());
+                        return NULL;
+                }
+                if (!g_module_symbol(backend->module, FLASH_BACKEND_SYMBOL,
+                                     (gpointer *) &backend->flash) || !backend->flash) {
+                        g_set_error(error, FLASH_ERROR, FLASH_ERROR_BACKEND,
+                                    "Flash backend %s: %s", module, g_module_error());
+                        return NULL;
+                }
+                g_debug("Using flash backend %s", module);
+                return g_steal_pointer(&backend);
+        }
+
+        if (!g_shell_parse_argv(command, NULL, &backend->command, error)) {
+                g_prefix_error(error, "Invalid bootloader command '%s': ", command);
+                return NULL;
+        }
+
+        return g_steal_pointer(&backend);
+}
+
+gboolean flash_backend_flash(FlashBackend *backend, const FlashRequest *request,
+                             GError **error)
+{
+        g_return_val_if_fail(backend, FALSE);
+        g_return_val_if_fail(request && request->firmware, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        g_debug("Flashing %s to %s[%d]", request->firmware, request->device_name,
+                request->device_id);
+
+        if (backend->flash) {
+                GError *ierror = NULL;
+
+                if (backend->flash(request, &ierror))
+                        return TRUE;
+
+                if (!ierror)
+                        ierror = g_error_new(FLASH_ERROR, FLASH_ERROR_FAILED,
+                                             "Flash backend failed");
+                g_propagate_error(error, ierror);
+                return FALSE;
+        }
+
+        return flash_spawn(backend, request, error);
+}
+
+void flash_backend_free(FlashBackend *backend)
+{
+        if (!backend)
+                return;
+
+        g_strfreev(backend->command);
+        if (backend->module)
+                g_module_close(backend->module);
+        g_free(backend);
+}
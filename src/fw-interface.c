@@ -6,16 +6,67 @@
 #include "json-helper.h"
 #include <stdbool.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 #include<unistd.h>
 #include <glib/gstdio.h>
+#include "ihex.h"
+#include "flash-backend.h"
+#include "compat.h"
+#include "digest.h"
+#include "download-planner.h"
+#include "arena.h"
+#include "state-file.h"
+#include "peer-server.h"
+#include "fallback-store.h"
 
 extern  Config *hawkbit_config;
 extern const char *HTTPMethod_STRING[];
 extern const gint resumable_codes[];
-extern GThread *thread_download;
 extern GSourceFunc software_ready_cb;
 extern struct HawkbitAction *active_action;
 
+// minimum progress between two flashing progress feedback messages [percent]
+#define FLASH_PROGRESS_STEP 10
+// maximum backoff between flashing attempts of an offline device [s]
+#define FLASH_RETRY_MAX_INTERVAL (60 * 60)
+
+static FlashBackend *flash_backend = NULL;
+
+/**
+ * @brief Flashing progress of a single device, reported to hawkBit.
+ */
+typedef struct {
+    Artifact *artifact;
+    gint device_id;
+    gint last_reported;
+} FlashProgress;
+
+/**
+ * @brief Device offline or unreachable when flashing, flashed again with backoff.
+ */
+typedef struct {
+    Artifact *artifact;
+    gint device_id;
+    guint attempts;
+    gint64 next_retry;                /**< monotonic time of next attempt [us] */
+} FlashRetry;
+
+/**
+ * @brief Artifacts of a deployment, owned by the deployment's arena together with all their data.
+ */
+typedef struct {
+    Arena *arena;
+    GList *artifacts;
+    GPtrArray *retries;               /**< FlashRetry of devices to flash again */
+    guint flashed;                    /**< devices flashed successfully */
+    guint failed;                     /**< devices failed to flash for good */
+    struct HawkbitAction *action;     /**< action flashing devices again or prefetched for */
+    DownloadPlan *plan;               /**< placement of downloads, NULL until planned */
+    gboolean prefetched;              /**< all downloads verified while installation was skipped */
+    gint64 retry_deadline;            /**< monotonic time flashing again gives up [us] */
+    gint64 db_mtime;                  /**< device database modification time [us] */
+} FwDeployment;
+
 
 
 /**
@@ -57,33 +108,33 @@ int callback(void *images, int argc, char **argv,
     GList **images_list = (GList **) images;
     gchar *tmp_version =NULL;
 
-    RCE_DEVICE *device =  malloc(sizeof(RCE_DEVICE));
+    RCE_DEVICE *device = g_new0(RCE_DEVICE, 1);
     device-> id  = atoi(argv[0]);
-    device->name = malloc(strlen(argv[1]) + 1);
-    strcpy ( device->name, argv[1]);
-    
+    device->name = g_strdup(argv[1]);
 
-    tmp_version = malloc(strlen(argv[2]) + 1 );
-    strcpy ( tmp_version, argv[2]);
+    // parse_version() modifies its argument
+    device->fw_version = g_strdup(argv[2]);
+    tmp_version = g_strdup(argv[2]);
     device->fw = parse_version(tmp_version);
     g_free(tmp_version);
 
-    tmp_version = malloc(strlen(argv[3]) + 1);
-    strcpy ( tmp_version, argv[3]);
+    device->latest_version = g_strdup(argv[3]);
+    tmp_version = g_strdup(argv[3]);
     device->latest_fw = parse_version(tmp_version);
-    g_free(tmp_version);    
+    g_free(tmp_version);
 
-    tmp_version = malloc(strlen(argv[4]) + 1);
-    strcpy ( tmp_version, argv[3]);
+    device->fallback_version = g_strdup(argv[4]);
+    tmp_version = g_strdup(argv[4]);
     device->fallback_fw = parse_version(tmp_version);
-    g_free(tmp_version);    
+    g_free(tmp_version);
 
-    tmp_version = malloc(strlen(argv[5]) + 1);
-    strcpy ( tmp_version, argv[3]);
+    device->hw_version = g_strdup(argv[5]);
+    tmp_version = g_strdup(argv[5]);
     device->hw = parse_version(tmp_version);
-    g_free(tmp_version);    
+    g_free(tmp_version);
 
-    *images_list = g_list_append(*images_list, device);
+    // prepend for O(1), get_current_devices() restores database order
+    *images_list = g_list_prepend(*images_list, device);
 
     if (images_list == NULL){
         g_debug("No devices found in database");
@@ -107,6 +158,10 @@ void free_image(gpointer data)
 		return;
 
 	g_free(image->name);
+	g_free(image->fw_version);
+	g_free(image->hw_version);
+	g_free(image->latest_version);
+	g_free(image->fallback_version);
 	g_free(image);
 }
 
@@ -174,30 +229,6 @@ void print_image(RCE_DEVICE *data)
 
 
 
-/**
- * @brief construct path to which store the rauc update
- *
- * @param[in] name string representing name of fw
- * @return  new alloaceted pointer
- */
-
-gchar* get_fw_path(gchar *name)
-
-{ 
-    gchar *location_fw = NULL;
-
-    location_fw = malloc(strlen("/tmp/") + strlen(name) + strlen(".raucb") +1);
-    if (location_fw == NULL)
-        g_debug("NULL");
-    strcpy(location_fw,"/tmp/");
-    strcat(location_fw,name);
-    strcat(location_fw,".raucb");
-
-    return location_fw ;
-
-}
-
-
 /**
  * @brief construct path to which store the rauc update
  *
@@ -239,7 +270,7 @@ GList * get_current_devices()
     
     sqlite3_close(db);
 
-    return images;
+    return g_list_reverse(images);
 } 
 
 
@@ -272,6 +303,31 @@ bool update_dabase(gchar *query)
 
 
 
+/**
+ * @brief Send feedback for the active action without holding its mutex, as the main loop waits
+ *        for it and workers may run at idle priority. The action must not change meanwhile, i.e.
+ *        it is busy until the caller updates its state afterwards.
+ *
+ * @param[in] url       feedback URL, NULL for the one of the active action
+ * @param[in] detail    detail message
+ * @param[in] finished  hawkBit status of the result
+ * @param[in] execution hawkBit status of the action execution
+ */
+static void action_feedback(const gchar *url, const gchar *detail, const gchar *finished,
+                            const gchar *execution)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *id = NULL, *action_url = NULL;
+
+        g_mutex_lock(&active_action->mutex);
+        id = g_strdup(active_action->id);
+        action_url = g_strdup(url ? url : active_action->feedback_url);
+        g_mutex_unlock(&active_action->mutex);
+
+        if (!feedback(action_url, id, detail, finished, execution, &error))
+                g_warning("%s", error->message);
+}
+
 /**
  * @brief Callback called when rauc finishes installing bundle
  *
@@ -281,27 +337,17 @@ bool update_dabase(gchar *query)
 
 gboolean rauc_complete_cb(gpointer ptr)
 {
-        gboolean res = FALSE;
-        g_autoptr(GError) error = NULL;
         struct on_install_complete_userdata *result = ptr;
-        g_autofree gchar *feedback_url = NULL;
 
         g_return_val_if_fail(ptr, FALSE);
         g_debug("Installing done");
-        g_mutex_lock(&active_action->mutex);
 
-        active_action->state = result->install_success ? ACTION_STATE_PROCESSING : ACTION_STATE_ERROR;
-        feedback_url = build_api_url("deploymentBase/%s/feedback", active_action->id);
-        res = feedback(
-                feedback_url, active_action->id,
-                result->install_success ? "Software bundle installed successfully."
-                : "Failed to install software bundle.",
-                result->install_success ? "success" : "failure",
-                "proceeding", &error);
-
-        if (!res)
-                g_warning("%s", error->message);
+        action_feedback(NULL, result->install_success ? "Software bundle installed successfully."
+                                                      : "Failed to install software bundle.",
+                        result->install_success ? "success" : "failure", "proceeding");
 
+        g_mutex_lock(&active_action->mutex);
+        active_action->state = result->install_success ? ACTION_STATE_PROCESSING : ACTION_STATE_ERROR;
         g_mutex_unlock(&active_action->mutex);
         g_debug("callback done");
     
@@ -323,15 +369,18 @@ gboolean rauc_complete_cb(gpointer ptr)
 static gpointer download_thread_fw(Artifact *artifact)
 {
 
-        g_autoptr(GError) error = NULL, feedback_error = NULL;
-        g_autofree gchar *msg = NULL, *sha1sum = NULL;
-        gchar *location_fw = NULL;
-        gboolean test;
-        curl_off_t speed;
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *msg = NULL, *checksum = NULL;
+        g_autoptr(DownloadSources) sources = NULL;
+        GChecksumType checksum_type;
+        const gchar *expected_checksum = NULL;
+        gboolean test, peer_hit;
+        DownloadProgress progress;
         
         g_debug("DOWNLOAD_THREAD_STARTED");
         g_return_val_if_fail(artifact, NULL);
-        g_assert_nonnull(hawkbit_config->bundle_download_location);
+        g_return_val_if_fail(artifact->file, NULL);
+        expected_checksum = artifact_get_checksum(artifact, &checksum_type);
 
         g_mutex_lock(&active_action->mutex);
         if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
@@ -348,23 +397,34 @@ static gpointer download_thread_fw(Artifact *artifact)
 
 
         g_debug("Start downloading: %s", artifact->download_url);
-        while (1) {
+        download_progress_init(&progress, artifact);
+        sources = download_sources_new(artifact->download_url, hawkbit_config->download_mirrors,
+                                       !hawkbit_config->ssl);
+        // prefer peers sharing the artifact, falling back to hawkBit
+        peer_hit = get_binary_from_peers(artifact, artifact->file, &checksum, &progress);
+        while (!peer_hit) {
                 gboolean resumable = FALSE;
                 GStatBuf bundle_stat;
                 curl_off_t resume_from = 0;
 
-                g_clear_pointer(&sha1sum, g_free);                
-                location_fw = get_fw_path(artifact->name);
-                
-                // Download software bundle (artifact)
-                if (g_stat(location_fw, &bundle_stat) == 0)
+                g_clear_pointer(&checksum, g_free);
+
+                // Download software bundle (artifact) to its staging file
+                if (g_stat(artifact->file, &bundle_stat) == 0)
                         resume_from = (curl_off_t) bundle_stat.st_size;
+                state_file_set_downloaded(artifact, resume_from);
 
-                if (get_binary(artifact->download_url,location_fw,
-                               resume_from, &sha1sum, &speed, &error))
+                if (get_binary(sources, artifact->file, resume_from, checksum_type, &checksum,
+                               &progress, &error))
 
                         break;
 
+                if (g_error_matches(error, RHU_HAWKBIT_CLIENT_CURL_ERROR,
+                                    CURLE_ABORTED_BY_CALLBACK)) {
+                        g_mutex_lock(&active_action->mutex);
+                        goto cancel;
+                }
+
                 for (const gint *code = &resumable_codes[0]; *code; code++)
                         resumable |= g_error_matches(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, *code);
 
@@ -384,68 +444,56 @@ static gpointer download_thread_fw(Artifact *artifact)
                 // sleep 0.5 s before attempting to resume download
             g_usleep(500000);
         }
-        g_free(location_fw);
         // notify hawkbit that download is complete
-        g_debug("Download of %s complete. %.2f MB/s", artifact->name, (double)speed/(1024*1024));
         msg = g_strdup_printf("Download of %s complete. %.2f MB/s", artifact->name,
-                              (double)speed/(1024*1024));
-
-        g_mutex_lock(&active_action->mutex);
+                              (double)download_progress_get_speed(&progress)/(1024*1024));
+        g_debug("%s", msg);
 
+        // the action does not change while downloading, the feedback request must not hold the
+        // action mutex the main loop waits for (workers may run at idle priority)
         if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error)) {
                 g_warning("%s", error->message);
                 g_clear_error(&error);
         }
-        
-        g_mutex_unlock(&active_action->mutex);
 
         // validate checksum
-        if (g_strcmp0(artifact->sha1, sha1sum)) {
+        if (g_strcmp0(expected_checksum, checksum)) {
                 g_set_error(&error, RHU_HAWKBIT_CLIENT_ERROR, RHU_HAWKBIT_CLIENT_ERROR_DOWNLOAD,
-                            "Software: %s V%s. Invalid checksum: %s expected %s", artifact->name,
-                            artifact->version, sha1sum, artifact->sha1);
+                            "Software: %s V%s. Invalid %s checksum: %s expected %s",
+                            artifact->name, artifact->version,
+                            digest_type_to_string(digest_type_from_checksum_type(checksum_type)),
+                            checksum, expected_checksum);
                 goto report_err;
         }
     
-        g_mutex_lock(&active_action->mutex);
         msg = g_strdup_printf("File checksum of %s OK", artifact->name);
         if (!feedback_progress(artifact->feedback_url, active_action->id, "File checksum OK.",
                                &error)) {
                 g_warning("%s", error->message);
                 g_clear_error(&error);
         }
-        g_mutex_unlock(&active_action->mutex);
+        peer_server_add(active_action->id, artifact, artifact->file);
     
         // last chance to cancel installation
 
         g_mutex_lock(&active_action->mutex);
         if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
                 goto cancel;
-
-        // skip installation if hawkBit asked us to do so
-        if (!artifact->do_install) {
-                active_action->state = ACTION_STATE_NONE;
-                g_mutex_unlock(&active_action->mutex);
-
-                return GINT_TO_POINTER(true);
-        }
-    
         g_mutex_unlock(&active_action->mutex);
 
         return true;
 
 report_err:
-    
+        action_feedback(artifact->feedback_url, error->message, "failure", "closed");
+
         g_mutex_lock(&active_action->mutex);
-        if (!feedback(artifact->feedback_url, active_action->id, error->message, "failure",
-                      "closed", &feedback_error))
-                g_warning("%s", feedback_error->message);
-        
         active_action->state = ACTION_STATE_ERROR;
 
 cancel:
-        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
+        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
                 active_action->state = ACTION_STATE_CANCELED;
+                process_cancel_complete();
+        }
 
         g_cond_signal(&active_action->cond);
         g_mutex_unlock(&active_action->mutex);
@@ -462,7 +510,7 @@ gboolean install(Artifact *artifact)
     struct on_new_software_userdata userdata = {
         .install_progress_callback = (GSourceFunc) hawkbit_progress,
         .install_complete_callback = rauc_complete_cb,
-        .file = get_fw_path(artifact->name),
+        .file = artifact->file,
         .auth_header = NULL,
         .ssl_verify = hawkbit_config->ssl_verify,
         .install_success = FALSE,
@@ -473,107 +521,455 @@ gboolean install(Artifact *artifact)
     
     software_ready_cb(&userdata);
 
-    g_free(userdata.file);
-
     return userdata.install_success;
 }
 
 /**
- * @brief Install succesfully downloaded artifact
+ * @brief Get path of the firmware installed for name, which is flashed to its devices
  *
- * @param[in] artifact pointer to artifact struct
- * @return  True if succcess, False otherwise
+ * @param[in] name firmware/device name
+ * @return  newly allocated path
  */
+static gchar* active_firmware_path(const gchar *name)
+{
+        return g_build_filename(hawkbit_config->firmware_dir, name, "Active", "firmware.hex",
+                                NULL);
+}
 
-gboolean can_install(Artifact *artifact)
+/**
+ * @brief Load firmware image of hex file and check it against the memory map configured for
+ *        the firmware name. Images are cached, so this is cheap for further devices of the
+ *        same type.
+ *
+ * @param[in]  path  path to firmware hex file
+ * @param[in]  name  firmware/device name
+ * @param[out] error Error
+ * @return IhexImage* if valid (unref with ihex_image_unref()), NULL otherwise (error set)
+ */
+static IhexImage* validate_firmware(const gchar *path, const gchar *name, GError **error)
 {
-    g_autoptr(GError) error = NULL, feedback_error = NULL;
-    g_autofree gchar *msg = NULL; 
-    GList *rce_devices_list= get_current_devices(); 
+        g_autoptr(IhexImage) image = NULL;
+        GArray *memory_map = NULL;
+        gint64 start = g_get_monotonic_time();
 
-    if(rce_devices_list == NULL)
-        return false;
+        image = ihex_image_load(path, error);
+        if (!image)
+                return NULL;
 
-    int ret = 0;
-    g_debug("CAN_INSTALL: LOOPING THROUGH DEVICES %d",g_list_length(rce_devices_list));
-    while(rce_devices_list)
-    {
-        GList *next = rce_devices_list->next;
-        RCE_DEVICE *rce_device = (RCE_DEVICE *) rce_devices_list->data;
-        if (strcmp(rce_device->name, artifact->name) != 0)
-        {
-            g_debug("%s : %s", rce_device->name, artifact->name);
-            rce_devices_list = next;
+        if (hawkbit_config->memory_map)
+                memory_map = g_hash_table_lookup(hawkbit_config->memory_map, name);
+        if (memory_map && !ihex_image_check_memory_map(image, memory_map, error))
+                return NULL;
+        if (!memory_map)
+                g_debug("No memory map configured for %s, skipping address range check", name);
 
-            continue;
+        g_debug("Firmware %s validated in %.1f ms: %u bytes at 0x%08x", path,
+                (g_get_monotonic_time() - start) / 1000.0, image->size, image->base);
+
+        return g_steal_pointer(&image);
+}
+
+/**
+ * @brief Get flashing backend configured by flash_backend/flash_command, created on first use.
+ *
+ * @param[out] error Error
+ * @return FlashBackend*, NULL on error (error set)
+ */
+static FlashBackend* get_flash_backend(GError **error)
+{
+        if (!flash_backend)
+                flash_backend = flash_backend_new(hawkbit_config->flash_backend,
+                                                  hawkbit_config->flash_command, error);
+
+        return flash_backend;
+}
+
+/**
+ * @brief Forward flashing progress to hawkBit in steps of FLASH_PROGRESS_STEP percent.
+ *
+ * @param[in] percentage progress in percent
+ * @param[in] message    progress message of backend
+ * @param[in] data       FlashProgress
+ */
+static void flash_progress_cb(gint percentage, const gchar *message, gpointer data)
+{
+        FlashProgress *progress = data;
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *msg = NULL;
+
+        if (percentage == progress->last_reported ||
+            (percentage < progress->last_reported + FLASH_PROGRESS_STEP && percentage != 100))
+                return;
+        progress->last_reported = percentage;
+
+        msg = g_strdup_printf("Flashing %s on device %d: %d%%", progress->artifact->name,
+                              progress->device_id, percentage);
+        if (!feedback_progress(progress->artifact->feedback_url, active_action->id, msg, &error))
+                g_warning("%s", error->message);
+}
+
+/**
+ * @brief Run post_flash_check command as "<command> <device id> <firmware name>" to check a
+ *        device came up with the firmware just flashed.
+ *
+ * @param[in]  rce_device device flashed
+ * @param[out] error      Error
+ * @return  TRUE if the check passed or none is configured, FALSE otherwise (error set)
+ */
+static gboolean post_flash_check(const RCE_DEVICE *rce_device, GError **error)
+{
+        g_auto(GStrv) command = NULL;
+        g_autoptr(GPtrArray) argv = NULL;
+        g_autoptr(GSubprocess) subprocess = NULL;
+
+        if (!hawkbit_config->post_flash_check)
+                return TRUE;
+
+        if (!g_shell_parse_argv(hawkbit_config->post_flash_check, NULL, &command, error)) {
+                g_prefix_error(error, "Invalid post flash check '%s': ",
+                               hawkbit_config->post_flash_check);
+                return FALSE;
         }
-    
-        g_autofree gchar *path  = g_strdup_printf("/data/fw/%s/Active/firmware.hex", rce_device->name);
-        g_autofree gchar *bootloader_call = g_strdup_printf("/app/BootloaderCmd -start %d %s", rce_device->id, path);
-        g_debug("Calling %s",bootloader_call);
-        
-        ret  = system(bootloader_call);
-        
 
-        if( ret == -1)
-        { 
-            g_debug("Couldnt call properly BootloaderCmd");
-            return false;
+        argv = g_ptr_array_new_with_free_func(g_free);
+        for (gchar **arg = command; *arg; arg++)
+                g_ptr_array_add(argv, g_strdup(*arg));
+        g_ptr_array_add(argv, g_strdup_printf("%d", rce_device->id));
+        g_ptr_array_add(argv, g_strdup(rce_device->name));
+        g_ptr_array_add(argv, NULL);
+
+        subprocess = g_subprocess_newv((const gchar * const *) argv->pdata,
+                                       G_SUBPROCESS_FLAGS_NONE, error);
+        if (!subprocess || !g_subprocess_wait_check(subprocess, NULL, error)) {
+                g_prefix_error(error, "Post flash check failed: ");
+                return FALSE;
         }
 
+        return TRUE;
+}
 
-        
-        if ( WEXITSTATUS(ret) == 0)
-        {
-            msg = g_strdup_printf("Successfully installed new firmware on %s ", artifact->name);
-            if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error)) {
+/**
+ * @brief Re-flash device with firmware retained in the fallback store, without network access,
+ *        and record it in the database. The outcome is sent to hawkBit as progress feedback.
+ *
+ * @param[in] backend    flashing backend
+ * @param[in] artifact   artifact the rollback is reported for
+ * @param[in] rce_device device to roll back
+ * @param[in] version    firmware version to roll back to
+ * @return  TRUE if rolled back, FALSE otherwise
+ */
+static gboolean rollback_device(FlashBackend *backend, Artifact *artifact,
+                            const RCE_DEVICE *rce_device, const gchar *version)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *path = NULL, *msg = NULL, *query = NULL;
+        gint64 start = g_get_monotonic_time();
+        gboolean res;
+        FlashProgress progress = {
+                .artifact = artifact,
+                .device_id = rce_device->id,
+                .last_reported = -FLASH_PROGRESS_STEP,
+        };
+        FlashRequest request = {
+                .device_id = rce_device->id,
+                .device_name = rce_device->name,
+                .timeout = hawkbit_config->flash_timeout > 0 ? hawkbit_config->flash_timeout : 0,
+                .progress = flash_progress_cb,
+                .progress_data = &progress,
+        };
+
+        if (hawkbit_config->fallback_dir)
+                path = fallback_store_lookup(hawkbit_config->fallback_dir, rce_device->name,
+                                             version);
+        request.firmware = path;
+
+        if (!path)
+                g_set_error(&error, FLASH_ERROR, FLASH_ERROR_FAILED,
+                            "firmware %s not retained", version);
+        else if (flash_backend_flash(backend, &request, &error))
+                post_flash_check(rce_device, &error);
+
+        res = !error;
+        if (error) {
+                msg = g_strdup_printf("Failed to roll back %s on device %d to %s: %s",
+                                      artifact->name, rce_device->id, version, error->message);
+                g_warning("%s", msg);
+        } else {
+                msg = g_strdup_printf("Rolled back %s on device %d to %s in %.1f s",
+                                      artifact->name, rce_device->id, version,
+                                      (g_get_monotonic_time() - start) / (double) G_USEC_PER_SEC);
+                g_message("%s", msg);
+
+                query = g_strdup_printf("UPDATE DEVICES SET FW_LATEST = \"%s\" WHERE ID = %d",
+                                        version, rce_device->id);
+                if (update_dabase(query))
+                        g_warning("Failed to record rollback of device %d in database",
+                                  rce_device->id);
+        }
+        g_clear_error(&error);
+
+        if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error))
                 g_warning("%s", error->message);
-                g_clear_error(&error);
-                }
-        } 
 
-        if ( WEXITSTATUS(ret) == 4)
-        { 
-            msg = g_strdup_printf("Couldnt install %s , error in communication with bootloader", artifact->name);
-            if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error)) {
+        return res;
+}
+
+/**
+ * @brief Roll devices back to the version of a rollback artifact requested by hawkBit
+ *
+ * @param[in] deployment deployment counting rolled back and failed devices
+ * @param[in] artifact   artifact with rollback set
+ * @param[in] devices    GPtrArray of RCE_DEVICE named like the artifact
+ */
+static void rollback_devices(FwDeployment *deployment, Artifact *artifact, GPtrArray *devices)
+{
+        g_autoptr(GError) error = NULL;
+        FlashBackend *backend = get_flash_backend(&error);
+
+        if (!backend) {
                 g_warning("%s", error->message);
-                g_clear_error(&error);
-            }
+                deployment->failed += devices->len;
+                return;
+        }
+
+        for (guint d = 0; d < devices->len; d++) {
+                if (rollback_device(backend, artifact, g_ptr_array_index(devices, d),
+                                    artifact->version))
+                        deployment->flashed++;
+                else
+                        deployment->failed++;
+        }
+}
+
+/**
+ * @brief Flash firmware to a single device, check it and send the outcome to hawkBit as progress
+ *        feedback. Devices failing after flashing started are rolled back to their fallback
+ *        firmware, if retained.
+ *
+ * @param[in]  backend    flashing backend
+ * @param[in]  artifact   artifact installed
+ * @param[in]  path       firmware HEX file validated for artifact
+ * @param[in]  rce_device device to flash
+ * @param[out] error      Error
+ * @return  TRUE if flashed, FALSE otherwise (error set)
+ */
+static gboolean flash_device(FlashBackend *backend, Artifact *artifact, const gchar *path,
+                             const RCE_DEVICE *rce_device, GError **error)
+{
+        g_autoptr(GError) ierror = NULL, feedback_error = NULL;
+        g_autofree gchar *msg = NULL;
+        gboolean rollback;
+        FlashProgress progress = {
+                .artifact = artifact,
+                .device_id = rce_device->id,
+                .last_reported = -FLASH_PROGRESS_STEP,
+        };
+        FlashRequest request = {
+                .device_id = rce_device->id,
+                .device_name = rce_device->name,
+                .firmware = path,
+                .timeout = hawkbit_config->flash_timeout > 0 ? hawkbit_config->flash_timeout : 0,
+                .progress = flash_progress_cb,
+                .progress_data = &progress,
+        };
+
+        if (flash_backend_flash(backend, &request, &ierror) &&
+            post_flash_check(rce_device, &ierror))
+                msg = g_strdup_printf("Successfully installed new firmware on %s ",
+                                      artifact->name);
+        else if (g_error_matches(ierror, FLASH_ERROR, FLASH_ERROR_COMMUNICATION))
+                msg = g_strdup_printf("Couldnt install %s , error in communication with bootloader",
+                                      artifact->name);
+        else if (g_error_matches(ierror, FLASH_ERROR, FLASH_ERROR_OFFLINE))
+                msg = g_strdup_printf("Couldnt install %s , device is not online",
+                                      artifact->name);
+        else
+                msg = g_strdup_printf("Couldnt install %s on device %d: %s", artifact->name,
+                                      rce_device->id, ierror->message);
+        // unreachable or untouched devices cannot be helped by flashing again
+        rollback = ierror && !g_error_matches(ierror, FLASH_ERROR, FLASH_ERROR_COMMUNICATION) &&
+                   !g_error_matches(ierror, FLASH_ERROR, FLASH_ERROR_OFFLINE) &&
+                   !g_error_matches(ierror, FLASH_ERROR, FLASH_ERROR_BACKEND);
+
+        if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &feedback_error))
+                g_warning("%s", feedback_error->message);
+
+        if (rollback)
+                rollback_device(backend, artifact, rce_device, rce_device->fallback_version);
+
+        if (ierror) {
+                g_propagate_error(error, g_steal_pointer(&ierror));
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Whether flashing failed because the device was offline or unreachable, so flashing it
+ *        again later may succeed
+ */
+static gboolean flash_retriable(const GError *error)
+{
+        return g_error_matches(error, FLASH_ERROR, FLASH_ERROR_OFFLINE) ||
+               g_error_matches(error, FLASH_ERROR, FLASH_ERROR_COMMUNICATION);
+}
+
+/**
+ * @brief Queue device for flashing artifact again, unless retrying is disabled
+ *
+ * @param[in] deployment deployment the retry is queued in
+ * @param[in] artifact   artifact to flash
+ * @param[in] device_id  device to flash
+ */
+static void queue_flash_retry(FwDeployment *deployment, Artifact *artifact, gint device_id)
+{
+        FlashRetry *retry = NULL;
+
+        if (hawkbit_config->flash_retry_timeout <= 0) {
+                deployment->failed++;
+                return;
+        }
+
+        retry = arena_new0(deployment->arena, FlashRetry);
+        retry->artifact = artifact;
+        retry->device_id = device_id;
+        retry->next_retry = g_get_monotonic_time() +
+                            hawkbit_config->flash_retry_interval * G_USEC_PER_SEC;
+        g_ptr_array_add(deployment->retries, retry);
+}
+
+/**
+ * @brief Persist devices queued for flashing again, so retries continue after a restart
+ *
+ * @param[in] deployment deployment with retries
+ */
+static void save_flash_retries(FwDeployment *deployment)
+{
+        for (GList *l = deployment->artifacts; l; l = l->next) {
+                Artifact *artifact = l->data;
+                g_autoptr(GArray) device_ids = g_array_new(FALSE, FALSE, sizeof(gint));
+
+                for (guint r = 0; r < deployment->retries->len; r++) {
+                        FlashRetry *retry = g_ptr_array_index(deployment->retries, r);
+
+                        if (retry->artifact == artifact)
+                                g_array_append_val(device_ids, retry->device_id);
+                }
+                state_file_set_flash_retries(artifact, device_ids);
         }
+}
+
+/**
+ * @brief Install succesfully downloaded artifact. Devices offline or unreachable are queued for
+ *        flashing again.
+ *
+ * @param[in] deployment deployment counting flashed and failed devices
+ * @param[in] artifact pointer to artifact struct
+ * @param[in] devices GPtrArray of RCE_DEVICE named like the artifact
+ * @return  True if succcess, False otherwise
+ */
+
+gboolean can_install(FwDeployment *deployment, Artifact *artifact, GPtrArray *devices)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(IhexImage) image = NULL;
+    FlashBackend *backend = NULL;
+
+    g_debug("CAN_INSTALL: LOOPING THROUGH %u DEVICES", devices->len);
+    for (guint d = 0; d < devices->len; d++)
+    {
+        RCE_DEVICE *rce_device = g_ptr_array_index(devices, d);
+        g_autofree gchar *path  = active_firmware_path(rce_device->name);
 
-        if ( WEXITSTATUS(ret) == 5)
+        // reject corrupt or incompatible firmware before flashing the first device
+        if (!image)
         {
-            msg = g_strdup_printf("Couldnt install %s , device is not online", artifact->name);
-            if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error)) {
-                g_warning("%s", error->message);
+            image = validate_firmware(path, artifact->name, &error);
+            if (!image)
+            {
+                g_autofree gchar *reject_msg = g_strdup_printf("Rejecting firmware %s: %s",
+                                                               artifact->name, error->message);
+                g_warning("%s", reject_msg);
                 g_clear_error(&error);
+                if (!feedback_progress(artifact->feedback_url, active_action->id, reject_msg, &error))
+                {
+                    g_warning("%s", error->message);
+                    g_clear_error(&error);
                 }
+                deployment->failed += devices->len;
+                return false;
+            }
         }
 
-        rce_devices_list = next;
+        if (!backend)
+        {
+            backend = get_flash_backend(&error);
+            if (!backend)
+            {
+                g_warning("%s", error->message);
+                deployment->failed += devices->len;
+                return false;
+            }
+        }
 
+        if (flash_device(backend, artifact, path, rce_device, &error))
+            deployment->flashed++;
+        else if (flash_retriable(error))
+            queue_flash_retry(deployment, artifact, rce_device->id);
+        else
+            deployment->failed++;
+        g_clear_error(&error);
     }
 
     return true;
 }
 
 
-gboolean can_install_list(GList *list)
+gboolean can_install_list(FwDeployment *deployment, GList *list)
 { 
+    GList *rce_devices_list = get_current_devices();
+    g_autoptr(GHashTable) devices_by_name = NULL;
+
+    if (rce_devices_list == NULL)
+        return true;
+
+    // index devices by name once instead of querying and scanning them per artifact
+    devices_by_name = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) g_ptr_array_unref);
+    for (GList *l = rce_devices_list; l; l = l->next)
+    {
+        RCE_DEVICE *rce_device = l->data;
+        GPtrArray *devices = g_hash_table_lookup(devices_by_name, rce_device->name);
+
+        if (!devices)
+        {
+            devices = g_ptr_array_new();
+            g_hash_table_insert(devices_by_name, rce_device->name, devices);
+        }
+        g_ptr_array_add(devices, rce_device);
+    }
 
     while(list)
     { 
         GList *next = list->next;
         Artifact *testptr = list->data;
+        GPtrArray *devices = NULL;
         if(testptr->config_install)
         {
             break;
         }
-        if (testptr->install_can)
-            can_install(testptr);
+        devices = g_hash_table_lookup(devices_by_name, testptr->name);
+        if (testptr->rollback && devices)
+            rollback_devices(deployment, testptr, devices);
+        else if (testptr->install_can && devices)
+            can_install(deployment, testptr, devices);
         list = next; 
     }
 
+    g_clear_pointer(&devices_by_name, g_hash_table_unref);
+    g_list_free_full(rce_devices_list, free_image);
+
     return true;
 
 }
@@ -581,150 +977,548 @@ gboolean can_install_list(GList *list)
 
 
 /**
- * @brief Calls installfunction for all artifacts, after success it updates database
+ * @brief Retain valid firmware installed for name in the fallback store, so its devices can be
+ *        rolled back to it without downloading it again
  *
- * @param[in] list list of artifacts
- * @return  True if Success, False otherwise
+ * @param[in] name    firmware/device name
+ * @param[in] version version the installed firmware is retained as
  */
-gboolean install_fw(GList *list)
+static void retain_active_firmware(const gchar *name, const gchar *version)
+{
+        g_autofree gchar *path = active_firmware_path(name);
+        g_autoptr(IhexImage) image = NULL;
+        g_autoptr(GError) error = NULL;
 
-{   
-    while(list)
-    {  
-        GList *next = list->next;
-        Artifact *testptr = list->data;
-        if (!install(testptr))
-            return false;
-        
-        if(!testptr->config_install)
-        {
-            gchar *query = g_strdup_printf("Update DEVICES set FW_LATEST = \"%s\", FW_FALLBACK = (SELECT DISTINCT FW_LATEST FROM DEVICES WHERE NAME=\"%s\" )"
-            "WHERE NAME=\"%s\"", testptr->version, testptr->name, testptr->name);
-            if(update_dabase(query))
-            {
-                g_free(query);
-                return false;
-            }
-            g_free(query);
-        }
-        list = next;
-    }
+        if (!g_file_test(path, G_FILE_TEST_IS_REGULAR))
+                return;
 
-    return true;
+        // invalid firmware is rejected before flashing, it is no use as fallback
+        image = validate_firmware(path, name, &error);
+        if (!image || !fallback_store_retain(hawkbit_config->fallback_dir,
+                                             hawkbit_config->fallback_images, name, version, path,
+                                             &error))
+                g_warning("Failed to retain fallback firmware %s %s: %s", name, version,
+                          error->message);
 }
 
 /**
- * @brief Calls download for all artifacts in list
+ * @brief Retain firmware installed before this updater kept fallback firmware, so the first
+ *        update has a fallback as well
  *
- * @param[in] list list of artifacts
- * @return  True if Success, False otherwise
+ * @param[in] name firmware/device name
  */
-gboolean download_fw(GList *list)
-{ 
-
-    while(list)
-    {  
-        GList *next = list->next;
-        g_debug("FIRST ARTIFACT");
-        Artifact *testptr = list->data;
-        g_debug("TESTPOINTERURL %s", testptr->download_url);
-        g_debug("%s",active_action->id); 
-        
-        download_thread_fw(testptr);
-        
-        
-        list = next;
-    }
-
-    return true;
+static void retain_initial_firmware(const gchar *name)
+{
+        GList *rce_devices_list = get_current_devices();
+        GList *found = g_list_find_custom(rce_devices_list, name, (GCompareFunc) find_name);
+        const gchar *version = found ? ((RCE_DEVICE *) found->data)->latest_version : NULL;
+        g_autofree gchar *retained = NULL;
+
+        if (version)
+                retained = fallback_store_lookup(hawkbit_config->fallback_dir, name, version);
+        // a retained version was installed by us, the database is authoritative for it
+        if (version && !retained)
+                retain_active_firmware(name, version);
+
+        g_list_free_full(rce_devices_list, free_image);
 }
 
-
 /**
- * @brief Calls download and install functions for all artifacts in list
+ * @brief Calls installfunction for artifact, after success it updates database
  *
- * @param[in] dat pointer to list of data
- * @return  G_SOUCE_REMOVE
+ * @param[in] artifact downloaded artifact
+ * @return  True if Success, False otherwise
  */
-gboolean download_and_install(gpointer data)
+static gboolean install_fw_artifact(Artifact *artifact)
 {
+    gboolean retain = hawkbit_config->fallback_dir && !artifact->config_install;
 
-    GList *list = (GList *) data;
-    gboolean ret = false;
-    GError *error = NULL;
-    g_autofree gchar *feedback_url = NULL;
+    if (retain)
+        retain_initial_firmware(artifact->name);
 
-    download_fw(list);
+    if (!install(artifact))
+        return false;
 
-    g_mutex_lock(&active_action->mutex);
-    active_action->state = ACTION_STATE_INSTALLING;
-    g_cond_signal(&active_action->cond);
-    g_mutex_unlock(&active_action->mutex);
+    if (retain)
+        retain_active_firmware(artifact->name, artifact->version);
 
-    ret = install_fw(list);
-    if(ret)
+    if(!artifact->config_install)
     {
-        can_install_list(list);
+        gchar *query = g_strdup_printf("Update DEVICES set FW_LATEST = \"%s\", FW_FALLBACK = (SELECT DISTINCT FW_LATEST FROM DEVICES WHERE NAME=\"%s\" )"
+        "WHERE NAME=\"%s\"", artifact->version, artifact->name, artifact->name);
+        if(update_dabase(query))
+        {
+            g_free(query);
+            return false;
+        }
+        g_free(query);
     }
 
-    g_mutex_lock(&active_action->mutex);
-    feedback_url = build_api_url("deploymentBase/%s/feedback", active_action->id);
-    active_action->state = ret ? ACTION_STATE_SUCCESS : ACTION_STATE_ERROR;
-    feedback(feedback_url, active_action->id,
-             ret ? "Software bundle installed completely."
-                 : "Failed to install software bundle.",
-             ret ? "success" : "failure",
-             "closed", error);
-    g_mutex_unlock(&active_action->mutex);
-    process_deployment_cleanup();
-
-    return G_SOURCE_REMOVE; 
+    return true;
 }
 
 /**
- * @brief Adds info about devices to attributes which are send to hawkbit
+ * @brief Downloads artifacts in planned order and installs each one as soon as it is downloaded,
+ *        unless hawkBit asked to skip installation. Prefetched artifacts are installed only.
  *
- * @param[in] hash GhashTable which consists atributes to send to server
+ * @param[in] deployment deployment to download and install
+ * @param[out] downloaded whether all downloads succeeded (download errors are reported already)
  * @return  True if Success, False otherwise
  */
-gboolean  add_devices_to_config(GHashTable *hash)
-{ 
-    gchar *hash_value  = NULL;
-    GList *rce_devices_list= get_current_devices();
+static gboolean download_and_install_planned(FwDeployment *deployment, gboolean *downloaded)
+{
+    *downloaded = false;
+
+    for (GList *l = deployment->plan->order; l; l = l->next)
+    {
+        Artifact *artifact = l->data;
+
+        if (!deployment->prefetched && !GPOINTER_TO_INT(download_thread_fw(artifact)))
+            return false;
+
+        if (!artifact->do_install)
+            continue;
+
+        g_mutex_lock(&active_action->mutex);
+        active_action->state = ACTION_STATE_INSTALLING;
+        g_cond_signal(&active_action->cond);
+        g_mutex_unlock(&active_action->mutex);
+
+        state_file_set_downloaded(artifact, artifact->size);
+        state_file_set_phase(STATE_PHASE_INSTALLING);
+        if (!install_fw_artifact(artifact))
+        {
+            *downloaded = true;
+            return false;
+        }
+    }
+
+    *downloaded = true;
+    return true;
+}
+
+
+/**
+ * @brief Get modification time of the device database, which changes e.g. when a device reports
+ *        back online
+ *
+ * @return  modification time [us], 0 if unknown
+ */
+static gint64 database_mtime(void)
+{
+        GStatBuf st;
+
+        if (g_stat(hawkbit_config->database_location, &st) != 0)
+                return 0;
+
+        return (gint64) st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+}
+
+/**
+ * @brief Find device by id
+ *
+ * @param[in] devices GList of RCE_DEVICE
+ * @param[in] id      device id
+ * @return  RCE_DEVICE owned by devices, NULL if not found
+ */
+static RCE_DEVICE* find_device(GList *devices, gint id)
+{
+        for (GList *l = devices; l; l = l->next) {
+                RCE_DEVICE *rce_device = l->data;
+
+                if (rce_device->id == id)
+                        return rce_device;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Deployment flashing offline or unreachable devices again, driven by the main loop
+ *        (set by the worker which queued the retries, cleared by fw_flash_retries_finish())
+ */
+static FwDeployment *retrying_deployment = NULL;
+
+/**
+ * @brief Queue devices which were offline or unreachable for flashing again, reports progress
+ *        and persists the queue. The deployment is finished by fw_flash_retries_finish().
+ *
+ * @param[in] deployment deployment with retries queued by can_install() (transfer full if
+ *                       retries are queued)
+ * @return  TRUE if retries are queued, FALSE if there is nothing to retry
+ */
+static gboolean start_flash_retries(FwDeployment *deployment)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *msg = NULL;
+
+        if (!deployment->retries->len)
+                return FALSE;
+
+        msg = g_strdup_printf("Flashed %u of %u devices, retrying %u offline or unreachable devices",
+                              deployment->flashed,
+                              deployment->flashed + deployment->failed + deployment->retries->len,
+                              deployment->retries->len);
+        g_message("%s", msg);
+        if (!feedback_progress(active_action->feedback_url, active_action->id, msg, &error)) {
+                g_warning("%s", error->message);
+                g_clear_error(&error);
+        }
+
+        state_file_set_phase(STATE_PHASE_RETRYING);
+        state_file_set_flash_counts(deployment->flashed, deployment->failed);
+        save_flash_retries(deployment);
+
+        deployment->action = active_action;
+        deployment->retry_deadline = g_get_monotonic_time() +
+                                     (gint64) hawkbit_config->flash_retry_timeout * G_USEC_PER_SEC;
+        deployment->db_mtime = database_mtime();
+        g_atomic_pointer_set(&retrying_deployment, deployment);
+
+        return TRUE;
+}
+
+struct HawkbitAction* fw_flash_retries_action(void)
+{
+        FwDeployment *deployment = g_atomic_pointer_get(&retrying_deployment);
+
+        return deployment ? deployment->action : NULL;
+}
+
+/**
+ * @brief Check whether queued devices are due to be flashed again. All queued devices are due at
+ *        once when the device database changes. Called from the main loop while no worker runs.
+ *
+ * @return  TRUE if devices are due or flash_retry_timeout expired, FALSE otherwise
+ */
+gboolean fw_flash_retries_due(void)
+{
+        FwDeployment *deployment = retrying_deployment;
+        gint64 now = g_get_monotonic_time();
+        gint64 mtime = database_mtime();
+        gboolean due = now >= deployment->retry_deadline;
+
+        if (mtime != deployment->db_mtime)
+                g_debug("Device database changed, flashing queued devices now");
+
+        for (guint r = 0; r < deployment->retries->len; r++) {
+                FlashRetry *retry = g_ptr_array_index(deployment->retries, r);
+
+                if (mtime != deployment->db_mtime)
+                        retry->next_retry = now;
+                due |= retry->next_retry <= now;
+        }
+        deployment->db_mtime = mtime;
+
+        return due;
+}
+
+/**
+ * @brief WorkerFunc flashing the devices due again with exponential backoff.
+ *
+ * @param[in] data unused
+ * @return  TRUE if devices are left to flash again before flash_retry_timeout expires, FALSE
+ *          otherwise
+ */
+gboolean fw_flash_retries_run(gpointer data)
+{
+        FwDeployment *deployment = retrying_deployment;
+        GList *rce_devices_list = NULL;
+        g_autoptr(GError) error = NULL;
+        FlashBackend *backend = NULL;
+        gint64 now = g_get_monotonic_time();
+
+        if (now >= deployment->retry_deadline)
+                return FALSE;
+
+        backend = get_flash_backend(&error);
+        if (!backend) {
+                g_warning("%s", error->message);
+                return FALSE;
+        }
+
+        rce_devices_list = get_current_devices();
+        for (guint r = 0; r < deployment->retries->len;) {
+                FlashRetry *retry = g_ptr_array_index(deployment->retries, r);
+                RCE_DEVICE *rce_device = NULL;
+                g_autofree gchar *path = NULL;
+                g_autoptr(IhexImage) image = NULL;
+                gint64 interval;
+
+                if (retry->next_retry > now) {
+                        r++;
+                        continue;
+                }
+
+                rce_device = find_device(rce_devices_list, retry->device_id);
+                if (rce_device) {
+                        path = active_firmware_path(rce_device->name);
+                        image = validate_firmware(path, retry->artifact->name, &error);
+                } else {
+                        g_set_error(&error, FLASH_ERROR, FLASH_ERROR_FAILED,
+                                    "device not in database anymore");
+                }
+
+                retry->attempts++;
+                if (image)
+                        g_message("Flashing %s on device %d again (attempt %u)",
+                                  retry->artifact->name, retry->device_id, retry->attempts + 1);
+                if (image && flash_device(backend, retry->artifact, path, rce_device, &error)) {
+                        deployment->flashed++;
+                } else if (flash_retriable(error)) {
+                        interval = MIN((gint64) hawkbit_config->flash_retry_interval <<
+                                       MIN(retry->attempts, 16),
+                                       FLASH_RETRY_MAX_INTERVAL);
+                        retry->next_retry = now + interval * G_USEC_PER_SEC;
+                        g_clear_error(&error);
+                        r++;
+                        continue;
+                } else {
+                        g_warning("Giving up flashing %s on device %d: %s",
+                                  retry->artifact->name, retry->device_id, error->message);
+                        deployment->failed++;
+                }
+                g_clear_error(&error);
+                g_ptr_array_remove_index(deployment->retries, r);
+        }
+        g_list_free_full(rce_devices_list, free_image);
+
+        state_file_set_flash_counts(deployment->flashed, deployment->failed);
+        save_flash_retries(deployment);
+
+        return deployment->retries->len > 0;
+}
+
+/**
+ * @brief Send final feedback of deployment, if due, and release the deployment's arena. Flashing
+ *        failing for some devices turns a successful deployment into a failed one, reporting
+ *        how many devices were flashed.
+ *
+ * @param[in] deployment FwDeployment (transfer full)
+ * @param[in] ret        whether all artifacts were downloaded and installed
+ * @param[in] final      whether final feedback is due, it was sent already otherwise
+ * @param[in] msg        final feedback detail, unless flashing failed for some devices
+ * @return  TRUE if the deployment succeeded, FALSE otherwise
+ */
+static gboolean finish_deployment(FwDeployment *deployment, gboolean ret, gboolean final,
+                                  const gchar *msg)
+{
+        g_autofree gchar *summary = NULL;
+
+        if (ret && deployment->failed) {
+                summary = g_strdup_printf("Firmware flashed on %u of %u devices.",
+                                          deployment->flashed,
+                                          deployment->flashed + deployment->failed);
+                msg = summary;
+                ret = FALSE;
+        }
+
+        if (final) {
+                action_feedback(NULL, msg, ret ? "success" : "failure", "closed");
+
+                g_mutex_lock(&active_action->mutex);
+                active_action->state = ret ? ACTION_STATE_SUCCESS : ACTION_STATE_ERROR;
+                g_mutex_unlock(&active_action->mutex);
+        }
+        process_deployment_cleanup();
+
+        // everything allocated for the deployment goes at once, deployment and list included
+        arena_free(deployment->arena);
+
+        return ret;
+}
+
+/**
+ * @brief Finish the deployment flashing offline or unreachable devices again. Devices still
+ *        queued count as failed. Called from the main loop with the deployment's target active.
+ *
+ * @param[in] canceled whether the action was canceled (cancelation acknowledged then)
+ * @return  TRUE if the deployment succeeded, FALSE otherwise
+ */
+gboolean fw_flash_retries_finish(gboolean canceled)
+{
+        FwDeployment *deployment = retrying_deployment;
+
+        g_atomic_pointer_set(&retrying_deployment, NULL);
+
+        if (canceled) {
+                g_message("Canceled flashing %u offline or unreachable devices",
+                          deployment->retries->len);
+                g_mutex_lock(&active_action->mutex);
+                active_action->state = ACTION_STATE_CANCELED;
+                process_cancel_complete();
+                g_mutex_unlock(&active_action->mutex);
+                return finish_deployment(deployment, FALSE, FALSE, NULL);
+        }
+
+        if (deployment->retries->len) {
+                g_warning("Giving up flashing %u offline or unreachable devices",
+                          deployment->retries->len);
+                deployment->failed += deployment->retries->len;
+                g_ptr_array_set_size(deployment->retries, 0);
+        }
+
+        return finish_deployment(deployment, TRUE, TRUE, "Software bundle installed completely.");
+}
+
+/**
+ * @brief Firmware deployment downloaded while hawkBit asked to skip installation, installed by
+ *        parse_fw() once hawkBit allows it
+ */
+static FwDeployment *prefetched_deployment = NULL;
+
+/**
+ * @brief Keep deployment downloaded and verified while hawkBit asked to skip installation until
+ *        hawkBit allows to install it
+ *
+ * @param[in] deployment downloaded FwDeployment (transfer full)
+ */
+static void keep_prefetched(FwDeployment *deployment)
+{
+        FwDeployment *previous = g_atomic_pointer_get(&prefetched_deployment);
+
+        deployment->prefetched = TRUE;
+        deployment->action = active_action;
+
+        g_mutex_lock(&active_action->mutex);
+        active_action->state = ACTION_STATE_NONE;
+        active_action->prefetched = TRUE;
+        g_mutex_unlock(&active_action->mutex);
+
+        g_message("Prefetched %u firmware artifacts, waiting for hawkBit to allow installation",
+                  g_list_length(deployment->plan->order));
+
+        // downloaded artifacts are picked up by the next deployment poll, not on restart
+        state_file_clear();
+
+        g_atomic_pointer_set(&prefetched_deployment, deployment);
+        if (previous)
+                arena_free(previous->arena);
+}
+
+void fw_discard_prefetched(void)
+{
+        FwDeployment *deployment = prefetched_deployment;
+
+        if (!deployment || deployment->action != active_action)
+                return;
+
+        prefetched_deployment = NULL;
+        arena_free(deployment->arena);
+}
+
+/**
+ * @brief Plans, downloads and installs all artifacts of a deployment, then releases the
+ *        deployment's arena unless offline or unreachable devices are flashed again or hawkBit
+ *        asked to skip installation
+ *
+ * @param[in] data FwDeployment (transfer full)
+ * @return  TRUE if all artifacts were downloaded and installed (or prefetched), FALSE otherwise
+ */
+gboolean download_and_install(gpointer data)
+{
+
+    FwDeployment *deployment = data;
+    GList *list = deployment->artifacts;
+    gboolean ret = false, downloaded = false;
+    g_autoptr(GError) error = NULL;
+    DownloadPlan *plan = NULL;
+    g_autoptr(GList) downloads = NULL;
+    const gchar *msg = NULL;
+
+    // rollbacks re-flash retained firmware, there is nothing to download for them
+    for (GList *l = list; l; l = l->next)
+    {
+        Artifact *artifact = l->data;
+
+        if (!artifact->rollback)
+            downloads = g_list_prepend(downloads, artifact);
+    }
+    downloads = g_list_reverse(downloads);
+
+    // place and reserve all downloads before the first transfer starts, prefetched
+    // deployments were planned already
+    if (!deployment->plan)
+    {
+        plan = download_plan_new(downloads, hawkbit_config->staging_dirs, &error);
+        if (plan)
+            deployment->plan = arena_take(deployment->arena, plan,
+                                          (GDestroyNotify) download_plan_free);
+    }
+    if (deployment->plan)
+    {
+        ret = download_and_install_planned(deployment, &downloaded);
+        // hawkBit skips installation of the deployment as a whole
+        if (ret && list && !((Artifact *) list->data)->do_install)
+        {
+            keep_prefetched(deployment);
+            return TRUE;
+        }
+        if(ret)
+        {
+            can_install_list(deployment, list);
+            // offline or unreachable devices are flashed again from the main loop
+            if (start_flash_retries(deployment))
+                return TRUE;
+        }
+        msg = ret ? "Software bundle installed completely." : "Failed to install software bundle.";
+    }
+    else
+    {
+        msg = error->message;
+        downloaded = true;
+    }
+
+    // failed/canceled downloads sent their final feedback already
+    return finish_deployment(deployment, ret, downloaded, msg);
+}
+
+/**
+ * @brief Continue flashing devices offline or unreachable before a restart from the main loop,
+ *        finish the deployment if none are left
+ *
+ * @param[in] data FwDeployment (transfer full)
+ * @return  FALSE if the deployment failed, TRUE otherwise
+ */
+static gboolean resume_flash_retries(gpointer data)
+{
+    FwDeployment *deployment = data;
+
+    if (start_flash_retries(deployment))
+        return TRUE;
+
+    return finish_deployment(deployment, TRUE, TRUE, "Software bundle installed completely.");
+}
+
+/**
+ * @brief Adds info about devices to attributes which are send to hawkbit
+ *
+ * @param[in] hash GhashTable which consists atributes to send to server
+ * @return  True if Success, False otherwise
+ */
+gboolean  add_devices_to_config(GHashTable *hash)
+{ 
+    GList *rce_devices_list = get_current_devices();
+    GString *summary = NULL;
 
     if(rce_devices_list == NULL)
         return false;
-    g_autofree gchar *devices = g_strdup_printf("%s","Devices");
-
 
-    while(rce_devices_list)
+    summary = g_string_new(NULL);
+    for (GList *l = rce_devices_list; l; l = l->next)
     { 
-        GList *next = rce_devices_list->next;
-        RCE_DEVICE *rce_device = rce_devices_list->data;
-        gchar *tmp = NULL;
-        
-        g_autofree gchar *value  = g_strdup_printf("FW: %d.%d | HW: %d.%d | Current %d.%d  | Fallback: %d.%d", rce_device->fw.major, rce_device->fw.minor,rce_device->hw.major,
+        RCE_DEVICE *rce_device = l->data;
+        gchar *value  = g_strdup_printf("FW: %d.%d | HW: %d.%d | Current %d.%d  | Fallback: %d.%d", rce_device->fw.major, rce_device->fw.minor,rce_device->hw.major,
         rce_device->hw.minor, rce_device->latest_fw.major, rce_device->latest_fw.minor, rce_device->fallback_fw.major, rce_device->fallback_fw.minor);
-        g_autofree gchar *key = g_strdup_printf("%s:%d", rce_device->name , rce_device->id);
-        
-        tmp = g_strdup_printf(" | %s:%d.%d",rce_device->name, rce_device->fw.major, rce_device->fw.minor);
-        if (hash_value != NULL)
-        { 
-            tmp = g_strdup_printf(" %s | %s:%d.%d",hash_value,rce_device->name, rce_device->fw.major, rce_device->fw.minor);  
-            g_free(hash_value);
-        } 
-        else{ 
-            tmp = g_strdup_printf(" | %s:%d.%d",rce_device->name, rce_device->fw.major, rce_device->fw.minor);
-        }
+        gchar *key = g_strdup_printf("%s:%d", rce_device->name , rce_device->id);
 
-        hash_value = g_strdup_printf("%s", tmp);
-        g_free(tmp);
-        g_hash_table_insert(hash, g_steal_pointer(&key), g_steal_pointer(&value));
-        
-        rce_devices_list = next;
+        g_string_append_printf(summary, " | %s:%d.%d", rce_device->name, rce_device->fw.major,
+                               rce_device->fw.minor);
+        g_hash_table_insert(hash, key, value);
     } 
-    g_hash_table_insert(hash,g_steal_pointer(&devices),hash_value);
+    g_hash_table_insert(hash, g_strdup("Devices"), g_string_free(summary, FALSE));
 
+    g_list_free_full(rce_devices_list, free_image);
 
     return true;
 
@@ -735,134 +1529,307 @@ gboolean  add_devices_to_config(GHashTable *hash)
 
 
 /**
- * @brief Parse firwmare chunks from hawkbit and call download thread
+ * @brief Get string matching JSONPath expression path in node, copied into arena
+ *
+ * @return  string owned by arena, NULL if not found
+ */
+static gchar* arena_json_string(Arena *arena, JsonNode *node, const gchar *path)
+{
+    g_autofree gchar *str = json_get_string(node, path, NULL);
+
+    return arena_strdup(arena, str);
+}
+
+/**
+ * @brief Collect artifacts of firmware chunks applicable to the given devices. A chunk applies
+ *        if any device of its name has hardware within the chunk's "HW" metadata range and (unless
+ *        forced) older firmware, see compat_plan().
  *
  * @param[in] json_chunks json chunks
+ * @param[in] rce_devices_list list of RCE_DEVICE to match chunks against
  * @param[in] feedback_url_tmp url for feedback
  * @param[in] forced parameter which determines if we want to check version or not
- * @return  True if Success, False otherwise
+ * @param[in] arena arena the artifacts, their data and the list are allocated in
+ * @param[out] error Error
+ * @return  list of Artifact owned by arena, NULL if nothing applies or on error (error set)
  */
-gboolean parse_fw(JsonArray *json_chunks, gchar *feedback_url_tmp, gboolean forced)
+GList* fw_collect_artifacts(JsonArray *json_chunks, GList *rce_devices_list,
+                            const gchar *feedback_url_tmp, gboolean forced, Arena *arena,
+                            GError **error)
 { 
-    GError **error = NULL;
-    JsonNode *chunk, *device, *metadata = NULL;
-    JsonArray *devices = NULL;
-    JsonArray *metadata_array = NULL;
-    GList *Artifact_list, *rce_devices_list, *one_device =  NULL;
-    gchar *hw = NULL;
-    gchar *config_ptr = NULL;
-    gchar *can_install = NULL;
-    RCE_DEVICE *rce_device = NULL;
-    rce_devices_list = get_current_devices();
-    guint8 len = json_array_get_length(json_chunks);
-
-    for (int i = 0; i < len; i++)
+    JsonNode *chunk, *device = NULL;
+    g_autoptr(JsonArray) devices = NULL;
+    g_autoptr(GArray) chunks = NULL;
+    g_autoptr(GArray) plan = NULL;
+    g_autoptr(CompatIndex) index = NULL;
+    g_autofree gboolean *selected = NULL;
+    g_autofree gboolean *install_can = NULL;
+    g_autofree gboolean *rollback = NULL;
+    GList *Artifact_list = NULL;
+    guint len = json_array_get_length(json_chunks);
+
+    chunks = g_array_sized_new(FALSE, TRUE, sizeof(CompatChunk), len);
+    g_array_set_size(chunks, len);
+    selected = g_new0(gboolean, len);
+    install_can = g_new0(gboolean, len);
+    rollback = g_new0(gboolean, len);
+
+    // parse name, version and metadata of every chunk once, borrowing strings from the document
+    for (guint i = 0; i < len; i++)
     { 
-        Artifact *artifact = malloc(sizeof(Artifact));
+        CompatChunk *compat_chunk = &g_array_index(chunks, CompatChunk, i);
+        JsonArray *metadata_array = NULL;
+        const gchar *name;
 
         chunk = json_array_get_element(json_chunks, i);
-        devices = json_get_array(chunk, "$.artifacts", error);
+        name = json_get_member_string(chunk, "name");
 
-        metadata_array = json_get_array(chunk,"$.metadata",error);
-        
-        int metadata_length = json_array_get_length(metadata_array);
-        for (int x = 0; x < metadata_length; x++)
-        { 
-            metadata = json_array_get_element(metadata_array,x);
-            if (!g_strcmp0(json_get_string(metadata,"$.key",error),"HW"))
-            { 
-              hw = json_get_string(metadata,"$.value",error);
-            }
-            else if (!g_strcmp0(json_get_string(metadata,"$.key",error),"install"))
-            {
-            
-                can_install = json_get_string(metadata,"$.value",error);
-            }
+        // config chunks are installed regardless of devices
+        if (name && strstr(name, "config"))
+        {
+            selected[i] = TRUE;
+            continue;
         }
 
-        device  = json_array_get_element(devices, 0);
-        
+        compat_chunk->name = name;
+        compat_chunk->version = json_get_member_string(chunk, "version");
 
-        //Check if we have fw for device which is in our config
+        metadata_array = json_get_member_array(chunk, "metadata");
+        for (guint x = 0; metadata_array && x < json_array_get_length(metadata_array); x++)
+        { 
+            JsonNode *metadata = json_array_get_element(metadata_array, x);
+            const gchar *key = json_get_member_string(metadata, "key");
+
+            if (!g_strcmp0(key, "HW"))
+                compat_chunk->hw = json_get_member_string(metadata, "value");
+            else if (!g_strcmp0(key, "install"))
+                install_can[i] = !g_strcmp0(json_get_member_string(metadata, "value"), "yes");
+            else if (!g_strcmp0(key, "rollback"))
+                rollback[i] = !g_strcmp0(json_get_member_string(metadata, "value"), "yes");
+        }
+    }
 
-        config_ptr = strstr(json_get_string(chunk, "$.name", error),"config");
-        
-        if(!config_ptr)
-        {
+    // match all chunks against all devices in one pass
+    index = compat_index_new(rce_devices_list);
+    plan = compat_plan(index, (const CompatChunk *) chunks->data, len, forced);
+    for (guint m = 0; m < plan->len; m++)
+        selected[g_array_index(plan, CompatMatch, m).chunk] = TRUE;
+    // rollbacks go to older firmware on purpose, the devices they apply to are picked when flashing
+    for (guint i = 0; i < len; i++)
+        selected[i] |= rollback[i];
 
-            one_device = g_list_find_custom(rce_devices_list,json_get_string(chunk, "$.name", error),find_name);
-            if(one_device)
-            { 
-                rce_device = one_device->data;
+    for (guint i = 0; i < len; i++)
+    { 
+        Artifact *artifact = NULL;
 
-                if(compare_version(parse_version(hw),rce_device->hw))
-                {
-                    //if update is forced we dont care what version it is
-                    if (!forced)
-                    {
-                    if (!compare_version(rce_device->fw,parse_version(json_get_string(chunk, "$.version", error))))
-                        { 
-                            g_debug("Latest version already installed, skipping this device");
-                            g_free(artifact);
-                            continue;
-                        }
-                    }
-                }
-                else 
-                { 
-                        g_debug("SW is for different HW VERSIOn");
-                        g_free(artifact);
-                        continue;
-                }
-            
-            }
-            else
-            {
-                continue;
-            }
-        } 
+        if (!selected[i])
+        { 
+            g_debug("Skipping %s: no device with matching HW and older FW",
+                    g_array_index(chunks, CompatChunk, i).name);
+            continue;
+        }
 
-        
-      //  print_version(parse_version(json_get_string(chunk, "$.version", error)));
-        artifact->version = json_get_string(chunk, "$.version", error);
-        artifact->name = json_get_string(chunk, "$.name", error);   
-        artifact->size = json_get_int(device, "$.size", error);
-        artifact->install_can = !g_strcmp0(can_install,"yes");
-        artifact->sha1 = json_get_string(device, "$.hashes.sha1", error);
-        artifact->feedback_url = malloc(strlen(feedback_url_tmp));
-        artifact->config_install = config_ptr;
-        strcpy(artifact->feedback_url,feedback_url_tmp);
+        artifact = arena_new0(arena, Artifact);
+        chunk = json_array_get_element(json_chunks, i);
+        g_clear_pointer(&devices, json_array_unref);
+        devices = json_get_array(chunk, "$.artifacts", NULL);
+        device  = json_array_get_element(devices, 0);
+
+        artifact->version = arena_strdup(arena, json_get_member_string(chunk, "version"));
+        artifact->name = arena_strdup(arena, json_get_member_string(chunk, "name"));
+        artifact->size = json_get_int(device, "$.size", NULL);
+        artifact->install_can = install_can[i];
+        artifact->rollback = rollback[i];
+        artifact->sha1 = arena_json_string(arena, device, "$.hashes.sha1");
+        artifact->sha256 = arena_json_string(arena, device, "$.hashes.sha256");
+        artifact->md5 = arena_json_string(arena, device, "$.hashes.md5");
+        artifact->feedback_url = arena_strdup(arena, feedback_url_tmp);
+        artifact->config_install = g_array_index(chunks, CompatChunk, i).name == NULL;
         
         // favour https download
-        artifact->download_url = json_get_string(device, "$._links.download.href", NULL);
+        artifact->download_url = arena_json_string(arena, device, "$._links.download.href");
         if (!artifact->download_url)
-                artifact->download_url = json_get_string(device, "$._links.download-http.href", error);
-        if (!artifact->download_url) {
-                g_prefix_error(error, "\"$._links.download{-http,}.href\": ");
-                g_debug("error during parsing");
-                return 0;
-        }  
+            artifact->download_url = arena_json_string(arena, device, "$._links.download-http.href");
+        if (!artifact->download_url)
+        {
+            g_set_error(error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_PARSE,
+                        "Firmware %s: no \"$._links.download{-http,}.href\"", artifact->name);
+            // artifacts collected so far are released with the arena
+            g_list_free(Artifact_list);
+            return NULL;
+        }
 
-        g_message("FW: New software ready for download (Name: %s, Version: %s, Size: %" G_GINT64_FORMAT " bytes, URL: %s)",
-                  artifact->name, artifact->version, artifact->size, artifact->download_url);
-        Artifact_list = g_list_append(Artifact_list, (gpointer) artifact);
+        if (artifact->rollback)
+            g_message("FW: Rollback requested (Name: %s, Version: %s)", artifact->name,
+                      artifact->version);
+        else
+            g_message("FW: New software ready for download (Name: %s, Version: %s, Size: %" G_GINT64_FORMAT " bytes, URL: %s)",
+                      artifact->name, artifact->version, artifact->size, artifact->download_url);
+        Artifact_list = g_list_prepend(Artifact_list, (gpointer) artifact);
 
     } 
 
+    return arena_take(arena, g_list_reverse(Artifact_list), (GDestroyNotify) g_list_free);
+}
+
+/**
+ * @brief Start download worker for deployment, it releases the deployment's arena when done
+ *
+ * @param[in] deployment FwDeployment (transfer full)
+ */
+static void start_deployment(FwDeployment *deployment)
+{
+    start_download_worker(download_and_install, deployment);
+}
+
+/**
+ * @brief Create deployment owning an arena all its data is allocated in
+ *
+ * @return  FwDeployment (release with arena_free() of its arena)
+ */
+static FwDeployment* deployment_new(void)
+{
+    Arena *arena = arena_new("deployment");
+    FwDeployment *deployment = arena_new0(arena, FwDeployment);
+
+    deployment->arena = arena;
+    deployment->retries = arena_take(arena, g_ptr_array_new(), (GDestroyNotify) g_ptr_array_unref);
+
+    return deployment;
+}
+
+/**
+ * @brief Create deployment of artifacts persisted by a previous run
+ *
+ * @param[in] artifacts list of Artifact (copied)
+ * @return  FwDeployment (release with arena_free() of its arena)
+ */
+static FwDeployment* deployment_copy(GList *artifacts)
+{
+    FwDeployment *deployment = deployment_new();
+    Arena *arena = deployment->arena;
+
+    for (GList *l = artifacts; l; l = l->next)
+    {
+        const Artifact *saved = l->data;
+        Artifact *artifact = arena_new0(arena, Artifact);
+
+        *artifact = *saved;
+        artifact->name = arena_strdup(arena, saved->name);
+        artifact->version = arena_strdup(arena, saved->version);
+        artifact->download_url = arena_strdup(arena, saved->download_url);
+        artifact->feedback_url = arena_strdup(arena, saved->feedback_url);
+        artifact->sha1 = arena_strdup(arena, saved->sha1);
+        artifact->sha256 = arena_strdup(arena, saved->sha256);
+        artifact->md5 = arena_strdup(arena, saved->md5);
+        artifact->file = NULL;
+        deployment->artifacts = g_list_prepend(deployment->artifacts, artifact);
+    }
+    deployment->artifacts = arena_take(arena, g_list_reverse(deployment->artifacts),
+                                       (GDestroyNotify) g_list_free);
+
+    return deployment;
+}
 
-    g_list_foreach(Artifact_list, (GFunc) print_Artifact,NULL);
+/**
+ * @brief Resume firmware deployment persisted by a previous run
+ *
+ * @param[in] artifacts list of Artifact to download and install (copied)
+ */
+void fw_resume_deployment(GList *artifacts)
+{
+    start_deployment(deployment_copy(artifacts));
+}
 
-    if (thread_download)
-                g_thread_join(thread_download);
+/**
+ * @brief Resume flashing devices which were offline or unreachable when a previous run installed
+ *        a firmware deployment
+ *
+ * @param[in] artifacts list of Artifact installed (copied)
+ * @param[in] flash_retries artifact name to GArray of gint ids of devices to flash
+ * @param[in] flashed devices flashed successfully by the previous run
+ * @param[in] failed devices failed to flash for good by the previous run
+ */
+void fw_resume_flash_retries(GList *artifacts, GHashTable *flash_retries, guint flashed,
+                             guint failed)
+{
+    FwDeployment *deployment = deployment_copy(artifacts);
+    gint64 now = g_get_monotonic_time();
 
+    deployment->flashed = flashed;
+    deployment->failed = failed;
+    for (GList *l = deployment->artifacts; l && flash_retries; l = l->next)
+    {
+        Artifact *artifact = l->data;
+        GArray *device_ids = g_hash_table_lookup(flash_retries, artifact->name);
 
-        // start download thread
-    thread_download = g_thread_new("downloader", download_and_install, (gpointer) g_steal_pointer(&Artifact_list));
+        for (guint d = 0; device_ids && d < device_ids->len; d++)
+        {
+            FlashRetry *retry = arena_new0(deployment->arena, FlashRetry);
 
-    g_list_foreach(Artifact_list, (GFunc) artifact_free,NULL); 
-    g_list_foreach(rce_devices_list, (GFunc) free_image,NULL);
+            // devices may have come back while the updater was down
+            retry->artifact = artifact;
+            retry->device_id = g_array_index(device_ids, gint, d);
+            retry->next_retry = now;
+            g_ptr_array_add(deployment->retries, retry);
+        }
+    }
+
+    start_download_worker(resume_flash_retries, deployment);
+}
+
+/**
+ * @brief Parse firwmare chunks from hawkbit and call download thread
+ *
+ * @param[in] json_chunks json chunks
+ * @param[in] feedback_url_tmp url for feedback
+ * @param[in] forced parameter which determines if we want to check version or not
+ * @param[in] do_install whether hawkBit allows installation, artifacts are prefetched otherwise
+ * @param[out] error Error
+ * @return  True if Success, False otherwise (error set, no deployment started)
+ */
+gboolean parse_fw(JsonArray *json_chunks, gchar *feedback_url_tmp, gboolean forced,
+                  gboolean do_install, GError **error)
+{ 
+    GList *rce_devices_list = NULL;
+    GError *ierror = NULL;
+    FwDeployment *deployment = prefetched_deployment;
+
+    // verified while waiting for the maintenance window, only installation is left
+    if (do_install && deployment && deployment->action == active_action &&
+        active_action->prefetched)
+    {
+        g_message("Installing prefetched firmware deployment %s", active_action->id);
+        prefetched_deployment = NULL;
+        active_action->prefetched = FALSE;
+        for (GList *l = deployment->artifacts; l; l = l->next)
+            ((Artifact *) l->data)->do_install = TRUE;
+        state_file_set_artifacts(true, deployment->artifacts);
+        start_deployment(deployment);
+        return 1;
+    }
+
+    // all artifacts of the deployment live until the download thread has installed them
+    deployment = deployment_new();
+    rce_devices_list = get_current_devices();
+    deployment->artifacts = fw_collect_artifacts(json_chunks, rce_devices_list, feedback_url_tmp,
+                                                 forced, deployment->arena, &ierror);
+    g_list_free_full(rce_devices_list, free_image);
+    if (ierror)
+    {
+        g_propagate_error(error, ierror);
+        arena_free(deployment->arena);
+        return false;
+    }
+    for (GList *l = deployment->artifacts; l; l = l->next)
+        ((Artifact *) l->data)->do_install = do_install;
+
+    g_list_foreach(deployment->artifacts, (GFunc) print_Artifact,NULL);
+    state_file_set_artifacts(true, deployment->artifacts);
+
+    start_deployment(deployment);
 
     g_debug("fw_interface donre");
 
     return 1;
-}
\ No newline at end of file
+}
@@ -19,17 +19,27 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <signal.h>
+#include <unistd.h>
 #include <sys/statvfs.h>
 #include <curl/curl.h>
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
 #include <json-glib/json-glib.h>
 #include <libgen.h>
 #include <gio/gio.h>
 #include <sys/reboot.h>
+#include "digest.h"
+#include "endpoints.h"
 #include "fw-interface.h"
 #include "json-helper.h"
+#include "loop-monitor.h"
+#include "peer-server.h"
+#include "scheduling.h"
+#include "state-file.h"
+#include "worker.h"
 #ifdef WITH_SYSTEMD
 #include "sd-helper.h"
 #endif
@@ -42,6 +52,9 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(CURL, curl_easy_cleanup)
 gboolean run_once = FALSE;
 
 static const gint MAX_RETRIES_ON_API_ERROR = 10;
+static const gsize FEEDBACK_TEMPLATE_SIZE = 160;     /**< feedback body without id and details */
+static const gint MAINTENANCE_WINDOW_DELAY = 2;      /**< seconds to poll after the maintenance
+                                                          window opened, covers clock skew */
 
 /**
  * @brief String representation of HTTP methods.
@@ -66,7 +79,34 @@ const gint resumable_codes[] = {
 Config *hawkbit_config = NULL; 
 GSourceFunc software_ready_cb;
 struct HawkbitAction *active_action = NULL;
-GThread *thread_download = NULL;
+
+static GPtrArray *hawkbit_targets = NULL;            /**< all targets served, first is own */
+static struct HawkbitTarget *active_target = NULL;   /**< target owning active_action */
+static GMainContext *main_context = NULL;            /**< context of the polling main loop */
+static gint download_result = -1;                    /**< result of last download worker, -1 if
+                                                          none finished (run_once only) */
+
+static gchar *config_path = NULL;                    /**< config file reloaded or NULL */
+static Config *initial_config = NULL;                /**< config passed to hawkbit_init() */
+static Config *pending_config = NULL;                /**< reload deferred until action finished */
+static GPtrArray *retired_configs = NULL;            /**< configs replaced by reloads */
+static GSource *reload_source = NULL;                /**< reload scheduled after file change */
+static GSource *maintenance_source = NULL;           /**< poll scheduled at maintenance window */
+static GSource *flash_retry_source = NULL;           /**< flashes offline devices again */
+static long probe_last_sec = 0;                      /**< seconds since servers were last probed */
+static gboolean probing = FALSE;                     /**< probe worker running */
+
+// connections, DNS cache and TLS sessions shared between all requests of all targets
+static CURLSH *curl_share = NULL;
+static GMutex curl_share_mutex[CURL_LOCK_DATA_LAST];
+
+// request headers only depend on the config, so they are built once instead of per request
+static struct {
+        GMutex mutex;                 /**< protects all members below */
+        struct curl_slist *get;       /**< headers of requests without body */
+        struct curl_slist *post;      /**< headers of requests with JSON body */
+        GSList *retired;              /**< header lists built from replaced configs */
+} request_headers;
 
 GQuark rhu_hawkbit_client_error_quark(void)
 {
@@ -100,6 +140,45 @@ static struct HawkbitAction *action_new(void)
         return action;
 }
 
+/**
+ * @brief Create and initialize a HawkbitTarget.
+ *
+ * @param[in] controller_id hawkBit controller id of target
+ * @param[in] action        HawkbitAction to use or NULL to create a new one
+ * @return Pointer to initialized HawkbitTarget
+ */
+static struct HawkbitTarget *target_new(const gchar *controller_id, struct HawkbitAction *action)
+{
+        struct HawkbitTarget *target = g_new0(struct HawkbitTarget, 1);
+
+        target->controller_id = g_strdup(controller_id);
+        target->action = action ? action : action_new();
+        target->interval_check_sec = hawkbit_config->retry_wait;
+        target->last_run_sec = hawkbit_config->retry_wait;
+
+        return target;
+}
+
+/**
+ * @brief Free a HawkbitTarget and its action.
+ *
+ * @param[in] target HawkbitTarget to free
+ */
+static void target_free(struct HawkbitTarget *target)
+{
+        if (!target)
+                return;
+
+        g_free(target->controller_id);
+        g_free(target->action->id);
+        g_free(target->action->feedback_url);
+        g_free(target->action->cancel_id);
+        g_mutex_clear(&target->action->mutex);
+        g_cond_clear(&target->action->cond);
+        g_free(target->action);
+        g_free(target);
+}
+
 /**
  * @brief Get available free space of a mounted file system.
  *
@@ -128,46 +207,41 @@ static gboolean get_available_space(const char *path, goffset *free_space, GErro
         return TRUE;
 }
 
-/**
- * @brief Calculate checksum for file.
- *
- * @param[in]  fp       File to read data from
- * @param[in]  type     Desired type of checksum
- * @param[out] checksum Calculated checksum digest hex string
- * @param[out] error    Error
- * @return TRUE if checksum calculation succeeded, FALSE otherwise (error set)
- */
-static gboolean get_file_checksum(FILE *fp, const GChecksumType type, gchar **checksum,
-                                  GError **error)
+gboolean get_file_checksum(FILE *fp, const GChecksumType type, gchar **checksum,
+                           GError **error)
 {
-        g_autoptr(GChecksum) ctx = g_checksum_new(type);
-        guchar buf[4096];
-        size_t r;
+        g_autoptr(Digest) digest = NULL;
+        DigestType digest_type = digest_type_from_checksum_type(type);
 
         g_return_val_if_fail(fp, FALSE);
+        g_return_val_if_fail(digest_type, FALSE);
         g_return_val_if_fail(checksum && *checksum == NULL, FALSE);
         g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-        g_assert_nonnull(ctx);
+        if (!digest_file(fp, digest_type, digest_default_backend(), &digest, error))
+                return FALSE;
 
-        fseek(fp, 0, SEEK_SET);
+        *checksum = g_strdup(digest_get_string(digest, digest_type));
 
-        while (1) {
-                r = fread(buf, 1, sizeof(buf), fp);
-                if (ferror(fp)) {
-                        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "Read failed");
-                        return FALSE;
-                }
+        return TRUE;
+}
 
-                g_checksum_update(ctx, buf, r);
+const gchar* artifact_get_checksum(const Artifact *artifact, GChecksumType *type)
+{
+        g_return_val_if_fail(artifact, NULL);
+        g_return_val_if_fail(type, NULL);
 
-                if (feof(fp))
-                        break;
+        if (artifact->sha256) {
+                *type = G_CHECKSUM_SHA256;
+                return artifact->sha256;
+        }
+        if (artifact->sha1) {
+                *type = G_CHECKSUM_SHA1;
+                return artifact->sha1;
         }
 
-        *checksum = g_strdup(g_checksum_get_string(ctx));
-
-        return TRUE;
+        *type = G_CHECKSUM_MD5;
+        return artifact->md5;
 }
 
 /**
@@ -241,118 +315,156 @@ static gboolean set_auth_curl_header(struct curl_slist **headers, GError **error
 }
 
 /**
- * @brief Set common Curl options, namely user agent, connect timeout, SSL
- *        verify peer and SSL verify host options.
+ * @brief Build headers of JSON REST requests.
  *
- * @param[in] curl Curl handle
+ * @param[in]  body  Whether the request has a JSON body
+ * @param[out] error Error
+ * @return curl_slist* of headers, NULL on error (error set)
  */
-static void set_default_curl_opts(CURL *curl)
+static struct curl_slist* build_request_headers(gboolean body, GError **error)
 {
-        g_return_if_fail(curl);
+        struct curl_slist *headers = NULL;
 
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, HAWKBIT_USERAGENT);
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, hawkbit_config->connect_timeout);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, hawkbit_config->ssl_verify ? 1L : 0L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, hawkbit_config->ssl_verify ? 1L : 0L);
+        if (!add_curl_header(&headers, "Accept: application/json;charset=UTF-8", error))
+                return NULL;
+
+        if (!set_auth_curl_header(&headers, error))
+                return NULL;
+
+        if (body &&
+            !add_curl_header(&headers, "Content-Type: application/json;charset=UTF-8", error))
+                return NULL;
+
+        return headers;
 }
 
 /**
- * @brief Download download_url to file.
+ * @brief Get headers of JSON REST requests, built once per config. Lists built from a config
+ *        replaced by a reload stay valid until free_retired_request_headers(), as requests of
+ *        other threads may still use them.
  *
- * @param[in]  download_url URL to download from
- * @param[in]  file         Download destination
- * @param[in]  resume_from  Offset to resume download from
- * @param[out] sha1sum      Calculated checksum or NULL
- * @param[out] speed        Average download speed
- * @param[out] error        Error
- * @return TRUE if download succeeded, FALSE otherwise (error set)
+ * @param[in]  body  Whether the request has a JSON body
+ * @param[out] error Error
+ * @return curl_slist* of headers owned by the cache, NULL on error (error set)
  */
-gboolean get_binary(const gchar *download_url, const gchar *file, curl_off_t resume_from,
-                           gchar **sha1sum, curl_off_t *speed, GError **error)
+static const struct curl_slist* get_request_headers(gboolean body, GError **error)
 {
-        g_autoptr(CURL) curl = NULL;
-        g_autoptr(FILE) fp = NULL;
-        CURLcode curl_code;
-        glong http_code = 0;
+        struct curl_slist **cached = NULL;
         struct curl_slist *headers = NULL;
 
-        g_return_val_if_fail(download_url, FALSE);
-        g_return_val_if_fail(file, FALSE);
-        g_return_val_if_fail(sha1sum == NULL || *sha1sum == NULL, FALSE);
-        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-
-        if (resume_from)
-                g_debug("Resuming download from offset %" CURL_FORMAT_CURL_OFF_T, resume_from);
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
-        fp = g_fopen(file, (resume_from) ? "ab+" : "wb+");
-        if (!fp) {
-                int err = errno;
-                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                            "Failed to open %s for download: %s", file, g_strerror(err));
-                return FALSE;
-        }
+        g_mutex_lock(&request_headers.mutex);
+        cached = body ? &request_headers.post : &request_headers.get;
+        if (!*cached)
+                *cached = build_request_headers(body, error);
+        headers = *cached;
+        g_mutex_unlock(&request_headers.mutex);
 
-        curl = curl_easy_init();
-        if (!curl) {
-                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, CURLE_FAILED_INIT,
-                            "Unable to start libcurl easy session");
-                return FALSE;
-        }
+        return headers;
+}
 
-        set_default_curl_opts(curl);
-        curl_easy_setopt(curl, CURLOPT_URL, download_url);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 8L);
-        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+/**
+ * @brief Rebuild header lists on the next request, as the config was replaced by a reload.
+ */
+static void retire_request_headers(void)
+{
+        g_mutex_lock(&request_headers.mutex);
+        if (request_headers.get)
+                request_headers.retired = g_slist_prepend(request_headers.retired,
+                                                          request_headers.get);
+        if (request_headers.post)
+                request_headers.retired = g_slist_prepend(request_headers.retired,
+                                                          request_headers.post);
+        request_headers.get = NULL;
+        request_headers.post = NULL;
+        g_mutex_unlock(&request_headers.mutex);
+}
 
-        // abort if slower than configured download rate during configured time span
-        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, hawkbit_config->low_speed_time);
-        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, hawkbit_config->low_speed_rate);
+/**
+ * @brief Free header lists retired by retire_request_headers(), once no request uses them.
+ */
+static void free_retired_request_headers(void)
+{
+        g_mutex_lock(&request_headers.mutex);
+        g_slist_free_full(request_headers.retired, (GDestroyNotify) curl_slist_free_all);
+        request_headers.retired = NULL;
+        g_mutex_unlock(&request_headers.mutex);
+}
 
-        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, resume_from);
+/**
+ * @brief Free header lists built by get_request_headers().
+ */
+static void free_request_headers(void)
+{
+        g_mutex_lock(&request_headers.mutex);
+        g_slist_free_full(request_headers.retired, (GDestroyNotify) curl_slist_free_all);
+        curl_slist_free_all(request_headers.get);
+        curl_slist_free_all(request_headers.post);
+        request_headers.retired = NULL;
+        request_headers.get = NULL;
+        request_headers.post = NULL;
+        g_mutex_unlock(&request_headers.mutex);
+}
 
-        if (!set_auth_curl_header(&headers, error))
-                return FALSE;
+static void curl_share_lock_cb(CURL *handle, curl_lock_data data, curl_lock_access access,
+                               void *userptr)
+{
+        g_mutex_lock(&curl_share_mutex[data]);
+}
 
-        // set up request headers
-        if (!add_curl_header(&headers, "Accept: application/octet-stream", error))
-                return FALSE;
+static void curl_share_unlock_cb(CURL *handle, curl_lock_data data, void *userptr)
+{
+        g_mutex_unlock(&curl_share_mutex[data]);
+}
 
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+/**
+ * @brief Create Curl share handle so all easy handles (of all targets and threads) reuse
+ *        connections, DNS lookups and TLS sessions.
+ *
+ * @return CURLSH* or NULL if sharing is unavailable
+ */
+static CURLSH* curl_share_new(void)
+{
+        CURLSH *share = curl_share_init();
 
-        // perform transfer
-        curl_code = curl_easy_perform(curl);
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, speed);
-        curl_slist_free_all(headers);
+        if (!share)
+                return NULL;
 
-        if (curl_code != CURLE_OK) {
-                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, curl_code, "%s",
-                            curl_easy_strerror(curl_code));
-                g_debug("curl failed");
-                return FALSE;
-        }
-        // consider ok/partial download/range not satisfiable (EOF reached) as success
-        if (http_code != 200 && http_code != 206 && http_code != 416) {
-                g_set_error(error, RHU_HAWKBIT_CLIENT_HTTP_ERROR, http_code,
-                            "HTTP request failed: %ld", http_code);
-                return FALSE;
-        }
+        for (gint i = 0; i < CURL_LOCK_DATA_LAST; i++)
+                g_mutex_init(&curl_share_mutex[i]);
 
-        // if checksum enabled then return the value
-        if (sha1sum && !get_file_checksum(fp, G_CHECKSUM_SHA1, sha1sum, error))
-                return FALSE;
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, curl_share_lock_cb);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock_cb);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        // connection cache sharing requires libcurl >= 7.57.0
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
 
-        return TRUE;
+        return share;
 }
 
 /**
- * @brief Curl callback writing REST response to RestPayload*->payload buffer.
+ * @brief Set common Curl options, namely user agent, connect timeout, SSL
+ *        verify peer and SSL verify host options and the shared connection pool.
  *
- * @see   https://curl.haxx.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
+ * @param[in] curl Curl handle
  */
-static size_t curl_write_cb(const void *content, size_t size, size_t nmemb, void *data)
+static void set_default_curl_opts(CURL *curl)
+{
+        g_return_if_fail(curl);
+
+        if (curl_share)
+                curl_easy_setopt(curl, CURLOPT_SHARE, curl_share);
+        curl_easy_setopt(curl, CURLOPT_USERAGENT, HAWKBIT_USERAGENT);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, hawkbit_config->connect_timeout);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, hawkbit_config->ssl_verify ? 1L : 0L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, hawkbit_config->ssl_verify ? 1L : 0L);
+}
+
+size_t curl_write_cb(const void *content, size_t size, size_t nmemb, void *data)
 {
         RestPayload *p = NULL;
         size_t real_size = size * nmemb;
@@ -371,24 +483,38 @@ static size_t curl_write_cb(const void *content, size_t size, size_t nmemb, void
         return real_size;
 }
 
+/**
+ * @brief Serialize JSON request body built by json_build_status().
+ *
+ * @param[in] builder JsonBuilder with built request
+ * @return newly allocated JSON string
+ */
+static gchar* json_builder_to_data(JsonBuilder *builder)
+{
+        g_autoptr(JsonGenerator) generator = json_generator_new();
+        g_autoptr(JsonNode) root = json_builder_get_root(builder);
+
+        json_generator_set_root(generator, root);
+        return json_generator_to_data(generator, NULL);
+}
+
 /**
  * @brief Perform REST request with JSON data, expecting response JSON data.
  *
  * @param[in]  method             HTTP Method, e.g. GET
  * @param[in]  url                URL used in HTTP REST request
- * @param[in]  jsonRequestBody    REST request body. If NULL, no body is sent
+ * @param[in]  jsonRequestBody    Serialized REST request body. If NULL, no body is sent
  * @param[out] jsonResponseParser Return location for a REST response or NULL to skip response
  *                                parsing
  * @param[out] error              Error
  * @return TRUE if request and response parser (if given) suceeded, FALSE otherwise (error set).
  */
 static gboolean rest_request(enum HTTPMethod method, const gchar *url,
-                             JsonBuilder *jsonRequestBody, JsonParser **jsonResponseParser,
+                             const gchar *jsonRequestBody, JsonParser **jsonResponseParser,
                              GError **error)
 {
-        g_autofree gchar *postdata = NULL;
         g_autoptr(RestPayload) fetch_buffer = NULL;
-        struct curl_slist *headers = NULL;
+        const struct curl_slist *headers = NULL;
         g_autoptr(CURL) curl = NULL;
         glong http_code = 0;
         CURLcode res;
@@ -418,26 +544,13 @@ static gboolean rest_request(enum HTTPMethod method, const gchar *url,
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, fetch_buffer);
 
         if (jsonRequestBody) {
-                g_autoptr(JsonGenerator) generator = json_generator_new();
-                g_autoptr(JsonNode) req_root = json_builder_get_root(jsonRequestBody);
-                g_autofree gchar *json_req_str = NULL;
-
-                json_generator_set_root(generator, req_root);
-                postdata = json_generator_to_data(generator, NULL);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postdata);
-                json_req_str = json_to_string(req_root, TRUE);
-                g_debug("Request body: %s", json_req_str);
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonRequestBody);
+                g_debug("Request body: %s", jsonRequestBody);
         }
 
         // set up request headers
-        if (!add_curl_header(&headers, "Accept: application/json;charset=UTF-8", error))
-                return FALSE;
-
-        if (!set_auth_curl_header(&headers, error))
-                return FALSE;
-
-        if (jsonRequestBody &&
-            !add_curl_header(&headers, "Content-Type: application/json;charset=UTF-8", error))
+        headers = get_request_headers(jsonRequestBody != NULL, error);
+        if (!headers)
                 return FALSE;
 
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
@@ -445,7 +558,6 @@ static gboolean rest_request(enum HTTPMethod method, const gchar *url,
         // perform request
         res = curl_easy_perform(curl);
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        curl_slist_free_all(headers);
         if (res != CURLE_OK) {
                 g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, res, "%s",
                             curl_easy_strerror(res));
@@ -483,14 +595,14 @@ static gboolean rest_request(enum HTTPMethod method, const gchar *url,
  *
  * @param[in]  method             HTTP Method, e.g. GET
  * @param[in]  url                URL used in HTTP REST request
- * @param[in]  jsonRequestBody    REST request body. If NULL, no body is sent
+ * @param[in]  jsonRequestBody    Serialized REST request body. If NULL, no body is sent
  * @param[out] jsonResponseParser Return location for a REST response or NULL to skip response
  *                                parsing
  * @param[out] error              Error
  * @return TRUE if request and response parser (if given) suceeded, FALSE otherwise (error set).
  */
 static gboolean rest_request_retriable(enum HTTPMethod method, const gchar *url,
-                                       JsonBuilder *jsonRequestBody,
+                                       const gchar *jsonRequestBody,
                                        JsonParser **jsonResponseParser, GError **error)
 {
         gboolean res, retry;
@@ -522,20 +634,8 @@ static gboolean rest_request_retriable(enum HTTPMethod method, const gchar *url,
         return res;
 }
 
-/**
- * @brief Build hawkBit JSON request.
- *
- * @see https://www.eclipse.org/hawkbit/rest-api/rootcontroller-api-guide/#_post_tenant_controller_v1_controllerid_deploymentbase_actionid_feedback
- *
- * @param[in] id         hawkBit action ID or NULL (configData usecase)
- * @param[in] detail     Detail message or NULL (configData usecase)
- * @param[in] finished   hawkBit status of the result
- * @param[in] execution  hawkBit status of the action execution
- * @param[in] attributes hawkBit controller attributes or NULL (feedback usecase)
- * @return JsonBuilder* with built hawkBit request
- */
-static JsonBuilder* json_build_status(const gchar *id, const gchar *detail, const gchar *finished,
-                                      const gchar *execution, GHashTable *attributes)
+JsonBuilder* json_build_status(const gchar *id, const gchar *detail, const gchar *finished,
+                               const gchar *execution, GHashTable *attributes)
 {
         GHashTableIter iter;
         gpointer key, value;
@@ -602,6 +702,88 @@ static JsonBuilder* json_build_status(const gchar *id, const gchar *detail, cons
         return g_steal_pointer(&builder);
 }
 
+/**
+ * @brief Append str to json as JSON string literal, escaping quotes, backslashes and control
+ *        characters.
+ *
+ * @param[in,out] json GString to append to
+ * @param[in]     str  UTF-8 string to append
+ */
+static void json_append_string(GString *json, const gchar *str)
+{
+        const gchar *start = str;
+
+        g_string_append_c(json, '"');
+        for (const gchar *c = str; *c; c++) {
+                if ((guchar) *c >= 0x20 && *c != '"' && *c != '\\')
+                        continue;
+
+                g_string_append_len(json, start, c - start);
+                switch (*c) {
+                case '"':
+                        g_string_append(json, "\\\"");
+                        break;
+                case '\\':
+                        g_string_append(json, "\\\\");
+                        break;
+                case '\n':
+                        g_string_append(json, "\\n");
+                        break;
+                case '\r':
+                        g_string_append(json, "\\r");
+                        break;
+                case '\t':
+                        g_string_append(json, "\\t");
+                        break;
+                default:
+                        g_string_append_printf(json, "\\u%04x", (guchar) *c);
+                        break;
+                }
+                start = c + 1;
+        }
+        g_string_append(json, start);
+        g_string_append_c(json, '"');
+}
+
+gchar* json_format_feedback(const gchar *id, const gchar *detail, const gchar *finished,
+                            const gchar *execution, gint cnt, gint of)
+{
+        GString *json = NULL;
+        time_t current_time;
+        struct tm time_info;
+        char timeString[16];
+
+        g_return_val_if_fail(id, NULL);
+        g_return_val_if_fail(detail, NULL);
+        g_return_val_if_fail(finished, NULL);
+        g_return_val_if_fail(execution, NULL);
+
+        // get current time in UTC
+        time(&current_time);
+        gmtime_r(&current_time, &time_info);
+        strftime(timeString, sizeof(timeString), "%Y%m%dT%H%M%S", &time_info);
+
+        // sized for the template, so only unusually long details reallocate
+        json = g_string_sized_new(FEEDBACK_TEMPLATE_SIZE + strlen(id) + strlen(detail));
+
+        g_string_append(json, "{\"id\":");
+        json_append_string(json, id);
+        g_string_append(json, ",\"time\":\"");
+        g_string_append(json, timeString);
+        g_string_append(json, "\",\"status\":{\"result\":{\"finished\":");
+        json_append_string(json, finished);
+        g_string_append(json, "},\"execution\":");
+        json_append_string(json, execution);
+        g_string_append(json, ",\"details\":[");
+        json_append_string(json, detail);
+        g_string_append_c(json, ']');
+        if (of > 0)
+                g_string_append_printf(json, ",\"progress\":{\"cnt\":%d,\"of\":%d}", cnt, of);
+        g_string_append(json, "}}");
+
+        return g_string_free(json, FALSE);
+}
+
 /**
  * @brief Send feedback to hawkBit.
  *
@@ -610,13 +792,17 @@ static JsonBuilder* json_build_status(const gchar *id, const gchar *detail, cons
  * @param[in]  detail     Detail message
  * @param[in]  finished   hawkBit status of the result
  * @param[in]  execution  hawkBit status of the action execution
+ * @param[in]  cnt        progress achieved (of of)
+ * @param[in]  of         progress total or 0 to omit progress
  * @param[out] error      Error
  * @return TRUE if feedback was sent successfully, FALSE otherwise (error set)
  */
-gboolean feedback(const gchar *url, const gchar *id, const gchar *detail,
-                         const gchar *finished, const gchar *execution, GError **error)
+static gboolean send_feedback(const gchar *url, const gchar *id, const gchar *detail,
+                              const gchar *finished, const gchar *execution, gint cnt, gint of,
+                              GError **error)
 {
-        g_autoptr(JsonBuilder) builder = NULL;
+        g_autofree gchar *body = NULL;
+        g_autofree gchar *server_url = NULL;
         gboolean res = FALSE;
 
         g_return_val_if_fail(url, FALSE);
@@ -626,20 +812,46 @@ gboolean feedback(const gchar *url, const gchar *id, const gchar *detail,
         g_return_val_if_fail(execution, FALSE);
         g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
+        // feedback URLs are built once per action, follow server failovers since then
+        server_url = endpoints_rewrite_url(url);
+
         if (!g_strcmp0(finished, "failure"))
                 g_warning("%s", detail);
         else
                 g_message("%s", detail);
 
-        builder = json_build_status(id, detail, finished, execution, NULL);
+        body = json_format_feedback(id, detail, finished, execution, cnt, of);
 
-        res = rest_request_retriable(POST, url, builder, NULL, error);
+        // final feedback must survive a restart until hawkBit acknowledged it
+        if (!g_strcmp0(execution, "closed"))
+                state_file_feedback_pending(server_url, id, detail, finished, execution);
+
+        res = rest_request_retriable(POST, server_url, body, NULL, error);
         if (!res)
                 g_prefix_error(error, "Failed to report \"%s\" feedback: ", detail);
+        else
+                state_file_feedback_sent(id, detail, execution);
 
         return res;
 }
 
+/**
+ * @brief Send feedback to hawkBit.
+ *
+ * @param[in]  url        hawkBit URL used for request
+ * @param[in]  id         hawkBit action ID
+ * @param[in]  detail     Detail message
+ * @param[in]  finished   hawkBit status of the result
+ * @param[in]  execution  hawkBit status of the action execution
+ * @param[out] error      Error
+ * @return TRUE if feedback was sent successfully, FALSE otherwise (error set)
+ */
+gboolean feedback(const gchar *url, const gchar *id, const gchar *detail,
+                         const gchar *finished, const gchar *execution, GError **error)
+{
+        return send_feedback(url, id, detail, finished, execution, 0, 0, error);
+}
+
 /**
  * @brief Send progress feedback to hawkBit (finished=none, execution=proceeding).
  *
@@ -665,71 +877,527 @@ gboolean feedback_progress(const gchar *url, const gchar *id, const gchar *detai
         return res;
 }
 
+void download_progress_init(DownloadProgress *progress, const Artifact *artifact)
+{
+        g_return_if_fail(progress);
+        g_return_if_fail(artifact);
+
+        *progress = (DownloadProgress) {
+                .artifact = artifact,
+                .started = g_get_monotonic_time(),
+        };
+        progress->last_report = progress->started;
+}
+
+curl_off_t download_progress_get_speed(const DownloadProgress *progress)
+{
+        gint64 elapsed;
+
+        g_return_val_if_fail(progress, 0);
+
+        elapsed = g_get_monotonic_time() - progress->started;
+        if (elapsed <= 0)
+                return 0;
+
+        return (progress->transferred + progress->current) * G_USEC_PER_SEC / elapsed;
+}
+
 /**
- * @brief Get polling sleep time from hawkBit JSON response.
+ * @brief Download progress report queued for the main loop by download_progress_report().
+ */
+typedef struct {
+        gchar *action_id;             /**< action the download belongs to */
+        gchar *feedback_url;          /**< URL to send the report to */
+        gchar *msg;                   /**< progress message */
+        gint percent;                 /**< progress [%] */
+} ProgressReport;
+
+/**
+ * @brief Send queued download progress report to hawkBit as progress feedback, unless the
+ *        download finished meanwhile.
  *
- * @param[in] root JsonNode* with hawkBit response
- * @return time to sleep in seconds, either from JSON or (if not found) from config's retry_wait (or 5s during active action)
+ * @param[in] data ProgressReport (freed)
+ * @return G_SOURCE_REMOVE is always returned
  */
-static long json_get_sleeptime(JsonNode *root)
+static gboolean download_progress_send(gpointer data)
 {
-        g_autofree gchar *sleeptime_str = NULL;
+        ProgressReport *report = data;
         g_autoptr(GError) error = NULL;
-        struct tm time;
-
-        g_return_val_if_fail(root, 0L);
+        gboolean downloading;
 
-        /* When processing an action, return fixed sleeptime of 5s to allow
-         * receiving cancelation requests etc.*/
         g_mutex_lock(&active_action->mutex);
-        if (active_action->state == ACTION_STATE_PROCESSING ||
-            active_action->state == ACTION_STATE_DOWNLOADING ||
-            active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
-                g_mutex_unlock(&active_action->mutex);
-                return 5L;
-        }
+        downloading = active_action->state == ACTION_STATE_DOWNLOADING &&
+                      !g_strcmp0(active_action->id, report->action_id);
         g_mutex_unlock(&active_action->mutex);
 
-        sleeptime_str = json_get_string(root, "$.config.polling.sleep", &error);
-        if (!sleeptime_str) {
-                g_warning("Polling sleep time not found: %s. Using fallback: %ds",
-                          error->message, hawkbit_config->retry_wait);
-                return hawkbit_config->retry_wait;
-        }
+        if (downloading && !send_feedback(report->feedback_url, report->action_id, report->msg,
+                                          "none", "proceeding", report->percent, 100, &error))
+                g_warning("Progress feedback: %s", error->message);
 
-        strptime(sleeptime_str, "%T", &time);
-        return (time.tm_sec + (time.tm_min * 60) + (time.tm_hour * 60 * 60));
+        g_free(report->action_id);
+        g_free(report->feedback_url);
+        g_free(report->msg);
+        g_free(report);
+
+        return G_SOURCE_REMOVE;
 }
 
 /**
- * @brief Build API URL
- *
- * @param path[in] a printf()-like format string describing the API path or NULL for base path
- * @param ... The arguments to be inserted in path
+ * @brief Queue download progress report for the main loop, which logs it and sends it to hawkBit
+ *        as progress feedback. Called from the transfer's progress callback, so the transfer is
+ *        not held up by the feedback request.
  *
- * @return a newly allocated full API URL
+ * @param[in,out] progress DownloadProgress of the download
  */
-__attribute__((__format__(__printf__, 1, 2)))
-gchar* build_api_url(const gchar *path, ...)
+static void download_progress_report(DownloadProgress *progress)
 {
+        g_autofree gchar *done = NULL, *total = NULL, *rate = NULL, *eta = NULL;
+        const Artifact *artifact = progress->artifact;
+        ProgressReport *report = NULL;
+        curl_off_t downloaded = progress->offset + progress->current;
+        curl_off_t speed = download_progress_get_speed(progress);
+        gint percent = 0;
+
+        progress->last_report = g_get_monotonic_time();
+
+        if (artifact->size > 0)
+                percent = CLAMP(downloaded * 100 / artifact->size, 0, 100);
+        if (speed > 0 && artifact->size > downloaded) {
+                gint64 left = (artifact->size - downloaded) / speed;
+                eta = g_strdup_printf("%" G_GINT64_FORMAT ":%02d:%02d", left / 3600,
+                                      (gint) (left / 60 % 60), (gint) (left % 60));
+        }
+
+        done = g_format_size(downloaded);
+        total = g_format_size(artifact->size);
+        rate = g_format_size(speed);
+
+        report = g_new0(ProgressReport, 1);
+        report->feedback_url = g_strdup(artifact->feedback_url);
+        report->msg = g_strdup_printf("Downloading %s: %s of %s (%d%%), %s/s, ETA %s",
+                                      artifact->name, done, total, percent, rate,
+                                      eta ? eta : "unknown");
+        report->percent = percent;
+        g_mutex_lock(&active_action->mutex);
+        report->action_id = g_strdup(active_action->id);
+        g_mutex_unlock(&active_action->mutex);
+
+        loop_monitor_invoke(main_context, "download-progress", download_progress_send, report);
+}
+
+/**
+ * @brief Curl progress callback tracking download progress. Reports progress every
+ *        progress_interval seconds and aborts transfers of canceled actions within one progress
+ *        tick. With progress->stall_time set, transfers slower than download_stall_rate over that
+ *        time are aborted as well (progress->stalled set).
+ *
+ * @see   https://curl.se/libcurl/c/CURLOPT_XFERINFOFUNCTION.html
+ */
+static int xferinfo_cb(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal,
+                       curl_off_t ulnow)
+{
+        DownloadProgress *progress = data;
+        gint64 interval = (gint64) hawkbit_config->progress_interval * G_USEC_PER_SEC;
+        gint64 now = g_get_monotonic_time();
+
+        if (g_atomic_int_get(&active_action->cancel_requested))
+                return 1;
+
+        progress->current = dlnow;
+        if (interval > 0 && now - progress->last_report >= interval)
+                download_progress_report(progress);
+
+        if (progress->stall_time > 0 &&
+            now - progress->window_start >= (gint64) progress->stall_time * G_USEC_PER_SEC) {
+                curl_off_t speed = (dlnow - progress->window_current) * G_USEC_PER_SEC /
+                                   (now - progress->window_start);
+
+                if (speed < hawkbit_config->download_stall_rate) {
+                        progress->stalled = TRUE;
+                        return 1;
+                }
+                progress->window_start = now;
+                progress->window_current = dlnow;
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Download download_url to file.
+ *
+ * @param[in]  download_url  URL to download from
+ * @param[in]  file          Download destination
+ * @param[in]  resume_from   Offset to resume download from
+ * @param[in]  authenticate  Whether to send the hawkBit authentication header
+ * @param[in]  checksum_type Type of checksum to calculate
+ * @param[out] checksum      Calculated checksum or NULL
+ * @param[in,out] progress   DownloadProgress updated during the transfer
+ * @param[out] error         Error
+ * @return TRUE if download succeeded, FALSE otherwise (error set)
+ */
+static gboolean fetch_binary(const gchar *download_url, const gchar *file,
+                             curl_off_t resume_from, gboolean authenticate,
+                             GChecksumType checksum_type, gchar **checksum,
+                             DownloadProgress *progress, GError **error)
+{
+        g_autoptr(CURL) curl = NULL;
+        g_autoptr(FILE) fp = NULL;
+        CURLcode curl_code;
+        glong http_code = 0;
+        curl_off_t transferred = 0;
+        struct curl_slist *headers = NULL;
+        GStatBuf file_stat;
+        gboolean empty_file;
+
+        g_return_val_if_fail(download_url, FALSE);
+        g_return_val_if_fail(file, FALSE);
+        g_return_val_if_fail(checksum == NULL || *checksum == NULL, FALSE);
+        g_return_val_if_fail(progress, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        if (resume_from)
+                g_debug("Resuming download from offset %" CURL_FORMAT_CURL_OFF_T, resume_from);
+
+        // don't truncate empty files, this would drop space reserved by the download planner
+        empty_file = !resume_from && g_stat(file, &file_stat) == 0 && !file_stat.st_size;
+
+        fp = g_fopen(file, (resume_from || empty_file) ? "ab+" : "wb+");
+        if (!fp) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                            "Failed to open %s for download: %s", file, g_strerror(err));
+                return FALSE;
+        }
+
+        curl = curl_easy_init();
+        if (!curl) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, CURLE_FAILED_INIT,
+                            "Unable to start libcurl easy session");
+                return FALSE;
+        }
+
+        set_default_curl_opts(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, download_url);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 8L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+
+        // abort if slower than configured download rate during configured time span, unless
+        // xferinfo_cb() switches to another source earlier
+        if (!progress->stall_time) {
+                curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, hawkbit_config->low_speed_time);
+                curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, hawkbit_config->low_speed_rate);
+        }
+
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, resume_from);
+
+        // track progress, abort within one progress tick once the action is canceled
+        progress->offset = resume_from;
+        progress->current = 0;
+        progress->window_start = g_get_monotonic_time();
+        progress->window_current = 0;
+        progress->stalled = FALSE;
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_cb);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, progress);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+        // peers are not trusted with the hawkBit credentials
+        if (authenticate && !set_auth_curl_header(&headers, error))
+                return FALSE;
+
+        // set up request headers
+        if (!add_curl_header(&headers, "Accept: application/octet-stream", error))
+                return FALSE;
+
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        // perform transfer
+        curl_code = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &transferred);
+        progress->transferred += transferred;
+        progress->current = 0;
+        curl_slist_free_all(headers);
+
+        if (curl_code != CURLE_OK) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, curl_code, "%s",
+                            curl_easy_strerror(curl_code));
+                g_debug("curl failed");
+                return FALSE;
+        }
+        // consider ok/partial download/range not satisfiable (EOF reached) as success
+        if (http_code != 200 && http_code != 206 && http_code != 416) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_HTTP_ERROR, http_code,
+                            "HTTP request failed: %ld", http_code);
+                return FALSE;
+        }
+
+        // if checksum enabled then return the value
+        if (checksum && !get_file_checksum(fp, checksum_type, checksum, error))
+                return FALSE;
+
+        return TRUE;
+}
+
+gboolean get_binary(DownloadSources *sources, const gchar *file, curl_off_t resume_from,
+                    GChecksumType checksum_type, gchar **checksum, DownloadProgress *progress,
+                    GError **error)
+{
+        guint count, failed = 0, stalled = 0;
+
+        g_return_val_if_fail(sources, FALSE);
+        g_return_val_if_fail(file, FALSE);
+        g_return_val_if_fail(progress, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        count = download_sources_count(sources);
+        while (1) {
+                const DownloadSource *source = sources->current;
+                g_autoptr(GError) ierror = NULL;
+                g_autofree gchar *url = NULL;
+                curl_off_t transferred = progress->transferred;
+                gint64 started = g_get_monotonic_time();
+                gboolean res;
+                GStatBuf file_stat;
+
+                // switch on stalls until each source stalled once, slow links have no better one
+                progress->stall_time = count > 1 && stalled < count
+                                       ? hawkbit_config->download_stall_time : 0;
+
+                // hawkBit URLs follow server failovers
+                url = endpoints_rewrite_url(source->url);
+                res = fetch_binary(url, file, resume_from, source->authenticate, checksum_type,
+                                   checksum, progress, &ierror);
+                progress->stall_time = 0;
+                download_sources_record(sources, progress->transferred - transferred,
+                                        g_get_monotonic_time() - started, res);
+                if (res)
+                        return TRUE;
+
+                // libcurl refuses to append replies of servers ignoring the range request
+                if (resume_from && g_error_matches(ierror, RHU_HAWKBIT_CLIENT_CURL_ERROR,
+                                                   CURLE_RANGE_ERROR)) {
+                        g_message("%s does not support range requests, restarting download",
+                                  source->url);
+                        if (truncate(file, 0) != 0) {
+                                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                                            "Failed to truncate %s: %s", file, g_strerror(errno));
+                                return FALSE;
+                        }
+                        resume_from = 0;
+                        continue;
+                }
+
+                if (progress->stalled) {
+                        stalled++;
+                        g_message("Download from %s stalled below %d bytes/s", source->url,
+                                  hawkbit_config->download_stall_rate);
+                } else if (g_error_matches(ierror, RHU_HAWKBIT_CLIENT_CURL_ERROR,
+                                           CURLE_ABORTED_BY_CALLBACK) ||
+                           count < 2 || ++failed >= count) {
+                        g_propagate_error(error, g_steal_pointer(&ierror));
+                        return FALSE;
+                } else {
+                        g_message("Download from %s failed: %s", source->url, ierror->message);
+                        // error pages must not end up in the artifact
+                        if (ierror->domain == RHU_HAWKBIT_CLIENT_HTTP_ERROR &&
+                            truncate(file, resume_from) != 0)
+                                g_warning("Failed to truncate %s: %s", file, g_strerror(errno));
+                }
+
+                source = download_sources_switch(sources);
+                g_message("Resuming download from %s", source->url);
+                if (g_stat(file, &file_stat) == 0)
+                        resume_from = (curl_off_t) file_stat.st_size;
+        }
+}
+
+gboolean get_binary_from_peers(const Artifact *artifact, const gchar *file, gchar **checksum,
+                               DownloadProgress *progress)
+{
+        g_autofree gchar *path = NULL;
+        const gchar *expected_checksum = NULL;
+        GChecksumType checksum_type;
+
+        g_return_val_if_fail(artifact, FALSE);
+        g_return_val_if_fail(file, FALSE);
+        g_return_val_if_fail(checksum && *checksum == NULL, FALSE);
+        g_return_val_if_fail(progress, FALSE);
+
+        // file is about to change, stop serving an older artifact downloaded to it
+        peer_server_forget(file);
+
+        if (!hawkbit_config->peers || !artifact->sha1)
+                return FALSE;
+
+        expected_checksum = artifact_get_checksum(artifact, &checksum_type);
+        path = peer_server_artifact_path(artifact->sha1);
+
+        for (gchar **peer = hawkbit_config->peers; *peer; peer++) {
+                g_autoptr(GError) error = NULL;
+                g_autofree gchar *url = g_strdup_printf("http://%s%s", *peer, path);
+                curl_off_t resume_from = 0;
+                GStatBuf file_stat;
+
+                if (g_stat(file, &file_stat) == 0)
+                        resume_from = (curl_off_t) file_stat.st_size;
+
+                g_clear_pointer(checksum, g_free);
+                if (!fetch_binary(url, file, resume_from, FALSE, checksum_type, checksum,
+                                  progress, &error)) {
+                        g_debug("Peer %s cannot provide %s: %s", *peer, artifact->name,
+                                error->message);
+                        // error pages must not end up in the artifact
+                        if (error->domain == RHU_HAWKBIT_CLIENT_HTTP_ERROR &&
+                            truncate(file, resume_from) != 0)
+                                g_warning("Failed to truncate %s: %s", file, g_strerror(errno));
+                        if (g_error_matches(error, RHU_HAWKBIT_CLIENT_CURL_ERROR,
+                                            CURLE_ABORTED_BY_CALLBACK))
+                                break;
+                        continue;
+                }
+
+                // peers are untrusted, the checksum supplied by hawkBit decides
+                if (!g_strcmp0(expected_checksum, *checksum)) {
+                        g_message("Downloaded %s from peer %s", artifact->name, *peer);
+                        return TRUE;
+                }
+
+                g_warning("Peer %s sent %s with invalid checksum %s, discarding it", *peer,
+                          artifact->name, *checksum);
+                if (truncate(file, 0) != 0)
+                        g_warning("Failed to truncate %s: %s", file, g_strerror(errno));
+        }
+
+        g_clear_pointer(checksum, g_free);
+
+        return FALSE;
+}
+
+/**
+ * @brief Get polling sleep time from hawkBit JSON response.
+ *
+ * @param[in] root JsonNode* with hawkBit response
+ * @param[in] action HawkbitAction of the polled target
+ * @return time to sleep in seconds, either from JSON or (if not found) from config's retry_wait (or 5s during active action)
+ */
+static long json_get_sleeptime(JsonNode *root, struct HawkbitAction *action)
+{
+        g_autofree gchar *sleeptime_str = NULL;
+        g_autoptr(GError) error = NULL;
+        struct tm time;
+
+        g_return_val_if_fail(root, 0L);
+
+        /* When processing an action, return fixed sleeptime of 5s to allow
+         * receiving cancelation requests etc.*/
+        g_mutex_lock(&action->mutex);
+        if (action->state == ACTION_STATE_PROCESSING ||
+            action->state == ACTION_STATE_DOWNLOADING ||
+            action->state == ACTION_STATE_CANCEL_REQUESTED) {
+                g_mutex_unlock(&action->mutex);
+                return 5L;
+        }
+        g_mutex_unlock(&action->mutex);
+
+        sleeptime_str = json_get_string(root, "$.config.polling.sleep", &error);
+        if (!sleeptime_str) {
+                g_warning("Polling sleep time not found: %s. Using fallback: %ds",
+                          error->message, hawkbit_config->retry_wait);
+                return hawkbit_config->retry_wait;
+        }
+
+        strptime(sleeptime_str, "%T", &time);
+        return (time.tm_sec + (time.tm_min * 60) + (time.tm_hour * 60 * 60));
+}
+
+/**
+ * @brief Build API URL for given controller id.
+ *
+ * @param server[in]        hawkBit server or NULL for the selected one
+ * @param controller_id[in] hawkBit controller id
+ * @param path[in]          a printf()-like format string describing the API path or NULL for base
+ *                          path
+ * @param args[in]          The arguments to be inserted in path
+ *
+ * @return a newly allocated full API URL
+ */
+__attribute__((__format__(__printf__, 3, 0)))
+static gchar* build_controller_api_url(const gchar *server, const gchar *controller_id,
+                                       const gchar *path, va_list args)
+{
+        g_autofree gchar *current = server ? NULL : endpoints_get_current();
         g_autofree gchar *buffer = NULL;
-        va_list args;
 
-        if (path) {
-                va_start(args, path);
+        if (path)
                 buffer = g_strdup_vprintf(path, args);
-                va_end(args);
-        }
 
         return g_strdup_printf(
                 "%s://%s/%s/controller/v1/%s%s%s",
                 hawkbit_config->ssl ? "https" : "http",
-                hawkbit_config->hawkbit_server, hawkbit_config->tenant_id,
-                hawkbit_config->controller_id,
+                server ? server : current, hawkbit_config->tenant_id,
+                controller_id,
                 buffer ? "/" : "",
                 buffer ? buffer : "");
 }
 
+__attribute__((__format__(__printf__, 1, 2)))
+gchar* build_api_url(const gchar *path, ...)
+{
+        gchar *url = NULL;
+        va_list args;
+
+        va_start(args, path);
+        url = build_controller_api_url(NULL, active_target
+                                       ? active_target->controller_id
+                                       : hawkbit_config->controller_id, path, args);
+        va_end(args);
+
+        return url;
+}
+
+/**
+ * @brief Build API URL for given target.
+ *
+ * @param target[in] HawkbitTarget to build URL for
+ * @param server[in] hawkBit server or NULL for the selected one
+ * @param path[in]   a printf()-like format string describing the API path or NULL for base path
+ * @param ... The arguments to be inserted in path
+ *
+ * @return a newly allocated full API URL
+ */
+__attribute__((__format__(__printf__, 3, 4)))
+static gchar* build_target_api_url(const struct HawkbitTarget *target, const gchar *server,
+                                   const gchar *path, ...)
+{
+        gchar *url = NULL;
+        va_list args;
+
+        g_return_val_if_fail(target, NULL);
+
+        va_start(args, path);
+        url = build_controller_api_url(server, target->controller_id, path, args);
+        va_end(args);
+
+        return url;
+}
+
+/**
+ * @brief Set id of active action and build its feedback URL once for all feedback sent during the
+ *        action. Must be called under locked active_action->mutex.
+ *
+ * @param[in] id hawkBit action id to take ownership of or NULL
+ */
+static void action_set_id(gchar *id)
+{
+        g_free(active_action->id);
+        g_free(active_action->feedback_url);
+        active_action->id = id;
+        active_action->feedback_url = id ? build_api_url("deploymentBase/%s/feedback", id) : NULL;
+}
+
 
 
 static void hawkbit_artifacts(const gchar *device)
@@ -756,7 +1424,6 @@ static void hawkbit_artifacts(const gchar *device)
 
 gboolean hawkbit_progress(const gchar *msg)
 {
-        g_autofree gchar *feedback_url = NULL;
         g_autoptr(GError) error = NULL;
 
         g_return_val_if_fail(msg, FALSE);
@@ -764,9 +1431,7 @@ gboolean hawkbit_progress(const gchar *msg)
         g_mutex_lock(&active_action->mutex);
         g_debug("HAWKBIT_PROGRESS_INSIDE_MUTEX");
 
-        feedback_url = build_api_url("deploymentBase/%s/feedback", active_action->id);
-
-        if (!feedback_progress(feedback_url, active_action->id, msg, &error))
+        if (!feedback_progress(active_action->feedback_url, active_action->id, msg, &error))
                 g_warning("%s", error->message);
 
         g_mutex_unlock(&active_action->mutex);
@@ -781,23 +1446,36 @@ gboolean hawkbit_progress(const gchar *msg)
  *
  * @see https://www.eclipse.org/hawkbit/rest-api/rootcontroller-api-guide/#_put_tenant_controller_v1_controllerid_configdata
  *
- * @param[out] error Error
+ * @param[in]  target HawkbitTarget to identify
+ * @param[out] error  Error
  * @return TRUE if identification succeeded, FALSE otherwise (error set)
  */
-static gboolean identify(GError **error)
+static gboolean identify(const struct HawkbitTarget *target, GError **error)
 {
         g_autofree gchar *put_config_data_url = NULL;
+        g_autofree gchar *body = NULL;
         g_autoptr(JsonBuilder) builder = NULL;
+        g_autoptr(GHashTable) gateway_attributes = NULL;
 
+        g_return_val_if_fail(target, FALSE);
         g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-        g_debug("Providing meta information to hawkbit server");
-        put_config_data_url = build_api_url("configData");
-        add_devices_to_config(hawkbit_config->device);
+        g_debug("Providing meta information of %s to hawkbit server", target->controller_id);
+        put_config_data_url = build_target_api_url(target, NULL, "configData");
 
-        builder = json_build_status(NULL, NULL, "success", "closed", hawkbit_config->device);
+        // targets served in gateway mode only announce the gateway they are reachable through
+        if (target != g_ptr_array_index(hawkbit_targets, 0)) {
+                gateway_attributes = g_hash_table_new(g_str_hash, g_str_equal);
+                g_hash_table_insert(gateway_attributes, "gateway", hawkbit_config->controller_id);
+                builder = json_build_status(NULL, NULL, "success", "closed", gateway_attributes);
+        } else {
+                add_devices_to_config(hawkbit_config->device);
+                builder = json_build_status(NULL, NULL, "success", "closed",
+                                            hawkbit_config->device);
+        }
 
-        return rest_request_retriable(PUT, put_config_data_url, builder, NULL, error);
+        body = json_builder_to_data(builder);
+        return rest_request_retriable(PUT, put_config_data_url, body, NULL, error);
 }
 
 /**
@@ -805,6 +1483,9 @@ static gboolean identify(GError **error)
  */
 void process_deployment_cleanup()
 {
+        active_action->prefetched = FALSE;
+        fw_discard_prefetched();
+
         if (!hawkbit_config->bundle_download_location)
                 return;
 
@@ -820,16 +1501,14 @@ gboolean install_complete_cb(gpointer ptr)
         gboolean res = FALSE;
         g_autoptr(GError) error = NULL;
         struct on_install_complete_userdata *result = ptr;
-        g_autofree gchar *feedback_url = NULL;
 
         g_return_val_if_fail(ptr, FALSE);
         g_debug("Installing done");
         g_mutex_lock(&active_action->mutex);
 
         active_action->state = result->install_success ? ACTION_STATE_SUCCESS : ACTION_STATE_ERROR;
-        feedback_url = build_api_url("deploymentBase/%s/feedback", active_action->id);
         res = feedback(
-                feedback_url, active_action->id,
+                active_action->feedback_url, active_action->id,
                 result->install_success ? "Software bundle installed successfully."
                 : "Failed to install software bundle.",
                 result->install_success ? "success" : "failure",
@@ -855,12 +1534,11 @@ gboolean install_complete_cb(gpointer ptr)
  * feedback and call software_ready_cb() callback on success.
  *
  * @param[in] data Artifact* to process
- * @return gpointer being 1 (TRUE) if download succeeded, 0 (FALSE) otherwise. The return value is
- *         meant to be used with the GPOINTER_TO_INT() macro only.
+ * @return TRUE if download succeeded, FALSE otherwise.
  *         Note that if the download thread waited for installation to finish ('run_once' mode),
  *         TRUE means both installation and download succeeded.
  */
-static gpointer download_thread(gpointer data)
+static gboolean download_thread(gpointer data)
 {
         struct on_new_software_userdata userdata = {
                 .install_progress_callback = (GSourceFunc) hawkbit_progress,
@@ -871,38 +1549,69 @@ static gpointer download_thread(gpointer data)
                 .install_success = FALSE,
         };
         g_autoptr(GError) error = NULL, feedback_error = NULL;
-        g_autofree gchar *msg = NULL, *sha1sum = NULL;
+        g_autofree gchar *msg = NULL, *checksum = NULL;
         g_autoptr(Artifact) artifact = data;
-        curl_off_t speed;
+        g_autoptr(DownloadSources) sources = NULL;
+        GChecksumType checksum_type;
+        const gchar *expected_checksum = NULL;
+        DownloadProgress progress;
+        gboolean peer_hit, prefetched;
+        GStatBuf bundle_stat;
 
-        g_return_val_if_fail(data, NULL);
+        g_return_val_if_fail(data, FALSE);
 
         g_assert_nonnull(hawkbit_config->bundle_download_location);
 
+        // verify against the strongest hash supplied by the server
+        expected_checksum = artifact_get_checksum(artifact, &checksum_type);
+
         g_mutex_lock(&active_action->mutex);
         if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
                 goto cancel;
 
         active_action->state = ACTION_STATE_DOWNLOADING;
+        // verified while waiting for the maintenance window, only installation is left
+        prefetched = active_action->prefetched &&
+                     g_stat(hawkbit_config->bundle_download_location, &bundle_stat) == 0 &&
+                     bundle_stat.st_size == artifact->size;
+        active_action->prefetched = FALSE;
         g_mutex_unlock(&active_action->mutex);
 
+        if (prefetched) {
+                g_message("Installing prefetched %s", artifact->name);
+                goto install;
+        }
+
         g_message("Start downloading: %s", artifact->download_url);
+        download_progress_init(&progress, artifact);
+        sources = download_sources_new(artifact->download_url, hawkbit_config->download_mirrors,
+                                       !hawkbit_config->ssl);
 
-        while (1) {
+        // prefer peers sharing the artifact, falling back to hawkBit
+        peer_hit = get_binary_from_peers(artifact, hawkbit_config->bundle_download_location,
+                                         &checksum, &progress);
+
+        while (!peer_hit) {
                 gboolean resumable = FALSE;
-                GStatBuf bundle_stat;
                 curl_off_t resume_from = 0;
 
-                g_clear_pointer(&sha1sum, g_free);
+                g_clear_pointer(&checksum, g_free);
 
                 // Download software bundle (artifact)
                 if (g_stat(hawkbit_config->bundle_download_location, &bundle_stat) == 0)
                         resume_from = (curl_off_t) bundle_stat.st_size;
+                state_file_set_downloaded(artifact, resume_from);
 
-                if (get_binary(artifact->download_url, hawkbit_config->bundle_download_location,
-                               resume_from, &sha1sum, &speed, &error))
+                if (get_binary(sources, hawkbit_config->bundle_download_location, resume_from,
+                               checksum_type, &checksum, &progress, &error))
                         break;
 
+                if (g_error_matches(error, RHU_HAWKBIT_CLIENT_CURL_ERROR,
+                                    CURLE_ABORTED_BY_CALLBACK)) {
+                        g_mutex_lock(&active_action->mutex);
+                        goto cancel;
+                }
+
                 for (const gint *code = &resumable_codes[0]; *code; code++)
                         resumable |= g_error_matches(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, *code);
 
@@ -925,42 +1634,50 @@ static gpointer download_thread(gpointer data)
 
         // notify hawkbit that download is complete
         msg = g_strdup_printf("Download complete. %.2f MB/s",
-                              (double)speed/(1024*1024));
-        g_mutex_lock(&active_action->mutex);
+                              (double)download_progress_get_speed(&progress)/(1024*1024));
+        // the action does not change while downloading, the feedback request must not hold the
+        // action mutex the main loop waits for (workers may run at idle priority)
         if (!feedback_progress(artifact->feedback_url, active_action->id, msg, &error)) {
                 g_warning("%s", error->message);
                 g_clear_error(&error);
         }
-        g_mutex_unlock(&active_action->mutex);
 
         // validate checksum
-        if (g_strcmp0(artifact->sha1, sha1sum)) {
+        if (g_strcmp0(expected_checksum, checksum)) {
                 g_set_error(&error, RHU_HAWKBIT_CLIENT_ERROR, RHU_HAWKBIT_CLIENT_ERROR_DOWNLOAD,
-                            "Software: %s V%s. Invalid checksum: %s expected %s", artifact->name,
-                            artifact->version, sha1sum, artifact->sha1);
+                            "Software: %s V%s. Invalid %s checksum: %s expected %s",
+                            artifact->name, artifact->version,
+                            digest_type_to_string(digest_type_from_checksum_type(checksum_type)),
+                            checksum, expected_checksum);
                 goto report_err;
         }
 
-        g_mutex_lock(&active_action->mutex);
         if (!feedback_progress(artifact->feedback_url, active_action->id, "File checksum OK.",
                                &error)) {
                 g_warning("%s", error->message);
                 g_clear_error(&error);
         }
-        g_mutex_unlock(&active_action->mutex);
 
+        peer_server_add(active_action->id, artifact, hawkbit_config->bundle_download_location);
+
+install:
         // last chance to cancel installation
 
         g_mutex_lock(&active_action->mutex);
         if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
                 goto cancel;
 
-        // skip installation if hawkBit asked us to do so
+        // skip installation if hawkBit asked us to do so, install once it allows to
         if (!artifact->do_install) {
                 active_action->state = ACTION_STATE_NONE;
+                active_action->prefetched = TRUE;
                 g_mutex_unlock(&active_action->mutex);
+                g_message("Prefetched %s, waiting for hawkBit to allow installation",
+                          artifact->name);
 
-                return GINT_TO_POINTER(TRUE);
+                // downloaded bundle is picked up by the next deployment poll, not on restart
+                state_file_clear();
+                return TRUE;
         }
 
         // start installation, cancelations are impossible now
@@ -968,9 +1685,12 @@ static gpointer download_thread(gpointer data)
         g_cond_signal(&active_action->cond);
         g_mutex_unlock(&active_action->mutex);
 
+        state_file_set_downloaded(artifact, artifact->size);
+        state_file_set_phase(STATE_PHASE_INSTALLING);
+
         software_ready_cb(&userdata);
 
-        return GINT_TO_POINTER(userdata.install_success);
+        return userdata.install_success;
 
 report_err:
         g_mutex_lock(&active_action->mutex);
@@ -981,54 +1701,295 @@ report_err:
         active_action->state = ACTION_STATE_ERROR;
 
 cancel:
-        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
+        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
                 active_action->state = ACTION_STATE_CANCELED;
+                process_cancel_complete();
+        }
 
         process_deployment_cleanup();
 
         g_cond_signal(&active_action->cond);
         g_mutex_unlock(&active_action->mutex);
 
-        return GINT_TO_POINTER(FALSE);
+        return FALSE;
 }
 
 /**
- * @brief Start a RAUC HTTP streaming installation without prior bundle download.
- *        This skips the download thread and starts the install thread (via rauc_install()
- *        directly).
- *        Must be called under locked active_action->mutex.
+ * @brief Poll the target which prefetched its deployment on the next tick, as its maintenance
+ *        window opened.
  *
- * @param[in]  artifcat Artifact* to install
- * @param[out] error    Error
- * @return TRUE if installation prcessing succeeded, FALSE otherwise (error set).
- *         Note that this functions returns TRUE even for canceled/skipped installations.
+ * @param[in] data HawkbitTarget active when the poll was scheduled
  */
-static gboolean start_streaming_installation(Artifact *artifact, GError **error)
+static gboolean maintenance_window_cb(gpointer data)
 {
-        g_autofree gchar *auth_header = get_auth_header();
-        struct on_new_software_userdata userdata = {
-                .install_progress_callback = (GSourceFunc) hawkbit_progress,
-                .install_complete_callback = install_complete_cb,
-                .file = artifact->download_url,
-                .auth_header = auth_header,
-                .ssl_verify = hawkbit_config->ssl_verify,
-                .install_success = FALSE,
-        };
+        struct HawkbitTarget *target = data;
 
-        // installation might already be canceled
-        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
-                active_action->state = ACTION_STATE_CANCELED;
-                g_cond_signal(&active_action->cond);
-                return TRUE;
-        }
+        g_message("Maintenance window opened, checking deployment");
+        target->last_run_sec = target->interval_check_sec;
 
-        // skip installation if hawkBit asked us to do so
-        if (!artifact->do_install) {
-                active_action->state = ACTION_STATE_NONE;
-                return TRUE;
-        }
+        g_clear_pointer(&maintenance_source, g_source_unref);
+        return G_SOURCE_REMOVE;
+}
 
-        active_action->state = ACTION_STATE_INSTALLING;
+/**
+ * @brief Schedule a poll for the next opening of the maintenance window configured locally, so a
+ *        prefetched bundle is installed right away instead of at the next regular poll, which
+ *        may be hours later. hawkBit still decides whether installation is allowed.
+ *        Must be called from the main loop.
+ */
+static void schedule_maintenance_poll(void)
+{
+        g_autoptr(GDateTime) now = NULL, start = NULL;
+        g_autofree gchar *start_str = NULL;
+        gint window_start = hawkbit_config->maintenance_window_start;
+
+        if (window_start < 0 || maintenance_source)
+                return;
+
+        now = g_date_time_new_now_local();
+        start = g_date_time_new_local(g_date_time_get_year(now), g_date_time_get_month(now),
+                                      g_date_time_get_day_of_month(now), window_start / 3600,
+                                      window_start / 60 % 60, window_start % 60);
+        if (start && g_date_time_compare(start, now) <= 0) {
+                GDateTime *tomorrow = g_date_time_add_days(start, 1);
+
+                g_date_time_unref(start);
+                start = tomorrow;
+        }
+        // start skipped by daylight saving time, fall back to regular polls
+        if (!start)
+                return;
+
+        start_str = g_date_time_format(start, "%F %T");
+        g_message("Installing once the maintenance window opens at %s", start_str);
+
+        maintenance_source = g_timeout_source_new_seconds(
+                g_date_time_difference(start, now) / G_USEC_PER_SEC + MAINTENANCE_WINDOW_DELAY);
+        g_source_set_name(maintenance_source, "maintenance-window");
+        loop_monitor_source_set_callback(maintenance_source, maintenance_window_cb,
+                                         active_target);
+        g_source_attach(maintenance_source, main_context);
+}
+
+/**
+ * @brief Make target the owner of the active action, so deployment processing, feedback and
+ * installation callbacks refer to it. Switching is only possible while no deployment of another
+ * target is in progress, since download location and RAUC are shared.
+ *
+ * @param[in] target HawkbitTarget to activate
+ * @return TRUE if target is active now, FALSE if another target is busy
+ */
+static gboolean activate_target(struct HawkbitTarget *target)
+{
+        struct HawkbitAction *action = active_action;
+        gboolean busy;
+
+        if (target == active_target)
+                return TRUE;
+
+        g_mutex_lock(&action->mutex);
+        busy = action->state >= ACTION_STATE_PROCESSING;
+        if (!busy) {
+                active_target = target;
+                active_action = target->action;
+        }
+        g_mutex_unlock(&action->mutex);
+
+        if (busy)
+                g_message("Deferring action of %s, deployment of %s in progress.",
+                          target->controller_id, active_target->controller_id);
+
+        return !busy;
+}
+
+/**
+ * @brief Find the target owning action.
+ *
+ * @param[in] action HawkbitAction of a target
+ * @return HawkbitTarget owning action, NULL if none
+ */
+static struct HawkbitTarget* target_of_action(struct HawkbitAction *action)
+{
+        for (guint i = 0; i < hawkbit_targets->len; i++) {
+                struct HawkbitTarget *target = g_ptr_array_index(hawkbit_targets, i);
+
+                if (target->action == action)
+                        return target;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Stop flashing offline or unreachable devices again and finish their deployment.
+ *        The deployment's target must be active.
+ *
+ * @param[in] canceled whether the action was canceled
+ */
+static void flash_retries_stop(gboolean canceled)
+{
+        download_result = fw_flash_retries_finish(canceled);
+
+        g_source_destroy(flash_retry_source);
+        g_clear_pointer(&flash_retry_source, g_source_unref);
+}
+
+/**
+ * @brief Check whether deployments of target wait for devices of another target's deployment to
+ *        be flashed again, as the state file only persists a single action.
+ *
+ * @param[in] target HawkbitTarget offering a deployment
+ * @return TRUE if the deployment is deferred, FALSE otherwise
+ */
+static gboolean flash_retries_defer(struct HawkbitTarget *target)
+{
+        struct HawkbitAction *action = fw_flash_retries_action();
+
+        if (!action || action == target->action)
+                return FALSE;
+
+        g_message("Deferring action of %s, flashing devices of %s again.", target->controller_id,
+                  target_of_action(action)->controller_id);
+        return TRUE;
+}
+
+/**
+ * @brief WorkerDoneFunc of flash retry workers, finishes the deployment once no devices are left,
+ *        flash_retry_timeout expired or the action was canceled meanwhile.
+ */
+static void flash_retry_done(gboolean result, gpointer user_data)
+{
+        gboolean canceled;
+
+        g_mutex_lock(&active_action->mutex);
+        canceled = active_action->state == ACTION_STATE_CANCEL_REQUESTED;
+        if (!canceled)
+                active_action->state = ACTION_STATE_NONE;
+        g_mutex_unlock(&active_action->mutex);
+
+        if (canceled || !result)
+                flash_retries_stop(canceled);
+}
+
+/**
+ * @brief Flash offline or unreachable devices again once they are due. The deployment's action
+ *        is idle in between, so other targets are polled and configuration reloads are applied
+ *        meanwhile.
+ */
+static gboolean flash_retry_cb(gpointer data)
+{
+        struct HawkbitTarget *target = target_of_action(fw_flash_retries_action());
+        gboolean canceled;
+
+        if (worker_count() || !activate_target(target))
+                return G_SOURCE_CONTINUE;
+
+        g_mutex_lock(&active_action->mutex);
+        canceled = active_action->state == ACTION_STATE_CANCEL_REQUESTED;
+        g_mutex_unlock(&active_action->mutex);
+
+        if (canceled) {
+                flash_retries_stop(TRUE);
+                return G_SOURCE_REMOVE;
+        }
+
+        if (!fw_flash_retries_due())
+                return G_SOURCE_CONTINUE;
+
+        g_mutex_lock(&active_action->mutex);
+        active_action->state = ACTION_STATE_INSTALLING;
+        g_mutex_unlock(&active_action->mutex);
+
+        worker_start(main_context, "flash-retry", fw_flash_retries_run, NULL, flash_retry_done,
+                     NULL);
+
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Check every second whether offline or unreachable devices are due to be flashed again.
+ *        Must be called with the deployment's target active.
+ */
+static void schedule_flash_retries(void)
+{
+        g_mutex_lock(&active_action->mutex);
+        if (active_action->state != ACTION_STATE_CANCEL_REQUESTED)
+                active_action->state = ACTION_STATE_NONE;
+        g_mutex_unlock(&active_action->mutex);
+
+        flash_retry_source = g_timeout_source_new_seconds(1);
+        g_source_set_name(flash_retry_source, "flash-retry");
+        loop_monitor_source_set_callback(flash_retry_source, flash_retry_cb, NULL);
+        g_source_attach(flash_retry_source, main_context);
+}
+
+/**
+ * @brief WorkerDoneFunc of download workers, remembers the result for run_once mode and schedules
+ *        the installation of prefetched bundles.
+ */
+static void download_worker_done(gboolean result, gpointer user_data)
+{
+        gboolean prefetched;
+
+        download_result = result;
+
+        if (fw_flash_retries_action() == active_action) {
+                schedule_flash_retries();
+                return;
+        }
+
+        g_mutex_lock(&active_action->mutex);
+        prefetched = active_action->prefetched;
+        g_mutex_unlock(&active_action->mutex);
+
+        if (prefetched && !run_once)
+                schedule_maintenance_poll();
+}
+
+void start_download_worker(WorkerFunc func, gpointer data)
+{
+        g_return_if_fail(func);
+
+        worker_start(main_context, "downloader", func, data, download_worker_done, NULL);
+}
+
+/**
+ * @brief Start a RAUC HTTP streaming installation without prior bundle download.
+ *        This skips the download thread and starts the install thread (via rauc_install()
+ *        directly).
+ *        Must be called under locked active_action->mutex.
+ *
+ * @param[in]  artifcat Artifact* to install
+ * @param[out] error    Error
+ * @return TRUE if installation prcessing succeeded, FALSE otherwise (error set).
+ *         Note that this functions returns TRUE even for canceled/skipped installations.
+ */
+static gboolean start_streaming_installation(Artifact *artifact, GError **error)
+{
+        g_autofree gchar *auth_header = get_auth_header();
+        struct on_new_software_userdata userdata = {
+                .install_progress_callback = (GSourceFunc) hawkbit_progress,
+                .install_complete_callback = install_complete_cb,
+                .file = artifact->download_url,
+                .auth_header = auth_header,
+                .ssl_verify = hawkbit_config->ssl_verify,
+                .install_success = FALSE,
+        };
+
+        // installation might already be canceled
+        if (active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
+                active_action->state = ACTION_STATE_CANCELED;
+                g_cond_signal(&active_action->cond);
+                return TRUE;
+        }
+
+        // skip installation if hawkBit asked us to do so
+        if (!artifact->do_install) {
+                active_action->state = ACTION_STATE_NONE;
+                return TRUE;
+        }
+
+        active_action->state = ACTION_STATE_INSTALLING;
         g_cond_signal(&active_action->cond);
         g_mutex_unlock(&active_action->mutex);
 
@@ -1079,7 +2040,15 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
                 return FALSE;
         }
 
+        // hawkBit offers the action until devices offline or unreachable are flashed again
+        if (fw_flash_retries_action() == active_action) {
+                g_debug("Deployment %s is flashing offline or unreachable devices again.",
+                        active_action->id);
+                return TRUE;
+        }
+
         active_action->state = ACTION_STATE_PROCESSING;
+        g_atomic_int_set(&active_action->cancel_requested, FALSE);
 
         // get deployment URL multiple definition of `hawkbit_confi
         deployment = json_get_string(req_root, "$._links.deploymentBase.href", error);
@@ -1127,6 +2096,8 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
         if (!artifact->do_install && !g_strcmp0(temp_id, active_action->id)) {
                 g_debug("Deployment %s is still waiting%s.", active_action->id, maintenance_msg);
                 active_action->state = ACTION_STATE_NONE;
+                if (active_action->prefetched)
+                        schedule_maintenance_poll();
                 return TRUE;
         }
 
@@ -1137,12 +2108,13 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
                 g_debug("Continuing scheduled deployment %s%s.", active_action->id,
                         maintenance_msg);
 
-        g_free(active_action->id);
-        active_action->id = g_steal_pointer(&temp_id);
+        action_set_id(g_steal_pointer(&temp_id));
         if (!active_action->id)
                 goto error;
 
-        artifact->feedback_url = build_api_url("deploymentBase/%s/feedback", active_action->id);
+        state_file_begin(active_target->controller_id, active_action->id);
+
+        artifact->feedback_url = g_strdup(active_action->feedback_url);
 
         // downloading multiple chunks not supported, only first chunk is downloaded (RAUC bundle)
         json_chunks = json_get_array(resp_root, "$.deployment.chunks", error);
@@ -1150,7 +2122,9 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
                 goto proc_error;
         //if length>1 we know its our fw repository     
         if (json_array_get_length(json_chunks) > 1) {
-                parse_fw(json_chunks,artifact->feedback_url,forced);
+                if (!parse_fw(json_chunks, artifact->feedback_url, forced, artifact->do_install,
+                              error))
+                        goto proc_error;
                 goto ret;
         }
 
@@ -1164,7 +2138,9 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
 
         if (g_strcmp0(part,"bApp") == 0)
         { 
-                parse_fw(json_chunks,artifact->feedback_url,forced);
+                if (!parse_fw(json_chunks, artifact->feedback_url, forced, artifact->do_install,
+                              error))
+                        goto proc_error;
         }
         else 
         {
@@ -1185,6 +2161,10 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
                 if (!artifact->sha1)
                         goto proc_error;
 
+                // optional, older hawkBit versions do not provide sha256
+                artifact->sha256 = json_get_string(json_artifact, "$.hashes.sha256", NULL);
+                artifact->md5 = json_get_string(json_artifact, "$.hashes.md5", NULL);
+
                 // favour https download
                 artifact->download_url = json_get_string(json_artifact, "$._links.download.href", NULL);
                 if (!artifact->download_url)
@@ -1215,13 +2195,10 @@ static gboolean process_deployment(JsonNode *req_root, GError **error)
                         goto proc_error;
                 }
 
-                // unref/free previous download thread by joining it
-                if (thread_download)
-                        g_thread_join(thread_download);
+                state_file_set_artifacts(FALSE, &(GList) { .data = artifact });
 
-                // start download thread
-                thread_download = g_thread_new("downloader", download_thread,
-                                        (gpointer) g_steal_pointer(&artifact));
+                // only enqueue the download, the worker reports back to the main loop
+                start_download_worker(download_thread, g_steal_pointer(&artifact));
         } 
 ret:
         return TRUE;
@@ -1238,16 +2215,66 @@ error:
 }
 
 /**
- * @brief Process hawkBit cancel action described by req_root.
+ * @brief Acknowledge cancelation stop_id to hawkBit depending on the state of the active action.
+ *        Must be called under locked active_action->mutex.
+ *
+ * @param[in]  stop_id hawkBit action ID to cancel
+ * @param[out] error   Error
+ * @return TRUE if cancelation was acknowledged (or needs no feedback), FALSE otherwise (error set)
+ */
+static gboolean cancel_feedback(const gchar *stop_id, GError **error)
+{
+        g_autofree gchar *feedback_url = build_api_url("cancelAction/%s/feedback", stop_id);
+        g_autofree gchar *msg = NULL;
+        gboolean res = TRUE;
+
+        switch (active_action->state) {
+        case ACTION_STATE_NONE:
+                // action unknown, acknowledge cancelation nonetheless
+                g_debug("Received cancelation for unprocessed action %s, acknowledging.",
+                        stop_id);
+        // fall through
+        case ACTION_STATE_CANCELED:
+                res = feedback(feedback_url, stop_id, "Action canceled.", "success", "closed",
+                               error);
+                break;
+        case ACTION_STATE_SUCCESS:
+                g_debug("Cancelation impossible, installation succeeded already");
+                break;
+        case ACTION_STATE_ERROR:
+                g_debug("Cancelation impossible, installation failed already");
+                break;
+        case ACTION_STATE_INSTALLING:
+                msg = g_strdup("Cancelation impossible, installation started already.");
+                res = feedback(feedback_url, stop_id, msg, "success", "rejected", error);
+                if (res) {
+                        res = FALSE;
+                        g_set_error(error, RHU_HAWKBIT_CLIENT_ERROR,
+                                    RHU_HAWKBIT_CLIENT_ERROR_CANCELATION, "%s", msg);
+                }
+                break;
+        default:
+                // other states are not expected here
+                g_critical("Unexpected action state after cancel request: %d", active_action->state);
+                g_assert_not_reached();
+                break;
+        }
+
+        return res;
+}
+
+/**
+ * @brief Process hawkBit cancel action described by req_root. Does not wait for a running download
+ *        to stop, the cancelation is acknowledged by cancel_complete_cb() in that case.
  *
  * @param[in]  req_root JsonNode* describing the cancel action
  * @param[out] error    Error
- * @return TRUE if cancel action succeeded, FALSE otherwise (error set)
+ * @return TRUE if cancel action succeeded (or is in progress), FALSE otherwise (error set)
  */
 static gboolean process_cancel(JsonNode *req_root, GError **error)
 {
         gboolean res = TRUE;
-        g_autofree gchar *cancel_url = NULL, *feedback_url = NULL, *stop_id = NULL, *msg = NULL;
+        g_autofree gchar *cancel_url = NULL, *stop_id = NULL;
         g_autoptr(JsonParser) json_response_parser = NULL;
         JsonNode *resp_root = NULL;
 
@@ -1272,109 +2299,355 @@ static gboolean process_cancel(JsonNode *req_root, GError **error)
 
         g_message("Received cancelation for action %s", stop_id);
 
-        // send cancel feedback
-        feedback_url = build_api_url("cancelAction/%s/feedback", stop_id);
-
-        // cancel action if install not started yet
         g_mutex_lock(&active_action->mutex);
+        if (!g_strcmp0(stop_id, active_action->id) &&
+            active_action->state == ACTION_STATE_CANCEL_REQUESTED) {
+                g_debug("Cancelation of action %s is in progress already", stop_id);
+                goto out;
+        }
+
+        // cancel action if install not started yet or while flashing offline devices again
         if (!g_strcmp0(stop_id, active_action->id) &&
             (active_action->state == ACTION_STATE_PROCESSING ||
-             active_action->state == ACTION_STATE_DOWNLOADING)) {
+             active_action->state == ACTION_STATE_DOWNLOADING ||
+             fw_flash_retries_action() == active_action)) {
 
-                g_debug("Action %s is in state %d, waiting for cancel request to be processed",
+                // download thread aborts its transfer and acknowledges via process_cancel_complete()
+                g_debug("Action %s is in state %d, requesting download thread to cancel",
                         stop_id, active_action->state);
                 active_action->state = ACTION_STATE_CANCEL_REQUESTED;
-
-                while (active_action->state == ACTION_STATE_CANCEL_REQUESTED)
-                        g_cond_wait(&active_action->cond, &active_action->mutex);
+                g_free(active_action->cancel_id);
+                active_action->cancel_id = g_steal_pointer(&stop_id);
+                g_atomic_int_set(&active_action->cancel_requested, TRUE);
+                goto out;
         }
         if (g_strcmp0(stop_id, active_action->id))
                 active_action->state = ACTION_STATE_NONE;
 
-        // send feedback
-        switch (active_action->state) {
-        case ACTION_STATE_NONE:
-                // action unknown, acknowledge cancelation nonetheless
-                g_debug("Received cancelation for unprocessed action %s, acknowledging.",
-                        stop_id);
-        // fall through
-        case ACTION_STATE_CANCELED:
-                res = feedback(feedback_url, stop_id, "Action canceled.", "success", "closed",
-                               error);
-                break;
-        case ACTION_STATE_SUCCESS:
-                g_debug("Cancelation impossible, installation succeeded already");
-                break;
-        case ACTION_STATE_ERROR:
-                g_debug("Cancelation impossible, installation failed already");
-                break;
-        case ACTION_STATE_INSTALLING:
-                msg = g_strdup("Cancelation impossible, installation started already.");
-                res = feedback(feedback_url, stop_id, msg, "success", "rejected", error);
-                if (res) {
-                        res = FALSE;
-                        g_set_error(error, RHU_HAWKBIT_CLIENT_ERROR,
-                                    RHU_HAWKBIT_CLIENT_ERROR_CANCELATION, "%s", msg);
-                }
-                break;
-        default:
-                // other states are not expected here
-                g_critical("Unexpected action state after cancel request: %d", active_action->state);
-                g_assert_not_reached();
-                break;
-        }
+        res = cancel_feedback(stop_id, error);
 
+out:
         g_mutex_unlock(&active_action->mutex);
         return res;
 }
 
+/**
+ * @brief Acknowledge cancelation requested for the active action once its download thread
+ *        stopped. Does nothing if no cancelation is pending.
+ *
+ * @param[in] data unused
+ * @return G_SOURCE_REMOVE is always returned
+ */
+static gboolean cancel_complete_cb(gpointer data)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *stop_id = NULL;
+
+        g_mutex_lock(&active_action->mutex);
+        stop_id = g_steal_pointer(&active_action->cancel_id);
+        g_atomic_int_set(&active_action->cancel_requested, FALSE);
+        if (stop_id && !cancel_feedback(stop_id, &error))
+                g_warning("%s", error->message);
+        g_mutex_unlock(&active_action->mutex);
+
+        return G_SOURCE_REMOVE;
+}
+
+void process_cancel_complete(void)
+{
+        if (active_action->cancel_id)
+                loop_monitor_invoke(main_context, "cancel-complete", cancel_complete_cb, NULL);
+}
+
 void hawkbit_init(Config *config, GSourceFunc on_install_ready)
 {
         g_return_if_fail(config);
 
         hawkbit_config = config;
+        initial_config = config;
         software_ready_cb = on_install_ready;
+        endpoints_init(config->hawkbit_servers);
+        state_file_init(config->state_file);
         curl_global_init(CURL_GLOBAL_ALL);
+        curl_share = curl_share_new();
 }
 
 typedef struct ClientData_ {
         GMainLoop *loop;
         gboolean res;
-        long hawkbit_interval_check_sec;
-        long last_run_sec;
+        guint pending_polls;          /**< targets not polled yet (run_once only) */
 } ClientData;
 
 /**
- * @brief Callback for main loop, should run regularly, polls controller base poll resource and
- * triggers appropriate actions.
+ * @brief Re-send final feedback of the active action not acknowledged by hawkBit yet, e.g. because
+ *        the connection failed or the process was restarted.
  *
- * @param[in] user_data ClientData*
- * @return TRUE if polling controller base resource and running appropriate actions succeeded,
- *         FALSE otherwise
+ * @return TRUE if no feedback is pending (anymore), FALSE otherwise
  */
-static gboolean hawkbit_pull_cb(gpointer user_data)
+static gboolean send_pending_feedback(void)
+{
+        g_autoptr(SavedAction) pending = state_file_get_pending_feedback();
+        g_autoptr(GError) error = NULL;
+
+        if (!pending)
+                return TRUE;
+
+        g_message("Re-sending final feedback of action %s.", pending->id);
+        if (!feedback(pending->feedback_url, pending->id, pending->feedback_detail,
+                      pending->feedback_finished, pending->feedback_execution, &error)) {
+                g_warning("%s", error->message);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Recover the action persisted by a previous run before the first poll: re-send its
+ *        pending final feedback or resume downloading and installing its artifacts.
+ */
+static void resume_saved_action(void)
+{
+        g_autoptr(SavedAction) saved = NULL;
+        g_autoptr(GError) error = NULL;
+        struct HawkbitTarget *target = NULL;
+
+        saved = state_file_load(&error);
+        if (!saved) {
+                if (error)
+                        g_warning("%s", error->message);
+                return;
+        }
+
+        for (guint i = 0; i < hawkbit_targets->len && !target; i++) {
+                struct HawkbitTarget *candidate = g_ptr_array_index(hawkbit_targets, i);
+
+                if (!g_strcmp0(candidate->controller_id, saved->controller_id))
+                        target = candidate;
+        }
+        if (!target) {
+                g_warning("Dropping saved action %s of %s, target is not served anymore.",
+                          saved->id, saved->controller_id);
+                state_file_clear();
+                return;
+        }
+
+        active_target = target;
+        active_action = target->action;
+
+        g_mutex_lock(&active_action->mutex);
+        action_set_id(g_strdup(saved->id));
+        g_mutex_unlock(&active_action->mutex);
+
+        if (saved->phase == STATE_PHASE_FEEDBACK) {
+                send_pending_feedback();
+                return;
+        }
+
+        if (!saved->artifacts || (!saved->firmware && hawkbit_config->stream_bundle)) {
+                g_debug("Nothing to resume for action %s.", saved->id);
+                state_file_clear();
+                return;
+        }
+
+        g_message("Resuming action %s after restart (%s, last feedback: %s).", saved->id,
+                  saved->phase == STATE_PHASE_INSTALLING ? "installation interrupted" :
+                  saved->phase == STATE_PHASE_RETRYING ? "flashing offline devices" :
+                  "downloading",
+                  saved->last_feedback ? saved->last_feedback : "none");
+
+        g_mutex_lock(&active_action->mutex);
+        active_action->state = ACTION_STATE_PROCESSING;
+        g_atomic_int_set(&active_action->cancel_requested, FALSE);
+        g_mutex_unlock(&active_action->mutex);
+
+        // firmware was installed already, only devices offline back then are left to flash
+        if (saved->firmware && saved->phase == STATE_PHASE_RETRYING) {
+                fw_resume_flash_retries(saved->artifacts, saved->flash_retries, saved->flashed,
+                                        saved->failed);
+                return;
+        }
+
+        // interrupted installations start over, after verifying the downloaded artifacts again
+        state_file_set_phase(STATE_PHASE_DOWNLOADING);
+        if (saved->firmware) {
+                fw_resume_deployment(saved->artifacts);
+        } else {
+                Artifact *artifact = saved->artifacts->data;
+
+                saved->artifacts = g_list_delete_link(saved->artifacts, saved->artifacts);
+                start_download_worker(download_thread, artifact);
+        }
+}
+
+/**
+ * @brief Check whether error means the server is unavailable rather than it rejected a request.
+ *
+ * @param[in] error Error of a request or NULL
+ * @return TRUE if the server could not be reached or reported a server error, FALSE otherwise
+ */
+static gboolean is_server_error(const GError *error)
+{
+        return error && (error->domain == RHU_HAWKBIT_CLIENT_CURL_ERROR ||
+                         (error->domain == RHU_HAWKBIT_CLIENT_HTTP_ERROR && error->code >= 500));
+}
+
+/**
+ * @brief Probe server with a HEAD request of the controller base resource of the own target.
+ *
+ * @param[in]  server hawkBit server to probe
+ * @param[out] rtt    Time from sending the request until the response started [us], excluding
+ *                    connection setup
+ * @param[out] error  Error
+ * @return TRUE if the server answered the request, FALSE otherwise (error set)
+ */
+static gboolean probe_server(const gchar *server, gint64 *rtt, GError **error)
+{
+        g_autofree gchar *url = NULL;
+        const struct curl_slist *headers = NULL;
+        g_autoptr(CURL) curl = NULL;
+        gdouble pretransfer = 0, starttransfer = 0;
+        glong http_code = 0;
+        CURLcode res;
+
+        g_return_val_if_fail(server, FALSE);
+        g_return_val_if_fail(rtt, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        curl = curl_easy_init();
+        if (!curl) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, CURLE_FAILED_INIT,
+                            "Unable to start libcurl easy session");
+                return FALSE;
+        }
+
+        headers = get_request_headers(FALSE, error);
+        if (!headers)
+                return FALSE;
+
+        url = build_target_api_url(g_ptr_array_index(hawkbit_targets, 0), server, NULL);
+        set_default_curl_opts(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, hawkbit_config->timeout);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        res = curl_easy_perform(curl);
+        if (res != CURLE_OK) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_CURL_ERROR, res, "%s",
+                            curl_easy_strerror(res));
+                return FALSE;
+        }
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code != 200) {
+                g_set_error(error, RHU_HAWKBIT_CLIENT_HTTP_ERROR, http_code,
+                            "HTTP request failed: %ld", http_code);
+                return FALSE;
+        }
+
+        // connections are reused, so only the request itself is comparable between servers
+        curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+        *rtt = (starttransfer - pretransfer) * G_USEC_PER_SEC;
+
+        return TRUE;
+}
+
+/**
+ * @brief WorkerFunc probing all hawkBit servers.
+ *
+ * @param[in] data unused
+ * @return TRUE
+ */
+static gboolean probe_servers(gpointer data)
+{
+        g_auto(GStrv) servers = endpoints_get_all();
+
+        for (gchar **server = servers; *server; server++) {
+                g_autoptr(GError) error = NULL;
+                gint64 rtt = 0;
+                gboolean res;
+
+                res = probe_server(*server, &rtt, &error);
+                if (!res)
+                        g_debug("Probing hawkBit server %s failed: %s", *server, error->message);
+                endpoints_probed(*server, res, rtt);
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief WorkerDoneFunc of the probe worker, selects the best ranked server.
+ */
+static void probe_servers_done(gboolean result, gpointer user_data)
+{
+        endpoints_select();
+        probing = FALSE;
+        probe_last_sec = 0;
+}
+
+/**
+ * @brief Probe hawkBit servers every server_probe_interval seconds, if more than one is
+ *        configured. Called every second by the main loop.
+ */
+static void schedule_probes(void)
+{
+        if (probing || !hawkbit_config->server_probe_interval || endpoints_count() < 2)
+                return;
+
+        if (++probe_last_sec < hawkbit_config->server_probe_interval)
+                return;
+
+        probing = TRUE;
+        worker_start(main_context, "probe", probe_servers, NULL, probe_servers_done, NULL);
+}
+
+/**
+ * @brief Poll controller base poll resource of target and trigger appropriate actions. If the
+ *        selected hawkBit server is unavailable, the other servers are tried right away.
+ *
+ * @param[in] target HawkbitTarget to poll
+ * @return TRUE if polling controller base resource and running appropriate actions succeeded,
+ *         FALSE otherwise
+ */
+static gboolean hawkbit_poll_target(struct HawkbitTarget *target)
 {
-        ClientData *data = user_data;
         gboolean res = FALSE;
         g_autoptr(GError) error1 = NULL;
         g_autoptr(GError) error = NULL;
         g_autofree gchar *get_tasks_url = NULL;
+        g_autofree gchar *server = NULL;
         g_autoptr(JsonParser) json_response_parser = NULL;
         JsonNode *json_root = NULL;
+        gboolean gateway = hawkbit_targets->len > 1;
 
-        g_return_val_if_fail(user_data, FALSE);
+        // close the active action before hawkBit offers it again
+        if (target == active_target && !send_pending_feedback()) {
+                target->interval_check_sec = hawkbit_config->retry_wait;
+                return FALSE;
+        }
 
-        if (++data->last_run_sec < data->hawkbit_interval_check_sec)
-                return G_SOURCE_CONTINUE;
+        if (!gateway)
+                identify(target, &error1);
 
-        data->last_run_sec = 0;
-        identify(&error1);
-        // build hawkBit get tasks URL
-        get_tasks_url = build_api_url(NULL);
+        if (gateway)
+                g_message("Checking for new software for %s...", target->controller_id);
+        else
+                g_message("Checking for new software...");
+        while (1) {
+                // build hawkBit get tasks URL
+                server = endpoints_get_current();
+                get_tasks_url = build_target_api_url(target, server, NULL);
+                res = rest_request(GET, get_tasks_url, NULL, &json_response_parser, &error);
+                if (!endpoints_request_done(server, !is_server_error(error)))
+                        break;
 
-        g_message("Checking for new software...");
-        //hawkbit_artifacts(device);
-        res = rest_request(GET, get_tasks_url, NULL, &json_response_parser, &error);
+                g_debug("Polling %s failed: %s", server, error->message);
+                g_clear_pointer(&server, g_free);
+                g_clear_pointer(&get_tasks_url, g_free);
+                g_clear_error(&error);
+        }
         if (!res) {
                 if (g_error_matches(error, RHU_HAWKBIT_CLIENT_HTTP_ERROR, 401)) {
                         if (hawkbit_config->auth_token)
@@ -1386,8 +2659,8 @@ static gboolean hawkbit_pull_cb(gpointer user_data)
                                   error->message, error->code);
                 }
 
-                data->hawkbit_interval_check_sec = hawkbit_config->retry_wait;
-                goto out;
+                target->interval_check_sec = hawkbit_config->retry_wait;
+                return FALSE;
         }
 
         // owned by the JsonParser and should never be modified or freed
@@ -1395,7 +2668,7 @@ static gboolean hawkbit_pull_cb(gpointer user_data)
 
         if (json_contains(json_root, "$._links.configData")) {
                 // hawkBit has asked us to identify ourselves
-                res = identify(&error);
+                res = identify(target, &error);
                 if (!res) {
                         g_warning("%s", error->message);
                         g_clear_error(&error);
@@ -1403,39 +2676,239 @@ static gboolean hawkbit_pull_cb(gpointer user_data)
         }
         if (json_contains(json_root, "$._links.deploymentBase")) {
                 // hawkBit has a new deployment for us
-                g_mutex_lock(&active_action->mutex);
-                res = process_deployment(json_root, &error);
-                g_mutex_unlock(&active_action->mutex);
-                if (!res) {
-                        if (g_error_matches(error, RHU_HAWKBIT_CLIENT_ERROR,
-                                            RHU_HAWKBIT_CLIENT_ERROR_ALREADY_IN_PROGRESS))
-                                g_debug("%s", error->message);
-                        else
-                                g_warning("%s", error->message);
+                if (!flash_retries_defer(target) && activate_target(target)) {
+                        g_mutex_lock(&active_action->mutex);
+                        res = process_deployment(json_root, &error);
+                        g_mutex_unlock(&active_action->mutex);
+                        if (!res) {
+                                if (g_error_matches(error, RHU_HAWKBIT_CLIENT_ERROR,
+                                                    RHU_HAWKBIT_CLIENT_ERROR_ALREADY_IN_PROGRESS))
+                                        g_debug("%s", error->message);
+                                else
+                                        g_warning("%s", error->message);
+                        }
                 }
         } else {
                 g_message("No new software.");
         }
-        if (json_contains(json_root, "$._links.cancelAction")) {
+        if (json_contains(json_root, "$._links.cancelAction") && activate_target(target)) {
                 res = process_cancel(json_root, &error);
                 if (!res) {
                         g_warning("%s", error->message);
                         g_clear_error(&error);
                 }
         }
-        //hawkbit_artifacts(device);
 
         // get hawkbit sleep time (how often should we check for new software)
-        data->hawkbit_interval_check_sec = json_get_sleeptime(json_root);
+        target->interval_check_sec = json_get_sleeptime(json_root, target->action);
 
-out:
-        if (run_once) {
-                if (thread_download) {
-                        gpointer thread_ret = g_thread_join(thread_download);
-                        res = GPOINTER_TO_INT(thread_ret);
+        return res;
+}
+
+void hawkbit_set_config_file(const gchar *config_file)
+{
+        g_free(config_path);
+        config_path = g_strdup(config_file);
+}
+
+/**
+ * @brief Check whether the active action is being processed, downloaded or installed.
+ *
+ * @return TRUE if an action is in progress, FALSE otherwise
+ */
+static gboolean action_in_progress(void)
+{
+        gboolean busy;
+
+        g_mutex_lock(&active_action->mutex);
+        busy = active_action->state >= ACTION_STATE_PROCESSING;
+        g_mutex_unlock(&active_action->mutex);
+
+        return busy;
+}
+
+/**
+ * @brief Join names of settings for logging.
+ */
+static gchar* settings_join(GPtrArray *settings)
+{
+        g_ptr_array_add(settings, NULL);
+        return g_strjoinv(", ", (gchar **) settings->pdata);
+}
+
+/**
+ * @brief Make config the global config. The replaced config is kept until no worker runs
+ *        anymore, since download and install threads may still refer to it.
+ *
+ * @param[in] config Config to apply (transfer full)
+ */
+static void apply_config(Config *config)
+{
+        g_autoptr(GError) error = NULL;
+        Config *current = hawkbit_config;
+
+        g_atomic_pointer_set(&hawkbit_config, config);
+        retire_request_headers();
+        if (current != initial_config) {
+                if (!retired_configs)
+                        retired_configs = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) config_file_free);
+                g_ptr_array_add(retired_configs, current);
+        }
+
+        loop_monitor_init(config->loop_stall_threshold);
+
+        // targets served in gateway mode are only identified on request, announce new attributes
+        if (hawkbit_targets->len > 1 && !identify(g_ptr_array_index(hawkbit_targets, 0), &error))
+                g_warning("%s", error->message);
+
+        g_message("Configuration reloaded.");
+}
+
+/**
+ * @brief Reload config_path, validate it and apply it right away or, if settings an action in
+ *        progress depends on changed, once the action finished.
+ */
+static void reload_config(void)
+{
+        g_autoptr(GError) error = NULL;
+        g_autoptr(Config) config = NULL;
+        g_autoptr(GPtrArray) restart = NULL, action = NULL;
+        g_autofree gchar *settings = NULL;
+
+        g_message("Reloading configuration %s", config_path);
+        config = load_config_file(config_path, &error);
+        if (!config) {
+                g_warning("Reloading configuration failed, keeping current one: %s",
+                          error->message);
+                return;
+        }
+
+        restart = config_file_keep_restart_settings(config, hawkbit_config);
+        if (restart->len) {
+                settings = settings_join(restart);
+                g_warning("Changed settings require a restart, keeping current values: %s",
+                          settings);
+                g_clear_pointer(&settings, g_free);
+        }
+
+        action = config_file_changed_action_settings(config, hawkbit_config);
+        if (action->len && action_in_progress()) {
+                settings = settings_join(action);
+                g_message("Deferring configuration reload until action %s finished (%s changed).",
+                          active_action->id, settings);
+                g_clear_pointer(&pending_config, config_file_free);
+                pending_config = g_steal_pointer(&config);
+                return;
+        }
+
+        // a newer reload supersedes a deferred one
+        g_clear_pointer(&pending_config, config_file_free);
+        apply_config(g_steal_pointer(&config));
+}
+
+/**
+ * @brief Callback for SIGHUP, reloads config file.
+ *
+ * @param[in] data unused
+ * @return G_SOURCE_CONTINUE is always returned
+ */
+static gboolean sighup_cb(gpointer data)
+{
+        reload_config();
+
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Callback for timeout scheduled by config_file_changed_cb(), reloads config file.
+ *
+ * @param[in] data unused
+ * @return G_SOURCE_REMOVE is always returned
+ */
+static gboolean reload_config_cb(gpointer data)
+{
+        g_clear_pointer(&reload_source, g_source_unref);
+        reload_config();
+
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Callback for GFileMonitor of config file. Schedules a reload shortly after, so editors
+ *        writing the file in several steps trigger a single reload.
+ */
+static void config_file_changed_cb(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                                   GFileMonitorEvent event_type, gpointer data)
+{
+        if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+            event_type != G_FILE_MONITOR_EVENT_CREATED)
+                return;
+
+        if (reload_source)
+                return;
+
+        reload_source = g_timeout_source_new(500);
+        g_source_set_name(reload_source, "config-reload");
+        loop_monitor_source_set_callback(reload_source, reload_config_cb, NULL);
+        g_source_attach(reload_source, main_context);
+}
+
+/**
+ * @brief Callback for main loop, should run regularly, polls controller base poll resource of
+ * all targets due and triggers appropriate actions.
+ *
+ * @param[in] user_data ClientData*
+ * @return G_SOURCE_CONTINUE, or G_SOURCE_REMOVE once all targets were polled in run_once mode
+ */
+static gboolean hawkbit_pull_cb(gpointer user_data)
+{
+        ClientData *data = user_data;
+
+        g_return_val_if_fail(user_data, FALSE);
+
+        if (pending_config && !action_in_progress())
+                apply_config(g_steal_pointer(&pending_config));
+        // workers running while configs were replaced are done with them
+        if (!worker_count()) {
+                g_clear_pointer(&retired_configs, g_ptr_array_unref);
+                free_retired_request_headers();
+        }
+
+        schedule_probes();
+
+        for (guint i = 0; i < hawkbit_targets->len; i++) {
+                struct HawkbitTarget *target = g_ptr_array_index(hawkbit_targets, i);
+                gboolean res;
+
+                if (++target->last_run_sec < target->interval_check_sec)
+                        continue;
+
+                target->last_run_sec = 0;
+                res = hawkbit_poll_target(target);
+
+                if (run_once) {
+                        // overall result is the one of the own target
+                        if (i == 0)
+                                data->res = res;
+                        // poll every target exactly once
+                        target->interval_check_sec = G_MAXLONG;
+                        data->pending_polls--;
+                } else if (i == 0) {
+                        // dispatch latencies so far, at the poll interval of the own target
+                        loop_monitor_log_histogram();
                 }
+        }
+
+        if (run_once && !data->pending_polls) {
+                // downloads (and installations) started by the polls report back to this loop
+                if (worker_count() || flash_retry_source)
+                        return G_SOURCE_CONTINUE;
+                if (download_result >= 0)
+                        data->res = download_result;
+                // loop quits before dispatching a cancelation completed meanwhile
+                cancel_complete_cb(NULL);
 
-                data->res = res;
                 g_main_loop_quit(data->loop);
                 return G_SOURCE_REMOVE;
         }
@@ -1443,11 +2916,63 @@ out:
         return G_SOURCE_CONTINUE;
 }
 
+/**
+ * @brief Collect targets to serve: the own target (target_name) first, followed by targets
+ * configured via gateway_targets and, if enabled, all devices of the database. Initial polls are
+ * staggered evenly across retry_wait so hundreds of targets do not hit hawkBit at once.
+ *
+ * @return GPtrArray* of HawkbitTarget*
+ */
+static GPtrArray* hawkbit_targets_new(void)
+{
+        GPtrArray *targets = g_ptr_array_new_with_free_func((GDestroyNotify) target_free);
+        g_autoptr(GHashTable) seen = g_hash_table_new(g_str_hash, g_str_equal);
+        g_autoptr(GPtrArray) ids = g_ptr_array_new_with_free_func(g_free);
+
+        g_ptr_array_add(ids, g_strdup(hawkbit_config->controller_id));
+        for (gchar **id = hawkbit_config->gateway_targets; id && *id; id++)
+                g_ptr_array_add(ids, g_strdup(*id));
+
+        if (hawkbit_config->gateway_targets_from_database) {
+                GList *devices = get_current_devices();
+
+                for (GList *l = devices; l; l = l->next) {
+                        RCE_DEVICE *device = l->data;
+                        g_ptr_array_add(ids, g_strdup(device->name));
+                }
+                g_list_free_full(devices, free_image);
+        }
+
+        for (guint i = 0; i < ids->len; i++) {
+                const gchar *id = g_ptr_array_index(ids, i);
+
+                if (!g_hash_table_add(seen, (gpointer) id))
+                        continue;
+
+                // own target reuses the global action created beforehand
+                g_ptr_array_add(targets, target_new(id, targets->len ? NULL : active_action));
+        }
+
+        for (guint i = 1; i < targets->len && !run_once; i++) {
+                struct HawkbitTarget *target = g_ptr_array_index(targets, i);
+
+                target->last_run_sec = hawkbit_config->retry_wait -
+                                       (long) i * hawkbit_config->retry_wait / targets->len;
+        }
+
+        if (targets->len > 1)
+                g_message("Gateway mode: serving %u targets.", targets->len);
+
+        return targets;
+}
+
 int hawkbit_start_service_sync()
 {
         g_autoptr(GMainContext) ctx = NULL;
         ClientData cdata;
         g_autoptr(GSource) timeout_source = NULL;
+        g_autoptr(GSource) sighup_source = NULL;
+        g_autoptr(GFileMonitor) config_monitor = NULL;
         int res = 0;
 #ifdef WITH_SYSTEMD
         g_autoptr(GSource) event_source = NULL;
@@ -1455,24 +2980,71 @@ int hawkbit_start_service_sync()
 #endif
 
         active_action = action_new();
+        hawkbit_targets = hawkbit_targets_new();
+        active_target = g_ptr_array_index(hawkbit_targets, 0);
+        // probe servers right away, so polls soon go to the best one
+        probe_last_sec = hawkbit_config->server_probe_interval;
 
         ctx = g_main_context_new();
+        main_context = ctx;
         cdata.loop = g_main_loop_new(ctx, FALSE);
-        cdata.hawkbit_interval_check_sec = hawkbit_config->retry_wait;
-        cdata.last_run_sec = hawkbit_config->retry_wait;
+        cdata.res = FALSE;
+        cdata.pending_polls = hawkbit_targets->len;
+
+        // before any worker thread or bootloader is started, they inherit the cgroup
+        scheduling_init(hawkbit_config);
+
+        if (hawkbit_config->peer_port > 0) {
+                g_autoptr(GError) error = NULL;
+
+                if (!peer_server_start(ctx, hawkbit_config->peer_port,
+                                       hawkbit_config->peer_cache_dir, &error))
+                        g_warning("Not sharing artifacts with peers: %s", error->message);
+        }
+
+        // recover from restart/power cut right away instead of after the first poll interval
+        resume_saved_action();
+
+        // record how long callbacks block the main loop (and the watchdog serviced by it)
+        loop_monitor_init(hawkbit_config->loop_stall_threshold);
 
         // pull every second
         timeout_source = g_timeout_source_new(1000);
-        g_source_set_name(timeout_source, "Add timeout");
-        g_source_set_callback(timeout_source, (GSourceFunc) hawkbit_pull_cb, &cdata, NULL);
+        g_source_set_name(timeout_source, "hawkbit-poll");
+        loop_monitor_source_set_callback(timeout_source, (GSourceFunc) hawkbit_pull_cb, &cdata);
         g_source_attach(timeout_source, ctx);
 
+        if (hawkbit_config->watchdog_stall_limit > 0 &&
+            loop_monitor_start_watchdog(hawkbit_config->watchdog_stall_limit))
+                g_debug("Watchdog serviced by health thread");
+
+        if (config_path) {
+                g_autoptr(GFile) file = g_file_new_for_path(config_path);
+                g_autoptr(GError) error = NULL;
+
+                sighup_source = g_unix_signal_source_new(SIGHUP);
+                g_source_set_name(sighup_source, "config-reload");
+                loop_monitor_source_set_callback(sighup_source, sighup_cb, NULL);
+                g_source_attach(sighup_source, ctx);
+
+                // monitor emits signals in the thread-default context it was created in
+                g_main_context_push_thread_default(ctx);
+                config_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+                g_main_context_pop_thread_default(ctx);
+                if (config_monitor)
+                        g_signal_connect(config_monitor, "changed",
+                                         G_CALLBACK(config_file_changed_cb), NULL);
+                else
+                        g_warning("Cannot watch %s for changes, reload on SIGHUP only: %s",
+                                  config_path, error->message);
+        }
+
 #ifdef WITH_SYSTEMD
         res = sd_event_default(&event);
         if (res < 0)
                 goto finish;
-        // enable automatic service watchdog support
-        res = sd_event_set_watchdog(event, TRUE);
+        // enable automatic service watchdog support, unless the health thread services it
+        res = sd_event_set_watchdog(event, hawkbit_config->watchdog_stall_limit <= 0);
         if (res < 0)
                 goto finish;
 
@@ -1503,7 +3075,33 @@ finish:
         g_source_destroy(event_source);
         sd_event_set_watchdog(event, FALSE);
 #endif
+        loop_monitor_stop_watchdog();
+        loop_monitor_log_histogram();
+        peer_server_stop();
         g_main_loop_unref(cdata.loop);
+
+        if (reload_source) {
+                g_source_destroy(reload_source);
+                g_clear_pointer(&reload_source, g_source_unref);
+        }
+        if (maintenance_source) {
+                g_source_destroy(maintenance_source);
+                g_clear_pointer(&maintenance_source, g_source_unref);
+        }
+        // devices left to flash again are persisted and resumed on the next start
+        if (flash_retry_source) {
+                g_source_destroy(flash_retry_source);
+                g_clear_pointer(&flash_retry_source, g_source_unref);
+        }
+        // configs replaced by reloads, the initial config is owned by the caller
+        g_clear_pointer(&pending_config, config_file_free);
+        g_clear_pointer(&retired_configs, g_ptr_array_unref);
+        free_request_headers();
+        endpoints_clear();
+        if (hawkbit_config != initial_config) {
+                config_file_free(hawkbit_config);
+                hawkbit_config = initial_config;
+        }
         if (res < 0)
                 g_warning("%s", strerror(-res));
 
@@ -1520,6 +3118,8 @@ void artifact_free(Artifact *artifact)
         g_free(artifact->download_url);
         g_free(artifact->feedback_url);
         g_free(artifact->sha1);
+        g_free(artifact->sha256);
+        g_free(artifact->md5);
         g_free(artifact);
 }
 
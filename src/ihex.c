@@ -0,0 +1,598 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Intel HEX parser, validator and binary image cache
+ *
+ * Firmware HEX files are mmap'ed and parsed in a single pass. The resulting binary image and a
+ * per-block CRC table are stored next to the HEX file, so unchanged files are never parsed again,
+ * and kept in memory to share them between devices using the same firmware.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "ihex.h"
+
+// refuse to build sparse images spanning more than this
+#define IHEX_MAX_IMAGE_SIZE (64 * 1024 * 1024)
+
+#define IHEX_CACHE_MAGIC "RHUIHEX1"
+
+enum {
+        IHEX_RECORD_DATA = 0x00,
+        IHEX_RECORD_EOF = 0x01,
+        IHEX_RECORD_EXT_SEGMENT_ADDR = 0x02,
+        IHEX_RECORD_START_SEGMENT_ADDR = 0x03,
+        IHEX_RECORD_EXT_LINEAR_ADDR = 0x04,
+        IHEX_RECORD_START_LINEAR_ADDR = 0x05,
+};
+
+/**
+ * @brief Data record location, payload is stored in a separate buffer.
+ */
+typedef struct IhexSegment_ {
+        guint32 address;
+        guint32 len;
+        gsize offset;                 /**< offset of data in payload buffer */
+} IhexSegment;
+
+/**
+ * @brief Header of "<path>.crc" cache files, followed by n_extents IhexRange and n_blocks
+ *        CRC-32 values. Host byte order, the cache is never shared between machines.
+ */
+typedef struct IhexCacheHeader_ {
+        gchar magic[8];
+        guint32 base;
+        guint32 size;
+        guint32 block_size;
+        guint32 n_blocks;
+        guint32 n_extents;
+        guint32 reserved;
+        gint64 hex_mtime;
+        gint64 hex_size;
+} IhexCacheHeader;
+
+static GHashTable *image_cache = NULL;
+G_LOCK_DEFINE_STATIC(image_cache);
+
+GQuark ihex_error_quark(void)
+{
+        return g_quark_from_static_string("ihex_error_quark");
+}
+
+/**
+ * @brief Update CRC-32 (IEEE 802.3) with data.
+ *
+ * @param[in] crc  CRC of previous data, 0 initially
+ * @param[in] data Data
+ * @param[in] len  Length of data
+ * @return updated CRC
+ */
+static guint32 crc32_update(guint32 crc, const guint8 *data, gsize len)
+{
+        static gsize table_init = 0;
+        static guint32 table[256];
+
+        if (g_once_init_enter(&table_init)) {
+                for (guint32 i = 0; i < 256; i++) {
+                        guint32 c = i;
+
+                        for (gint k = 0; k < 8; k++)
+                                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                        table[i] = c;
+                }
+                g_once_init_leave(&table_init, 1);
+        }
+
+        crc = ~crc;
+        while (len--)
+                crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+        return ~crc;
+}
+
+/**
+ * @brief Calculate CRC table of image data.
+ *
+ * @param[in] image IhexImage with data/size set
+ */
+static void image_calc_crc(IhexImage *image)
+{
+        image->n_blocks = (image->size + IHEX_CRC_BLOCK_SIZE - 1) / IHEX_CRC_BLOCK_SIZE;
+        image->crc = g_new(guint32, image->n_blocks);
+
+        for (guint i = 0; i < image->n_blocks; i++) {
+                gsize offset = (gsize) i * IHEX_CRC_BLOCK_SIZE;
+
+                image->crc[i] = crc32_update(0, image->data + offset,
+                                             MIN(IHEX_CRC_BLOCK_SIZE, image->size - offset));
+        }
+}
+
+static gint range_compare(gconstpointer a, gconstpointer b)
+{
+        const IhexRange *ra = a, *rb = b;
+
+        return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+/**
+ * @brief Sort ranges and merge overlapping or adjacent ones.
+ *
+ * @param[in] ranges GArray of IhexRange
+ */
+static void ranges_normalize(GArray *ranges)
+{
+        guint out = 0;
+
+        if (ranges->len < 2)
+                return;
+
+        g_array_sort(ranges, range_compare);
+
+        for (guint i = 1; i < ranges->len; i++) {
+                IhexRange *last = &g_array_index(ranges, IhexRange, out);
+                IhexRange *cur = &g_array_index(ranges, IhexRange, i);
+
+                if (cur->start <= last->end) {
+                        last->end = MAX(last->end, cur->end);
+                        continue;
+                }
+                g_array_index(ranges, IhexRange, ++out) = *cur;
+        }
+        g_array_set_size(ranges, out + 1);
+}
+
+gboolean ihex_parse_memory_map(const gchar *spec, GArray **ranges, GError **error)
+{
+        g_autoptr(GArray) tmp = NULL;
+        g_auto(GStrv) elements = NULL;
+
+        g_return_val_if_fail(spec, FALSE);
+        g_return_val_if_fail(ranges && *ranges == NULL, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        tmp = g_array_new(FALSE, FALSE, sizeof(IhexRange));
+        elements = g_strsplit_set(spec, ", \t", -1);
+
+        for (gchar **element = elements; *element; element++) {
+                IhexRange range;
+                gchar *end = NULL;
+                guint64 last;
+
+                if (!**element)
+                        continue;
+
+                range.start = g_ascii_strtoull(*element, &end, 0);
+                if (end == *element || *end != '-')
+                        goto invalid;
+                last = g_ascii_strtoull(end + 1, &end, 0);
+                if (*end || last < range.start || last > G_MAXUINT32)
+                        goto invalid;
+
+                range.end = last + 1;
+                g_array_append_val(tmp, range);
+                continue;
+
+invalid:
+                g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                            "Invalid memory range '%s', expected <start>-<end>", *element);
+                return FALSE;
+        }
+
+        if (!tmp->len) {
+                g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE, "Empty memory map");
+                return FALSE;
+        }
+
+        ranges_normalize(tmp);
+        *ranges = g_steal_pointer(&tmp);
+        return TRUE;
+}
+
+static gint segment_compare(gconstpointer a, gconstpointer b)
+{
+        const IhexSegment *sa = a, *sb = b;
+
+        return (sa->address > sb->address) - (sa->address < sb->address);
+}
+
+/**
+ * @brief Decode two hex digits.
+ *
+ * @param[in] s Pointer to two characters
+ * @return byte value, -1 if s is not a hex byte
+ */
+static inline gint hex_byte(const gchar *s)
+{
+        gint hi = g_ascii_xdigit_value(s[0]), lo = g_ascii_xdigit_value(s[1]);
+
+        if (hi < 0 || lo < 0)
+                return -1;
+        return (hi << 4) | lo;
+}
+
+IhexImage* ihex_parse(const gchar *data, gsize len, GError **error)
+{
+        g_autoptr(GArray) segments = NULL;
+        g_autoptr(GByteArray) payload = NULL;
+        g_autoptr(IhexImage) image = NULL;
+        const gchar *p = data, *end = data + len;
+        guint32 base_address = 0;
+        guint64 image_end = 0;
+        gboolean eof = FALSE;
+        guint line = 0;
+        guint8 record_type = 0;
+
+        g_return_val_if_fail(data || !len, NULL);
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+        segments = g_array_new(FALSE, FALSE, sizeof(IhexSegment));
+        payload = g_byte_array_sized_new(len / 2);
+
+        while (p < end && !eof) {
+                guint8 record[5 + 255];
+                guint8 sum = 0;
+                guint record_len;
+                gint b;
+
+                if (g_ascii_isspace(*p)) {
+                        p++;
+                        continue;
+                }
+
+                line++;
+                if (*p != ':') {
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                                    "Line %u: record does not start with ':'", line);
+                        return NULL;
+                }
+                p++;
+
+                // byte count, address (2), type, data, checksum
+                if (end - p < 10 || (b = hex_byte(p)) < 0)
+                        goto truncated;
+                record_len = 5 + b;
+                if ((gsize) (end - p) < record_len * 2)
+                        goto truncated;
+
+                for (guint i = 0; i < record_len; i++, p += 2) {
+                        b = hex_byte(p);
+                        if (b < 0) {
+                                g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                                            "Line %u: invalid hex digit", line);
+                                return NULL;
+                        }
+                        record[i] = b;
+                        sum += b;
+                }
+                if (sum) {
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_CHECKSUM,
+                                    "Line %u: record checksum mismatch", line);
+                        return NULL;
+                }
+                if (p < end && *p != '\r' && *p != '\n') {
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                                    "Line %u: trailing characters after record", line);
+                        return NULL;
+                }
+
+                record_type = record[3];
+                switch (record_type) {
+                case IHEX_RECORD_DATA: {
+                        IhexSegment segment = {
+                                .address = base_address + ((record[1] << 8) | record[2]),
+                                .len = record[0],
+                                .offset = payload->len,
+                        };
+
+                        if (!segment.len)
+                                break;
+                        if ((guint64) segment.address + segment.len > (guint64) G_MAXUINT32 + 1) {
+                                g_set_error(error, IHEX_ERROR, IHEX_ERROR_RANGE,
+                                            "Line %u: data exceeds 32 bit address space", line);
+                                return NULL;
+                        }
+                        g_byte_array_append(payload, &record[4], segment.len);
+                        g_array_append_val(segments, segment);
+                        break;
+                }
+                case IHEX_RECORD_EOF:
+                        eof = TRUE;
+                        break;
+                case IHEX_RECORD_EXT_SEGMENT_ADDR:
+                case IHEX_RECORD_EXT_LINEAR_ADDR:
+                        if (record[0] != 2)
+                                goto invalid_length;
+                        base_address = (record[4] << 8) | record[5];
+                        base_address <<= record_type == IHEX_RECORD_EXT_LINEAR_ADDR ? 16 : 4;
+                        break;
+                case IHEX_RECORD_START_SEGMENT_ADDR:
+                case IHEX_RECORD_START_LINEAR_ADDR:
+                        // entry point, irrelevant for the image
+                        if (record[0] != 4)
+                                goto invalid_length;
+                        break;
+                default:
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                                    "Line %u: unsupported record type 0x%02x", line, record_type);
+                        return NULL;
+                }
+        }
+
+        if (!eof) {
+                g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE, "Missing end of file record");
+                return NULL;
+        }
+        if (!segments->len) {
+                g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE, "No data records");
+                return NULL;
+        }
+
+        g_array_sort(segments, segment_compare);
+
+        image = g_new0(IhexImage, 1);
+        image->ref_count = 1;
+        image->extents = g_array_new(FALSE, FALSE, sizeof(IhexRange));
+        image->base = g_array_index(segments, IhexSegment, 0).address;
+
+        for (guint i = 0; i < segments->len; i++) {
+                IhexSegment *segment = &g_array_index(segments, IhexSegment, i);
+                IhexRange extent = { segment->address, (guint64) segment->address + segment->len };
+
+                if (extent.start < image_end) {
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_RANGE,
+                                    "Overlapping data at 0x%08x", segment->address);
+                        return NULL;
+                }
+                image_end = extent.end;
+                g_array_append_val(image->extents, extent);
+        }
+        ranges_normalize(image->extents);
+
+        if (image_end - image->base > IHEX_MAX_IMAGE_SIZE) {
+                g_set_error(error, IHEX_ERROR, IHEX_ERROR_SIZE,
+                            "Image spanning 0x%08x-0x%08" G_GINT64_MODIFIER "x exceeds %d bytes",
+                            image->base, image_end - 1, IHEX_MAX_IMAGE_SIZE);
+                return NULL;
+        }
+
+        image->size = image_end - image->base;
+        image->data = g_malloc(image->size);
+        memset(image->data, 0xff, image->size);
+        for (guint i = 0; i < segments->len; i++) {
+                IhexSegment *segment = &g_array_index(segments, IhexSegment, i);
+
+                memcpy(image->data + (segment->address - image->base),
+                       payload->data + segment->offset, segment->len);
+        }
+
+        image_calc_crc(image);
+
+        return g_steal_pointer(&image);
+
+truncated:
+        g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE, "Line %u: truncated record", line);
+        return NULL;
+
+invalid_length:
+        g_set_error(error, IHEX_ERROR, IHEX_ERROR_PARSE,
+                    "Line %u: invalid length of record type 0x%02x", line, record_type);
+        return NULL;
+}
+
+/**
+ * @brief Map file and parse it with ihex_parse().
+ *
+ * @param[in]  path  Intel HEX file
+ * @param[in]  st    GStatBuf of path
+ * @param[out] error Error
+ * @return IhexImage*, NULL on error (error set)
+ */
+static IhexImage* ihex_parse_file(const gchar *path, const GStatBuf *st, GError **error)
+{
+        g_autoptr(GMappedFile) mapped = NULL;
+        IhexImage *image = NULL;
+
+        mapped = g_mapped_file_new(path, FALSE, error);
+        if (!mapped) {
+                g_prefix_error(error, "Failed to map %s: ", path);
+                return NULL;
+        }
+
+        image = ihex_parse(g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped),
+                           error);
+        if (!image) {
+                g_prefix_error(error, "%s: ", path);
+                return NULL;
+        }
+
+        image->hex_mtime = st->st_mtime;
+        image->hex_size = st->st_size;
+        return image;
+}
+
+/**
+ * @brief Load image from "<path>.bin"/"<path>.crc" cache files. The cache is only used if it
+ *        belongs to the current HEX file and the CRC of each block matches.
+ *
+ * @param[in] path Intel HEX file
+ * @param[in] st   GStatBuf of path
+ * @return IhexImage*, NULL if there is no valid cache
+ */
+static IhexImage* ihex_cache_read(const gchar *path, const GStatBuf *st)
+{
+        g_autofree gchar *bin_path = g_strconcat(path, ".bin", NULL);
+        g_autofree gchar *crc_path = g_strconcat(path, ".crc", NULL);
+        g_autofree gchar *crc = NULL, *bin = NULL;
+        g_autoptr(IhexImage) image = NULL;
+        const IhexCacheHeader *header;
+        gsize crc_len = 0, bin_len = 0;
+
+        if (!g_file_get_contents(crc_path, &crc, &crc_len, NULL) ||
+            crc_len < sizeof(IhexCacheHeader))
+                return NULL;
+
+        header = (const IhexCacheHeader *) crc;
+        if (memcmp(header->magic, IHEX_CACHE_MAGIC, sizeof(header->magic)) ||
+            header->hex_mtime != st->st_mtime || header->hex_size != st->st_size ||
+            header->block_size != IHEX_CRC_BLOCK_SIZE ||
+            header->n_blocks != (header->size + (guint64) IHEX_CRC_BLOCK_SIZE - 1) / IHEX_CRC_BLOCK_SIZE ||
+            crc_len != sizeof(*header) + header->n_extents * sizeof(IhexRange) +
+                       header->n_blocks * sizeof(guint32))
+                return NULL;
+
+        if (!g_file_get_contents(bin_path, &bin, &bin_len, NULL) || bin_len != header->size)
+                return NULL;
+
+        image = g_new0(IhexImage, 1);
+        image->ref_count = 1;
+        image->base = header->base;
+        image->size = header->size;
+        image->data = (guint8 *) g_steal_pointer(&bin);
+        image->hex_mtime = header->hex_mtime;
+        image->hex_size = header->hex_size;
+        image->extents = g_array_sized_new(FALSE, FALSE, sizeof(IhexRange), header->n_extents);
+        g_array_append_vals(image->extents, crc + sizeof(*header), header->n_extents);
+        image_calc_crc(image);
+
+        if (memcmp(image->crc, crc + sizeof(*header) + header->n_extents * sizeof(IhexRange),
+                   image->n_blocks * sizeof(guint32))) {
+                g_debug("Image cache %s corrupt, ignoring", bin_path);
+                return NULL;
+        }
+
+        return g_steal_pointer(&image);
+}
+
+/**
+ * @brief Store image as "<path>.bin"/"<path>.crc" cache files.
+ *
+ * @param[in]  path  Intel HEX file
+ * @param[in]  image IhexImage to store
+ * @param[out] error Error
+ * @return TRUE on success, FALSE otherwise (error set)
+ */
+static gboolean ihex_cache_write(const gchar *path, const IhexImage *image, GError **error)
+{
+        g_autofree gchar *bin_path = g_strconcat(path, ".bin", NULL);
+        g_autofree gchar *crc_path = g_strconcat(path, ".crc", NULL);
+        g_autoptr(GByteArray) crc = g_byte_array_new();
+        IhexCacheHeader header = {
+                .base = image->base,
+                .size = image->size,
+                .block_size = IHEX_CRC_BLOCK_SIZE,
+                .n_blocks = image->n_blocks,
+                .n_extents = image->extents->len,
+                .hex_mtime = image->hex_mtime,
+                .hex_size = image->hex_size,
+        };
+
+        memcpy(header.magic, IHEX_CACHE_MAGIC, sizeof(header.magic));
+        g_byte_array_append(crc, (const guint8 *) &header, sizeof(header));
+        g_byte_array_append(crc, (const guint8 *) image->extents->data,
+                            image->extents->len * sizeof(IhexRange));
+        g_byte_array_append(crc, (const guint8 *) image->crc, image->n_blocks * sizeof(guint32));
+
+        // write CRC table last, it validates the binary image
+        return g_file_set_contents(bin_path, (const gchar *) image->data, image->size, error) &&
+               g_file_set_contents(crc_path, (const gchar *) crc->data, crc->len, error);
+}
+
+IhexImage* ihex_image_load(const gchar *path, GError **error)
+{
+        IhexImage *image = NULL;
+        GStatBuf st;
+
+        g_return_val_if_fail(path, NULL);
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+        if (g_stat(path, &st) != 0) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Failed to stat %s: %s", path, g_strerror(err));
+                return NULL;
+        }
+
+        G_LOCK(image_cache);
+        if (!image_cache)
+                image_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                    (GDestroyNotify) ihex_image_unref);
+
+        image = g_hash_table_lookup(image_cache, path);
+        if (image && image->hex_mtime == st.st_mtime && image->hex_size == st.st_size) {
+                image = ihex_image_ref(image);
+                goto out;
+        }
+
+        image = ihex_cache_read(path, &st);
+        if (!image) {
+                g_autoptr(GError) cache_error = NULL;
+
+                image = ihex_parse_file(path, &st, error);
+                if (!image)
+                        goto out;
+
+                if (!ihex_cache_write(path, image, &cache_error))
+                        g_warning("Failed to cache firmware image: %s", cache_error->message);
+        }
+
+        g_hash_table_replace(image_cache, g_strdup(path), ihex_image_ref(image));
+
+out:
+        G_UNLOCK(image_cache);
+        return image;
+}
+
+gboolean ihex_image_check_memory_map(const IhexImage *image, const GArray *memory_map,
+                                     GError **error)
+{
+        guint r = 0;
+
+        g_return_val_if_fail(image, FALSE);
+        g_return_val_if_fail(memory_map, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+        // both are sorted and merged, so a single walk suffices
+        for (guint e = 0; e < image->extents->len; e++) {
+                const IhexRange *extent = &g_array_index(image->extents, IhexRange, e);
+
+                while (r < memory_map->len &&
+                       g_array_index(memory_map, IhexRange, r).end <= extent->start)
+                        r++;
+
+                if (r == memory_map->len ||
+                    g_array_index(memory_map, IhexRange, r).start > extent->start ||
+                    g_array_index(memory_map, IhexRange, r).end < extent->end) {
+                        g_set_error(error, IHEX_ERROR, IHEX_ERROR_RANGE,
+                                    "Data at 0x%08" G_GINT64_MODIFIER "x-0x%08" G_GINT64_MODIFIER
+                                    "x outside of memory map", extent->start, extent->end - 1);
+                        return FALSE;
+                }
+        }
+
+        return TRUE;
+}
+
+IhexImage* ihex_image_ref(IhexImage *image)
+{
+        g_return_val_if_fail(image, NULL);
+
+        g_atomic_int_inc(&image->ref_count);
+        return image;
+}
+
+void ihex_image_unref(IhexImage *image)
+{
+        if (!image || !g_atomic_int_dec_and_test(&image->ref_count))
+                return;
+
+        g_free(image->data);
+        g_free(image->crc);
+        if (image->extents)
+                g_array_unref(image->extents);
+        g_free(image);
+}
@@ -144,3 +144,40 @@ gboolean json_contains(JsonNode *json_node, gchar *path)
 
         return FALSE;
 }
+
+/**
+ * @brief Get member node of a JSON object node.
+ *
+ * @param[in] json_node JsonNode holding an object
+ * @param[in] member    Member name
+ * @return JsonNode*, member node owned by json_node, NULL if not found
+ */
+static JsonNode* json_get_member(JsonNode *json_node, const gchar *member)
+{
+        g_return_val_if_fail(member, NULL);
+
+        if (!json_node || !JSON_NODE_HOLDS_OBJECT(json_node))
+                return NULL;
+
+        return json_object_get_member(json_node_get_object(json_node), member);
+}
+
+const gchar* json_get_member_string(JsonNode *json_node, const gchar *member)
+{
+        JsonNode *node = json_get_member(json_node, member);
+
+        if (!node || json_node_get_value_type(node) != G_TYPE_STRING)
+                return NULL;
+
+        return json_node_get_string(node);
+}
+
+JsonArray* json_get_member_array(JsonNode *json_node, const gchar *member)
+{
+        JsonNode *node = json_get_member(json_node, member);
+
+        if (!node || !JSON_NODE_HOLDS_ARRAY(node))
+                return NULL;
+
+        return json_node_get_array(node);
+}
@@ -0,0 +1,272 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Main loop dispatch latency instrumentation and watchdog health thread
+ */
+
+#include <glib.h>
+#ifdef WITH_SYSTEMD
+#include <systemd/sd-daemon.h>
+#endif
+#include "loop-monitor.h"
+
+/**
+ * @brief Upper bounds of the latency histogram buckets [us], the last bucket is unbounded.
+ */
+static const gint64 bucket_limits[] = {
+        1000, 10 * 1000, 100 * 1000, G_USEC_PER_SEC, 10 * G_USEC_PER_SEC, 60 * G_USEC_PER_SEC,
+};
+static const gchar *bucket_names[] = {
+        "<1ms", "<10ms", "<100ms", "<1s", "<10s", "<60s", ">=60s",
+};
+
+#define LOOP_MONITOR_BUCKETS G_N_ELEMENTS(bucket_names)
+
+/**
+ * @brief Dispatch latencies recorded for one callback.
+ */
+typedef struct LoopStats_ {
+        guint count;                  /**< number of dispatches */
+        gint64 max;                   /**< longest dispatch [us] */
+        guint buckets[LOOP_MONITOR_BUCKETS];
+} LoopStats;
+
+/**
+ * @brief Callback wrapped by loop_monitor_source_set_callback().
+ */
+typedef struct MonitoredCallback_ {
+        GSourceFunc func;
+        gpointer data;
+} MonitoredCallback;
+
+static struct {
+        GMutex mutex;                 /**< protects all members below */
+        GCond cond;                   /**< signals stop to health thread */
+        gint64 stall_threshold;       /**< log dispatches at least this long [us], 0 disables */
+        GHashTable *stats;            /**< callback name to LoopStats */
+        const gchar *dispatch_name;   /**< callback currently dispatched or NULL */
+        gint64 dispatch_start;        /**< monotonic time current dispatch started or 0 */
+        gint64 last_dispatch_end;     /**< monotonic time last dispatch finished */
+        GThread *thread;              /**< health thread or NULL */
+        gint64 stall_limit;           /**< time the main loop may block [us] */
+        gboolean stop;                /**< health thread should stop */
+} monitor;
+
+void loop_monitor_init(gint stall_threshold_ms)
+{
+        g_mutex_lock(&monitor.mutex);
+        monitor.stall_threshold = (gint64) MAX(stall_threshold_ms, 0) * 1000;
+        if (!monitor.stats)
+                monitor.stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        monitor.last_dispatch_end = g_get_monotonic_time();
+        g_mutex_unlock(&monitor.mutex);
+}
+
+/**
+ * @brief Record dispatch latency of callback name. Must be called under locked monitor.mutex.
+ *
+ * @param[in] name     Callback name
+ * @param[in] duration Dispatch latency [us]
+ */
+static void record_latency(const gchar *name, gint64 duration)
+{
+        LoopStats *stats;
+        guint bucket = 0;
+
+        if (!monitor.stats)
+                return;
+
+        stats = g_hash_table_lookup(monitor.stats, name);
+        if (!stats) {
+                stats = g_new0(LoopStats, 1);
+                g_hash_table_insert(monitor.stats, g_strdup(name), stats);
+        }
+
+        while (bucket < G_N_ELEMENTS(bucket_limits) && duration >= bucket_limits[bucket])
+                bucket++;
+
+        stats->count++;
+        stats->buckets[bucket]++;
+        stats->max = MAX(stats->max, duration);
+}
+
+/**
+ * @brief Dispatch wrapped callback, recording its latency.
+ *
+ * @param[in] data MonitoredCallback
+ * @return return value of the wrapped callback
+ */
+static gboolean monitored_dispatch(gpointer data)
+{
+        MonitoredCallback *callback = data;
+        const gchar *name = g_source_get_name(g_main_current_source());
+        gint64 start, duration;
+        gboolean res;
+
+        if (!name)
+                name = "unnamed";
+
+        start = g_get_monotonic_time();
+        g_mutex_lock(&monitor.mutex);
+        monitor.dispatch_name = name;
+        monitor.dispatch_start = start;
+        g_mutex_unlock(&monitor.mutex);
+
+        res = callback->func(callback->data);
+
+        g_mutex_lock(&monitor.mutex);
+        monitor.last_dispatch_end = g_get_monotonic_time();
+        duration = monitor.last_dispatch_end - start;
+        monitor.dispatch_name = NULL;
+        monitor.dispatch_start = 0;
+        record_latency(name, duration);
+        if (monitor.stall_threshold && duration >= monitor.stall_threshold)
+                g_message("Main loop stalled for %.3f s in %s", (double) duration / G_USEC_PER_SEC,
+                          name);
+        g_mutex_unlock(&monitor.mutex);
+
+        return res;
+}
+
+void loop_monitor_source_set_callback(GSource *source, GSourceFunc func, gpointer data)
+{
+        MonitoredCallback *callback;
+
+        g_return_if_fail(source);
+        g_return_if_fail(func);
+
+        callback = g_new0(MonitoredCallback, 1);
+        callback->func = func;
+        callback->data = data;
+        g_source_set_callback(source, monitored_dispatch, callback, g_free);
+}
+
+void loop_monitor_invoke(GMainContext *context, const gchar *name, GSourceFunc func,
+                         gpointer data)
+{
+        g_autoptr(GSource) source = NULL;
+
+        g_return_if_fail(name);
+        g_return_if_fail(func);
+
+        source = g_idle_source_new();
+        g_source_set_priority(source, G_PRIORITY_DEFAULT);
+        g_source_set_name(source, name);
+        loop_monitor_source_set_callback(source, func, data);
+        g_source_attach(source, context);
+}
+
+/**
+ * @brief Health thread: checks main loop liveness periodically and services the systemd watchdog
+ *        while the main loop is alive.
+ *
+ * @param[in] data interval between checks [us], as pointer
+ * @return NULL is always returned
+ */
+static gpointer watchdog_thread(gpointer data)
+{
+        gint64 interval = GPOINTER_TO_SIZE(data);
+        gboolean reported = FALSE;
+
+        g_mutex_lock(&monitor.mutex);
+        while (!monitor.stop) {
+                gint64 now = g_get_monotonic_time();
+                gint64 blocked = now - (monitor.dispatch_start ? monitor.dispatch_start
+                                                               : monitor.last_dispatch_end);
+
+                if (blocked < monitor.stall_limit) {
+#ifdef WITH_SYSTEMD
+                        sd_notify(0, "WATCHDOG=1");
+#endif
+                        reported = FALSE;
+                } else if (!reported) {
+                        // stop servicing the watchdog, but tell which callback is to blame
+                        g_warning("Main loop blocked for %" G_GINT64_FORMAT " s in %s",
+                                  blocked / G_USEC_PER_SEC,
+                                  monitor.dispatch_name ? monitor.dispatch_name
+                                                        : "main loop itself");
+                        reported = TRUE;
+                }
+
+                g_cond_wait_until(&monitor.cond, &monitor.mutex, now + interval);
+        }
+        g_mutex_unlock(&monitor.mutex);
+
+        return NULL;
+}
+
+gboolean loop_monitor_start_watchdog(gint stall_limit_sec)
+{
+#ifdef WITH_SYSTEMD
+        guint64 watchdog_usec = 0;
+#endif
+        gint64 interval = G_USEC_PER_SEC;
+        gboolean watchdog = FALSE;
+
+        g_return_val_if_fail(stall_limit_sec > 0, FALSE);
+        g_return_val_if_fail(!monitor.thread, FALSE);
+
+#ifdef WITH_SYSTEMD
+        watchdog = sd_watchdog_enabled(0, &watchdog_usec) > 0;
+        // ping twice per watchdog period, as sd-event does
+        if (watchdog)
+                interval = watchdog_usec / 2;
+#endif
+        if (!watchdog)
+                g_debug("No watchdog configured, health thread only logs main loop stalls");
+
+        g_mutex_lock(&monitor.mutex);
+        monitor.stall_limit = (gint64) stall_limit_sec * G_USEC_PER_SEC;
+        monitor.stop = FALSE;
+        if (!monitor.last_dispatch_end)
+                monitor.last_dispatch_end = g_get_monotonic_time();
+        g_mutex_unlock(&monitor.mutex);
+
+        monitor.thread = g_thread_new("watchdog", watchdog_thread, GSIZE_TO_POINTER(interval));
+
+        return watchdog;
+}
+
+void loop_monitor_stop_watchdog(void)
+{
+        if (!monitor.thread)
+                return;
+
+        g_mutex_lock(&monitor.mutex);
+        monitor.stop = TRUE;
+        g_cond_signal(&monitor.cond);
+        g_mutex_unlock(&monitor.mutex);
+
+        g_thread_join(monitor.thread);
+        monitor.thread = NULL;
+}
+
+void loop_monitor_log_histogram(void)
+{
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_mutex_lock(&monitor.mutex);
+        if (!monitor.stats) {
+                g_mutex_unlock(&monitor.mutex);
+                return;
+        }
+
+        g_hash_table_iter_init(&iter, monitor.stats);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+                const LoopStats *stats = value;
+                g_autoptr(GString) line = g_string_new(NULL);
+
+                g_string_append_printf(line, "Dispatch latency of %s: %u calls, max %.3f s (",
+                                       (const gchar *) key, stats->count,
+                                       (double) stats->max / G_USEC_PER_SEC);
+                for (guint i = 0; i < LOOP_MONITOR_BUCKETS; i++)
+                        g_string_append_printf(line, "%s%s: %u", i ? ", " : "", bucket_names[i],
+                                               stats->buckets[i]);
+                g_string_append_c(line, ')');
+
+                g_message("%s", line->str);
+        }
+        g_mutex_unlock(&monitor.mutex);
+}
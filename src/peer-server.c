@@ -0,0 +1,508 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Embedded HTTP server sharing verified artifacts with peers on the local network
+ *
+ * Artifacts are served by SHA1 at GET/HEAD /artifacts/<sha1>, supporting single byte ranges so
+ * peers can resume interrupted transfers. Each connection serves one request in a thread of the
+ * threaded socket service. Peers verify artifacts against the checksums supplied by hawkBit, so
+ * the server does not need to be trusted.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include "peer-server.h"
+
+#define PEER_ARTIFACT_PREFIX "/artifacts/"
+
+static const gint PEER_MAX_CONNECTIONS = 4;
+static const guint PEER_SOCKET_TIMEOUT = 30;           // 30 sec.
+static const gsize PEER_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * @brief Artifact shared with peers.
+ */
+typedef struct PeerArtifact_ {
+        gchar *file;                  /**< file the artifact is served from */
+        goffset size;                 /**< size of the verified file */
+        gboolean cached;              /**< whether file is a link in the cache directory */
+} PeerArtifact;
+
+static struct {
+        GMutex mutex;                 /**< protects all members below */
+        GSocketService *service;      /**< threaded socket service or NULL if not running */
+        GHashTable *artifacts;        /**< lower case SHA1 to PeerArtifact */
+        gchar *cache_dir;             /**< directory artifacts are linked into or NULL */
+        gchar *cache_action;          /**< action id of cached artifacts or NULL */
+} peer_server;
+
+static void peer_artifact_free(PeerArtifact *artifact)
+{
+        g_free(artifact->file);
+        g_free(artifact);
+}
+
+gchar* peer_server_artifact_path(const gchar *sha1)
+{
+        g_autofree gchar *lower = NULL;
+
+        g_return_val_if_fail(sha1, NULL);
+
+        lower = g_ascii_strdown(sha1, -1);
+        return g_strconcat(PEER_ARTIFACT_PREFIX, lower, NULL);
+}
+
+/**
+ * @brief Register file as artifact sha1. Must be called under locked peer_server.mutex.
+ *
+ * @param[in] sha1   Lower case SHA1 hex digest
+ * @param[in] file   File to serve
+ * @param[in] cached Whether file is a link in the cache directory
+ */
+static void register_artifact(const gchar *sha1, const gchar *file, gboolean cached)
+{
+        PeerArtifact *artifact = NULL;
+        GStatBuf st;
+
+        if (g_stat(file, &st) != 0) {
+                g_debug("Cannot share %s with peers: %s", file, g_strerror(errno));
+                return;
+        }
+
+        artifact = g_new0(PeerArtifact, 1);
+        artifact->file = g_strdup(file);
+        artifact->size = st.st_size;
+        artifact->cached = cached;
+        g_hash_table_replace(peer_server.artifacts, g_strdup(sha1), artifact);
+}
+
+/**
+ * @brief Register artifacts kept in the cache directory by a previous run. Must be called under
+ *        locked peer_server.mutex.
+ */
+static void scan_cache_dir(void)
+{
+        g_autoptr(GDir) dir = NULL;
+        g_autoptr(GError) error = NULL;
+        const gchar *name = NULL;
+
+        if (g_mkdir_with_parents(peer_server.cache_dir, 0755) != 0) {
+                g_warning("Failed to create peer cache %s: %s", peer_server.cache_dir,
+                          g_strerror(errno));
+                return;
+        }
+
+        dir = g_dir_open(peer_server.cache_dir, 0, &error);
+        if (!dir) {
+                g_warning("Failed to open peer cache: %s", error->message);
+                return;
+        }
+
+        while ((name = g_dir_read_name(dir))) {
+                g_autofree gchar *file = g_build_filename(peer_server.cache_dir, name, NULL);
+
+                // only files named by their SHA1 were put there by us
+                if (strlen(name) != 40 || strspn(name, "0123456789abcdef") != 40)
+                        continue;
+
+                register_artifact(name, file, TRUE);
+        }
+}
+
+/**
+ * @brief Drop cached artifacts of other actions than action_id. Must be called under locked
+ *        peer_server.mutex.
+ *
+ * @param[in] action_id hawkBit action id to keep cached artifacts of
+ */
+static void evict_cache(const gchar *action_id)
+{
+        GHashTableIter iter;
+        gpointer value;
+
+        if (!g_strcmp0(action_id, peer_server.cache_action))
+                return;
+
+        g_hash_table_iter_init(&iter, peer_server.artifacts);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+                const PeerArtifact *artifact = value;
+
+                if (!artifact->cached)
+                        continue;
+
+                if (g_remove(artifact->file) != 0 && errno != ENOENT)
+                        g_warning("Failed to remove %s from peer cache: %s", artifact->file,
+                                  g_strerror(errno));
+                g_hash_table_iter_remove(&iter);
+        }
+
+        g_free(peer_server.cache_action);
+        peer_server.cache_action = g_strdup(action_id);
+}
+
+void peer_server_add(const gchar *action_id, const Artifact *artifact, const gchar *file)
+{
+        g_autofree gchar *sha1 = NULL, *cached = NULL;
+
+        g_return_if_fail(artifact);
+        g_return_if_fail(file);
+
+        if (!artifact->sha1)
+                return;
+
+        sha1 = g_ascii_strdown(artifact->sha1, -1);
+
+        g_mutex_lock(&peer_server.mutex);
+        if (!peer_server.service) {
+                g_mutex_unlock(&peer_server.mutex);
+                return;
+        }
+
+        if (peer_server.cache_dir) {
+                evict_cache(action_id);
+
+                // hard link, so the download location may be deleted or reused meanwhile
+                cached = g_build_filename(peer_server.cache_dir, sha1, NULL);
+                if (g_remove(cached) != 0 && errno != ENOENT)
+                        g_debug("Failed to replace %s: %s", cached, g_strerror(errno));
+                if (link(file, cached) != 0) {
+                        g_warning("Failed to link %s into peer cache, sharing it while it exists: %s",
+                                  file, g_strerror(errno));
+                        g_clear_pointer(&cached, g_free);
+                }
+        }
+
+        register_artifact(sha1, cached ? cached : file, cached != NULL);
+        g_mutex_unlock(&peer_server.mutex);
+
+        g_debug("Sharing %s (%s) with peers", artifact->name, sha1);
+}
+
+void peer_server_forget(const gchar *file)
+{
+        GHashTableIter iter;
+        gpointer value;
+
+        g_return_if_fail(file);
+
+        g_mutex_lock(&peer_server.mutex);
+        if (peer_server.artifacts) {
+                g_hash_table_iter_init(&iter, peer_server.artifacts);
+                while (g_hash_table_iter_next(&iter, NULL, &value)) {
+                        const PeerArtifact *artifact = value;
+
+                        if (!artifact->cached && !g_strcmp0(artifact->file, file))
+                                g_hash_table_iter_remove(&iter);
+                }
+        }
+        g_mutex_unlock(&peer_server.mutex);
+}
+
+/**
+ * @brief Look up file serving artifact sha1, if it is still unchanged.
+ *
+ * @param[in]  sha1 SHA1 hex digest requested
+ * @param[out] size Size of the artifact
+ * @return newly allocated file name or NULL if not available
+ */
+static gchar* lookup_artifact(const gchar *sha1, goffset *size)
+{
+        g_autofree gchar *lower = g_ascii_strdown(sha1, -1);
+        const PeerArtifact *artifact = NULL;
+        gchar *file = NULL;
+        GStatBuf st;
+
+        g_mutex_lock(&peer_server.mutex);
+        artifact = peer_server.artifacts ? g_hash_table_lookup(peer_server.artifacts, lower)
+                                         : NULL;
+        // a changed size means the file is being replaced, e.g. by the next download
+        if (artifact && g_stat(artifact->file, &st) == 0 && st.st_size == artifact->size) {
+                file = g_strdup(artifact->file);
+                *size = artifact->size;
+        }
+        g_mutex_unlock(&peer_server.mutex);
+
+        return file;
+}
+
+/**
+ * @brief Parse Range header value. Unsupported ranges (multiple ranges, other units, invalid
+ *        syntax) are ignored, so the whole artifact is served.
+ *
+ * @param[in]  range Range header value, e.g. "bytes=100-"
+ * @param[in]  size  Size of the artifact
+ * @param[out] start First byte to serve
+ * @param[out] end   Last byte to serve
+ * @return FALSE if the range is not satisfiable, TRUE otherwise
+ */
+static gboolean parse_range(const gchar *range, goffset size, goffset *start, goffset *end)
+{
+        const gchar *spec = NULL, *dash = NULL;
+        gchar *rest = NULL;
+        gint64 first, last;
+
+        if (!g_str_has_prefix(range, "bytes=") || strchr(range, ','))
+                return TRUE;
+
+        spec = range + strlen("bytes=");
+        dash = strchr(spec, '-');
+        if (!dash)
+                return TRUE;
+
+        // suffix range: last n bytes
+        if (dash == spec) {
+                last = g_ascii_strtoll(dash + 1, &rest, 10);
+                if (*rest || rest == dash + 1 || last <= 0)
+                        return TRUE;
+                *start = MAX(size - last, 0);
+                return size > 0;
+        }
+
+        first = g_ascii_strtoll(spec, &rest, 10);
+        if (rest != dash || first < 0)
+                return TRUE;
+
+        if (dash[1]) {
+                last = g_ascii_strtoll(dash + 1, &rest, 10);
+                if (*rest || last < first)
+                        return TRUE;
+                *end = MIN(last, size - 1);
+        }
+        *start = first;
+
+        return first < size;
+}
+
+/**
+ * @brief Send response without body.
+ *
+ * @param[in]  out     Output stream of the connection
+ * @param[in]  status  HTTP status code
+ * @param[in]  reason  HTTP reason phrase
+ * @param[in]  headers Additional headers, each terminated by CRLF, or NULL
+ * @param[out] error   Error
+ * @return TRUE if the response was sent, FALSE otherwise (error set)
+ */
+static gboolean send_status(GOutputStream *out, guint status, const gchar *reason,
+                            const gchar *headers, GError **error)
+{
+        g_autofree gchar *response = g_strdup_printf("HTTP/1.1 %u %s\r\n"
+                                                     "Content-Length: 0\r\n"
+                                                     "%sConnection: close\r\n\r\n",
+                                                     status, reason, headers ? headers : "");
+
+        return g_output_stream_write_all(out, response, strlen(response), NULL, NULL, error);
+}
+
+/**
+ * @brief Send bytes start to end of file.
+ *
+ * @param[in]  out   Output stream of the connection
+ * @param[in]  file  File to send
+ * @param[in]  start First byte to send
+ * @param[in]  end   Last byte to send
+ * @param[out] error Error
+ * @return TRUE if all bytes were sent, FALSE otherwise (error set)
+ */
+static gboolean send_file(GOutputStream *out, const gchar *file, goffset start, goffset end,
+                          GError **error)
+{
+        g_autoptr(GFile) gfile = g_file_new_for_path(file);
+        g_autoptr(GFileInputStream) in = NULL;
+        g_autofree guchar *buffer = NULL;
+        goffset remaining = end - start + 1;
+
+        in = g_file_read(gfile, NULL, error);
+        if (!in)
+                return FALSE;
+
+        if (start && !g_seekable_seek(G_SEEKABLE(in), start, G_SEEK_SET, NULL, error))
+                return FALSE;
+
+        buffer = g_malloc(PEER_BUFFER_SIZE);
+        while (remaining > 0) {
+                gssize n = g_input_stream_read(G_INPUT_STREAM(in), buffer,
+                                               MIN((goffset) PEER_BUFFER_SIZE, remaining), NULL,
+                                               error);
+                if (n < 0)
+                        return FALSE;
+                if (n == 0) {
+                        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                    "%s truncated while serving it", file);
+                        return FALSE;
+                }
+                if (!g_output_stream_write_all(out, buffer, n, NULL, NULL, error))
+                        return FALSE;
+                remaining -= n;
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Serve one request on connection.
+ *
+ * @param[in]  connection Connection of a peer
+ * @param[out] error      Error
+ * @return TRUE if the request was answered, FALSE otherwise (error set)
+ */
+static gboolean serve_request(GSocketConnection *connection, GError **error)
+{
+        GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+        g_autoptr(GDataInputStream) in = NULL;
+        g_autofree gchar *request = NULL, *range = NULL, *file = NULL;
+        g_autoptr(GString) headers = NULL;
+        g_auto(GStrv) parts = NULL;
+        goffset size = 0, start = 0, end = 0;
+        gboolean partial = FALSE;
+
+        g_socket_set_timeout(g_socket_connection_get_socket(connection), PEER_SOCKET_TIMEOUT);
+
+        in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+        g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+        g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(in), FALSE);
+
+        request = g_data_input_stream_read_line(in, NULL, NULL, error);
+        if (!request) {
+                if (error && !*error)
+                        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                                    "Connection closed before request");
+                return FALSE;
+        }
+
+        // only the Range header is of interest
+        while (1) {
+                g_autofree gchar *line = g_data_input_stream_read_line(in, NULL, NULL, error);
+
+                if (!line) {
+                        if (error && !*error)
+                                g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                                            "Connection closed within request headers");
+                        return FALSE;
+                }
+                if (!*line)
+                        break;
+                if (!g_ascii_strncasecmp(line, "Range:", strlen("Range:"))) {
+                        g_free(range);
+                        range = g_strstrip(g_strdup(line + strlen("Range:")));
+                }
+        }
+
+        parts = g_strsplit(request, " ", 3);
+        if (g_strv_length(parts) != 3)
+                return send_status(out, 400, "Bad Request", NULL, error);
+        if (g_strcmp0(parts[0], "GET") && g_strcmp0(parts[0], "HEAD"))
+                return send_status(out, 405, "Method Not Allowed", "Allow: GET, HEAD\r\n", error);
+
+        if (g_str_has_prefix(parts[1], PEER_ARTIFACT_PREFIX))
+                file = lookup_artifact(parts[1] + strlen(PEER_ARTIFACT_PREFIX), &size);
+        if (!file)
+                return send_status(out, 404, "Not Found", NULL, error);
+
+        end = size - 1;
+        if (range) {
+                g_autofree gchar *unsatisfiable = NULL;
+
+                if (!parse_range(range, size, &start, &end)) {
+                        unsatisfiable = g_strdup_printf("Content-Range: bytes */%" G_GOFFSET_FORMAT
+                                                        "\r\n", size);
+                        return send_status(out, 416, "Range Not Satisfiable", unsatisfiable,
+                                           error);
+                }
+                partial = start > 0 || end < size - 1;
+        }
+
+        g_debug("Serving %s bytes %" G_GOFFSET_FORMAT "-%" G_GOFFSET_FORMAT " to peer", parts[1],
+                start, end);
+
+        headers = g_string_new(NULL);
+        g_string_append_printf(headers, "HTTP/1.1 %s\r\n"
+                               "Content-Type: application/octet-stream\r\n"
+                               "Content-Length: %" G_GOFFSET_FORMAT "\r\n"
+                               "Accept-Ranges: bytes\r\n",
+                               partial ? "206 Partial Content" : "200 OK", end - start + 1);
+        if (partial)
+                g_string_append_printf(headers, "Content-Range: bytes %" G_GOFFSET_FORMAT "-%"
+                                       G_GOFFSET_FORMAT "/%" G_GOFFSET_FORMAT "\r\n",
+                                       start, end, size);
+        g_string_append(headers, "Connection: close\r\n\r\n");
+
+        if (!g_output_stream_write_all(out, headers->str, headers->len, NULL, NULL, error))
+                return FALSE;
+
+        if (!g_strcmp0(parts[0], "HEAD") || !size)
+                return TRUE;
+
+        return send_file(out, file, start, end, error);
+}
+
+/**
+ * @brief GThreadedSocketService::run handler, called in a thread of the service.
+ */
+static gboolean peer_server_run(GThreadedSocketService *service, GSocketConnection *connection,
+                                GObject *source_object, gpointer user_data)
+{
+        g_autoptr(GError) error = NULL;
+
+        if (!serve_request(connection, &error))
+                g_debug("Peer request failed: %s", error->message);
+
+        return TRUE;
+}
+
+gboolean peer_server_start(GMainContext *context, gint port, const gchar *cache_dir,
+                           GError **error)
+{
+        g_autoptr(GSocketService) service = NULL;
+
+        g_return_val_if_fail(port > 0 && port <= G_MAXUINT16, FALSE);
+        g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+        g_return_val_if_fail(!peer_server.service, FALSE);
+
+        // connections are accepted in the thread-default context when a port is added
+        g_main_context_push_thread_default(context);
+        service = g_threaded_socket_service_new(PEER_MAX_CONNECTIONS);
+        g_signal_connect(service, "run", G_CALLBACK(peer_server_run), NULL);
+        if (!g_socket_listener_add_inet_port(G_SOCKET_LISTENER(service), port, NULL, error)) {
+                g_main_context_pop_thread_default(context);
+                g_prefix_error(error, "Failed to listen on port %d: ", port);
+                return FALSE;
+        }
+        g_socket_service_start(service);
+        g_main_context_pop_thread_default(context);
+
+        g_mutex_lock(&peer_server.mutex);
+        peer_server.service = g_steal_pointer(&service);
+        peer_server.artifacts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                      (GDestroyNotify) peer_artifact_free);
+        peer_server.cache_dir = g_strdup(cache_dir);
+        if (peer_server.cache_dir)
+                scan_cache_dir();
+        g_mutex_unlock(&peer_server.mutex);
+
+        g_message("Sharing artifacts with peers on port %d", port);
+
+        return TRUE;
+}
+
+void peer_server_stop(void)
+{
+        g_autoptr(GSocketService) service = NULL;
+
+        g_mutex_lock(&peer_server.mutex);
+        service = g_steal_pointer(&peer_server.service);
+        g_clear_pointer(&peer_server.artifacts, g_hash_table_destroy);
+        g_clear_pointer(&peer_server.cache_dir, g_free);
+        g_clear_pointer(&peer_server.cache_action, g_free);
+        g_mutex_unlock(&peer_server.mutex);
+
+        if (!service)
+                return;
+
+        g_socket_service_stop(service);
+        g_socket_listener_close(G_SOCKET_LISTENER(service));
+}
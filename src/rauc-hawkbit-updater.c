@@ -163,6 +163,7 @@ int main(int argc, char **argv)
 
         setup_logging(PROGRAM, log_level, opt_output_systemd);
         hawkbit_init(config, on_new_software_ready_cb);
+        hawkbit_set_config_file(config_file);
 
         return hawkbit_start_service_sync();
 }
@@ -5,6 +5,10 @@
  *
  * @file
  * @brief RAUC client
+ *
+ * A single long-lived installer thread owns the D-Bus connection and the RAUC proxy. Install
+ * requests are queued as jobs and processed one after another via asynchronous InstallBundle
+ * calls, so callers never block on a previous installation.
  */
 
 #include <gio/gio.h>
@@ -14,8 +18,96 @@
 #include "gobject/gclosure.h"
 #include "rauc-installer.h"
 #include "rauc-installer-gen.h"
+#include "scheduling.h"
 
-static GThread *thread_install = NULL;
+/**
+ * @brief State of the installer service, all members except mutex/jobs are only accessed from
+ *        the installer thread.
+ */
+static struct {
+        GMutex mutex;                         /**< protects thread and jobs */
+        GThread *thread;                      /**< installer thread, started on first install */
+        GMainContext *context;                /**< GMainContext of the installer thread */
+        GQueue jobs;                          /**< pending install_context jobs */
+        RInstaller *proxy;                    /**< RAUC D-Bus proxy, created lazily */
+        struct install_context *current;      /**< job currently being installed */
+} installer = { 0 };
+
+static gboolean installer_dispatch_next(gpointer data);
+
+/**
+ * @brief Create and init a install_context
+ *
+ * @return Pointer to initialized install_context struct. Should be freed by calling
+ *         install_context_free().
+ */
+static struct install_context *install_context_new(void)
+{
+        struct install_context *context = g_new0(struct install_context, 1);
+
+        g_mutex_init(&context->status_mutex);
+        g_cond_init(&context->finished_cond);
+        g_queue_init(&context->status_messages);
+        context->status_result = -2;
+
+        return context;
+}
+
+/**
+ * @brief Free a install_context and its members
+ *
+ * @param[in] context the install_context struct that should be freed.
+ *                    If NULL
+ */
+static void install_context_free(struct install_context *context)
+{
+        if (!context)
+                return;
+
+        g_free(context->bundle);
+        g_free(context->auth_header);
+        g_mutex_clear(&context->status_mutex);
+        g_cond_clear(&context->finished_cond);
+
+        g_assert_cmpint(context->status_result, >=, 0);
+        g_assert_true(g_queue_is_empty(&context->status_messages));
+        g_free(context);
+}
+
+/**
+ * @brief Finish the current job: notify the result of the RAUC installation, then either wake up
+ *        the waiting caller or free the job. Starts the next queued job.
+ *
+ * @param[in] result installation result, 0 on success
+ */
+static void installer_job_finish(gint result)
+{
+        struct install_context *context = installer.current;
+
+        g_return_if_fail(context);
+
+        installer.current = NULL;
+
+        g_mutex_lock(&context->status_mutex);
+        context->status_result = result;
+        g_mutex_unlock(&context->status_mutex);
+
+        // Notify the result of the RAUC installation
+        if (context->notify_complete)
+                context->notify_complete(context);
+
+        // on wait, calling function will take care of freeing after reading context->status_result
+        if (context->keep_install_context) {
+                g_mutex_lock(&context->status_mutex);
+                context->finished = TRUE;
+                g_cond_signal(&context->finished_cond);
+                g_mutex_unlock(&context->status_mutex);
+        } else {
+                install_context_free(context);
+        }
+
+        installer_dispatch_next(NULL);
+}
 
 /**
  * @brief RAUC DBUS property changed callback
@@ -25,23 +117,26 @@ static GThread *thread_install = NULL;
 static void on_installer_status(GDBusProxy *proxy, GVariant *changed,
                                 const gchar* const *invalidated, gpointer data)
 {
-        struct install_context *context = data;
+        struct install_context *context = installer.current;
         gint32 percentage;
         g_autofree gchar *message = NULL;
 
         g_return_if_fail(changed);
-        g_return_if_fail(context);
         g_debug("ON_INSTALLER_STATUS");
 
         if (invalidated && invalidated[0]) {
                 g_warning("RAUC DBUS service disappeared");
-                g_mutex_lock(&context->status_mutex);
-                context->status_result = 2;
-                g_mutex_unlock(&context->status_mutex);
-                g_main_loop_quit(context->mainloop);
+                // recreate proxy on next job
+                g_signal_handlers_disconnect_by_data(installer.proxy, &installer);
+                g_clear_object(&installer.proxy);
+                if (context)
+                        installer_job_finish(2);
                 return;
         }
 
+        if (!context)
+                return;
+
         if (context->notify_event) {
                 gboolean status_received = FALSE;
                 g_debug("NOTIFY_EVENT");
@@ -74,80 +169,107 @@ static void on_installer_status(GDBusProxy *proxy, GVariant *changed,
  */
 static void on_installer_completed(GDBusProxy *proxy, gint result, gpointer data)
 {
-        struct install_context *context = data;
-
-        g_return_if_fail(context);
         g_debug("ON_INSTALLER_COMPLETED");
-        g_mutex_lock(&context->status_mutex);
-        context->status_result = result;
-        g_mutex_unlock(&context->status_mutex);
+
+        if (!installer.current) {
+                g_debug("Ignoring completion of installation not started by us");
+                return;
+        }
 
         if (result >= 0)
-                g_main_loop_quit(context->mainloop);
+                installer_job_finish(result);
 }
 
 /**
- * @brief Create and init a install_context
+ * @brief Get RAUC DBUS proxy, creating it (and connecting its signals) on first use or after the
+ *        connection was lost.
  *
- * @return Pointer to initialized install_context struct. Should be freed by calling
- *         install_context_free().
+ * @param[out] error Error
+ * @return RInstaller* owned by the installer service, NULL on error (error set)
  */
-static struct install_context *install_context_new(void)
+static RInstaller* installer_get_proxy(GError **error)
 {
-        struct install_context *context = g_new0(struct install_context, 1);
+        GBusType bus_type = (!g_strcmp0(g_getenv("DBUS_STARTER_BUS_TYPE"), "session"))
+                            ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM;
+        g_autoptr(RInstaller) proxy = NULL;
 
-        g_mutex_init(&context->status_mutex);
-        g_queue_init(&context->status_messages);
-        context->status_result = -2;
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
-        return context;
+        if (installer.proxy &&
+            !g_dbus_connection_is_closed(g_dbus_proxy_get_connection(G_DBUS_PROXY(installer.proxy))))
+                return installer.proxy;
+
+        if (installer.proxy) {
+                g_signal_handlers_disconnect_by_data(installer.proxy, &installer);
+                g_clear_object(&installer.proxy);
+        }
+
+        g_debug("Creating RAUC DBUS proxy");
+        proxy = r_installer_proxy_new_for_bus_sync(
+                bus_type, G_DBUS_PROXY_FLAGS_GET_INVALIDATED_PROPERTIES,
+                "de.pengutronix.rauc", "/", NULL, error);
+        if (!proxy) {
+                g_prefix_error(error, "Failed to create RAUC DBUS proxy: ");
+                return NULL;
+        }
+        if (g_signal_connect(proxy, "g-properties-changed",
+                             G_CALLBACK(on_installer_status), &installer) <= 0) {
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to connect properties-changed signal");
+                return NULL;
+        }
+        if (g_signal_connect(proxy, "completed",
+                             G_CALLBACK(on_installer_completed), &installer) <= 0) {
+                g_signal_handlers_disconnect_by_data(proxy, &installer);
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to connect completed signal");
+                return NULL;
+        }
+
+        installer.proxy = g_steal_pointer(&proxy);
+        return installer.proxy;
 }
 
 /**
- * @brief Free a install_context and its members
- *
- * @param[in] context the install_context struct that should be freed.
- *                    If NULL
+ * @brief Async InstallBundle reply callback. On success, the job completes with the "completed"
+ *        signal, otherwise it is finished right away.
  */
-static void install_context_free(struct install_context *context)
+static void on_install_bundle_ready(GObject *source, GAsyncResult *res, gpointer data)
 {
-        if (!context)
-                return;
-
-        g_free(context->bundle);
-        g_free(context->auth_header);
-        g_mutex_clear(&context->status_mutex);
+        g_autoptr(GError) error = NULL;
 
-        // make sure all pending events are processed
-        while (g_main_context_iteration(context->loop_context, FALSE));
-        g_main_context_unref(context->loop_context);
+        if (r_installer_call_install_bundle_finish(R_INSTALLER(source), res, &error))
+                return;
 
-        g_assert_cmpint(context->status_result, >=, 0);
-        g_assert_true(g_queue_is_empty(&context->status_messages));
-        g_main_loop_unref(context->mainloop);
-        g_free(context);
+        g_warning("%s", error->message);
+        if (installer.current == data)
+                installer_job_finish(2);
 }
 
 /**
- * @brief RAUC client mainloop
+ * @brief Start next queued job, if no installation is running. Runs in installer thread.
  *
- * Install mainloop running until installation completes.
- * @param[in] data pointer to a install_context struct.
- * @return NULL is always returned.
+ * @param[in] data unused
+ * @return G_SOURCE_REMOVE is always returned
  */
-static gpointer install_loop_thread(gpointer data)
+static gboolean installer_dispatch_next(gpointer data)
 {
-        GBusType bus_type = (!g_strcmp0(g_getenv("DBUS_STARTER_BUS_TYPE"), "session"))
-                            ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM;
-        RInstaller *r_installer_proxy = NULL;
-        g_autoptr(GError) error = NULL;
         g_auto(GVariantDict) args = G_VARIANT_DICT_INIT(NULL);
+        g_autoptr(GError) error = NULL;
         struct install_context *context = NULL;
+        RInstaller *proxy = NULL;
+
+        if (installer.current)
+                return G_SOURCE_REMOVE;
 
-        g_return_val_if_fail(data, NULL);
+        g_mutex_lock(&installer.mutex);
+        context = g_queue_pop_head(&installer.jobs);
+        g_mutex_unlock(&installer.mutex);
+        if (!context)
+                return G_SOURCE_REMOVE;
+
+        installer.current = context;
 
-        context = data;
-        g_main_context_push_thread_default(context->loop_context);
         if (context->auth_header) {
                 gchar *headers[2] = {NULL, NULL};
                 headers[0] = context->auth_header;
@@ -156,49 +278,35 @@ static gpointer install_loop_thread(gpointer data)
                 g_variant_dict_insert(&args, "tls-no-verify", "b", !context->ssl_verify);
         }
 
-        g_debug("Creating RAUC DBUS proxy");
-        r_installer_proxy = r_installer_proxy_new_for_bus_sync(
-                bus_type, G_DBUS_PROXY_FLAGS_GET_INVALIDATED_PROPERTIES,
-                "de.pengutronix.rauc", "/", NULL, &error);
-        if (!r_installer_proxy) {
-                g_warning("Failed to create RAUC DBUS proxy: %s", error->message);
-                goto notify_complete;
-        }
-        if (g_signal_connect(r_installer_proxy, "g-properties-changed",
-                             G_CALLBACK(on_installer_status), context) <= 0) {
-                g_warning("Failed to connect properties-changed signal");
-                goto out_loop;
-        }
-        if (g_signal_connect(r_installer_proxy, "completed",
-                             G_CALLBACK(on_installer_completed), context) <= 0) {
-                g_warning("Failed to connect completed signal");
-                goto out_loop;
-        }
-
-        g_debug("Trying to contact RAUC DBUS service check123");
-        if (!r_installer_call_install_bundle_sync(r_installer_proxy, context->bundle,
-                                                  g_variant_dict_end(&args), NULL, &error)) {
-                g_debug("%s", error->message);
-                goto out_loop;
+        proxy = installer_get_proxy(&error);
+        if (!proxy) {
+                g_warning("%s", error->message);
+                installer_job_finish(2);
+                return G_SOURCE_REMOVE;
         }
 
-        g_main_loop_run(context->mainloop);
+        g_debug("Trying to contact RAUC DBUS service");
+        r_installer_call_install_bundle(proxy, context->bundle, g_variant_dict_end(&args), NULL,
+                                        on_install_bundle_ready, context);
 
-out_loop:
-        g_debug("OUT OF LOPP");
-        g_signal_handlers_disconnect_by_data(r_installer_proxy, context);
+        return G_SOURCE_REMOVE;
+}
 
-notify_complete:
-        // Notify the result of the RAUC installation
-        if (context->notify_complete)
-                context->notify_complete(context);
+/**
+ * @brief RAUC client mainloop, runs for the lifetime of the process.
+ *
+ * @param[in] data unused
+ * @return NULL is always returned.
+ */
+static gpointer installer_thread(gpointer data)
+{
+        g_autoptr(GMainLoop) loop = g_main_loop_new(installer.context, FALSE);
 
-        g_clear_pointer(&r_installer_proxy, g_object_unref);
-        g_main_context_pop_thread_default(context->loop_context);
+        scheduling_apply_to_thread("installer");
+        g_main_context_push_thread_default(installer.context);
+        g_main_loop_run(loop);
+        g_main_context_pop_thread_default(installer.context);
 
-        // on wait, calling function will take care of freeing after reading context->status_result
-        if (!context->keep_install_context)
-                install_context_free(context);
         return NULL;
 }
 
@@ -206,39 +314,45 @@ gboolean rauc_install(const gchar *bundle, const gchar *auth_header, gboolean ss
                       GSourceFunc on_install_notify, GSourceFunc on_install_complete,
                       gboolean wait)
 {
-        GMainContext *loop_context = NULL;
         struct install_context *context = NULL;
 
         g_return_val_if_fail(bundle, FALSE);
 
-        loop_context = g_main_context_new();
+        g_mutex_lock(&installer.mutex);
+        if (!installer.thread) {
+                installer.context = g_main_context_new();
+                installer.thread = g_thread_new("installer", installer_thread, NULL);
+        }
+
         context = install_context_new();
         context->bundle = g_strdup(bundle);
         context->auth_header = g_strdup(auth_header);
         context->ssl_verify = ssl_verify;
         context->notify_event = on_install_notify;
         context->notify_complete = on_install_complete;
-        context->mainloop = g_main_loop_new(loop_context, FALSE);
-        context->loop_context = loop_context;
+        context->loop_context = installer.context;
         context->status_result = 2;
         context->keep_install_context = wait;
         g_debug("RAUC_INSTALL");
-        // unref/free previous install thread by joining it
-        if (thread_install)
-                g_thread_join(thread_install);
 
-        // start install thread
-        thread_install = g_thread_new("installer", install_loop_thread, (gpointer) context);
+        g_queue_push_tail(&installer.jobs, context);
+        g_mutex_unlock(&installer.mutex);
+
+        g_main_context_invoke(installer.context, installer_dispatch_next, NULL);
+
         if (wait) {
                 gboolean result;
 
-                g_thread_join(thread_install);
+                g_mutex_lock(&context->status_mutex);
+                while (!context->finished)
+                        g_cond_wait(&context->finished_cond, &context->status_mutex);
                 result = context->status_result == 0;
+                g_mutex_unlock(&context->status_mutex);
 
                 install_context_free(context);
                 return result;
         }
 
-        // return immediately if we did not wait for the install thread
+        // return immediately if we did not wait for the installation
         return TRUE;
 }
@@ -0,0 +1,186 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief CPU and I/O scheduling of updater work
+ *
+ * Worker threads (downloads, hashing, flashing) get a configurable nice level or SCHED_IDLE, an
+ * I/O priority class and CPU affinity, so they do not compete with the primary workload of the
+ * device. Processes spawned by them (bootloader) inherit these. Optionally the whole updater is
+ * moved into a cgroup v2 sub-tree with its own CPU and I/O weights.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <glib/gstdio.h>
+#include "scheduling.h"
+
+// see linux/ioprio.h, not provided by older kernel headers
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#define IOPRIO_WHO_PROCESS 1
+
+static struct {
+        gint nice;                    /**< nice level, 0 leaves it unchanged */
+        gboolean idle;                /**< use SCHED_IDLE */
+        IoClass io_class;             /**< I/O scheduling class, IO_CLASS_NONE leaves it unchanged */
+        gint io_priority;             /**< I/O priority within io_class */
+        gboolean affinity;            /**< restrict threads to cpus */
+        cpu_set_t cpus;               /**< CPUs threads may run on */
+} scheduling;
+
+/**
+ * @brief Write value to file of cgroup.
+ *
+ * @param[in]  cgroup Directory of the cgroup
+ * @param[in]  file   Interface file of the cgroup, e.g. "cpu.weight"
+ * @param[in]  value  Value to write
+ * @param[out] error  Error
+ * @return TRUE if written, FALSE otherwise (error set)
+ */
+static gboolean cgroup_write(const gchar *cgroup, const gchar *file, const gchar *value,
+                             GError **error)
+{
+        g_autofree gchar *path = g_build_filename(cgroup, file, NULL);
+        FILE *fp = NULL;
+        gboolean res;
+
+        // cgroup files must be written at once, g_file_set_contents() would replace them
+        fp = g_fopen(path, "w");
+        if (!fp) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Failed to open %s: %s", path, g_strerror(err));
+                return FALSE;
+        }
+
+        res = fputs(value, fp) >= 0;
+        res = (fclose(fp) == 0) && res;
+        if (!res) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Failed to write '%s' to %s: %s", value, path, g_strerror(err));
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * @brief Move the updater into cgroup and set its weights. The controllers are enabled in the
+ *        parent cgroup after moving, as a cgroup with enabled controllers must not contain
+ *        processes itself.
+ *
+ * @param[in]  config Config with cgroup settings
+ * @param[out] error  Error
+ * @return TRUE if the updater was moved, FALSE otherwise (error set)
+ */
+static gboolean cgroup_setup(const Config *config, GError **error)
+{
+        g_autofree gchar *parent = g_path_get_dirname(config->cgroup);
+        g_autofree gchar *weight = NULL;
+        g_autoptr(GError) ierror = NULL;
+
+        if (g_mkdir(config->cgroup, 0755) != 0 && errno != EEXIST) {
+                int err = errno;
+                g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(err),
+                            "Failed to create cgroup %s: %s", config->cgroup, g_strerror(err));
+                return FALSE;
+        }
+
+        // "0" is the writing process, threads and children started later follow
+        if (!cgroup_write(config->cgroup, "cgroup.procs", "0", error))
+                return FALSE;
+
+        if (config->cgroup_cpu_weight > 0) {
+                if (!cgroup_write(parent, "cgroup.subtree_control", "+cpu", &ierror)) {
+                        g_debug("%s", ierror->message);
+                        g_clear_error(&ierror);
+                }
+                weight = g_strdup_printf("%d", config->cgroup_cpu_weight);
+                if (!cgroup_write(config->cgroup, "cpu.weight", weight, error))
+                        return FALSE;
+                g_clear_pointer(&weight, g_free);
+        }
+
+        if (config->cgroup_io_weight > 0) {
+                if (!cgroup_write(parent, "cgroup.subtree_control", "+io", &ierror)) {
+                        g_debug("%s", ierror->message);
+                        g_clear_error(&ierror);
+                }
+                weight = g_strdup_printf("default %d", config->cgroup_io_weight);
+                if (!cgroup_write(config->cgroup, "io.weight", weight, error))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+void scheduling_init(const Config *config)
+{
+        g_autoptr(GError) error = NULL;
+
+        g_return_if_fail(config);
+
+        scheduling.nice = config->worker_nice;
+        scheduling.idle = config->worker_sched_idle;
+        scheduling.io_class = config->worker_io_class;
+        scheduling.io_priority = config->worker_io_priority;
+
+        CPU_ZERO(&scheduling.cpus);
+        scheduling.affinity = config->worker_cpus != NULL;
+        // validated by load_config_file()
+        for (gchar **cpu = config->worker_cpus; cpu && *cpu; cpu++)
+                CPU_SET(g_ascii_strtoull(*cpu, NULL, 10), &scheduling.cpus);
+
+        if (!config->cgroup)
+                return;
+
+        if (!cgroup_setup(config, &error)) {
+                g_warning("Failed to set up cgroup %s: %s", config->cgroup, error->message);
+                return;
+        }
+
+        g_debug("Moved to cgroup %s", config->cgroup);
+}
+
+void scheduling_apply_to_thread(const gchar *name)
+{
+        // the thread id, setpriority() and ioprio_set() act on single threads on Linux
+        pid_t tid = syscall(SYS_gettid);
+
+        if (scheduling.nice && setpriority(PRIO_PROCESS, tid, scheduling.nice) != 0)
+                g_warning("Failed to set nice level %d of %s thread: %s", scheduling.nice, name,
+                          g_strerror(errno));
+
+        if (scheduling.idle) {
+                struct sched_param param = { .sched_priority = 0 };
+                int err = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+                if (err)
+                        g_warning("Failed to set SCHED_IDLE for %s thread: %s", name,
+                                  g_strerror(err));
+        }
+
+        if (scheduling.io_class != IO_CLASS_NONE &&
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+                    IOPRIO_PRIO_VALUE(scheduling.io_class, scheduling.io_priority)) != 0)
+                g_warning("Failed to set I/O priority of %s thread: %s", name, g_strerror(errno));
+
+        if (scheduling.affinity) {
+                int err = pthread_setaffinity_np(pthread_self(), sizeof(scheduling.cpus),
+                                                 &scheduling.cpus);
+
+                if (err)
+                        g_warning("Failed to set CPU affinity of %s thread: %s", name,
+                                  g_strerror(err));
+        }
+}
@@ -0,0 +1,463 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Persistence of the action state machine for warm starts
+ *
+ * The state file is a key file with an [action] group (target, id, phase, last feedback), an
+ * [artifactN] group per artifact and, while final feedback is pending, a [feedback] group. It is
+ * rewritten atomically at every transition and removed once hawkBit acknowledged the final
+ * feedback.
+ */
+
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "state-file.h"
+
+#define STATE_GROUP_ACTION   "action"
+#define STATE_GROUP_FEEDBACK "feedback"
+
+static const gchar *phase_names[] = {
+        [STATE_PHASE_DOWNLOADING] = "downloading",
+        [STATE_PHASE_INSTALLING] = "installing",
+        [STATE_PHASE_RETRYING] = "retrying",
+        [STATE_PHASE_FEEDBACK] = "feedback",
+};
+
+static gchar *state_path = NULL;
+static GKeyFile *state = NULL;        /**< state of current action, NULL if none */
+static GMutex state_mutex;            /**< protects state, written from downloader thread too */
+
+void state_file_init(const gchar *path)
+{
+        g_mutex_lock(&state_mutex);
+        g_free(state_path);
+        state_path = g_strdup(path);
+        g_clear_pointer(&state, g_key_file_unref);
+        g_mutex_unlock(&state_mutex);
+}
+
+/**
+ * @brief Write state to state_path atomically. Must be called with state_mutex locked.
+ */
+static void state_save(void)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *data = NULL;
+        gsize length;
+
+        if (!state_path || !state)
+                return;
+
+        data = g_key_file_to_data(state, &length, NULL);
+        if (!g_file_set_contents(state_path, data, length, &error))
+                g_warning("Failed to save state: %s", error->message);
+}
+
+/**
+ * @brief Whether id is the action currently persisted. Must be called with state_mutex locked.
+ */
+static gboolean state_is_action(const gchar *id)
+{
+        g_autofree gchar *state_id = NULL;
+
+        if (!state || !id)
+                return FALSE;
+
+        state_id = g_key_file_get_string(state, STATE_GROUP_ACTION, "id", NULL);
+        return !g_strcmp0(state_id, id);
+}
+
+/**
+ * @brief Forget state and remove state file. Must be called with state_mutex locked.
+ */
+static void state_remove(void)
+{
+        g_clear_pointer(&state, g_key_file_unref);
+        if (state_path && g_unlink(state_path) && errno != ENOENT)
+                g_warning("Failed to remove state file %s: %s", state_path, g_strerror(errno));
+}
+
+static StatePhase phase_from_string(const gchar *name, GError **error)
+{
+        for (guint i = 0; i < G_N_ELEMENTS(phase_names); i++) {
+                if (!g_strcmp0(name, phase_names[i]))
+                        return i;
+        }
+
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Unknown phase '%s'", name);
+        return STATE_PHASE_DOWNLOADING;
+}
+
+static Artifact* artifact_from_group(GKeyFile *key_file, const gchar *group, GError **error)
+{
+        g_autoptr(Artifact) artifact = g_new0(Artifact, 1);
+        GError *ierror = NULL;
+
+        artifact->name = g_key_file_get_string(key_file, group, "name", &ierror);
+        if (!artifact->name)
+                goto error;
+        artifact->download_url = g_key_file_get_string(key_file, group, "download_url", &ierror);
+        if (!artifact->download_url)
+                goto error;
+        artifact->feedback_url = g_key_file_get_string(key_file, group, "feedback_url", &ierror);
+        if (!artifact->feedback_url)
+                goto error;
+        artifact->size = g_key_file_get_int64(key_file, group, "size", &ierror);
+        if (ierror)
+                goto error;
+
+        artifact->version = g_key_file_get_string(key_file, group, "version", NULL);
+        artifact->sha1 = g_key_file_get_string(key_file, group, "sha1", NULL);
+        artifact->sha256 = g_key_file_get_string(key_file, group, "sha256", NULL);
+        artifact->md5 = g_key_file_get_string(key_file, group, "md5", NULL);
+        artifact->do_install = g_key_file_get_boolean(key_file, group, "do_install", NULL);
+        artifact->install_can = g_key_file_get_boolean(key_file, group, "install_can", NULL);
+        artifact->config_install = g_key_file_get_boolean(key_file, group, "config_install",
+                                                          NULL);
+        artifact->rollback = g_key_file_get_boolean(key_file, group, "rollback", NULL);
+
+        return g_steal_pointer(&artifact);
+
+error:
+        g_propagate_prefixed_error(error, ierror, "[%s]: ", group);
+        return NULL;
+}
+
+/**
+ * @brief Add devices whose flashing of artifact name is retried to saved->flash_retries.
+ */
+static void flash_retries_from_group(SavedAction *saved, GKeyFile *key_file, const gchar *group,
+                                     const gchar *name)
+{
+        g_autofree gint *ids = NULL;
+        GArray *device_ids = NULL;
+        gsize length = 0;
+
+        ids = g_key_file_get_integer_list(key_file, group, "retry_devices", &length, NULL);
+        if (!ids || !length)
+                return;
+
+        if (!saved->flash_retries)
+                saved->flash_retries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                             (GDestroyNotify) g_array_unref);
+        device_ids = g_array_sized_new(FALSE, FALSE, sizeof(gint), length);
+        g_array_append_vals(device_ids, ids, length);
+        g_hash_table_replace(saved->flash_retries, g_strdup(name), device_ids);
+}
+
+/**
+ * @brief Parse action persisted in key_file.
+ */
+static SavedAction* saved_action_new(GKeyFile *key_file, GError **error)
+{
+        g_autoptr(SavedAction) saved = g_new0(SavedAction, 1);
+        g_auto(GStrv) groups = NULL;
+        g_autofree gchar *phase = NULL;
+        GError *ierror = NULL;
+
+        saved->controller_id = g_key_file_get_string(key_file, STATE_GROUP_ACTION, "target",
+                                                     &ierror);
+        if (!saved->controller_id)
+                goto error;
+        saved->id = g_key_file_get_string(key_file, STATE_GROUP_ACTION, "id", &ierror);
+        if (!saved->id)
+                goto error;
+        phase = g_key_file_get_string(key_file, STATE_GROUP_ACTION, "phase", &ierror);
+        if (!phase)
+                goto error;
+        saved->phase = phase_from_string(phase, &ierror);
+        if (ierror)
+                goto error;
+        saved->firmware = g_key_file_get_boolean(key_file, STATE_GROUP_ACTION, "firmware", NULL);
+        saved->last_feedback = g_key_file_get_string(key_file, STATE_GROUP_ACTION,
+                                                     "last_feedback", NULL);
+        saved->flashed = g_key_file_get_integer(key_file, STATE_GROUP_ACTION, "flashed", NULL);
+        saved->failed = g_key_file_get_integer(key_file, STATE_GROUP_ACTION, "failed", NULL);
+
+        if (saved->phase == STATE_PHASE_FEEDBACK) {
+                saved->feedback_url = g_key_file_get_string(key_file, STATE_GROUP_FEEDBACK, "url",
+                                                            &ierror);
+                if (!saved->feedback_url)
+                        goto error;
+                saved->feedback_detail = g_key_file_get_string(key_file, STATE_GROUP_FEEDBACK,
+                                                               "detail", &ierror);
+                if (!saved->feedback_detail)
+                        goto error;
+                saved->feedback_finished = g_key_file_get_string(key_file, STATE_GROUP_FEEDBACK,
+                                                                 "finished", &ierror);
+                if (!saved->feedback_finished)
+                        goto error;
+                saved->feedback_execution = g_key_file_get_string(key_file, STATE_GROUP_FEEDBACK,
+                                                                  "execution", &ierror);
+                if (!saved->feedback_execution)
+                        goto error;
+        }
+
+        groups = g_key_file_get_groups(key_file, NULL);
+        for (gchar **group = groups; *group; group++) {
+                Artifact *artifact = NULL;
+
+                if (!g_str_has_prefix(*group, "artifact"))
+                        continue;
+
+                artifact = artifact_from_group(key_file, *group, &ierror);
+                if (!artifact)
+                        goto error;
+                saved->artifacts = g_list_prepend(saved->artifacts, artifact);
+
+                if (saved->phase == STATE_PHASE_RETRYING)
+                        flash_retries_from_group(saved, key_file, *group, artifact->name);
+        }
+        saved->artifacts = g_list_reverse(saved->artifacts);
+
+        return g_steal_pointer(&saved);
+
+error:
+        g_propagate_error(error, ierror);
+        return NULL;
+}
+
+SavedAction* state_file_load(GError **error)
+{
+        g_autoptr(GKeyFile) key_file = g_key_file_new();
+        SavedAction *saved = NULL;
+        GError *ierror = NULL;
+
+        g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+        g_mutex_lock(&state_mutex);
+        g_clear_pointer(&state, g_key_file_unref);
+
+        if (!state_path || !g_file_test(state_path, G_FILE_TEST_EXISTS))
+                goto out;
+
+        if (!g_key_file_load_from_file(key_file, state_path, G_KEY_FILE_NONE, &ierror) ||
+            !(saved = saved_action_new(key_file, &ierror))) {
+                g_propagate_prefixed_error(error, ierror, "Invalid state file %s: ", state_path);
+                state_remove();
+                goto out;
+        }
+
+        state = g_steal_pointer(&key_file);
+
+out:
+        g_mutex_unlock(&state_mutex);
+        return saved;
+}
+
+void state_file_begin(const gchar *controller_id, const gchar *id)
+{
+        g_return_if_fail(controller_id);
+        g_return_if_fail(id);
+
+        g_mutex_lock(&state_mutex);
+        if (!state_path)
+                goto out;
+
+        g_clear_pointer(&state, g_key_file_unref);
+        state = g_key_file_new();
+        g_key_file_set_string(state, STATE_GROUP_ACTION, "target", controller_id);
+        g_key_file_set_string(state, STATE_GROUP_ACTION, "id", id);
+        g_key_file_set_string(state, STATE_GROUP_ACTION, "phase",
+                              phase_names[STATE_PHASE_DOWNLOADING]);
+        state_save();
+
+out:
+        g_mutex_unlock(&state_mutex);
+}
+
+/**
+ * @brief Set string key unless value is NULL.
+ */
+static void set_string(const gchar *group, const gchar *key, const gchar *value)
+{
+        if (value)
+                g_key_file_set_string(state, group, key, value);
+}
+
+void state_file_set_artifacts(gboolean firmware, GList *artifacts)
+{
+        guint n = 0;
+
+        g_mutex_lock(&state_mutex);
+        if (!state)
+                goto out;
+
+        g_key_file_set_boolean(state, STATE_GROUP_ACTION, "firmware", firmware);
+        for (GList *l = artifacts; l; l = l->next, n++) {
+                const Artifact *artifact = l->data;
+                g_autofree gchar *group = g_strdup_printf("artifact%u", n);
+
+                set_string(group, "name", artifact->name);
+                set_string(group, "version", artifact->version);
+                g_key_file_set_int64(state, group, "size", artifact->size);
+                set_string(group, "download_url", artifact->download_url);
+                set_string(group, "feedback_url", artifact->feedback_url);
+                set_string(group, "sha1", artifact->sha1);
+                set_string(group, "sha256", artifact->sha256);
+                set_string(group, "md5", artifact->md5);
+                g_key_file_set_boolean(state, group, "do_install", artifact->do_install);
+                g_key_file_set_boolean(state, group, "install_can", artifact->install_can);
+                g_key_file_set_boolean(state, group, "config_install", artifact->config_install);
+                g_key_file_set_boolean(state, group, "rollback", artifact->rollback);
+                g_key_file_set_int64(state, group, "downloaded", 0);
+        }
+        state_save();
+
+out:
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_set_phase(StatePhase phase)
+{
+        g_mutex_lock(&state_mutex);
+        if (state) {
+                g_key_file_set_string(state, STATE_GROUP_ACTION, "phase", phase_names[phase]);
+                state_save();
+        }
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_set_downloaded(const Artifact *artifact, goffset bytes)
+{
+        g_auto(GStrv) groups = NULL;
+
+        g_return_if_fail(artifact);
+
+        g_mutex_lock(&state_mutex);
+        if (!state)
+                goto out;
+
+        groups = g_key_file_get_groups(state, NULL);
+        for (gchar **group = groups; *group; group++) {
+                g_autofree gchar *name = g_key_file_get_string(state, *group, "name", NULL);
+
+                if (!g_str_has_prefix(*group, "artifact") || g_strcmp0(name, artifact->name))
+                        continue;
+
+                if (g_key_file_get_int64(state, *group, "downloaded", NULL) != bytes) {
+                        g_key_file_set_int64(state, *group, "downloaded", bytes);
+                        state_save();
+                }
+                break;
+        }
+
+out:
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_set_flash_counts(guint flashed, guint failed)
+{
+        g_mutex_lock(&state_mutex);
+        if (state) {
+                g_key_file_set_integer(state, STATE_GROUP_ACTION, "flashed", flashed);
+                g_key_file_set_integer(state, STATE_GROUP_ACTION, "failed", failed);
+                state_save();
+        }
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_set_flash_retries(const Artifact *artifact, GArray *device_ids)
+{
+        g_auto(GStrv) groups = NULL;
+
+        g_return_if_fail(artifact);
+        g_return_if_fail(device_ids);
+
+        g_mutex_lock(&state_mutex);
+        if (!state)
+                goto out;
+
+        groups = g_key_file_get_groups(state, NULL);
+        for (gchar **group = groups; *group; group++) {
+                g_autofree gchar *name = g_key_file_get_string(state, *group, "name", NULL);
+
+                if (!g_str_has_prefix(*group, "artifact") || g_strcmp0(name, artifact->name))
+                        continue;
+
+                if (device_ids->len)
+                        g_key_file_set_integer_list(state, *group, "retry_devices",
+                                                    (gint *) device_ids->data, device_ids->len);
+                else
+                        g_key_file_remove_key(state, *group, "retry_devices", NULL);
+                state_save();
+                break;
+        }
+
+out:
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_feedback_pending(const gchar *url, const gchar *id, const gchar *detail,
+                                 const gchar *finished, const gchar *execution)
+{
+        g_mutex_lock(&state_mutex);
+        if (state_is_action(id)) {
+                g_key_file_set_string(state, STATE_GROUP_ACTION, "phase",
+                                      phase_names[STATE_PHASE_FEEDBACK]);
+                g_key_file_set_string(state, STATE_GROUP_FEEDBACK, "url", url);
+                g_key_file_set_string(state, STATE_GROUP_FEEDBACK, "detail", detail);
+                g_key_file_set_string(state, STATE_GROUP_FEEDBACK, "finished", finished);
+                g_key_file_set_string(state, STATE_GROUP_FEEDBACK, "execution", execution);
+                state_save();
+        }
+        g_mutex_unlock(&state_mutex);
+}
+
+void state_file_feedback_sent(const gchar *id, const gchar *detail, const gchar *execution)
+{
+        g_mutex_lock(&state_mutex);
+        if (state_is_action(id)) {
+                if (!g_strcmp0(execution, "closed")) {
+                        state_remove();
+                } else {
+                        g_key_file_set_string(state, STATE_GROUP_ACTION, "last_feedback", detail);
+                        state_save();
+                }
+        }
+        g_mutex_unlock(&state_mutex);
+}
+
+SavedAction* state_file_get_pending_feedback(void)
+{
+        g_autofree gchar *phase = NULL;
+        SavedAction *saved = NULL;
+
+        g_mutex_lock(&state_mutex);
+        if (state)
+                phase = g_key_file_get_string(state, STATE_GROUP_ACTION, "phase", NULL);
+        if (!g_strcmp0(phase, phase_names[STATE_PHASE_FEEDBACK]))
+                saved = saved_action_new(state, NULL);
+        g_mutex_unlock(&state_mutex);
+
+        return saved;
+}
+
+void state_file_clear(void)
+{
+        g_mutex_lock(&state_mutex);
+        if (state)
+                state_remove();
+        g_mutex_unlock(&state_mutex);
+}
+
+void saved_action_free(SavedAction *saved)
+{
+        if (!saved)
+                return;
+
+        g_free(saved->controller_id);
+        g_free(saved->id);
+        g_list_free_full(saved->artifacts, (GDestroyNotify) artifact_free);
+        if (saved->flash_retries)
+                g_hash_table_destroy(saved->flash_retries);
+        g_free(saved->last_feedback);
+        g_free(saved->feedback_url);
+        g_free(saved->feedback_detail);
+        g_free(saved->feedback_finished);
+        g_free(saved->feedback_execution);
+        g_free(saved);
+}
@@ -0,0 +1,102 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * @file
+ * @brief Tracked worker threads reporting completion to a main context
+ */
+
+#include "loop-monitor.h"
+#include "scheduling.h"
+#include "worker.h"
+
+/**
+ * @brief Worker started by worker_start().
+ */
+typedef struct Worker_ {
+        gchar *name;                  /**< name used in log messages */
+        WorkerFunc func;              /**< function run in the worker thread */
+        gpointer data;                /**< data passed to func */
+        WorkerDoneFunc done;          /**< completion callback or NULL */
+        gpointer user_data;           /**< data passed to done */
+        GMainContext *context;        /**< context to dispatch done in */
+        gint64 started;               /**< monotonic time the worker was started [us] */
+        gboolean result;              /**< return value of func */
+} Worker;
+
+static gint workers = 0;              /**< workers whose completion was not dispatched yet */
+
+static void worker_free(Worker *worker)
+{
+        g_free(worker->name);
+        g_main_context_unref(worker->context);
+        g_free(worker);
+}
+
+/**
+ * @brief Completion of a worker, dispatched by the context the worker was started for.
+ *
+ * @param[in] data Worker (freed)
+ * @return G_SOURCE_REMOVE is always returned
+ */
+static gboolean worker_ready(gpointer data)
+{
+        Worker *worker = data;
+
+        g_debug("Worker %s finished after %.1f s (%s)", worker->name,
+                (double) (g_get_monotonic_time() - worker->started) / G_USEC_PER_SEC,
+                worker->result ? "succeeded" : "failed");
+
+        g_atomic_int_dec_and_test(&workers);
+        if (worker->done)
+                worker->done(worker->result, worker->user_data);
+
+        worker_free(worker);
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief GThreadFunc running the worker's function.
+ *
+ * @param[in] data Worker
+ * @return NULL is always returned
+ */
+static gpointer worker_thread(gpointer data)
+{
+        Worker *worker = data;
+
+        // the thread is dedicated to the worker, so the scheduling applied ends with it instead of
+        // affecting GLib's shared thread pool
+        scheduling_apply_to_thread(worker->name);
+        worker->result = worker->func(worker->data);
+
+        loop_monitor_invoke(worker->context, worker->name, worker_ready, worker);
+        return NULL;
+}
+
+void worker_start(GMainContext *context, const gchar *name, WorkerFunc func, gpointer data,
+                  WorkerDoneFunc done, gpointer user_data)
+{
+        Worker *worker = NULL;
+
+        g_return_if_fail(name);
+        g_return_if_fail(func);
+
+        worker = g_new0(Worker, 1);
+        worker->name = g_strdup(name);
+        worker->func = func;
+        worker->data = data;
+        worker->done = done;
+        worker->user_data = user_data;
+        worker->context = g_main_context_ref(context ? context : g_main_context_default());
+        worker->started = g_get_monotonic_time();
+
+        g_atomic_int_inc(&workers);
+        g_debug("Starting worker %s", name);
+        // nobody joins the thread, it is freed once it returns
+        g_thread_unref(g_thread_new(worker->name, worker_thread, worker));
+}
+
+guint worker_count(void)
+{
+        return g_atomic_int_get(&workers);
+}
@@ -8,6 +8,7 @@ from configparser import ConfigParser
 
 import pytest
 
+from ddi_mock import DDIMock
 from hawkbit_mgmt import HawkbitMgmtTestClient, HawkbitError
 from helper import run_pexpect, available_port
 
@@ -332,3 +333,60 @@ def partial_download_port(nginx_proxy):
         'limit_rate': '70k',
     }
     return nginx_proxy(location_options)
+
+@pytest.fixture
+def ddi_mock():
+    """
+    Runs a local hawkBit DDI API mock (see ddi_mock.py) on an available port. Latency, bandwidth,
+    connection drops and HTTP error injection can be configured on the returned DDIMock.
+    """
+    with DDIMock(port=available_port(), polling_sleep='00:00:01') as mock:
+        yield mock
+
+@pytest.fixture
+def mock_config(tmp_path, ddi_mock):
+    """
+    Creates a temporary rauc-hawkbit-updater configuration pointing to the ddi_mock fixture.
+    Returns a function accepting options to add/overwrite or remove, similar to adjust_config.
+    """
+    import sqlite3
+
+    database = tmp_path / 'devices.db'
+    with sqlite3.connect(database) as db:
+        db.execute('CREATE TABLE IF NOT EXISTS DEVICES '
+                   '(ID INTEGER, NAME TEXT, FW TEXT, FW_LATEST TEXT, FW_FALLBACK TEXT, HW TEXT)')
+
+    def _mock_config(options={'client': {}}, remove={}):
+        mock_config = ConfigParser()
+        mock_config['client'] = {
+            'hawkbit_server': ddi_mock.address,
+            'ssl': 'false',
+            'ssl_verify': 'false',
+            'tenant_id': ddi_mock.tenant,
+            'target_name': 'mock-target',
+            'auth_token': 'mock-token',
+            'bundle_download_location': str(tmp_path / 'bundle.raucb'),
+            'database_location': str(database),
+            'retry_wait': '60',
+            'connect_timeout': '20',
+            'timeout': '60',
+            'log_level': 'debug',
+        }
+        mock_config['device'] = {
+            'product': 'Terminator',
+            'hw_revision': '2',
+        }
+
+        for section, option in options.items():
+            for key, value in option.items():
+                mock_config.set(section, key, value)
+
+        for section, option in remove.items():
+            mock_config.remove_option(section, option)
+
+        tmp_config = tmp_path / 'rauc-hawkbit-updater-mock.conf'
+        with tmp_config.open('w') as f:
+            mock_config.write(f)
+        return tmp_config
+
+    return _mock_config
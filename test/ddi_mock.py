@@ -0,0 +1,537 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: LGPL-2.1-only
+
+"""
+Self-contained stand-in for the hawkBit DDI (Direct Device Integration) API.
+
+Implements the endpoints rauc-hawkbit-updater talks to:
+
+- GET  /{tenant}/controller/v1/{controller_id}                        (base poll)
+- PUT  /{tenant}/controller/v1/{controller_id}/configData
+- GET  /{tenant}/controller/v1/{controller_id}/deploymentBase/{action}
+- POST /{tenant}/controller/v1/{controller_id}/deploymentBase/{action}/feedback
+- GET  /{tenant}/controller/v1/{controller_id}/cancelAction/{action}
+- POST /{tenant}/controller/v1/{controller_id}/cancelAction/{action}/feedback
+- GET  /{tenant}/controller/v1/{controller_id}/softwaremodules/{module}/artifacts/{filename}
+
+Artifacts are served with HTTP Range support. Per-request latency, bandwidth limits, connection
+drops mid-transfer and 409/429 injection allow benchmarking download, resume and retry behavior
+without a real hawkBit instance.
+
+Can be used in-process (see DDIMock) or standalone:
+
+    python3 -m ddi_mock --port 8081 --artifact bundle.raucb --bandwidth 70k --drop-after 200k
+"""
+
+import hashlib
+import json
+import re
+import threading
+import time
+from dataclasses import dataclass, field
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+
+
+def parse_size(value):
+    """Parses sizes like '512', '70k', '2M' into bytes. Returns None for None."""
+    if value is None:
+        return None
+    value = str(value).strip()
+    factors = {'k': 1024, 'm': 1024**2, 'g': 1024**3}
+    if value[-1].lower() in factors:
+        return int(float(value[:-1]) * factors[value[-1].lower()])
+    return int(value)
+
+
+@dataclass
+class MockArtifact:
+    """Artifact served by the mock, content is kept in memory."""
+    filename: str
+    content: bytes
+    module_id: int = 1
+    size: int = None  # size announced in the deployment, defaults to len(content)
+    links: bool = True  # announce download links in the deployment
+
+    @property
+    def hashes(self):
+        return {
+            'sha1': hashlib.sha1(self.content).hexdigest(),
+            'md5': hashlib.md5(self.content).hexdigest(),
+            'sha256': hashlib.sha256(self.content).hexdigest(),
+        }
+
+
+@dataclass
+class MockChunk:
+    """Deployment chunk (software module) referencing one or more artifacts."""
+    name: str
+    version: str
+    artifacts: list
+    part: str = 'os'
+    metadata: dict = field(default_factory=dict)
+
+
+@dataclass
+class MockAction:
+    """Deployment or cancel action assigned to a target."""
+    id: int
+    chunks: list
+    download: str = 'forced'
+    update: str = 'forced'
+    maintenance_window: str = None
+    canceled: bool = False
+    finished: bool = False
+
+
+@dataclass
+class Fault:
+    """HTTP error injected for requests whose path matches `pattern`."""
+    pattern: str
+    status: int
+    count: int = 1
+    retry_after: int = None
+
+
+class DDIMock:
+    """
+    hawkBit DDI mock server running in a background thread.
+
+    Knobs (all can be changed at runtime):
+    - latency: seconds to sleep before each response
+    - bandwidth: artifact download rate limit in bytes/s (None for unlimited)
+    - drop_after: close the connection after sending this many artifact bytes (None to disable)
+    - drop_count: number of connections to drop before serving artifacts normally again
+    - ignore_range: serve whole artifacts regardless of Range requests, like some mirrors do
+    - polling_sleep: polling interval announced in the base resource (HH:MM:SS)
+    """
+    def __init__(self, host='localhost', port=0, tenant='DEFAULT', polling_sleep='00:00:05',
+                 latency=0.0, bandwidth=None, drop_after=None, drop_count=1, ignore_range=False):
+        self.tenant = tenant
+        self.polling_sleep = polling_sleep
+        self.latency = latency
+        self.bandwidth = parse_size(bandwidth)
+        self.drop_after = parse_size(drop_after)
+        self.drop_count = drop_count
+        self.ignore_range = ignore_range
+
+        self.lock = threading.Lock()
+        self.artifacts = {}
+        self.actions = {}
+        self.active = {}
+        self.faults = []
+        self.config_data = {}
+        self.feedback = []
+        self.requests = []
+        self.request_times = []
+        self.config_data_requested = set()
+        self._next_action_id = 1
+
+        self._server = ThreadingHTTPServer((host, port), _make_handler(self))
+        self._server.daemon_threads = True
+        self._thread = None
+
+    @property
+    def host(self):
+        return self._server.server_address[0]
+
+    @property
+    def port(self):
+        return self._server.server_address[1]
+
+    @property
+    def address(self):
+        return f'{self.host}:{self.port}'
+
+    def start(self):
+        self._thread = threading.Thread(target=self._server.serve_forever, daemon=True)
+        self._thread.start()
+        return self
+
+    def stop(self):
+        self._server.shutdown()
+        self._server.server_close()
+        if self._thread:
+            self._thread.join()
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *args):
+        self.stop()
+
+    def add_artifact(self, path=None, content=None, filename=None, module_id=1):
+        """Adds an artifact from file `path` or `content` bytes. Returns MockArtifact."""
+        if path is not None:
+            content = Path(path).read_bytes()
+            filename = filename or Path(path).name
+        artifact = MockArtifact(filename or 'artifact.bin', content, module_id)
+        with self.lock:
+            self.artifacts[(module_id, artifact.filename)] = artifact
+        return artifact
+
+    def assign(self, controller_id, chunks, **kwargs):
+        """
+        Assigns a deployment consisting of `chunks` (list of MockChunk) to `controller_id`.
+        Returns the action ID.
+        """
+        with self.lock:
+            action = MockAction(self._next_action_id, chunks, **kwargs)
+            self._next_action_id += 1
+            self.actions[action.id] = action
+            self.active[controller_id] = action
+        return action.id
+
+    def assign_artifact(self, controller_id, artifact, name='bundle', version='1.0', **kwargs):
+        """Assigns a single chunk deployment containing `artifact` to `controller_id`."""
+        return self.assign(controller_id, [MockChunk(name, version, [artifact])], **kwargs)
+
+    def cancel(self, controller_id):
+        """Cancels the active action of `controller_id`."""
+        with self.lock:
+            self.active[controller_id].canceled = True
+
+    def inject(self, pattern, status, count=1, retry_after=None):
+        """
+        Responds to the next `count` requests with a path matching regex `pattern` with HTTP
+        `status` (e.g. 409 or 429) and an optional Retry-After header.
+        """
+        with self.lock:
+            self.faults.append(Fault(pattern, status, count, retry_after))
+
+    def requests_matching(self, pattern, method=None):
+        """Returns recorded (method, path, headers) tuples with path matching regex `pattern`."""
+        with self.lock:
+            return [r for r in self.requests
+                    if re.search(pattern, r[1]) and (method is None or r[0] == method)]
+
+    def request_time(self, pattern, method=None):
+        """
+        Returns time.monotonic() of the first recorded request with path matching regex `pattern`
+        or None.
+        """
+        with self.lock:
+            for (r_method, path, _), at in zip(self.requests, self.request_times):
+                if re.search(pattern, path) and (method is None or r_method == method):
+                    return at
+        return None
+
+    def feedback_for(self, action_id):
+        """Returns feedback JSON documents received for given action ID."""
+        with self.lock:
+            return [fb for aid, fb in self.feedback if aid == action_id]
+
+    # request handling, called from handler threads
+
+    def _take_fault(self, path):
+        with self.lock:
+            for fault in self.faults:
+                if fault.count > 0 and re.search(fault.pattern, path):
+                    fault.count -= 1
+                    return fault
+        return None
+
+    def _take_drop(self):
+        with self.lock:
+            if self.drop_after is None or self.drop_count <= 0:
+                return None
+            self.drop_count -= 1
+            return self.drop_after
+
+    def _base_url(self, handler, controller_id):
+        host = handler.headers.get('Host', self.address)
+        return f'http://{host}/{self.tenant}/controller/v1/{controller_id}'
+
+    def base(self, handler, controller_id):
+        links = {}
+        base_url = self._base_url(handler, controller_id)
+        with self.lock:
+            if controller_id not in self.config_data_requested:
+                links['configData'] = {'href': f'{base_url}/configData'}
+            action = self.active.get(controller_id)
+            if action and not action.finished:
+                if action.canceled:
+                    links['cancelAction'] = {'href': f'{base_url}/cancelAction/{action.id}'}
+                else:
+                    links['deploymentBase'] = {
+                        'href': f'{base_url}/deploymentBase/{action.id}?c=-{action.id}'}
+
+        return {'config': {'polling': {'sleep': self.polling_sleep}}, '_links': links}
+
+    def deployment(self, handler, controller_id, action_id):
+        base_url = self._base_url(handler, controller_id)
+        with self.lock:
+            action = self.actions.get(action_id)
+        if not action:
+            return None
+
+        chunks = []
+        for chunk in action.chunks:
+            artifacts = []
+            for artifact in chunk.artifacts:
+                href = f'{base_url}/softwaremodules/{artifact.module_id}/artifacts/' \
+                       f'{artifact.filename}'
+                artifacts.append({
+                    'filename': artifact.filename,
+                    'hashes': artifact.hashes,
+                    'size': len(artifact.content) if artifact.size is None else artifact.size,
+                    '_links': {
+                        'download-http': {'href': href},
+                        'md5sum-http': {'href': f'{href}.MD5SUM'},
+                    } if artifact.links else {},
+                })
+            chunks.append({
+                'part': chunk.part,
+                'version': chunk.version,
+                'name': chunk.name,
+                'artifacts': artifacts,
+                'metadata': [{'key': k, 'value': v} for k, v in chunk.metadata.items()],
+            })
+
+        deployment = {'download': action.download, 'update': action.update, 'chunks': chunks}
+        if action.maintenance_window:
+            deployment['maintenanceWindow'] = action.maintenance_window
+
+        return {'id': str(action.id), 'deployment': deployment}
+
+    def cancel_action(self, controller_id, action_id):
+        with self.lock:
+            action = self.actions.get(action_id)
+        if not action or not action.canceled:
+            return None
+        return {'id': str(action.id), 'cancelAction': {'stopId': str(action.id)}}
+
+    def add_feedback(self, action_id, body):
+        with self.lock:
+            self.feedback.append((action_id, body))
+            action = self.actions.get(action_id)
+            if action and body.get('status', {}).get('execution') == 'closed':
+                action.finished = True
+
+
+def _make_handler(mock):
+    controller_re = re.compile(
+        rf'^/{re.escape(mock.tenant)}/controller/v1/(?P<controller>[^/?]+)(?P<rest>/[^?]*)?')
+
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = 'HTTP/1.1'
+
+        def log_message(self, format, *args):
+            pass
+
+        def _send_json(self, status, doc=None, headers={}):
+            body = json.dumps(doc).encode() if doc is not None else b''
+            self.send_response(status)
+            if doc is not None:
+                self.send_header('Content-Type', 'application/json')
+            for key, value in headers.items():
+                self.send_header(key, str(value))
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def _read_json(self):
+            length = int(self.headers.get('Content-Length', 0))
+            data = self.rfile.read(length) if length else b''
+            return json.loads(data) if data else None
+
+        def _prepare(self):
+            """Records request, applies latency and faults. Returns False if already handled."""
+            with mock.lock:
+                mock.requests.append((self.command, self.path, dict(self.headers)))
+                mock.request_times.append(time.monotonic())
+
+            if mock.latency:
+                time.sleep(mock.latency)
+
+            fault = mock._take_fault(self.path)
+            if fault:
+                # consume body to keep the connection usable
+                self._read_json()
+                headers = {'Retry-After': fault.retry_after} if fault.retry_after else {}
+                self._send_json(fault.status, {'errorCode': 'mock.injected',
+                                               'message': f'injected {fault.status}'}, headers)
+                return False
+            return True
+
+        def _route(self):
+            match = controller_re.match(self.path)
+            if not match:
+                return None, None
+            return match.group('controller'), (match.group('rest') or '').strip('/').split('/')
+
+        def do_GET(self):
+            if not self._prepare():
+                return
+            controller_id, parts = self._route()
+
+            if controller_id is None:
+                self._send_json(404)
+            elif parts == ['']:
+                self._send_json(200, mock.base(self, controller_id))
+            elif parts[0] == 'deploymentBase' and len(parts) == 2:
+                doc = mock.deployment(self, controller_id, int(parts[1]))
+                self._send_json(200 if doc else 404, doc)
+            elif parts[0] == 'cancelAction' and len(parts) == 2:
+                doc = mock.cancel_action(self, controller_id, int(parts[1]))
+                self._send_json(200 if doc else 404, doc)
+            elif parts[0] == 'softwaremodules' and len(parts) == 4 and parts[2] == 'artifacts':
+                self._send_artifact(int(parts[1]), parts[3])
+            else:
+                self._send_json(404)
+
+        def do_HEAD(self):
+            if not self._prepare():
+                return
+            controller_id, parts = self._route()
+
+            # base resource without body, used to probe servers
+            self.send_response(200 if controller_id is not None and parts == [''] else 404)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+
+        def do_PUT(self):
+            if not self._prepare():
+                return
+            controller_id, parts = self._route()
+            body = self._read_json()
+
+            if parts == ['configData']:
+                with mock.lock:
+                    mock.config_data[controller_id] = body
+                    mock.config_data_requested.add(controller_id)
+                self._send_json(200)
+            else:
+                self._send_json(404)
+
+        def do_POST(self):
+            if not self._prepare():
+                return
+            controller_id, parts = self._route()
+            body = self._read_json()
+
+            if parts and parts[0] in ('deploymentBase', 'cancelAction') and len(parts) == 3 and \
+                    parts[2] == 'feedback':
+                action_id = int(parts[1])
+                mock.add_feedback(action_id, body)
+                if parts[0] == 'cancelAction':
+                    with mock.lock:
+                        mock.actions[action_id].finished = True
+                self._send_json(200)
+            else:
+                self._send_json(404)
+
+        def _send_artifact(self, module_id, filename):
+            with mock.lock:
+                artifact = mock.artifacts.get((module_id, filename))
+            if not artifact:
+                self._send_json(404)
+                return
+
+            content = artifact.content
+            start, end = 0, len(content) - 1
+            status = 200
+
+            range_header = self.headers.get('Range')
+            if range_header and not mock.ignore_range:
+                match = re.fullmatch(r'bytes=(\d*)-(\d*)', range_header.strip())
+                if not match or (not match.group(1) and not match.group(2)):
+                    self._send_json(416, headers={'Content-Range': f'bytes */{len(content)}'})
+                    return
+                if match.group(1):
+                    start = int(match.group(1))
+                    if match.group(2):
+                        end = min(int(match.group(2)), end)
+                else:
+                    # suffix range: last N bytes
+                    start = max(0, len(content) - int(match.group(2)))
+                if start >= len(content) or start > end:
+                    self._send_json(416, headers={'Content-Range': f'bytes */{len(content)}'})
+                    return
+                status = 206
+
+            self.send_response(status)
+            self.send_header('Content-Type', 'application/octet-stream')
+            self.send_header('Accept-Ranges', 'bytes')
+            self.send_header('Content-Length', str(end - start + 1))
+            if status == 206:
+                self.send_header('Content-Range', f'bytes {start}-{end}/{len(content)}')
+            self.end_headers()
+
+            if self.command == 'HEAD':
+                return
+
+            self._write_throttled(memoryview(content)[start:end + 1], mock._take_drop())
+
+        def _write_throttled(self, data, drop_after):
+            piece_size = 16 * 1024
+            if mock.bandwidth:
+                # keep sleep granularity at ~10 pieces per second
+                piece_size = max(1, min(piece_size, mock.bandwidth // 10))
+
+            sent = 0
+            started = time.monotonic()
+            while sent < len(data):
+                piece = data[sent:sent + piece_size]
+                if drop_after is not None and sent + len(piece) > drop_after:
+                    self.wfile.write(piece[:max(0, drop_after - sent)])
+                    self.wfile.flush()
+                    self.close_connection = True
+                    self.connection.close()
+                    return
+                self.wfile.write(piece)
+                sent += len(piece)
+
+                if mock.bandwidth:
+                    ahead = sent / mock.bandwidth - (time.monotonic() - started)
+                    if ahead > 0:
+                        time.sleep(ahead)
+
+        do_HEAD = do_GET
+
+    return Handler
+
+
+if __name__ == '__main__':
+    import argparse
+
+    parser = argparse.ArgumentParser(description='hawkBit DDI API mock server')
+    parser.add_argument('--host', default='localhost')
+    parser.add_argument('--port', type=int, default=8081)
+    parser.add_argument('--tenant', default='DEFAULT')
+    parser.add_argument('--controller-id', default='test-target',
+                        help='Target to assign the artifact to')
+    parser.add_argument('--artifact', action='append', default=[],
+                        help='File to assign as deployment (one chunk per file)')
+    parser.add_argument('--polling-sleep', default='00:00:05')
+    parser.add_argument('--latency', type=float, default=0.0,
+                        help='Delay before each response in seconds')
+    parser.add_argument('--bandwidth', help='Artifact download rate limit, e.g. 70k')
+    parser.add_argument('--drop-after', help='Drop artifact connections after N bytes, e.g. 200k')
+    parser.add_argument('--drop-count', type=int, default=1,
+                        help='Number of connections to drop')
+    parser.add_argument('--inject', action='append', default=[], metavar='PATTERN:STATUS[:COUNT]',
+                        help='Inject HTTP errors, e.g. "configData:429:2"')
+    args = parser.parse_args()
+
+    mock = DDIMock(args.host, args.port, args.tenant, args.polling_sleep, args.latency,
+                   args.bandwidth, args.drop_after, args.drop_count)
+
+    chunks = []
+    for i, path in enumerate(args.artifact):
+        artifact = mock.add_artifact(path, module_id=i + 1)
+        chunks.append(MockChunk(Path(path).stem, '1.0', [artifact]))
+    if chunks:
+        mock.assign(args.controller_id, chunks)
+
+    for spec in args.inject:
+        pattern, status, *count = spec.rsplit(':', 2) if spec.count(':') >= 2 \
+                                  else spec.rsplit(':', 1)
+        mock.inject(pattern, int(status), int(count[0]) if count else 1)
+
+    with mock:
+        print(f'Serving on {mock.address}', flush=True)
+        try:
+            threading.Event().wait()
+        except KeyboardInterrupt:
+            pass
@@ -0,0 +1,777 @@
+# SPDX-License-Identifier: LGPL-2.1-only
+
+"""
+Tests running against the local DDI mock (ddi_mock.py) instead of a hawkBit instance. These
+exercise retry and resume paths deterministically.
+"""
+
+import http.server
+import re
+import signal
+import sqlite3
+import threading
+import urllib.error
+import urllib.request
+from datetime import datetime, timedelta
+
+import pytest
+from pexpect import EOF
+
+from helper import available_port, run, run_pexpect
+from ddi_mock import DDIMock, MockChunk
+
+def test_mock_register(ddi_mock, mock_config):
+    """Register against the mock and check configData and the auth header arrive."""
+    config = mock_config()
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'MESSAGE: Checking for new software...' in out
+    assert err == ''
+    assert exitcode == 0
+
+    assert ddi_mock.config_data['mock-target']['data']['product'] == 'Terminator'
+    [(_, _, headers)] = ddi_mock.requests_matching('/configData$', 'PUT')
+    assert headers['Authorization'] == 'TargetToken mock-token'
+
+def test_mock_config_data_retry(ddi_mock, mock_config):
+    """Inject 409/429 on configData and make sure the request is retried."""
+    ddi_mock.inject('/configData$', 429)
+    ddi_mock.inject('/configData$', 409)
+
+    config = mock_config()
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert err == ''
+    assert exitcode == 0
+    assert len(ddi_mock.requests_matching('/configData$', 'PUT')) == 3
+    assert 'mock-target' in ddi_mock.config_data
+
+def test_mock_download_drop_with_resume(ddi_mock, mock_config, rauc_bundle):
+    """Drop the artifact connection mid-transfer and make sure the download resumes via Range."""
+    ddi_mock.bandwidth = 256 * 1024
+    ddi_mock.drop_after = 200 * 1024
+    ddi_mock.drop_count = 2
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+
+    config = mock_config({'client': {'resume_downloads': 'true'}})
+
+    # ignore failing installation
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert len(re.findall('Resuming download from offset [1-9]', out)) == 2
+    assert 'Download complete.' in out
+    assert 'File checksum OK.' in out
+
+    downloads = ddi_mock.requests_matching(f'/artifacts/{artifact.filename}$', 'GET')
+    assert len(downloads) == 3
+    assert [h.get('Range') for _, _, h in downloads[1:]] == \
+            ['bytes=204800-', 'bytes=409600-']
+
+def test_mock_download_resume_range_ignored(ddi_mock, mock_config, rauc_bundle):
+    """
+    Drop the artifact connection mid-transfer and make sure the download starts over from a server
+    ignoring the Range request of the resumed transfer instead of failing to resume forever.
+    """
+    ddi_mock.bandwidth = 256 * 1024
+    ddi_mock.drop_after = 200 * 1024
+    ddi_mock.ignore_range = True
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+
+    config = mock_config({'client': {'resume_downloads': 'true'}})
+
+    # ignore failing installation
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Resuming download from offset 204800' in out
+    assert 'does not support range requests, restarting download' in out
+    assert 'File checksum OK.' in out
+
+    downloads = ddi_mock.requests_matching(f'/artifacts/{artifact.filename}$', 'GET')
+    assert [h.get('Range') for _, _, h in downloads] == [None, 'bytes=204800-', None]
+
+def test_mock_download_mirror_stall(ddi_mock, mock_config, rauc_bundle):
+    """
+    Download from a mirror that stalls and make sure the download switches to hawkBit mid-transfer,
+    resuming via Range instead of starting over.
+    """
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+
+    with DDIMock(port=available_port(), bandwidth='4k') as mirror:
+        mirror.add_artifact(rauc_bundle)
+        config = mock_config({'client': {
+            'download_mirrors': f'http://{ddi_mock.address}/=http://{mirror.address}/',
+            'download_stall_rate': '16384',
+            'download_stall_time': '2',
+        }})
+
+        # ignore failing installation
+        out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+        assert mirror.requests_matching(f'/artifacts/{artifact.filename}$', 'GET')
+
+    assert f'Download from http://{mirror.address}/' in out
+    assert 'stalled below 16384 bytes/s' in out
+    assert 'File checksum OK.' in out
+
+    [(_, _, headers)] = ddi_mock.requests_matching(f'/artifacts/{artifact.filename}$', 'GET')
+    assert re.fullmatch('bytes=[1-9][0-9]*-', headers.get('Range', ''))
+
+def test_mock_download_drop_without_resume(ddi_mock, mock_config, rauc_bundle):
+    """Drop the artifact connection mid-transfer without resuming configured."""
+    ddi_mock.drop_after = 100 * 1024
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+
+    config = mock_config()
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Start downloading: ' in out
+    assert err.strip() == 'WARNING: Download failed: Transferred a partial file'
+    assert exitcode == 1
+
+    [feedback] = ddi_mock.feedback_for(1)[-1:]
+    assert feedback['status']['result']['finished'] == 'failure'
+
+def test_mock_gateway_targets(ddi_mock, mock_config):
+    """Serve multiple targets in gateway mode and make sure each of them is polled/registered."""
+    config = mock_config(
+        {'client': {'gateway_token': 'mock-gateway', 'gateway_targets': 'sub-1, sub-2'}},
+        remove={'client': 'auth_token'},
+    )
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Gateway mode: serving 3 targets.' in out
+    assert err == ''
+    assert exitcode == 0
+
+    for target in ('mock-target', 'sub-1', 'sub-2'):
+        [(_, _, headers)] = ddi_mock.requests_matching(f'/controller/v1/{target}$', 'GET')
+        assert headers['Authorization'] == 'GatewayToken mock-gateway'
+        assert target in ddi_mock.config_data
+
+    assert ddi_mock.config_data['sub-1']['data'] == {'gateway': 'mock-target'}
+
+def test_mock_gateway_deferred_deployment(ddi_mock, mock_config, rauc_bundle):
+    """
+    Assign deployments to two targets served in gateway mode and make sure only one is processed
+    at a time.
+    """
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+    ddi_mock.assign_artifact('sub-1', artifact)
+
+    config = mock_config(
+        {'client': {'gateway_token': 'mock-gateway', 'gateway_targets': 'sub-1'}},
+        remove={'client': 'auth_token'},
+    )
+
+    # ignore failing installation
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Deferring action of sub-1, deployment of mock-target in progress.' in out
+    assert len(ddi_mock.requests_matching('/deploymentBase/', 'GET')) == 1
+
+def test_mock_many_chunks(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a generated deployment with thousands of firmware chunks and make sure chunks beyond
+    the first 255 are matched against the device database as well.
+    """
+    chunks_num = 2000
+    matching = (3, 300, chunks_num - 1)
+
+    config = mock_config()
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.executemany('INSERT INTO DEVICES VALUES (?, ?, "0.1", "0.1", "0.1", "5.0")',
+                       [(i, f'scale-fw-{i}') for i in matching])
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    chunks = [MockChunk(f'scale-fw-{i}', '1.0', [artifact], part='bApp',
+                        metadata={'HW': '2.0', 'install': 'no'}) for i in range(chunks_num)]
+    ddi_mock.assign('mock-target', chunks)
+
+    # ignore download/installation result
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r', timeout=60)
+
+    ready = re.findall(r'FW: New software ready for download \(Name: (\S+),', out)
+    assert ready == [f'scale-fw-{i}' for i in matching]
+
+def test_mock_chunk_version_matching(ddi_mock, mock_config, tmp_path):
+    """
+    Assign firmware chunks to devices with semantic versions and hardware ranges and make sure only
+    chunks newer than the firmware of a compatible device are downloaded. Devices are not flashed
+    again with the version they run, including its patch level.
+    """
+    devices = [
+        # name, FW, FW_LATEST, HW
+        ('same-fw', '1.2.3', '1.2.3', '5.0'),
+        ('patch-fw', '1.2.3', '1.2.3', '5.0'),
+        ('older-fw', '1.2.3', '1.2.3', '5.0'),
+        ('prerelease-fw', '1.2.3', '1.2.3', '5.0'),
+        ('release-fw', '1.3.0-rc.1', '1.3.0-rc.1', '5.0'),
+        ('numeric-fw', '1.9.0', '1.9.0', '5.0'),
+        ('lagging-fw', '1.0', '1.2.3', '5.0'),
+        ('hw-below-fw', '1.0', '1.0', '5.0.1'),
+        ('hw-within-fw', '1.0', '1.0', '5.0.2'),
+    ]
+    chunks = [
+        # name, version, HW
+        ('same-fw', '1.2.3', '2.0'),
+        ('patch-fw', '1.2.4', '2.0'),
+        ('older-fw', '1.2.2', '2.0'),
+        ('prerelease-fw', '1.2.4-rc.1', '2.0'),
+        ('release-fw', '1.3.0', '2.0'),
+        ('numeric-fw', '1.10.0', '2.0'),
+        ('lagging-fw', '1.2.3', '2.0'),
+        ('hw-below-fw', '2.0', '>=5.0.2, <6'),
+        ('hw-within-fw', '2.0', '>=5.0.2, <6'),
+    ]
+
+    config = mock_config()
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.executemany('INSERT INTO DEVICES VALUES (?, ?, ?, ?, "0.1", ?)',
+                       [(i, *device) for i, device in enumerate(devices)])
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    ddi_mock.assign('mock-target', [MockChunk(name, version, [artifact], part='bApp',
+                                              metadata={'HW': hw, 'install': 'no'})
+                                    for name, version, hw in chunks])
+
+    # ignore download/installation result
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    ready = re.findall(r'FW: New software ready for download \(Name: (\S+),', out)
+    assert ready == ['patch-fw', 'prerelease-fw', 'release-fw', 'numeric-fw', 'hw-within-fw']
+
+def test_mock_deployment_exceeds_staging_space(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a firmware deployment larger than the free space of the staging directories and make
+    sure it fails with a single feedback message before any artifact is downloaded.
+    """
+    config = mock_config({'client': {'staging_dirs': str(tmp_path / 'staging')}})
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.executemany('INSERT INTO DEVICES VALUES (?, ?, "0.1", "0.1", "0.1", "5.0")',
+                       [(i, f'staging-fw-{i}') for i in range(2)])
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    artifact.size = 2**50
+    chunks = [MockChunk(f'staging-fw-{i}', '1.0', [artifact], part='bApp') for i in range(2)]
+    action_id = ddi_mock.assign('mock-target', chunks)
+
+    out, err, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert re.search(r'Deployment needs [\d.]+ PB, but only .* available in staging directories',
+                     err)
+    assert not ddi_mock.requests_matching('/artifacts/', 'GET')
+
+    [feedback] = ddi_mock.feedback_for(action_id)
+    assert feedback['status']['execution'] == 'closed'
+    assert feedback['status']['result']['finished'] == 'failure'
+    assert feedback['status']['details'][0].startswith('Deployment needs')
+
+def test_mock_firmware_without_download_link(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a firmware chunk without download links and make sure the deployment fails instead of
+    reporting an empty deployment as installed.
+    """
+    config = mock_config()
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.execute('INSERT INTO DEVICES VALUES (7, "linkless-fw", "1.0", "1.0", "0.1", "5.0")')
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    artifact.links = False
+    action_id = ddi_mock.assign('mock-target', [MockChunk('linkless-fw', '2.0', [artifact],
+                                                          part='bApp', metadata={'HW': '2.0'})])
+
+    run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    [feedback] = ddi_mock.feedback_for(action_id)
+    assert feedback['status']['execution'] == 'closed'
+    assert feedback['status']['result']['finished'] == 'failure'
+    assert feedback['status']['details'] == \
+        ['Firmware linkless-fw: no "$._links.download{-http,}.href"']
+
+def test_mock_deployment_memory_released(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a firmware deployment and make sure the memory of the deployment is released as a
+    unit once the action completes, reporting its size and the process RSS.
+    """
+    config = mock_config()
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.executemany('INSERT INTO DEVICES VALUES (?, ?, "0.1", "0.1", "0.1", "5.0")',
+                       [(i, f'arena-fw-{i}') for i in range(3)])
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    chunks = [MockChunk(f'arena-fw-{i}', '1.0', [artifact], part='bApp',
+                        metadata={'install': 'no'}) for i in range(3)]
+    ddi_mock.assign('mock-target', chunks)
+
+    # ignore download/installation result
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r', timeout=60)
+
+    released = re.findall(r'Released deployment memory: [\d.]+ [kMG]?B in (\d+) allocations .*'
+                          r'\(high-water mark [\d.]+ [kMG]?B\), RSS [\d.]+ [kMG]?B', out)
+    assert len(released) == 1
+    assert int(released[0]) > 0
+
+def test_mock_warm_start_resends_final_feedback(ddi_mock, mock_config, tmp_path):
+    """
+    Start with a state file holding final feedback not acknowledged before a restart and make sure
+    it is re-sent before the first poll, closing the action.
+    """
+    action_id = ddi_mock.assign_artifact('mock-target', ddi_mock.add_artifact(content=b'bundle'))
+    feedback_url = f'http://{ddi_mock.address}/{ddi_mock.tenant}/controller/v1/mock-target/' \
+                   f'deploymentBase/{action_id}/feedback'
+    state = tmp_path / 'state'
+    state.write_text(f'[action]\ntarget=mock-target\nid={action_id}\nphase=feedback\n'
+                     f'[feedback]\nurl={feedback_url}\ndetail=Software bundle installed successfully.\n'
+                     f'finished=success\nexecution=closed\n')
+    config = mock_config({'client': {'state_file': str(state)}})
+
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert f'Re-sending final feedback of action {action_id}.' in out
+    assert err == ''
+    assert exitcode == 0
+    assert not state.exists()
+
+    method, path, _ = ddi_mock.requests[0]
+    assert (method, path) == ('POST', f'/{ddi_mock.tenant}/controller/v1/mock-target/'
+                                      f'deploymentBase/{action_id}/feedback')
+    [feedback] = ddi_mock.feedback_for(action_id)
+    assert feedback['status']['result']['finished'] == 'success'
+    assert not ddi_mock.requests_matching('/deploymentBase/', 'GET')
+
+def test_mock_warm_start_resumes_download(ddi_mock, mock_config, tmp_path, rauc_bundle):
+    """
+    Start with a state file and a partial bundle left by a download interrupted by a restart and
+    make sure the download resumes right away instead of processing the deployment again.
+    """
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    action_id = ddi_mock.assign_artifact('mock-target', artifact)
+    base_url = f'http://{ddi_mock.address}/{ddi_mock.tenant}/controller/v1/mock-target'
+    partial = 100 * 1024
+    (tmp_path / 'bundle.raucb').write_bytes(artifact.content[:partial])
+
+    state = tmp_path / 'state'
+    state.write_text(f'[action]\ntarget=mock-target\nid={action_id}\nphase=downloading\n'
+                     f'firmware=false\nlast_feedback=Download started.\n'
+                     f'[artifact0]\nname=bundle\nversion=1.0\nsize={len(artifact.content)}\n'
+                     f'download_url={base_url}/softwaremodules/1/artifacts/{artifact.filename}\n'
+                     f'feedback_url={base_url}/deploymentBase/{action_id}/feedback\n'
+                     f'sha1={artifact.hashes["sha1"]}\ndo_install=true\ndownloaded={partial}\n')
+    config = mock_config({'client': {'state_file': str(state)}})
+
+    # ignore failing installation
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert f'Resuming action {action_id} after restart (downloading, last feedback: ' \
+           f'Download started.).' in out
+    assert 'File checksum OK.' in out
+
+    [(_, _, headers)] = ddi_mock.requests_matching(f'/artifacts/{artifact.filename}$', 'GET')
+    assert headers.get('Range') == f'bytes={partial}-'
+    assert not ddi_mock.requests_matching('/deploymentBase/', 'GET')
+
+def test_mock_cancel_during_download_latency(ddi_mock, mock_config, rauc_bundle):
+    """
+    Cancel the action while its bundle is downloaded and make sure the transfer is aborted and the
+    cancelation acknowledged right away instead of after the download finished.
+    """
+    ddi_mock.bandwidth = 64 * 1024
+    action_id = ddi_mock.assign_artifact('mock-target', ddi_mock.add_artifact(rauc_bundle))
+    config = mock_config()
+
+    # note: -r would prevent further polling of the base resource announcing the cancelation
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect('Start downloading: ')
+    ddi_mock.cancel('mock-target')
+
+    # do not wait longer than 5 s (poll interval) + 3 s (processing margin)
+    proc.expect(f'Received cancelation for action {action_id}', timeout=8)
+    proc.expect('Action canceled.', timeout=2)
+    proc.terminate(force=True)
+    proc.expect(EOF)
+
+    assert 'Download complete' not in proc.before
+
+    requested = ddi_mock.request_time(f'/cancelAction/{action_id}$', 'GET')
+    acknowledged = ddi_mock.request_time(f'/cancelAction/{action_id}/feedback$', 'POST')
+    assert acknowledged - requested < 1.0
+
+    feedback = ddi_mock.feedback_for(action_id)[-1]
+    assert feedback['status']['execution'] == 'closed'
+    assert feedback['status']['details'] == ['Action canceled.']
+
+def test_mock_poll_during_download(ddi_mock, mock_config, rauc_bundle):
+    """
+    Throttle a bundle download and make sure the base resource is still polled at its interval
+    meanwhile, as the main loop never waits for the download worker.
+    """
+    ddi_mock.bandwidth = 64 * 1024
+    ddi_mock.assign_artifact('mock-target', ddi_mock.add_artifact(rauc_bundle))
+    config = mock_config({'client': {'loop_stall_threshold': '500'}})
+
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect('Start downloading: ')
+    polls = len(ddi_mock.requests_matching('/controller/v1/mock-target$', 'GET'))
+
+    # download takes 8 s, polling every second must go on (1 s interval + 1 s margin each)
+    for _ in range(3):
+        assert proc.expect(['Checking for new software...', 'Main loop stalled'], timeout=2) == 0
+    assert len(ddi_mock.requests_matching('/controller/v1/mock-target$', 'GET')) >= polls + 3
+    proc.expect('Download complete.', timeout=10)
+    proc.terminate(force=True)
+
+def test_mock_download_progress(ddi_mock, mock_config, rauc_bundle):
+    """
+    Download a bundle in multiple resumed transfers and make sure progress is reported
+    periodically, with the throughput aggregated across the transfers.
+    """
+    ddi_mock.bandwidth = 128 * 1024
+    ddi_mock.drop_after = 200 * 1024
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    action_id = ddi_mock.assign_artifact('mock-target', artifact)
+
+    config = mock_config({'client': {'resume_downloads': 'true', 'progress_interval': '1'}})
+
+    # ignore failing installation
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    reports = re.findall(r'Downloading bundle: [\d.]+ [kMG]?B of [\d.]+ [kMG]?B \((\d+)%\), '
+                         r'[\d.]+ [kMG]?B/s, ETA (\d+:\d\d:\d\d|unknown)', out)
+    assert len(reports) >= 2
+    percents = [int(p) for p, _ in reports]
+    assert percents == sorted(percents)
+
+    progress = [fb['status']['progress'] for fb in ddi_mock.feedback_for(action_id)
+                if 'progress' in fb['status']]
+    assert [p['cnt'] for p in progress] == percents
+    assert all(p['of'] == 100 for p in progress)
+
+    # throughput across all transfers, including the pause before resuming
+    speed = float(re.search(r'Download complete. ([\d.]+) MB/s', out).group(1))
+    assert 0 < speed <= 0.125
+
+def test_mock_main_loop_stall(ddi_mock, mock_config):
+    """
+    Slow down all responses of the mock and make sure the polling callback blocking the main loop
+    is logged and a dispatch latency histogram is reported on exit.
+    """
+    ddi_mock.latency = 0.3
+    config = mock_config({'client': {'loop_stall_threshold': '200'}})
+
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert err == ''
+    assert exitcode == 0
+    assert re.search(r'Main loop stalled for [\d.]+ s in hawkbit-poll', out)
+
+    [histogram] = re.findall(r'Dispatch latency of hawkbit-poll: (\d+) calls, max ([\d.]+) s '
+                             r'\(<1ms: \d+, .*, >=60s: \d+\)', out)
+    assert int(histogram[0]) >= 1
+    assert float(histogram[1]) >= 0.3
+
+def test_mock_main_loop_histogram_periodic(ddi_mock, mock_config):
+    """
+    Start rauc-hawkbit-updater as a daemon and make sure the dispatch latency histogram is logged
+    after polling, not only on exit.
+    """
+    config = mock_config()
+
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect('No new software.')
+    proc.expect(r'Dispatch latency of hawkbit-poll: \d+ calls')
+    proc.terminate(force=True)
+
+def test_mock_config_reload(ddi_mock, mock_config):
+    """
+    Change the config file of a running rauc-hawkbit-updater and make sure it is reloaded on change
+    and on SIGHUP: device attributes are announced right away, settings requiring a restart are
+    kept.
+    """
+    config = mock_config()
+
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect('Checking for new software...')
+
+    mock_config({'client': {'tenant_id': 'OTHER'}, 'device': {'product': 'T-1000'}})
+    proc.expect('Changed settings require a restart, keeping current values: tenant_id')
+    proc.expect('Configuration reloaded.')
+    # identification precedes the next poll
+    proc.expect('Checking for new software...')
+    assert ddi_mock.config_data['mock-target']['data']['product'] == 'T-1000'
+
+    proc.kill(signal.SIGHUP)
+    proc.expect(f'Reloading configuration {config}')
+    proc.expect('Configuration reloaded.')
+    proc.terminate(force=True)
+    proc.expect(EOF)
+
+    # polling continued against the initial tenant
+    assert not ddi_mock.requests_matching('^/OTHER/')
+
+def test_mock_peer_download(ddi_mock, mock_config, rauc_bundle, tmp_path):
+    """
+    Download a bundle with one rauc-hawkbit-updater sharing it with peers and make sure a second
+    one downloads it from the first instead of hawkBit.
+    """
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    sha1 = artifact.hashes['sha1']
+    port = available_port()
+
+    mock_config({'client': {'target_name': 'mock-peer',
+                            'bundle_download_location': str(tmp_path / 'peer.raucb'),
+                            'peers': f'127.0.0.1:{port}'}})
+    peer_config = (tmp_path / 'rauc-hawkbit-updater-mock.conf').rename(tmp_path / 'peer.conf')
+    config = mock_config({'client': {'peer_port': str(port),
+                                     'peer_cache_dir': str(tmp_path / 'peer-cache')}})
+
+    ddi_mock.assign_artifact('mock-target', artifact)
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect(f'Sharing .* \\({sha1}\\) with peers')
+
+    request = urllib.request.Request(f'http://127.0.0.1:{port}/artifacts/{sha1}',
+                                     headers={'Range': 'bytes=1000-'})
+    with urllib.request.urlopen(request) as response:
+        assert response.status == 206
+        assert response.read() == artifact.content[1000:]
+    with pytest.raises(urllib.error.HTTPError) as e:
+        urllib.request.urlopen(f'http://127.0.0.1:{port}/artifacts/{"0" * 40}')
+    assert e.value.code == 404
+
+    # ignore failing installation
+    ddi_mock.assign_artifact('mock-peer', artifact)
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{peer_config}" -r')
+    proc.terminate(force=True)
+
+    assert f'Downloaded bundle from peer 127.0.0.1:{port}' in out
+    assert 'File checksum OK.' in out
+    assert len(ddi_mock.requests_matching('/artifacts/', 'GET')) == 1
+
+def test_mock_peer_invalid_artifact(ddi_mock, mock_config, rauc_bundle):
+    """
+    Make sure an artifact sent by a peer is verified against the checksum supplied by hawkBit and
+    downloaded from hawkBit on mismatch.
+    """
+    class CorruptPeer(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            self.send_response(200)
+            self.send_header('Content-Length', str(len(artifact.content)))
+            self.end_headers()
+            self.wfile.write(bytes(len(artifact.content)))
+
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    ddi_mock.assign_artifact('mock-target', artifact)
+
+    with http.server.ThreadingHTTPServer(('127.0.0.1', 0), CorruptPeer) as peer:
+        threading.Thread(target=peer.serve_forever, daemon=True).start()
+        config = mock_config({'client': {'peers': f'127.0.0.1:{peer.server_address[1]}'}})
+
+        # ignore failing installation
+        out, err, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+        peer.shutdown()
+
+    assert 'sent bundle with invalid checksum' in err
+    assert 'File checksum OK.' in out
+    assert len(ddi_mock.requests_matching('/artifacts/', 'GET')) == 1
+
+def test_mock_maintenance_window_prefetch(ddi_mock, mock_config, rauc_bundle):
+    """
+    Assign a bundle outside of the maintenance window and make sure it is downloaded right away,
+    then installed without downloading it again as soon as the window opens instead of at the next
+    regular poll.
+    """
+    ddi_mock.polling_sleep = '01:00:00'
+    artifact = ddi_mock.add_artifact(rauc_bundle)
+    action_id = ddi_mock.assign_artifact('mock-target', artifact, update='skip',
+                                         maintenance_window='unavailable')
+    window_start = datetime.now() + timedelta(seconds=10)
+    config = mock_config({'client': {
+        'maintenance_window_start': window_start.strftime('%H:%M:%S')}})
+
+    proc = run_pexpect(f'rauc-hawkbit-updater -c "{config}"')
+    proc.expect('Prefetched bundle, waiting for hawkBit to allow installation')
+    proc.expect('Installing once the maintenance window opens at ')
+
+    action = ddi_mock.actions[action_id]
+    action.update = 'attempt'
+    action.maintenance_window = 'available'
+
+    proc.expect('Maintenance window opened', timeout=20)
+    proc.expect('Installing prefetched bundle')
+    proc.terminate(force=True)
+
+    assert len(ddi_mock.requests_matching('/artifacts/', 'GET')) == 1
+
+def test_mock_firmware_update_skip(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a firmware deployment hawkBit asks to skip installation of and make sure its artifacts
+    are downloaded and verified, but not installed and the action stays open.
+    """
+    config = mock_config()
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.execute('INSERT INTO DEVICES VALUES (7, "skip-fw", "1.0", "1.0", "0.1", "5.0")')
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    action_id = ddi_mock.assign('mock-target', [MockChunk('skip-fw', '2.0', [artifact],
+                                                          part='bApp', metadata={'HW': '2.0'})],
+                                update='skip')
+
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Prefetched 1 firmware artifacts, waiting for hawkBit to allow installation' in out
+    assert len(ddi_mock.requests_matching('/artifacts/', 'GET')) == 1
+    assert all(f['status']['execution'] != 'closed' for f in ddi_mock.feedback_for(action_id))
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        assert db.execute('SELECT FW_LATEST FROM DEVICES WHERE ID = 7').fetchone() == ('1.0',)
+
+def test_mock_worker_scheduling(ddi_mock, mock_config, rauc_bundle):
+    """
+    Download a bundle with deprioritized worker threads and make sure the scheduling is applied
+    without errors. Invalid scheduling settings are rejected.
+    """
+    config = mock_config({'client': {'worker_io_class': 'lowest'}})
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert exitcode == 4
+    assert err.strip() == "Loading config file failed: Invalid 'worker_io_class' 'lowest' " \
+                          "(none, realtime, best-effort or idle)"
+
+    ddi_mock.assign_artifact('mock-target', ddi_mock.add_artifact(rauc_bundle))
+    config = mock_config({'client': {'worker_nice': '10', 'worker_sched_idle': 'true',
+                                     'worker_io_class': 'idle', 'worker_cpus': '0'}})
+
+    # ignore failing installation
+    out, err, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'File checksum OK.' in out
+    assert 'Failed to set' not in err
+
+def test_mock_rollback_from_fallback_store(ddi_mock, mock_config, tmp_path):
+    """
+    Assign a firmware chunk requesting a rollback and make sure the device is re-flashed with the
+    firmware retained in the fallback store, without downloading anything.
+    """
+    fallback_dir = tmp_path / 'fallback'
+    (fallback_dir / 'rollback-fw').mkdir(parents=True)
+    (fallback_dir / 'rollback-fw' / '0.1.hex').write_text(':00000001FF\n')
+    config = mock_config({'client': {'fallback_dir': str(fallback_dir), 'flash_command': 'true'}})
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.execute('INSERT INTO DEVICES VALUES (7, "rollback-fw", "0.2", "0.2", "0.1", "5.0")')
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    chunks = [MockChunk('rollback-fw', '0.1', [artifact], part='bApp',
+                        metadata={'rollback': 'yes'})]
+    action_id = ddi_mock.assign('mock-target', chunks)
+
+    out, _, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'FW: Rollback requested (Name: rollback-fw, Version: 0.1)' in out
+    assert not ddi_mock.requests_matching('/artifacts/', 'GET')
+    details = [d for f in ddi_mock.feedback_for(action_id) for d in f['status']['details']]
+    assert any(re.match(r'Rolled back rollback-fw on device 7 to 0\.1 in [\d.]+ s', d)
+               for d in details)
+
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        assert db.execute('SELECT FW_LATEST FROM DEVICES WHERE ID = 7').fetchone() == ('0.1',)
+
+def test_mock_warm_start_resumes_flash_retries(ddi_mock, mock_config, tmp_path):
+    """
+    Start with a state file holding a device queued for flashing again when it was offline before
+    a restart and make sure flashing it is retried right away, without downloading anything, and
+    the final feedback reports how many devices were flashed.
+    """
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    action_id = ddi_mock.assign('mock-target', [MockChunk('retry-fw', '1.0', [artifact],
+                                                          part='bApp')])
+    base_url = f'http://{ddi_mock.address}/{ddi_mock.tenant}/controller/v1/mock-target'
+    config = mock_config({'client': {'state_file': str(tmp_path / 'state'),
+                                     'firmware_dir': str(tmp_path / 'fw')}})
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.execute('INSERT INTO DEVICES VALUES (7, "retry-fw", "0.1", "1.0", "0.1", "5.0")')
+
+    state = tmp_path / 'state'
+    state.write_text(f'[action]\ntarget=mock-target\nid={action_id}\nphase=retrying\n'
+                     f'firmware=true\nflashed=2\nfailed=0\n'
+                     f'[artifact0]\nname=retry-fw\nversion=1.0\nsize={len(artifact.content)}\n'
+                     f'download_url={base_url}/softwaremodules/1/artifacts/{artifact.filename}\n'
+                     f'feedback_url={base_url}/deploymentBase/{action_id}/feedback\n'
+                     f'sha1={artifact.hashes["sha1"]}\ninstall_can=true\nretry_devices=7;\n')
+
+    out, err, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert f'Resuming action {action_id} after restart (flashing offline devices' in out
+    # no firmware installed in firmware_dir, so the device cannot be flashed
+    assert 'Giving up flashing retry-fw on device 7' in err
+    assert not ddi_mock.requests_matching('/artifacts/', 'GET')
+
+    feedback = ddi_mock.feedback_for(action_id)
+    assert feedback[0]['status']['details'] == \
+        ['Flashed 2 of 3 devices, retrying 1 offline or unreachable devices']
+    assert feedback[-1]['status']['execution'] == 'closed'
+    assert feedback[-1]['status']['result']['finished'] == 'failure'
+    assert feedback[-1]['status']['details'] == ['Firmware flashed on 2 of 3 devices.']
+
+def test_mock_offline_device_reflashed(ddi_mock, mock_config, tmp_path):
+    """
+    Start with a state file holding a device queued for flashing again, let the bootloader report
+    it offline once and make sure it is flashed again from the main loop once due and the final
+    feedback reports success.
+    """
+    firmware_dir = tmp_path / 'fw'
+    (firmware_dir / 'reflash-fw' / 'Active').mkdir(parents=True)
+    (firmware_dir / 'reflash-fw' / 'Active' / 'firmware.hex').write_text(':00000001FF\n')
+
+    marker = tmp_path / 'online'
+    flash_command = tmp_path / 'flash'
+    flash_command.write_text(f'#!/bin/sh\n[ -e "{marker}" ] && exit 0\ntouch "{marker}"\nexit 5\n')
+    flash_command.chmod(0o755)
+
+    artifact = ddi_mock.add_artifact(content=b'firmware', filename='firmware.hex')
+    action_id = ddi_mock.assign('mock-target', [MockChunk('reflash-fw', '1.0', [artifact],
+                                                          part='bApp')])
+    base_url = f'http://{ddi_mock.address}/{ddi_mock.tenant}/controller/v1/mock-target'
+    config = mock_config({'client': {'state_file': str(tmp_path / 'state'),
+                                     'flash_command': str(flash_command),
+                                     'flash_retry_interval': '1',
+                                     'firmware_dir': str(firmware_dir)}})
+    with sqlite3.connect(tmp_path / 'devices.db') as db:
+        db.execute('INSERT INTO DEVICES VALUES (7, "reflash-fw", "0.1", "1.0", "0.1", "5.0")')
+
+    state = tmp_path / 'state'
+    state.write_text(f'[action]\ntarget=mock-target\nid={action_id}\nphase=retrying\n'
+                     f'firmware=true\nflashed=2\nfailed=0\n'
+                     f'[artifact0]\nname=reflash-fw\nversion=1.0\nsize={len(artifact.content)}\n'
+                     f'download_url={base_url}/softwaremodules/1/artifacts/{artifact.filename}\n'
+                     f'feedback_url={base_url}/deploymentBase/{action_id}/feedback\n'
+                     f'sha1={artifact.hashes["sha1"]}\ninstall_can=true\nretry_devices=7;\n')
+
+    out, err, _ = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert 'Flashing reflash-fw on device 7 again (attempt 2)' in out
+    assert 'Flashing reflash-fw on device 7 again (attempt 3)' in out
+    assert 'Giving up flashing' not in err
+
+    feedback = ddi_mock.feedback_for(action_id)
+    assert feedback[-1]['status']['execution'] == 'closed'
+    assert feedback[-1]['status']['result']['finished'] == 'success'
+    assert feedback[-1]['status']['details'] == ['Software bundle installed completely.']
+
+def test_mock_server_failover(ddi_mock, mock_config):
+    """
+    Configure an unreachable hawkBit server in front of the mock and make sure polling fails over
+    to the mock right away instead of waiting retry_wait.
+    """
+    unreachable = f'127.0.0.1:{available_port()}'
+    config = mock_config({'client': {'hawkbit_server': f'{unreachable}, {ddi_mock.address}'}})
+
+    out, err, exitcode = run(f'rauc-hawkbit-updater -c "{config}" -r')
+
+    assert f'Switching hawkBit server from {unreachable} to {ddi_mock.address}' in out
+    assert 'No new software.' in out
+    assert err == ''
+    assert exitcode == 0
+    assert ddi_mock.requests_matching('/controller/v1/mock-target$', 'GET')